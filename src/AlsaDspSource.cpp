@@ -43,6 +43,24 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#else
+#error need poll.h
+#endif
+
 #include "Util.h"
 #include "Exception.h"
 #include "AlsaDspSource.h"
@@ -78,12 +96,17 @@ AlsaDspSource :: isBigEndian ( void ) const                  throw ()
  *  Initialize the object
  *----------------------------------------------------------------------------*/
 void
-AlsaDspSource :: init (  const char      * name )    throw ( Exception )
+AlsaDspSource :: init (  const char      * name,
+                         bool              useMmap )  throw ( Exception )
 {
     pcmName       = Util::strDup( name);
     captureHandle = 0;
     bufferTime    = 1000000; // Do 1s buffering
     running       = false;
+    this->useMmap = useMmap;
+    pollFds       = 0;
+    pollCount     = 0;
+    overruns      = 0;
 }
 
 
@@ -128,7 +151,9 @@ AlsaDspSource :: open ( void )                       throw ( Exception )
             return false;
     }
 
-    if (snd_pcm_open(&captureHandle, pcmName, SND_PCM_STREAM_CAPTURE, 0) < 0) {
+    // non-blocking, as we wait on the poll descriptors of the PCM
+    if (snd_pcm_open(&captureHandle, pcmName, SND_PCM_STREAM_CAPTURE,
+                     SND_PCM_NONBLOCK) < 0) {
         captureHandle = 0;
         return false;
     }
@@ -146,7 +171,13 @@ AlsaDspSource :: open ( void )                       throw ( Exception )
                         "parameter structure");
     }
 
-    if (snd_pcm_hw_params_set_access(captureHandle, hwParams,
+    if (useMmap && snd_pcm_hw_params_set_access(captureHandle, hwParams,
+                                     SND_PCM_ACCESS_MMAP_INTERLEAVED) < 0) {
+        reportEvent(2, "mmap access not supported by", pcmName);
+        useMmap = false;
+    }
+
+    if (!useMmap && snd_pcm_hw_params_set_access(captureHandle, hwParams,
                                      SND_PCM_ACCESS_RW_INTERLEAVED) < 0) {
         snd_pcm_hw_params_free(hwParams);
         close();
@@ -203,12 +234,92 @@ AlsaDspSource :: open ( void )                       throw ( Exception )
                         "for use");
     }
 
+    pollCount = snd_pcm_poll_descriptors_count(captureHandle);
+    if (pollCount <= 0) {
+        close();
+        throw Exception( __FILE__, __LINE__, "can't get poll descriptors");
+    }
+    pollFds = new struct pollfd[pollCount];
+    if (snd_pcm_poll_descriptors(captureHandle, pollFds, pollCount) < 0) {
+        close();
+        throw Exception( __FILE__, __LINE__, "can't get poll descriptors");
+    }
+
     bytesPerFrame = getChannel() * getBitsPerSample() / 8;
+    overruns      = 0;
 
     return true;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Recover from an error of the PCM
+ *----------------------------------------------------------------------------*/
+void
+AlsaDspSource :: recover ( int             err )     throw ( Exception )
+{
+    if (err == -EPIPE) {
+        ++overruns;
+        reportEvent(1, "Buffer overrun! overruns so far:", overruns);
+    }
+
+    if ((err = snd_pcm_recover(captureHandle, err, 1)) < 0) {
+        throw Exception(__FILE__, __LINE__, snd_strerror(err));
+    }
+
+    // capture with mmap access does not start by itself
+    snd_pcm_start(captureHandle);
+    running = true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wait until there are frames to read
+ *----------------------------------------------------------------------------*/
+snd_pcm_sframes_t
+AlsaDspSource :: waitForFrames ( int             msecs )  throw ( Exception )
+{
+    snd_pcm_sframes_t   avail;
+    unsigned short      revents;
+    int                 ret;
+
+    if ( !running ) {
+        snd_pcm_start(captureHandle);
+        running = true;
+    }
+
+    while ( true ) {
+        if ((avail = snd_pcm_avail_update(captureHandle)) < 0) {
+            recover(avail);
+            continue;
+        }
+        if (avail > 0) {
+            return avail;
+        }
+
+        ret = poll(pollFds, pollCount, msecs);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret < 0) {
+            throw Exception( __FILE__, __LINE__, "poll error", errno);
+        }
+        if (ret == 0) {
+            reportEvent(2, "no audio captured from", pcmName);
+            return 0;
+        }
+
+        snd_pcm_poll_descriptors_revents(captureHandle, pollFds, pollCount,
+                                         &revents);
+        if (revents & POLLERR) {
+            // the state of the PCM tells what happened
+            recover(snd_pcm_state(captureHandle) == SND_PCM_STATE_SUSPENDED
+                    ? -ESTRPIPE : -EPIPE);
+        }
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Check wether read() would return anything
  *----------------------------------------------------------------------------*/
@@ -220,20 +331,7 @@ AlsaDspSource :: canRead ( unsigned int    sec,
         return false;
     }
 
-    if ( !running ) {
-        snd_pcm_start(captureHandle); 
-        running = true;
-    }
-
-    /*
-     * FIXME How to check for available frames? It
-     * seems like snd_pcm_wait stops working when
-     * it comes to ALSA plugins... :-(
-     *
-     * int milliDelay = sec * 1000 + usec/1000;
-     * return snd_pcm_wait(captureHandle, milliDelay)!=0;
-     */
-    return true; // bad!!
+    return waitForFrames(sec * 1000 + usec / 1000) > 0;
 }
 
 
@@ -244,29 +342,56 @@ unsigned int
 AlsaDspSource :: read (    void          * buf,
                            unsigned int    len )     throw ( Exception )
 {
-    snd_pcm_sframes_t ret;
+    snd_pcm_uframes_t           frames = len / bytesPerFrame;
+    snd_pcm_sframes_t           ret;
+    const snd_pcm_channel_area_t  * areas;
+    snd_pcm_uframes_t           offset;
 
     if ( !isOpen() ) {
         return 0;
     }
 
-    do {
-        ret = snd_pcm_readi(captureHandle, buf, len/bytesPerFrame);
+    while ( true ) {
+        // wait for data, but never return nothing, as that means the end
+        do {
+            ret = waitForFrames(1000);
+        } while (ret == 0);
+        if ( (snd_pcm_uframes_t) ret < frames ) {
+            frames = ret;
+        }
 
-        // Check for buffer overrun
-        if (ret == -EPIPE) {
-            reportEvent(1, "Buffer overrun!");
-            snd_pcm_prepare(captureHandle);
-            ret = -EAGAIN;
+        if ( !useMmap ) {
+            ret = snd_pcm_readi(captureHandle, buf, frames);
+            if (ret == -EAGAIN) {
+                continue;
+            }
+            if (ret < 0) {
+                recover(ret);
+                continue;
+            }
+            return ret * bytesPerFrame;
         }
-    } while (ret == -EAGAIN);
 
-    if ( ret < 0 ) {
-        throw Exception(__FILE__, __LINE__, snd_strerror(ret));
+        // copy straight from the buffer of the device, frames are
+        // interleaved, so the first area holds all channels
+        if ((ret = snd_pcm_mmap_begin(captureHandle, &areas, &offset,
+                                      &frames)) < 0) {
+            recover(ret);
+            continue;
+        }
+        memcpy(buf,
+               (const char *) areas[0].addr + areas[0].first / 8
+                                            + offset * areas[0].step / 8,
+               frames * bytesPerFrame);
+
+        ret = snd_pcm_mmap_commit(captureHandle, offset, frames);
+        if (ret < 0 || (snd_pcm_uframes_t) ret != frames) {
+            // the data copied may have been overwritten already
+            recover(ret < 0 ? ret : -EPIPE);
+            continue;
+        }
+        return frames * bytesPerFrame;
     }
-
-    running = true;
-    return ret * bytesPerFrame;
 }
 
 
@@ -281,8 +406,11 @@ AlsaDspSource :: close ( void )                  throw ( Exception )
     }
 
     snd_pcm_close(captureHandle);
+    delete[] pollFds;
 
     captureHandle  = 0;
+    pollFds        = 0;
+    pollCount      = 0;
     running        = false;
 }
 
@@ -99,6 +99,28 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
          */
         unsigned int bufferTime;
 
+        /**
+         *  Read the samples straight from the buffer of the device
+         *  (SND_PCM_ACCESS_MMAP_INTERLEAVED), instead of through
+         *  snd_pcm_readi().
+         */
+        bool useMmap;
+
+        /**
+         *  The file descriptors to poll for captured data.
+         */
+        struct pollfd *pollFds;
+
+        /**
+         *  The number of file descriptors in pollFds.
+         */
+        int pollCount;
+
+        /**
+         *  The number of buffer overruns since opening.
+         */
+        unsigned int overruns;
+
 
     protected:
 
@@ -117,10 +139,13 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
          *  Initialize the object
          *
          *  @param name the PCM to open.
+         *  @param useMmap read the samples straight from the buffer of
+         *                 the device.
          *  @exception Exception
          */
         void
-        init (  const char    * name )              throw ( Exception );
+        init (  const char    * name,
+                bool            useMmap )           throw ( Exception );
 
         /**
          *  De-iitialize the object
@@ -130,6 +155,26 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
         void
         strip ( void )                              throw ( Exception );
 
+        /**
+         *  Recover from an error of the PCM, restarting capture.
+         *  Buffer overruns are counted.
+         *
+         *  @param err the error returned by an ALSA function.
+         *  @exception Exception if the PCM can't be recovered.
+         */
+        void
+        recover (   int             err )           throw ( Exception );
+
+        /**
+         *  Wait until there are frames to read, or until the timeout.
+         *
+         *  @param msecs the maximum milliseconds to wait.
+         *  @return the number of frames available, 0 on timeout.
+         *  @exception Exception
+         */
+        snd_pcm_sframes_t
+        waitForFrames ( int             msecs )     throw ( Exception );
+
 
     public:
 
@@ -141,17 +186,21 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
          *  @param bitsPerSample bits per sample (e.g. 16 bits).
          *  @param channel number of channels of the audio source
          *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @param useMmap read the samples straight from the buffer of
+         *                 the device (mmap access), if the device
+         *                 supports it.
          *  @exception Exception
          */
         inline
         AlsaDspSource (  const char    * name,
                          int             sampleRate    = 44100,
                          int             bitsPerSample = 16,
-                         int             channel       = 2 )
+                         int             channel       = 2,
+                         bool            useMmap       = false )
                                                         throw ( Exception )
                     : AudioSource( sampleRate, bitsPerSample, channel)
         {
-            init( name);
+            init( name, useMmap);
         }
 
         /**
@@ -164,7 +213,7 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
         AlsaDspSource (  const AlsaDspSource &    ds )    throw ( Exception )
                     : AudioSource( ds )
         {
-            init( ds.pcmName);
+            init( ds.pcmName, ds.useMmap);
         }
 
         /**
@@ -191,7 +240,7 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
             if ( this != &ds ) {
                 strip();
                 AudioSource::operator=( ds);
-                init( ds.pcmName);
+                init( ds.pcmName, ds.useMmap);
             }
             return *this;
         }
@@ -231,7 +280,8 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
 
         /**
          *  Check if the AlsaDspSource can be read from.
-         *  Blocks until the specified time for data to be available.
+         *  Blocks until the specified time for data to be available,
+         *  polling the descriptors of the PCM.
          *  Puts the PCM into recording mode.
          *
          *  @param sec the maximum seconds to block.
@@ -265,6 +315,18 @@ class AlsaDspSource : public AudioSource, public virtual Reporter
         virtual void
         close ( void )                                  throw ( Exception );
 
+        /**
+         *  Get the number of buffer overruns since opening, when
+         *  captured samples were lost because they were not read in time.
+         *
+         *  @return the number of buffer overruns.
+         */
+        inline virtual unsigned int
+        getOverruns ( void ) const                      throw ()
+        {
+            return overruns;
+        }
+
         /**
          *  Returns the buffer size in useconds.
          *
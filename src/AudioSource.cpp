@@ -33,6 +33,12 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
 #include "AudioSource.h"
 #include "Util.h"
 #include "Exception.h"
@@ -54,6 +60,39 @@ static const char fileid[] = "$Id$";
 
 /* =============================================================  module code */
 
+/*------------------------------------------------------------------------------
+ *  Wait until the next samples are due, but at most for the timeout
+ *----------------------------------------------------------------------------*/
+bool
+AudioSource :: pace (   const struct timeval  & startTime,
+                        double                  due,
+                        unsigned int            sec,
+                        unsigned int            usec )      throw ()
+{
+    struct timeval      now;
+    double              elapsed;
+    double              timeout;
+    double              wait;
+
+    gettimeofday( &now, 0);
+    elapsed = (now.tv_sec - startTime.tv_sec)
+            + (now.tv_usec - startTime.tv_usec) / 1000000.0;
+    timeout = sec + usec / 1000000.0;
+    wait    = due - elapsed;
+
+    if ( wait <= 0.0 ) {
+        return true;
+    }
+    if ( wait > timeout ) {
+        usleep( (useconds_t) (timeout * 1000000.0));
+        return false;
+    }
+    usleep( (useconds_t) (wait * 1000000.0));
+
+    return true;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Return an audio source based on the compiled DSP supports and the
  *  supplied device name parameter.
@@ -64,11 +103,38 @@ AudioSource :: createDspSource( const char    * deviceName,
                                 const char    * paSourceName,
                                 int             sampleRate,
                                 int             bitsPerSample,
-                                int             channel)
+                                int             channel,
+                                bool            alsaMmap,
+                                unsigned int    paFragSize,
+                                unsigned int    paMaxLength,
+                                bool            pacing,
+                                bool            ossMmap)
                                                             throw ( Exception )
 {
     
-    if ( Util::strEq( deviceName, "/dev/tty", 8) ) {
+    if ( Util::strEq( deviceName, "file:", 5) ) {
+#if defined( SUPPORT_FILE_SOURCE )
+        Reporter::reportEvent( 1, "Using audio file as input:",
+                                  deviceName + 5);
+        return new FileSource( deviceName + 5,
+                               sampleRate,
+                               bitsPerSample,
+                               channel,
+                               pacing);
+#else
+        throw Exception( __FILE__, __LINE__,
+                             "trying to read an audio file "
+                             "without support compiled", deviceName);
+#endif
+    } else if ( Util::strEq( deviceName, "generator:", 10) ) {
+        Reporter::reportEvent( 1, "Using test signal generator as input:",
+                                  deviceName + 10);
+        return new GeneratorSource( deviceName + 10,
+                                    sampleRate,
+                                    bitsPerSample,
+                                    channel,
+                                    pacing);
+    } else if ( Util::strEq( deviceName, "/dev/tty", 8) ) {
 #if defined( SUPPORT_SERIAL_ULAW )
         Reporter::reportEvent( 1, "Using Serial Ulaw input device:",
                                   deviceName);
@@ -87,7 +153,8 @@ AudioSource :: createDspSource( const char    * deviceName,
         return new OssDspSource( deviceName,
                                  sampleRate,
                                  bitsPerSample,
-                                 channel);
+                                 channel,
+                                 ossMmap);
 #elif defined( SUPPORT_SOLARIS_DSP )
         Reporter::reportEvent( 1, "Using Solaris DSP input device:",deviceName);
         return new SolarisDspSource( deviceName,
@@ -118,7 +185,9 @@ AudioSource :: createDspSource( const char    * deviceName,
         return new PulseAudioDspSource( paSourceName,
                                         sampleRate,
                                         bitsPerSample,
-                                        channel);
+                                        channel,
+                                        paFragSize,
+                                        paMaxLength);
 #else
         throw Exception( __FILE__, __LINE__,
                              "trying to open PulseAudio device without "
@@ -130,7 +199,8 @@ AudioSource :: createDspSource( const char    * deviceName,
         return new AlsaDspSource( deviceName,
                                   sampleRate,
                                   bitsPerSample,
-                                  channel);
+                                  channel,
+                                  alsaMmap);
 #else
         throw Exception( __FILE__, __LINE__,
                              "trying to open ALSA DSP device without "
@@ -39,6 +39,12 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#error need sys/time.h
+#endif
+
 #include "Source.h"
 #include "Reporter.h"
 
@@ -80,6 +86,11 @@
 #define SUPPORT_SERIAL_ULAW 1
 #endif
 
+#if defined( HAVE_SYS_MMAN_H )
+// audio files are read through mmap
+#define SUPPORT_FILE_SOURCE 1
+#endif
+
 #if !defined( SUPPORT_ALSA_DSP ) \
     && !defined( SUPPORT_PULSEAUDIO_DSP ) \
     && !defined( SUPPORT_OSS_DSP ) \
@@ -202,6 +213,24 @@ class AudioSource : public Source, public virtual Reporter
             return *this;
         }
 
+        /**
+         *  Wait until the next samples of a source that is read at the
+         *  speed of its audio are due, but at most for the timeout.
+         *
+         *  @param startTime the time reading started.
+         *  @param due the time of the next samples, in seconds after
+         *             startTime.
+         *  @param sec the maximum seconds to wait.
+         *  @param usec the maximum micro seconds to wait.
+         *  @return true if the samples are due, false if the timeout
+         *          ran out first.
+         */
+        bool
+        pace (  const struct timeval  & startTime,
+                double                  due,
+                unsigned int            sec,
+                unsigned int            usec )          throw ();
+
 
     public:
 
@@ -264,18 +293,41 @@ class AudioSource : public Source, public virtual Reporter
             return bitsPerSample;
         }
 
+        /**
+         *  Get the number of buffer overruns since opening, when
+         *  captured samples were lost because they were not read in time.
+         *  Sources that can't tell always return 0.
+         *
+         *  @return the number of buffer overruns.
+         */
+        virtual unsigned int
+        getOverruns ( void ) const          throw ()
+        {
+            return 0;
+        }
+
         /**
          *  Factory method for creating an AudioSource object of the
          *  appropriate type, based on the compiled DSP support and
          *  the supplied DSP name parameter.
          *
-         *  @param deviceName the audio device (/dev/dspX, hwplug:0,0, etc)
+         *  @param deviceName the audio device (/dev/dspX, hwplug:0,0,
+         *                    file:/path/to/file.wav, generator:pink, etc)
          *  @param jackClientName the source name for jack server
          *  @param paSourceName the pulse audio source
          *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
          *  @param bitsPerSample bits per sample (e.g. 16 bits).
          *  @param channel number of channels of the audio source
          *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @param alsaMmap read ALSA devices with mmap access.
+         *  @param paFragSize the PulseAudio fragment size in milliseconds,
+         *                    0 for the server default.
+         *  @param paMaxLength the PulseAudio maximum buffer length in
+         *                     milliseconds, 0 for the server default.
+         *  @param pacing read audio files, or generate test signals,
+         *                at the speed of the audio, instead of as
+         *                fast as possible.
+         *  @param ossMmap read OSS devices with mmap access.
          *  @exception Exception
          */
         static AudioSource *
@@ -284,7 +336,13 @@ class AudioSource : public Source, public virtual Reporter
                          const char    * paSourceName,
                          int             sampleRate    = 44100,
                          int             bitsPerSample = 16,
-                         int             channel       = 2) throw ( Exception );
+                         int             channel       = 2,
+                         bool            alsaMmap      = false,
+                         unsigned int    paFragSize    = 0,
+                         unsigned int    paMaxLength   = 0,
+                         bool            pacing        = true,
+                         bool            ossMmap       = false)
+                                                        throw ( Exception );
 
 };
 
@@ -318,6 +376,12 @@ class AudioSource : public Source, public virtual Reporter
 #include "SerialUlaw.h"
 #endif
 
+#if defined( SUPPORT_FILE_SOURCE )
+#include "FileSource.h"
+#endif
+
+#include "GeneratorSource.h"
+
 
 /* ====================================================== function prototypes */
 
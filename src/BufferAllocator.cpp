@@ -0,0 +1,253 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : BufferAllocator.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <map>
+
+#include "BufferAllocator.h"
+
+
+/* ===================================================  local data structures */
+
+/*------------------------------------------------------------------------------
+ *  A mapping made for a buffer
+ *----------------------------------------------------------------------------*/
+struct Mapping {
+    size_t      len;
+    bool        isLocked;
+};
+
+/*------------------------------------------------------------------------------
+ *  The mappings made, by start address
+ *----------------------------------------------------------------------------*/
+static std::map<void*, Mapping> mappings;
+
+/*------------------------------------------------------------------------------
+ *  Mutex guarding mappings and lockedBytes
+ *----------------------------------------------------------------------------*/
+static pthread_mutex_t          mappingsMutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The size of a huge page, buffers at least this large use huge pages
+ *----------------------------------------------------------------------------*/
+static const size_t hugePageSize = 2 * 1024 * 1024;
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+BufferAllocator::Mode   BufferAllocator::mode        = BufferAllocator::heap;
+unsigned long           BufferAllocator::lockedBytes = 0;
+
+
+/*------------------------------------------------------------------------------
+ *  Set the allocation mode
+ *----------------------------------------------------------------------------*/
+void
+BufferAllocator :: setMode (    Mode        mode )      throw ( Exception )
+{
+#ifndef HAVE_SYS_MMAN_H
+    if ( mode != heap ) {
+        throw Exception( __FILE__, __LINE__,
+                         "locked buffer memory not supported on this system");
+    }
+#endif
+#ifndef MAP_HUGETLB
+    if ( mode == hugePages ) {
+        throw Exception( __FILE__, __LINE__,
+                         "huge pages not supported on this system");
+    }
+#endif
+
+    BufferAllocator::mode = mode;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Map, prefault and lock memory for a buffer
+ *----------------------------------------------------------------------------*/
+void *
+BufferAllocator :: map (    size_t          size,
+                            size_t        & len,
+                            bool          & isLocked )  throw ()
+{
+#ifdef HAVE_SYS_MMAN_H
+    void      * p     = MAP_FAILED;
+    int         flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    size_t      page  = sysconf( _SC_PAGESIZE);
+
+#ifdef MAP_POPULATE
+    flags |= MAP_POPULATE;
+#endif
+
+#ifdef MAP_HUGETLB
+    if ( mode == hugePages && size >= hugePageSize ) {
+        len = (size + hugePageSize - 1) / hugePageSize * hugePageSize;
+        p   = mmap( 0, len, PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+        if ( p == MAP_FAILED ) {
+            reportEvent( 2, "no huge pages available for a buffer of", size);
+        }
+    }
+#endif
+
+    if ( p == MAP_FAILED ) {
+        len = (size + page - 1) / page * page;
+        p   = mmap( 0, len, PROT_READ | PROT_WRITE, flags, -1, 0);
+        if ( p == MAP_FAILED ) {
+            return 0;
+        }
+    }
+
+    // touch every page, in case MAP_POPULATE is not honored
+    memset( p, 0, len);
+
+    isLocked = mlock( p, len) == 0;
+    if ( !isLocked ) {
+        reportEvent( 2, "can't lock buffer memory, size", len,
+                        "errno", errno);
+    } else {
+        unsigned long   total;
+
+        pthread_mutex_lock( &mappingsMutex);
+        lockedBytes += len;
+        total        = lockedBytes;
+        pthread_mutex_unlock( &mappingsMutex);
+        reportEvent( 3, "buffer memory locked (kB):", total / 1024);
+    }
+
+    return p;
+#else
+    return 0;
+#endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Allocate a buffer
+ *----------------------------------------------------------------------------*/
+void *
+BufferAllocator :: allocate (   size_t      size )      throw ( Exception )
+{
+    void      * p;
+    Mapping     mapping;
+
+    if ( mode == heap || size == 0 ) {
+        return new unsigned char[size];
+    }
+
+    if ( !(p = map( size, mapping.len, mapping.isLocked)) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "can't map buffer memory, size", size);
+    }
+
+    pthread_mutex_lock( &mappingsMutex);
+    mappings[p] = mapping;
+    pthread_mutex_unlock( &mappingsMutex);
+
+    return p;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Free a buffer
+ *----------------------------------------------------------------------------*/
+void
+BufferAllocator :: release (    void      * buffer )    throw ()
+{
+    std::map<void*, Mapping>::iterator  it;
+
+    if ( !buffer ) {
+        return;
+    }
+
+    pthread_mutex_lock( &mappingsMutex);
+    it = mappings.find( buffer);
+    if ( it == mappings.end() ) {
+        pthread_mutex_unlock( &mappingsMutex);
+        // not mapped by us, so it came from the heap
+        delete[] (unsigned char *) buffer;
+        return;
+    }
+
+#ifdef HAVE_SYS_MMAN_H
+    if ( it->second.isLocked ) {
+        munlock( buffer, it->second.len);
+        lockedBytes -= it->second.len;
+    }
+    munmap( buffer, it->second.len);
+#endif
+    mappings.erase( it);
+    pthread_mutex_unlock( &mappingsMutex);
+}
+
@@ -0,0 +1,221 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : BufferAllocator.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef BUFFER_ALLOCATOR_H
+#define BUFFER_ALLOCATOR_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <stddef.h>
+
+#include "Reporter.h"
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  Allocator for the audio buffers on the realtime path.
+ *  Depending on the mode set, buffers come from the heap, or are
+ *  mapped, prefaulted and locked into memory so that they are never
+ *  swapped out, optionally backed by huge pages.
+ *  The mode should be set before any buffer is allocated.
+ *  This class can not be instantiated, it contains static functions
+ *  only.
+ *
+ *  Typical usage:
+ *
+ *  <pre>
+ *  #include "BufferAllocator.h"
+ *
+ *  BufferAllocator::setMode( BufferAllocator::locked);
+ *  unsigned char * buf = (unsigned char *) BufferAllocator::allocate( size);
+ *  ...
+ *  BufferAllocator::release( buf);
+ *  </pre>
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class BufferAllocator : public virtual Reporter
+{
+    public:
+
+        /**
+         *  Type describing where the buffers come from:
+         *  - heap - plain heap allocation
+         *  - locked - prefaulted and locked into memory
+         *  - hugePages - as locked, with huge pages for large buffers
+         */
+        enum Mode { heap, locked, hugePages };
+
+
+    private:
+
+        /**
+         *  The current mode.
+         */
+        static Mode                     mode;
+
+        /**
+         *  The number of bytes locked into memory.
+         */
+        static unsigned long            lockedBytes;
+
+        /**
+         *  Map memory for a buffer, and lock it.
+         *
+         *  @param size the size of the buffer.
+         *  @param len the length of the mapping made (out parameter).
+         *  @param isLocked if the mapping could be locked (out parameter).
+         *  @return the mapped memory, or 0 if mapping failed.
+         */
+        static void *
+        map (   size_t          size,
+                size_t        & len,
+                bool          & isLocked )              throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        BufferAllocator ( void )                        throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception.
+         *
+         *  @param a the object to copy.
+         *  @exception Exception
+         */
+        inline
+        BufferAllocator ( const BufferAllocator &   a ) throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Assignment operator. Always throws an Exception.
+         *
+         *  @param a the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline BufferAllocator &
+        operator= ( const BufferAllocator &   a )       throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Set where buffers allocated from now on come from.
+         *
+         *  @param mode the mode to use.
+         *  @exception Exception if the mode is not supported
+         *             on this system.
+         */
+        static void
+        setMode (   Mode        mode )                  throw ( Exception );
+
+        /**
+         *  Get where buffers are allocated from.
+         *
+         *  @return the current mode.
+         */
+        static inline Mode
+        getMode ( void )                                throw ()
+        {
+            return mode;
+        }
+
+        /**
+         *  Get the number of bytes currently locked into memory.
+         *
+         *  @return the number of bytes locked.
+         */
+        static inline unsigned long
+        getLockedBytes ( void )                         throw ()
+        {
+            return lockedBytes;
+        }
+
+        /**
+         *  Allocate a buffer. If the memory can not be locked, the buffer
+         *  is still returned, unlocked, and the failure is reported.
+         *
+         *  @param size the size of the buffer, in bytes.
+         *  @return the buffer allocated.
+         *  @exception Exception
+         */
+        static void *
+        allocate (  size_t      size )                  throw ( Exception );
+
+        /**
+         *  Free a buffer received from allocate().
+         *
+         *  @param buffer the buffer to free, may be 0.
+         */
+        static void
+        release (   void      * buffer )                throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* BUFFER_ALLOCATOR_H */
+
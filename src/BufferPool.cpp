@@ -0,0 +1,201 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : BufferPool.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "BufferAllocator.h"
+#include "BufferPool.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+BufferPool :: init (    unsigned long       budget,
+                        unsigned int        slabSize )  throw ( Exception )
+{
+    if ( !slabSize ) {
+        throw Exception( __FILE__, __LINE__, "slab size is 0");
+    }
+    if ( budget < slabSize ) {
+        throw Exception( __FILE__, __LINE__,
+                         "buffer budget smaller than a slab", slabSize);
+    }
+
+    this->budget   = budget;
+    this->slabSize = slabSize;
+    this->used     = 0;
+    this->peak     = 0;
+
+    pthread_mutex_init( &mutex, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+BufferPool :: strip ( void )                        throw ( Exception )
+{
+    std::vector<unsigned char*>::iterator   it;
+
+    for ( it = freeSlabs.begin(); it != freeSlabs.end(); ++it ) {
+        BufferAllocator::release( *it);
+    }
+    freeSlabs.clear();
+
+    pthread_mutex_destroy( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Register a client
+ *----------------------------------------------------------------------------*/
+void
+BufferPool :: attach (  Client        * client )    throw ()
+{
+    pthread_mutex_lock( &mutex);
+    clients.push_back( client);
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Unregister a client
+ *----------------------------------------------------------------------------*/
+void
+BufferPool :: detach (  Client        * client )    throw ()
+{
+    std::vector<Client*>::iterator  it;
+
+    pthread_mutex_lock( &mutex);
+    for ( it = clients.begin(); it != clients.end(); ++it ) {
+        if ( *it == client ) {
+            clients.erase( it);
+            break;
+        }
+    }
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Hand out a slab, taking one back from a lower priority client if the
+ *  budget is used up
+ *----------------------------------------------------------------------------*/
+unsigned char *
+BufferPool :: allocate (    Client        * client )    throw ()
+{
+    unsigned char * slab = 0;
+
+    pthread_mutex_lock( &mutex);
+
+    if ( used + slabSize <= budget ) {
+        if ( freeSlabs.empty() ) {
+            slab = (unsigned char *) BufferAllocator::allocate( slabSize);
+        } else {
+            slab = freeSlabs.back();
+            freeSlabs.pop_back();
+        }
+        used += slabSize;
+        if ( peak < used ) {
+            peak = used;
+            reportEvent( 4, "BufferPool, new peak:", peak);
+        }
+    } else {
+        int         priority = client->getPoolPriority();
+        std::vector<bool>   tried( clients.size(), false);
+        size_t              i;
+
+        // try the clients with a lower priority, the lowest first
+        while ( !slab ) {
+            size_t  victim = clients.size();
+
+            for ( i = 0; i < clients.size(); ++i ) {
+                if ( !tried[i]
+                  && clients[i] != client
+                  && clients[i]->getPoolPriority() < priority
+                  && (victim == clients.size()
+                   || clients[i]->getPoolPriority()
+                                    < clients[victim]->getPoolPriority()) ) {
+                    victim = i;
+                }
+            }
+            if ( victim == clients.size() ) {
+                break;
+            }
+
+            tried[victim] = true;
+            slab          = clients[victim]->evictSlab();
+        }
+
+        if ( slab ) {
+            reportEvent( 4, "BufferPool, slab taken back from a client "
+                            "with lower priority than", priority);
+        }
+    }
+
+    pthread_mutex_unlock( &mutex);
+
+    return slab;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take a slab back
+ *----------------------------------------------------------------------------*/
+void
+BufferPool :: release ( unsigned char * slab )      throw ()
+{
+    pthread_mutex_lock( &mutex);
+    freeSlabs.push_back( slab);
+    used -= slabSize;
+    pthread_mutex_unlock( &mutex);
+}
+
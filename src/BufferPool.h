@@ -0,0 +1,309 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : BufferPool.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef BUFFER_POOL_H
+#define BUFFER_POOL_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <vector>
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A pool of fixed size memory slabs, shared by all output buffers,
+ *  with a global limit on the memory handed out.
+ *  When the limit is reached, slabs are taken back from the clients
+ *  with the lowest priority first.
+ *  The class is thread-safe.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class BufferPool : public virtual Referable, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The interface of the users of the pool, through which
+         *  slabs can be taken back under memory pressure.
+         */
+        class Client
+        {
+            public:
+                /**
+                 *  Destructor.
+                 *
+                 *  @exception Exception
+                 */
+                inline virtual
+                ~Client ( void )                            throw ( Exception )
+                {
+                }
+
+                /**
+                 *  Get the priority of the client. Slabs are taken back
+                 *  from clients with a lower priority first.
+                 *
+                 *  @return the priority of the client.
+                 */
+                virtual int
+                getPoolPriority ( void ) const              throw () = 0;
+
+                /**
+                 *  Give up the slab holding the oldest data, if possible
+                 *  without blocking. Called with the pool locked.
+                 *
+                 *  @return the slab given up, or 0 if none.
+                 */
+                virtual unsigned char *
+                evictSlab ( void )                          throw () = 0;
+        };
+
+
+    private:
+
+        /**
+         *  The maximum number of bytes handed out in slabs.
+         */
+        unsigned long               budget;
+
+        /**
+         *  The size of each slab.
+         */
+        unsigned int                slabSize;
+
+        /**
+         *  The number of bytes currently handed out in slabs.
+         */
+        unsigned long               used;
+
+        /**
+         *  The highest number of bytes handed out.
+         */
+        unsigned long               peak;
+
+        /**
+         *  Slabs allocated but not in use.
+         */
+        std::vector<unsigned char*> freeSlabs;
+
+        /**
+         *  The clients of the pool.
+         */
+        std::vector<Client*>        clients;
+
+        /**
+         *  The mutex of this object.
+         */
+        pthread_mutex_t             mutex;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param budget the maximum number of bytes to hand out.
+         *  @param slabSize the size of each slab.
+         *  @exception Exception
+         */
+        void
+        init (  unsigned long       budget,
+                unsigned int        slabSize )          throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                                  throw ( Exception );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        BufferPool ( void )                             throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the slabs
+         *  handed out can't be shared.
+         *
+         *  @param pool the object to copy.
+         *  @exception Exception
+         */
+        inline
+        BufferPool ( const BufferPool &     pool )      throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Assignment operator. Always throws an Exception, as the slabs
+         *  handed out can't be shared.
+         *
+         *  @param pool the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual BufferPool &
+        operator= ( const BufferPool &      pool )      throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param budget the maximum number of bytes to hand out.
+         *  @param slabSize the size of each slab.
+         *  @exception Exception
+         */
+        inline
+        BufferPool (    unsigned long       budget,
+                        unsigned int        slabSize = 16384 )
+                                                        throw ( Exception )
+        {
+            init( budget, slabSize);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~BufferPool ( void )                            throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Get the size of the slabs handed out.
+         *
+         *  @return the size of each slab.
+         */
+        inline unsigned int
+        getSlabSize ( void ) const                      throw ()
+        {
+            return slabSize;
+        }
+
+        /**
+         *  Get the number of bytes currently handed out.
+         *
+         *  @return the number of bytes handed out.
+         */
+        inline unsigned long
+        getUsed ( void ) const                          throw ()
+        {
+            return used;
+        }
+
+        /**
+         *  Register a client of the pool.
+         *
+         *  @param client the client to register.
+         */
+        void
+        attach (    Client        * client )            throw ();
+
+        /**
+         *  Unregister a client of the pool.
+         *
+         *  @param client the client to unregister.
+         */
+        void
+        detach (    Client        * client )            throw ();
+
+        /**
+         *  Get a slab for a client. If the budget is used up, a slab
+         *  is taken back from a client with a lower priority.
+         *
+         *  @param client the client requesting the slab.
+         *  @return a slab of getSlabSize() bytes, or 0 if none available.
+         */
+        unsigned char *
+        allocate (  Client        * client )            throw ();
+
+        /**
+         *  Give a slab back to the pool.
+         *
+         *  @param slab a slab received from allocate().
+         */
+        void
+        release (   unsigned char * slab )              throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* BUFFER_POOL_H */
+
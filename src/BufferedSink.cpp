@@ -57,6 +57,7 @@
 
 
 #include "Exception.h"
+#include "BufferAllocator.h"
 #include "BufferedSink.h"
 
 
@@ -73,6 +74,38 @@ static const char fileid[] = "$Id$";
 
 /* ===============================================  local function prototypes */
 
+/*------------------------------------------------------------------------------
+ *  Copy len bytes of the data in several buffers, starting offset bytes
+ *  into the data
+ *----------------------------------------------------------------------------*/
+static void
+gather (    unsigned char         * to,
+            const struct iovec    * iov,
+            unsigned int            iovcnt,
+            unsigned int            offset,
+            unsigned int            len )                   throw ()
+{
+    unsigned int    i;
+
+    for ( i = 0; i < iovcnt && len; ++i ) {
+        unsigned int    size = iov[i].iov_len;
+
+        if ( offset >= size ) {
+            offset -= size;
+            continue;
+        }
+
+        size -= offset;
+        if ( size > len ) {
+            size = len;
+        }
+        memcpy( to, (const unsigned char *) iov[i].iov_base + offset, size);
+        to    += size;
+        len   -= size;
+        offset = 0;
+    }
+}
+
 
 /* =============================================================  module code */
 
@@ -82,6 +115,8 @@ static const char fileid[] = "$Id$";
 void
 BufferedSink :: init (  Sink          * sink,
                         unsigned int    size,
+                        BufferPool    * pool,
+                        int             priority,
                         unsigned int    chunkSize )     throw ( Exception )
 {
     if ( !sink ) {
@@ -95,7 +130,30 @@ BufferedSink :: init (  Sink          * sink,
     this->bufferSize  -= this->bufferSize % this->chunkSize;
     this->peak         = 0;
     this->misalignment = 0;
-    this->buffer       = new unsigned char[bufferSize];
+    this->pool         = pool;
+    this->priority     = priority;
+    this->slabHead     = 0;
+    this->slabTail     = 0;
+    this->queued       = 0;
+
+    pthread_mutex_init( &mutex, 0);
+
+    if ( pool ) {
+        // the buffer memory is drawn from the pool when needed
+        this->slabBytes  = pool->getSlabSize();
+        this->slabBytes -= this->slabBytes % this->chunkSize;
+        if ( !this->slabBytes ) {
+            throw Exception( __FILE__, __LINE__,
+                             "chunk size larger than pool slabs",
+                             this->chunkSize);
+        }
+        this->buffer     = 0;
+        pool->attach( this);
+    } else {
+        this->slabBytes  = 0;
+        this->buffer     = (unsigned char *)
+                                BufferAllocator::allocate( bufferSize);
+    }
     this->bufferEnd    = buffer + bufferSize;
     this->inp          = buffer;
     this->outp         = buffer;
@@ -108,11 +166,17 @@ BufferedSink :: init (  Sink          * sink,
 BufferedSink :: BufferedSink (  const BufferedSink &  buffer )
                                                         throw ( Exception )
 {
-    init( buffer.sink.get(), buffer.bufferSize, buffer.chunkSize);
+    init( buffer.sink.get(),
+          buffer.bufferSize,
+          buffer.pool.get(),
+          buffer.priority,
+          buffer.chunkSize);
 
     this->peak         = buffer.peak;
     this->misalignment = buffer.misalignment;
-    memcpy( this->buffer, buffer.buffer, this->bufferSize);
+    if ( this->buffer ) {
+        memcpy( this->buffer, buffer.buffer, this->bufferSize);
+    }
 }
 
 
@@ -126,8 +190,15 @@ BufferedSink :: strip ( void )                      throw ( Exception )
         close();
     }
 
+    if ( pool.get() ) {
+        clearPooled();
+        pool->detach( this);
+        pool = 0;
+    }
+    pthread_mutex_destroy( &mutex);
+
     sink = 0;                                   // delete the reference
-    delete buffer;
+    BufferAllocator::release( buffer);
 }
 
 
@@ -141,11 +212,17 @@ BufferedSink :: operator= (     const BufferedSink &  buffer )
     if ( this != &buffer ) {
         strip();
         Sink::operator=( buffer );
-        init( buffer.sink.get(), buffer.bufferSize, buffer.chunkSize);
+        init( buffer.sink.get(),
+              buffer.bufferSize,
+              buffer.pool.get(),
+              buffer.priority,
+              buffer.chunkSize);
         
         this->peak         = buffer.peak;
         this->misalignment = buffer.misalignment;
-        memcpy( this->buffer, buffer.buffer, this->bufferSize);
+        if ( this->buffer ) {
+            memcpy( this->buffer, buffer.buffer, this->bufferSize);
+        }
     }
 
     return *this;
@@ -154,42 +231,61 @@ BufferedSink :: operator= (     const BufferedSink &  buffer )
 
 /*------------------------------------------------------------------------------
  *  Store bufferSize bytes into the buffer
- *  All data is consumed. The return value is less then bufferSize only
- *  if the BufferedSink's internal buffer is smaller than bufferSize,
- *  thus can't hold that much
- *  The data to be stored is treated as parts with chunkSize size
- *  Only full chunkSize sized parts are stored
  *----------------------------------------------------------------------------*/
 unsigned int
 BufferedSink :: store (     const void    * buffer,
                             unsigned int    bufferSize )    throw ( Exception )
 {
-    const unsigned char   * buf;
-    unsigned int            size;
-    unsigned int            i;
-    unsigned char         * oldInp;
+    struct iovec    iov;
 
     if ( !buffer ) {
         throw Exception( __FILE__, __LINE__, "buffer is null");
     }
 
-    if ( !bufferSize ) {
-        return 0;
+    iov.iov_base = (void *) buffer;
+    iov.iov_len  = bufferSize;
+
+    return storev( &iov, 1, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Store the data of several buffers into the buffer, after the first
+ *  skip bytes
+ *  The data to be stored is treated as parts with chunkSize size
+ *  Only full chunkSize sized parts are stored
+ *  Data is stored whole, or not at all: if it doesn't fit into the free
+ *  space of the buffer, it is dropped, so that the stream is only ever
+ *  cut between two writes, e.g. between encoded frames, and never
+ *  in the middle of one. Returns the number of bytes stored.
+ *----------------------------------------------------------------------------*/
+unsigned int
+BufferedSink :: storev (    const struct iovec    * iov,
+                            unsigned int            iovcnt,
+                            unsigned int            skip )  throw ( Exception )
+{
+    unsigned int            bufferSize = 0;
+    unsigned int            free;
+    unsigned int            i;
+
+    for ( i = 0; i < iovcnt; ++i ) {
+        bufferSize += iov[i].iov_len;
     }
+    bufferSize = bufferSize > skip ? bufferSize - skip : 0;
 
-    oldInp = inp;
-    buf    = (const unsigned char *) buffer;
-    
     // adjust so it is a multiple of chunkSize
     bufferSize -= bufferSize % chunkSize;
 
-    // cut the front of the supplied buffer if it wouldn't fit
-    if ( bufferSize > this->bufferSize ) {
-        size  = this->bufferSize - 1;
-        size -= size % chunkSize;       // keep it a multiple of chunkSize
-        buf  += bufferSize - size;
-    } else {
-        size = bufferSize;
+    if ( !bufferSize ) {
+        return 0;
+    }
+
+    // one byte is kept free, to tell a full buffer from an empty one
+    free = outp > inp ? outp - inp - 1
+                      : this->bufferSize - (inp - outp) - 1;
+    if ( bufferSize > free ) {
+        reportEvent( 4, "BufferedSink, buffer full, dropping", bufferSize);
+        return 0;
     }
 
     // copy the data into the buffer
@@ -198,40 +294,19 @@ BufferedSink :: store (     const void    * buffer,
         throw Exception( __FILE__, __LINE__, "copy quantity not aligned", i);
     }
 
-    if ( size <= i ) {
+    if ( bufferSize <= i ) {
         // the place between inp and bufferEnd is
         // big enough to hold the data
-        
-        memcpy( inp, buf, size);
-        inp = slidePointer( inp, size);
-
-        // adjust outp, lose the data that was overwritten, if any
-        if ( outp > oldInp && outp <= inp ) {
-            outp = slidePointer( inp, chunkSize);
-        }
-
+        gather( inp, iov, iovcnt, skip, bufferSize);
+        inp = slidePointer( inp, bufferSize);
     } else {
         // the place between inp and bufferEnd is not
         // big enough to hold the data
         // writing will take place in two turns, once from
         // inp -> bufferEnd, then from buffer ->
-
-        memcpy( inp, buf, i);
-        i = size - i;
-        if ( (i % chunkSize) != 0 ) {
-            throw Exception(__FILE__, __LINE__, "copy quantity not aligned", i);
-        }
-        memcpy( this->buffer, buf, i);
-        inp = slidePointer( this->buffer, i);
-        
-        // adjust outp, lose the data that was overwritten, if any
-        if ( outp <= oldInp ) {
-            if ( outp < inp ) {
-                outp = slidePointer( inp, chunkSize);
-            }
-        } else {
-            outp = slidePointer( inp, chunkSize);
-        }
+        gather( inp, iov, iovcnt, skip, i);
+        gather( this->buffer, iov, iovcnt, skip + i, bufferSize - i);
+        inp = slidePointer( this->buffer, bufferSize - i);
     }
 
     updatePeak();
@@ -240,12 +315,66 @@ BufferedSink :: store (     const void    * buffer,
         throw Exception( __FILE__, __LINE__,
                          "inp not aligned", inp - this->buffer);
     }
-    if ( ((outp - this->buffer) % chunkSize) != 0 ) {
-        throw Exception( __FILE__, __LINE__,
-                         "outp not aligned", outp - this->buffer);
+
+    return bufferSize;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write as much of the buffered data to the sink as it takes
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: sendBuffered ( void )               throw ( Exception )
+{
+    unsigned int    length;
+    unsigned int    soFar = 0;
+    unsigned int    size  = 0;
+    unsigned int    total = 0;
+
+    if ( outp > inp ) {
+        // valuable data is between outp -> bufferEnd and buffer -> inp
+        // try to write the outp -> bufferEnd
+        // the rest will be written in the next if
+
+        size    = bufferEnd - outp;
+        soFar   = 0;
+
+        while ( soFar < size && sink->canWrite( 0, 0) ) {
+            length  = sink->write( outp + soFar, size - soFar);
+            if ( !length ) {
+                break;
+            }
+            soFar  += length;
+        }
+
+        outp   = slidePointer( outp, soFar);
+        total += soFar;
     }
 
-    return size;
+    if ( outp < inp && soFar == size ) {
+        // valuable data is between outp and inp
+        // in the previous if wrote all data from the end
+        // this part will write the rest
+
+        size    = inp - outp;
+        soFar   = 0;
+
+        while ( soFar < size && sink->canWrite( 0, 0) ) {
+            length  = sink->write( outp + soFar, size - soFar);
+            if ( !length ) {
+                break;
+            }
+            soFar  += length;
+        }
+
+        outp   = slidePointer( outp, soFar);
+        total += soFar;
+    }
+
+    // calulate the misalignment to chunkSize boundaries,
+    // and skip the rest of the partially written chunk
+    misalignment = (chunkSize - (total % chunkSize)) % chunkSize;
+    outp         = slidePointer( outp, misalignment);
 }
 
 
@@ -265,6 +394,10 @@ BufferedSink :: write (    const void    * buf,
         throw Exception( __FILE__, __LINE__, "buf is null");
     }
 
+    if ( pool.get() ) {
+        return writePooled( b, len);
+    }
+
     if ( !isOpen() ) {
         return 0;
     }
@@ -278,50 +411,7 @@ BufferedSink :: write (    const void    * buf,
 
     // try to write data from the buffer first, if any
     if ( inp != outp ) {
-        unsigned int    size  = 0;
-        unsigned int    total = 0;
-
-        if ( outp > inp ) {
-            // valuable data is between outp -> bufferEnd and buffer -> inp
-            // try to write the outp -> bufferEnd
-            // the rest will be written in the next if
-
-            size    = bufferEnd - outp - 1;
-            size   -= size % chunkSize;
-            soFar   = 0;
-
-            while ( outp > inp && soFar < size && sink->canWrite( 0, 0) ) {
-                length  = sink->write( outp + soFar, size - soFar);
-                outp    = slidePointer( outp, length);
-                soFar  += length;
-            }
-
-            total += soFar;
-        }
-
-        if ( outp < inp ) {
-            // valuable data is between outp and inp
-            // in the previous if wrote all data from the end
-            // this part will write the rest
-
-            size    = inp - outp;
-            soFar   = 0;
-
-            while ( soFar < size && sink->canWrite( 0, 0) ) {
-                length  = sink->write( outp + soFar, size - soFar);
-                outp    = slidePointer( outp, length);
-                soFar  += length;
-            }
-
-            total += soFar;
-        }
-
-        while ( (outp - buffer) % chunkSize ) {
-            slidePointer( outp, 1);
-        }
-
-        // calulate the misalignment to chunkSize boundaries
-        misalignment = (chunkSize - (total % chunkSize)) % chunkSize;
+        sendBuffered();
     }
 
     if ( !align() ) {
@@ -347,10 +437,363 @@ BufferedSink :: write (    const void    * buf,
 
     if ( length < len ) {
         // if not all fresh could be written, store the remains
+        // that are aligned on chunkSize
+        length += misalignment;
+        if ( length < len ) {
+            store( b + length, len - length);
+        }
+    }
+
+    // tell them we ate everything up to chunkSize alignment
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write several buffers to the sink
+ *  When nothing is buffered, pass them on in one go. What is not written
+ *  is buffered, or dropped, as a whole, so that e.g. an Ogg page header
+ *  is never kept without its body
+ *----------------------------------------------------------------------------*/
+unsigned int
+BufferedSink :: writev (   const struct iovec    * iov,
+                           unsigned int            iovcnt )
+                                                        throw ( Exception )
+{
+    unsigned int    written = 0;
+    unsigned int    total   = 0;
+    unsigned int    i;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    for ( i = 0; i < iovcnt; ++i ) {
+        total += iov[i].iov_len;
+    }
+
+    if ( pool.get() ) {
+        pthread_mutex_lock( &mutex);
+    }
+
+    try {
+        // write the data buffered earlier first, if any
+        if ( align() ) {
+            if ( pool.get() && queued ) {
+                sendPooled();
+            } else if ( !pool.get() && inp != outp ) {
+                sendBuffered();
+            }
+        }
+
+        // only for unchunked data, so that a partial write can't misalign
+        if ( chunkSize == 1 && align()
+          && (pool.get() ? queued == 0 : inp == outp)
+          && sink->canWrite( 0, 0) ) {
+            written = sink->writev( iov, iovcnt);
+        }
+
+        if ( written < total ) {
+            if ( pool.get() ) {
+                storevPooled( iov, iovcnt, written);
+            } else {
+                storev( iov, iovcnt, written);
+            }
+        }
+    } catch ( Exception     & e ) {
+        if ( pool.get() ) {
+            pthread_mutex_unlock( &mutex);
+        }
+        reportEvent( 3, "Exception caught in BufferedSink :: writev");
+        throw;
+    }
+
+    if ( pool.get() ) {
+        pthread_mutex_unlock( &mutex);
+    }
 
-        store( b + length, len - length);
+    return total;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Remove the oldest slab, losing the data in it
+ *----------------------------------------------------------------------------*/
+unsigned char *
+BufferedSink :: dropSlab ( void )                   throw ()
+{
+    unsigned char * slab;
+
+    if ( slabs.empty() ) {
+        return 0;
+    }
+
+    slab = slabs.front();
+    slabs.pop_front();
+    if ( slabs.empty() ) {
+        queued   = 0;
+        slabTail = 0;
+    } else {
+        queued  -= slabBytes - slabHead;
+    }
+    slabHead = 0;
+
+    return slab;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Remove len bytes from the front of the slabs
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: consumePooled ( unsigned int    len )   throw ()
+{
+    if ( len >= queued ) {
+        while ( !slabs.empty() ) {
+            pool->release( dropSlab());
+        }
+        return;
+    }
+
+    queued   -= len;
+    slabHead += len;
+    while ( slabHead >= slabBytes ) {
+        pool->release( slabs.front());
+        slabs.pop_front();
+        slabHead -= slabBytes;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Give back all slabs to the pool
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: clearPooled ( void )                throw ()
+{
+    pthread_mutex_lock( &mutex);
+    consumePooled( queued);
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Give up the oldest slab to the pool, unless being written to right now
+ *  This is called by the pool from other threads, with the pool locked
+ *----------------------------------------------------------------------------*/
+unsigned char *
+BufferedSink :: evictSlab ( void )                  throw ()
+{
+    unsigned char * slab;
+
+    if ( pthread_mutex_trylock( &mutex) ) {
+        return 0;
+    }
+    slab = dropSlab();
+    pthread_mutex_unlock( &mutex);
+
+    if ( slab ) {
+        reportEvent( 4, "BufferedSink, slab taken by the pool, priority",
+                        priority);
+    }
+
+    return slab;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Store the data of several buffers, after the first skip bytes,
+ *  in slabs drawn from the pool
+ *  Data is stored whole, or not at all: when the buffer size or the pool
+ *  budget would be exceeded, it is dropped, so that the stream is only
+ *  ever cut between two writes, and never in the middle of one
+ *----------------------------------------------------------------------------*/
+unsigned int
+BufferedSink :: storevPooled (  const struct iovec    * iov,
+                                unsigned int            iovcnt,
+                                unsigned int            skip )
+                                                            throw ()
+{
+    unsigned int    bufferSize = 0;
+    unsigned int    soFar;
+    unsigned int    space;
+    unsigned int    needed;
+    unsigned int    fresh;
+    unsigned int    ix;
+    unsigned int    tail;
+    unsigned int    i;
+
+    for ( i = 0; i < iovcnt; ++i ) {
+        bufferSize += iov[i].iov_len;
+    }
+    bufferSize = bufferSize > skip ? bufferSize - skip : 0;
+
+    // adjust so it is a multiple of chunkSize
+    bufferSize -= bufferSize % chunkSize;
+
+    if ( !bufferSize ) {
+        return 0;
+    }
+
+    if ( queued + bufferSize > this->bufferSize ) {
+        reportEvent( 4, "BufferedSink, buffer full, dropping", bufferSize);
+        return 0;
+    }
+
+    // get all the slabs needed first
+    space  = slabs.empty() ? 0 : slabBytes - slabTail;
+    needed = bufferSize > space
+           ? (bufferSize - space + slabBytes - 1) / slabBytes
+           : 0;
+    fresh  = slabs.size();
+    for ( ; needed; --needed ) {
+        unsigned char * slab = pool->allocate( this);
+
+        if ( !slab ) {
+            // the pool is used up, give back what was taken
+            while ( slabs.size() > fresh ) {
+                pool->release( slabs.back());
+                slabs.pop_back();
+            }
+            reportEvent( 4, "BufferedSink, pool used up, dropping",
+                            bufferSize);
+            return 0;
+        }
+        slabs.push_back( slab);
+    }
+
+    // fill the last slab, then the ones just drawn
+    ix   = fresh ? fresh - 1 : 0;
+    tail = fresh ? slabTail : 0;
+    for ( soFar = 0; soFar < bufferSize; ) {
+        unsigned int    size;
+
+        if ( tail == slabBytes ) {
+            ++ix;
+            tail = 0;
+        }
+
+        size = slabBytes - tail;
+        if ( size > bufferSize - soFar ) {
+            size = bufferSize - soFar;
+        }
+        gather( slabs[ix] + tail, iov, iovcnt, skip + soFar, size);
+        tail  += size;
+        soFar += size;
+    }
+    if ( !slabs.empty() ) {
+        slabTail = tail;
+    }
+    queued += bufferSize;
+
+    if ( peak < queued ) {
+        peak = queued;
+        reportEvent( 4, "BufferedSink, new peak:", peak);
+    }
+
+    return bufferSize;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write as much of the data in the slabs to the sink as it takes
+ *  Call with the mutex locked
+ *----------------------------------------------------------------------------*/
+void
+BufferedSink :: sendPooled ( void )                 throw ( Exception )
+{
+    unsigned int    length;
+    unsigned int    total = 0;
+
+    while ( queued && sink->canWrite( 0, 0) ) {
+        unsigned int    size;
+
+        size = slabs.size() == 1 ? slabTail - slabHead
+                                 : slabBytes - slabHead;
+        length = sink->write( slabs.front() + slabHead, size);
+        consumePooled( length);
+        total += length;
+        if ( length < size ) {
+            break;
+        }
+    }
+
+    // calulate the misalignment to chunkSize boundaries,
+    // and skip the rest of the partially written chunk
+    misalignment = (chunkSize - (total % chunkSize)) % chunkSize;
+    consumePooled( misalignment);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write some data to the sink, buffering in slabs drawn from the pool
+ *  if len == 0, try to flush the buffer
+ *----------------------------------------------------------------------------*/
+unsigned int
+BufferedSink :: writePooled (   const unsigned char   * buf,
+                                unsigned int            len )
+                                                    throw ( Exception )
+{
+    unsigned int    length;
+    unsigned int    soFar;
+    struct iovec    iov;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    pthread_mutex_lock( &mutex);
+
+    try {
+        if ( !align() ) {
+            pthread_mutex_unlock( &mutex);
+            return 0;
+        }
+
+        // make it a multiple of chunkSize
+        len -= len % chunkSize;
+        iov.iov_base = (void *) buf;
+        iov.iov_len  = len;
+
+        // try to write data from the slabs first, if any
+        if ( queued ) {
+            sendPooled();
+        }
+
+        if ( !align() ) {
+            storevPooled( &iov, 1, 0);
+            pthread_mutex_unlock( &mutex);
+            return len;
+        }
+
+        // the slabs are empty, try to write the fresh data
+        soFar = 0;
+        if ( !queued ) { 
+            while ( soFar < len && sink->canWrite( 0, 0) ) {
+                soFar += sink->write( buf + soFar, len - soFar);
+            }
+        }
+        length = soFar;
+
+        // calulate the misalignment to chunkSize boundaries
+        misalignment = (chunkSize - (length % chunkSize)) % chunkSize;
+
+        if ( length < len ) {
+            // if not all fresh could be written, store the remains
+            // that are aligned on chunkSize
+            length += misalignment;
+            if ( length < len ) {
+                storevPooled( &iov, 1, length);
+            }
+        }
+    } catch ( Exception     & e ) {
+        pthread_mutex_unlock( &mutex);
+        reportEvent( 3, "Exception caught in BufferedSink :: writePooled");
+        throw;
     }
 
+    pthread_mutex_unlock( &mutex);
+
     // tell them we ate everything up to chunkSize alignment
     return len;
 }
@@ -369,5 +812,8 @@ BufferedSink :: close ( void )                      throw ( Exception )
     flush();
     sink->close();
     inp = outp = buffer;
+    if ( pool.get() ) {
+        clearPooled();
+    }
 }
 
@@ -36,9 +36,12 @@
 
 /* ============================================================ include files */
 
+#include <deque>
+
 #include "Ref.h"
 #include "Reporter.h"
 #include "Sink.h"
+#include "BufferPool.h"
 
 
 /* ================================================================ constants */
@@ -51,14 +54,23 @@
 
 /**
  *  A Sink First-In First-Out buffer.
- *  This buffer can always be written to, it overwrites any
- *  data contained if needed.
- *  The class is not thread-safe.
+ *  This buffer can always be written to. When it is full, the data
+ *  written is dropped as a whole, so that the stream is only ever cut
+ *  between two writes (e.g. between encoded frames), not in the middle
+ *  of one. The pool may still take back the oldest slab of a buffer
+ *  for a buffer of higher priority.
+ *  The buffer is either a fixed size ring of its own, or is built
+ *  from slabs drawn from a BufferPool shared with other buffers,
+ *  in which case memory is only used while data is queued.
+ *  The class is not thread-safe, except that slabs may be taken back
+ *  by the BufferPool from another thread.
  *
  *  @author  $Author$
  *  @version $Revision$
  */
-class BufferedSink : public Sink, public virtual Reporter
+class BufferedSink : public Sink,
+                     public virtual Reporter,
+                     public BufferPool::Client
 {
     private:
 
@@ -105,6 +117,46 @@ class BufferedSink : public Sink, public virtual Reporter
         unsigned char     * outp;
 
 
+        /**
+         *  The pool the slabs are drawn from, if any.
+         */
+        Ref<BufferPool>     pool;
+
+        /**
+         *  The priority of this buffer in the pool.
+         */
+        int                 priority;
+
+        /**
+         *  The slabs holding the queued data, oldest first.
+         */
+        std::deque<unsigned char*>  slabs;
+
+        /**
+         *  The number of bytes used of each slab, a multiple of chunkSize.
+         */
+        unsigned int        slabBytes;
+
+        /**
+         *  Start of sensible data in the first slab.
+         */
+        unsigned int        slabHead;
+
+        /**
+         *  Start of free territory in the last slab.
+         */
+        unsigned int        slabTail;
+
+        /**
+         *  The number of bytes queued in the slabs.
+         */
+        unsigned int        queued;
+
+        /**
+         *  Mutex guarding the slabs against the pool taking them back.
+         */
+        pthread_mutex_t     mutex;
+
         /**
          *  The underlying Sink.
          */
@@ -115,12 +167,17 @@ class BufferedSink : public Sink, public virtual Reporter
          *
          *  @param sink the Sink to attach this BufferedSink to.
          *  @param size the size of the internal buffer to use.
+         *  @param pool the pool to draw slabs from, or 0 to use
+         *              an internal buffer of its own.
+         *  @param priority the priority of this buffer in the pool.
          *  @param chunkSize size of chunks to handle data in.
          *  @exception Exception
          */
         void
         init (  Sink              * sink,
                 unsigned int        size,
+                BufferPool        * pool,
+                int                 priority,
                 unsigned int        chunkSize )         throw ( Exception );
 
         /**
@@ -170,6 +227,92 @@ class BufferedSink : public Sink, public virtual Reporter
             }
         }
 
+        /**
+         *  Remove the slab holding the oldest data, discarding the data.
+         *  Call with the mutex locked.
+         *
+         *  @return the slab removed, or 0 if there were none.
+         */
+        unsigned char *
+        dropSlab ( void )                               throw ();
+
+        /**
+         *  Remove bytes from the front of the slabs, giving emptied
+         *  slabs back to the pool. Call with the mutex locked.
+         *
+         *  @param len the number of bytes to remove.
+         */
+        void
+        consumePooled ( unsigned int    len )           throw ();
+
+        /**
+         *  Give back all slabs to the pool, discarding the data.
+         */
+        void
+        clearPooled ( void )                            throw ();
+
+        /**
+         *  Store the data of several buffers in slabs drawn from the pool.
+         *  If the buffer size or the pool budget is used up, the data is
+         *  dropped as a whole. Call with the mutex locked.
+         *
+         *  @param iov the buffers holding the data to store.
+         *  @param iovcnt the number of buffers in iov.
+         *  @param skip the number of bytes at the start of the data
+         *              not to store.
+         *  @return number of bytes really stored.
+         */
+        unsigned int
+        storevPooled (  const struct iovec    * iov,
+                        unsigned int            iovcnt,
+                        unsigned int            skip )          throw ();
+
+        /**
+         *  Write as much of the data in the slabs to the underlying
+         *  Sink as it takes. Call with the mutex locked.
+         *
+         *  @exception Exception
+         */
+        void
+        sendPooled ( void )                             throw ( Exception );
+
+        /**
+         *  Store the data of several buffers in the internal buffer.
+         *  If there is not enough space, the data is dropped as a whole.
+         *
+         *  @param iov the buffers holding the data to store.
+         *  @param iovcnt the number of buffers in iov.
+         *  @param skip the number of bytes at the start of the data
+         *              not to store.
+         *  @return number of bytes really stored.
+         *  @exception Exception
+         */
+        unsigned int
+        storev (    const struct iovec    * iov,
+                    unsigned int            iovcnt,
+                    unsigned int            skip )      throw ( Exception );
+
+        /**
+         *  Write as much of the data in the internal buffer to the
+         *  underlying Sink as it takes.
+         *
+         *  @exception Exception
+         */
+        void
+        sendBuffered ( void )                           throw ( Exception );
+
+        /**
+         *  The write() implementation when using slabs from a pool.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        unsigned int
+        writePooled (   const unsigned char   * buf,
+                        unsigned int            len )   throw ( Exception );
+
         /**
          *  If the underlying Sink is misaligned on chunkSize, write as
          *  many 0s as needed to get it aligned.
@@ -226,8 +369,7 @@ class BufferedSink : public Sink, public virtual Reporter
 
         /**
          *  Store data in the internal buffer. If there is not enough space,
-         *  discard all in the buffer and the beginning of the supplied
-         *  buffer if needed.
+         *  the data is dropped as a whole.
          *  
          *  @param buffer the data to store.
          *  @param bufferSize the amount of data to store in bytes.
@@ -254,7 +396,31 @@ class BufferedSink : public Sink, public virtual Reporter
                         unsigned int        size,
                         unsigned int        chunkSize = 1 ) throw ( Exception )
         {
-            init( sink, size, chunkSize);
+            init( sink, size, 0, 0, chunkSize);
+        }
+
+        /**
+         *  Constructor by an underlying Sink, a maximum buffer size,
+         *  a pool to draw the buffer memory from and chunk size.
+         *  
+         *  @param sink the Sink to attach this BufferSink to.
+         *  @param size the maximum amount of data to buffer.
+         *  @param pool the pool to draw the buffer memory from.
+         *  @param priority the priority of this buffer in the pool,
+         *                  buffers with a lower priority lose their
+         *                  data first when the pool is used up.
+         *  @param chunkSize hanlde all data in write() as chunks of
+         *                   chunkSize
+         *  @exception Exception
+         */
+        inline 
+        BufferedSink (  Sink              * sink,
+                        unsigned int        size,
+                        BufferPool        * pool,
+                        int                 priority,
+                        unsigned int        chunkSize = 1 ) throw ( Exception )
+        {
+            init( sink, size, pool, priority, chunkSize);
         }
 
         /**
@@ -297,6 +463,26 @@ class BufferedSink : public Sink, public virtual Reporter
             return peak;
         }
 
+        /**
+         *  Get the priority of this buffer in the pool.
+         *
+         *  @return the priority of this buffer.
+         */
+        inline virtual int
+        getPoolPriority ( void ) const                  throw ()
+        {
+            return priority;
+        }
+
+        /**
+         *  Give up the slab with the oldest data, if the buffer is not
+         *  being written to at the moment.
+         *
+         *  @return the slab given up, or 0 if none.
+         */
+        virtual unsigned char *
+        evictSlab ( void )                              throw ();
+
         /**
          *  Open the BufferedSink. Opens the underlying Sink.
          *  
@@ -352,6 +538,21 @@ class BufferedSink : public Sink, public virtual Reporter
         write (    const void    * buf,
                    unsigned int    len )                throw ( Exception );
 
+        /**
+         *  Write data from several buffers to the BufferedSink.
+         *  If nothing is buffered, the buffers are passed to the
+         *  underlying Sink in one go, and what it does not accept
+         *  is buffered.
+         *
+         *  @param iov the buffers to write.
+         *  @param iovcnt the number of buffers in iov.
+         *  @return the number of bytes written.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writev (   const struct iovec    * iov,
+                   unsigned int            iovcnt )     throw ( Exception );
+
         /**
          *  Flush all data that was written to the BufferedSink to the
          *  underlying Sink.
@@ -29,6 +29,17 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#error need sys/time.h
+#endif
+
+
 #include "Util.h"
 #include "Exception.h"
 #include "CastSink.h"
@@ -72,6 +83,30 @@ CastSink :: init (  TcpSocket             * socket,
     this->url            = url            ? Util::strDup( url)      : 0;
     this->genre          = genre          ? Util::strDup( genre)    : 0;
     this->isPublic       = isPublic;
+
+    current        = 0;
+    hotStandby     = false;
+    standby        = 0;
+    standbyReady   = false;
+    standbyRunning = false;
+    if ( socket ) {
+        servers.push_back( socket);
+    }
+
+    pthread_mutex_init( &mutex, 0);
+    pthread_cond_init( &cond, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Copy the list of servers of an other CastSink
+ *----------------------------------------------------------------------------*/
+void
+CastSink :: copyServers (   const CastSink    & cs )    throw ()
+{
+    servers    = cs.servers;
+    current    = cs.current;
+    hotStandby = cs.hotStandby;
 }
 
 
@@ -97,6 +132,38 @@ CastSink :: strip ( void )                          throw ( Exception )
     if ( genre ) {
         delete[] genre;
     }
+
+    servers.clear();
+    pthread_cond_destroy( &cond);
+    pthread_mutex_destroy( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Connect and log in to a server
+ *----------------------------------------------------------------------------*/
+bool
+CastSink :: login ( TcpSocket     * sock,
+                    bool            isLast )        throw ( Exception )
+{
+    try {
+        if ( !sock->open() ) {
+            return false;
+        }
+    } catch ( Exception     & e ) {
+        if ( isLast ) {
+            throw;
+        }
+        reportEvent( 3, e);
+        return false;
+    }
+
+    if ( !sendLogin( sock) ) {
+        sock->close();
+        return false;
+    }
+
+    return true;
 }
 
 
@@ -106,17 +173,26 @@ CastSink :: strip ( void )                          throw ( Exception )
 bool
 CastSink :: open ( void )                       throw ( Exception )
 {
+    unsigned int    i;
+
     if ( isOpen() ) {
         return false;
     }
 
-    if ( !getSink()->open() ) {
+    // try the servers in order of preference
+    for ( i = 0; i < servers.size(); ++i ) {
+        if ( login( servers[i].get(), i + 1 == servers.size()) ) {
+            break;
+        }
+    }
+    if ( i == servers.size() ) {
         return false;
     }
 
-    if ( !sendLogin() ) {
-        close();
-        return false;
+    current = i;
+    socket  = servers[i];
+    if ( current > 0 ) {
+        reportEvent( 2, "streaming to failover server", socket->getHost());
     }
 
     if ( streamDump != 0 ) {
@@ -126,8 +202,186 @@ CastSink :: open ( void )                       throw ( Exception )
             }
         }
     }
+
+    if ( hotStandby && servers.size() > 1 ) {
+        startStandby();
+    }
     
     return true;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Close the connection
+ *----------------------------------------------------------------------------*/
+void
+CastSink :: close ( void )                      throw ( Exception )
+{
+    stopStandby();
+
+    if ( streamDump != 0 ) {
+        streamDump->close();
+    }
+
+    return getSink()->close();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Switch to the standby server
+ *----------------------------------------------------------------------------*/
+bool
+CastSink :: failover ( void )                   throw ( Exception )
+{
+    bool    ready;
+
+    pthread_mutex_lock( &mutex);
+    ready = standbyReady;
+    if ( ready ) {
+        // a failed write has already closed the socket
+        current      = standby;
+        socket       = servers[current];
+        standbyReady = false;
+        pthread_cond_signal( &cond);
+    }
+    pthread_mutex_unlock( &mutex);
+
+    if ( ready ) {
+        reportEvent( 2, "failing over to server", socket->getHost());
+    }
+
+    return ready;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start the standby thread
+ *----------------------------------------------------------------------------*/
+void
+CastSink :: startStandby ( void )               throw ()
+{
+    if ( standbyRunning ) {
+        return;
+    }
+
+    standbyRunning = true;
+    if ( pthread_create( &standbyThread, 0, standbyFunction, this) ) {
+        reportEvent( 2, "can't create standby thread");
+        standbyRunning = false;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop the standby thread
+ *----------------------------------------------------------------------------*/
+void
+CastSink :: stopStandby ( void )                throw ( Exception )
+{
+    if ( !standbyRunning ) {
+        return;
+    }
+
+    pthread_mutex_lock( &mutex);
+    standbyRunning = false;
+    pthread_cond_signal( &cond);
+    pthread_mutex_unlock( &mutex);
+
+    pthread_join( standbyThread, 0);
+
+    if ( standbyReady ) {
+        servers[standby]->close();
+        standbyReady = false;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The function the standby thread starts with
+ *----------------------------------------------------------------------------*/
+void *
+CastSink :: standbyFunction (   void      * param )     throw ()
+{
+    ((CastSink *) param)->keepStandby();
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Keep the server after the current one logged in
+ *----------------------------------------------------------------------------*/
+void
+CastSink :: keepStandby ( void )                throw ()
+{
+    struct timeval      now;
+    struct timespec     timeout;
+
+    pthread_mutex_lock( &mutex);
+    while ( standbyRunning ) {
+        unsigned int    next = (current + 1) % servers.size();
+        TcpSocket     * sock = servers[next].get();
+        unsigned int    wait = 1;
+
+        if ( !standbyReady ) {
+            bool    ok = false;
+
+            // log in without holding the lock, as it may take a while
+            pthread_mutex_unlock( &mutex);
+            try {
+                if ( sock->isOpen() ) {
+                    sock->close();
+                }
+                ok = login( sock, false);
+            } catch ( Exception     & e ) {
+                reportEvent( 3, e);
+            }
+            pthread_mutex_lock( &mutex);
+
+            if ( !ok ) {
+                wait = standbyRetry;
+            } else if ( standbyRunning
+                     && next == (current + 1) % servers.size() ) {
+                standby      = next;
+                standbyReady = true;
+                reportEvent( 4, "standby server logged in", sock->getHost());
+            } else {
+                try {
+                    sock->close();
+                } catch ( Exception     & e ) {
+                }
+            }
+        } else {
+            bool    closed;
+
+            // probe without holding the lock, so that failover() is never
+            // kept waiting, and without reconnecting, as a reconnected
+            // socket would not be logged in
+            pthread_mutex_unlock( &mutex);
+            closed = sock->isPeerClosed();
+            pthread_mutex_lock( &mutex);
+
+            // unless failover() took the socket over in the meantime
+            if ( closed && standbyReady && standby == next ) {
+                reportEvent( 3, "standby server closed the connection",
+                                sock->getHost());
+                standbyReady = false;
+                try {
+                    sock->close();
+                } catch ( Exception     & e ) {
+                }
+            }
+        }
+
+        if ( !standbyRunning ) {
+            break;
+        }
+        gettimeofday( &now, 0);
+        timeout.tv_sec  = now.tv_sec + wait;
+        timeout.tv_nsec = now.tv_usec * 1000L;
+        pthread_cond_timedwait( &cond, &mutex, &timeout);
+    }
+    pthread_mutex_unlock( &mutex);
+}
+
+
@@ -36,6 +36,20 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <vector>
+
 #include "Ref.h"
 #include "Reporter.h"
 #include "Sink.h"
@@ -56,6 +70,12 @@
  *  This is an abstract class. A subclass should override at least
  *  the sendLogin() function.
  *
+ *  Several servers may be given, in order of preference. When opening,
+ *  the first one that accepts the login is used. With hot standby,
+ *  the next server is kept logged in by a background thread, and
+ *  when writing to the current server fails, the data is sent to the
+ *  standby server instead, without reconnecting.
+ *
  *  @author  $Author$
  *  @version $Revision$
  */
@@ -64,10 +84,62 @@ class CastSink : public Sink, public virtual Reporter
     private:
 
         /**
-         *  The socket connection to the server.
+         *  The socket connection to the server currently streamed to.
          */
         Ref<TcpSocket>      socket;
 
+        /**
+         *  The socket connections to all the servers, in order of
+         *  preference.
+         */
+        std::vector< Ref<TcpSocket> >   servers;
+
+        /**
+         *  The index of the server currently streamed to.
+         */
+        unsigned int        current;
+
+        /**
+         *  Keep the next server logged in, to fail over to it at once.
+         */
+        bool                hotStandby;
+
+        /**
+         *  The index of the standby server, if standbyReady.
+         */
+        unsigned int        standby;
+
+        /**
+         *  Is the standby server logged in and ready to take over.
+         */
+        bool                standbyReady;
+
+        /**
+         *  Should the standby thread keep running.
+         */
+        bool                standbyRunning;
+
+        /**
+         *  The thread keeping the standby server logged in.
+         */
+        pthread_t           standbyThread;
+
+        /**
+         *  Mutex guarding current, standby and standbyReady.
+         */
+        pthread_mutex_t     mutex;
+
+        /**
+         *  Condition to wake up the standby thread.
+         */
+        pthread_cond_t      cond;
+
+        /**
+         *  Seconds to wait between attempts to log in to the
+         *  standby server.
+         */
+        static const unsigned int   standbyRetry = 5;
+
         /**
          *  An optional Sink to enable stream dumps.
          */
@@ -134,6 +206,58 @@ class CastSink : public Sink, public virtual Reporter
         void
         strip ( void )                              throw ( Exception );
 
+        /**
+         *  Copy the list of servers of an other CastSink.
+         *
+         *  @param cs the CastSink to copy the servers of.
+         */
+        void
+        copyServers ( const CastSink  & cs )        throw ();
+
+        /**
+         *  Connect and log in to a server.
+         *
+         *  @param sock the socket connection to the server.
+         *  @param isLast if true, connection errors are thrown,
+         *                otherwise they are reported and false returned.
+         *  @return true if login was successful, false otherwise.
+         *  @exception Exception
+         */
+        bool
+        login ( TcpSocket     * sock,
+                bool            isLast )            throw ( Exception );
+
+        /**
+         *  Start the thread keeping the standby server logged in.
+         */
+        void
+        startStandby ( void )                       throw ();
+
+        /**
+         *  Stop the thread keeping the standby server logged in,
+         *  and close the standby connection.
+         *
+         *  @exception Exception
+         */
+        void
+        stopStandby ( void )                        throw ( Exception );
+
+        /**
+         *  The body of the standby thread: log in to the server after
+         *  the current one, and log in again if it drops the connection.
+         */
+        void
+        keepStandby ( void )                        throw ();
+
+        /**
+         *  The function the standby thread starts with.
+         *
+         *  @param param the CastSink to keep the standby server of.
+         *  @return NULL
+         */
+        static void *
+        standbyFunction ( void    * param )         throw ();
+
 
     protected:
 
@@ -149,13 +273,36 @@ class CastSink : public Sink, public virtual Reporter
         }
 
         /**
-         *  Log in to the server using the socket avialable.
+         *  Log in to a server.
          *
+         *  @param socket the connection to the server, already open.
          *  @return true if login was successful, false otherwise.
          *  @exception Exception
          */
         virtual bool
-        sendLogin ( void )              throw ( Exception )         = 0;
+        sendLogin ( TcpSocket     * socket )    throw ( Exception )     = 0;
+
+        /**
+         *  Switch to the standby server, if it is ready.
+         *  Called after writing to the current server failed.
+         *
+         *  @return true if switched to the standby server,
+         *          false if there was no standby server ready.
+         *  @exception Exception
+         */
+        bool
+        failover ( void )                           throw ( Exception );
+
+        /**
+         *  Get the Sink the stream is dumped to.
+         *
+         *  @return the Sink the stream is dumped to, or NULL.
+         */
+        inline Sink *
+        getStreamDump ( void ) const                throw ()
+        {
+            return streamDump.get();
+        }
 
         /**
          *  Get the Sink underneath this CastSink.
@@ -234,6 +381,7 @@ class CastSink : public Sink, public virtual Reporter
                   cs.url,
                   cs.genre,
                   cs.isPublic );
+            copyServers( cs);
         }
 
         /**
@@ -268,6 +416,7 @@ class CastSink : public Sink, public virtual Reporter
                       cs.url,
                       cs.genre,
                       cs.isPublic );
+                copyServers( cs);
             }
             return *this;
         }
@@ -326,7 +475,41 @@ class CastSink : public Sink, public virtual Reporter
                 streamDump->write( buf, len);
             }
 
-            return getSink()->write( buf, len);
+            try {
+                return getSink()->write( buf, len);
+            } catch ( Exception     & e ) {
+                if ( !failover() ) {
+                    throw;
+                }
+                return getSink()->write( buf, len);
+            }
+        }
+
+        /**
+         *  Write data from several buffers to the CastSink, in one go.
+         *
+         *  @param iov the buffers to write.
+         *  @param iovcnt the number of buffers in iov.
+         *  @return the number of bytes written.
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        writev (       const struct iovec    * iov,
+                       unsigned int            iovcnt )
+                                                    throw ( Exception )
+        {
+            if ( streamDump != 0 ) {
+                streamDump->writev( iov, iovcnt);
+            }
+
+            try {
+                return getSink()->writev( iov, iovcnt);
+            } catch ( Exception     & e ) {
+                if ( !failover() ) {
+                    throw;
+                }
+                return getSink()->writev( iov, iovcnt);
+            }
         }
 
         /**
@@ -362,14 +545,42 @@ class CastSink : public Sink, public virtual Reporter
          *
          *  @exception Exception
          */
-        inline virtual void
-        close ( void )                              throw ( Exception )
+        virtual void
+        close ( void )                              throw ( Exception );
+
+        /**
+         *  Add a server to fail over to, after the ones already added.
+         *
+         *  @param socket socket connection to the server.
+         */
+        inline void
+        addServer ( TcpSocket         * socket )    throw ( Exception )
         {
-            if ( streamDump != 0 ) {
-                streamDump->close();
-            }
+            servers.push_back( socket);
+        }
 
-            return getSink()->close();
+        /**
+         *  Set if the next server should be kept logged in, to fail
+         *  over to it without reconnecting.
+         *  Takes effect when the CastSink is opened.
+         *
+         *  @param hotStandby true to keep a standby server logged in.
+         */
+        inline void
+        setHotStandby ( bool            hotStandby )    throw ()
+        {
+            this->hotStandby = hotStandby;
+        }
+
+        /**
+         *  Tell if the next server is kept logged in.
+         *
+         *  @return true if a standby server is kept logged in.
+         */
+        inline bool
+        getHotStandby ( void ) const                throw ()
+        {
+            return hotStandby;
         }
 
         /**
@@ -30,6 +30,7 @@
 /* ============================================================ include files */
 
 #include "Exception.h"
+#include "Handle.h"
 #include "Connector.h"
 
 
@@ -269,7 +270,8 @@ Connector :: transfer ( unsigned long       bytes,
         return 0;
     }
 
-    unsigned char * buf = new unsigned char[bufSize];
+    // the buffer is deleted on all returns, including exceptions
+    Handle<unsigned char>   buf( new unsigned char[bufSize]);
 
     reportEvent( 6, "Connector :: tranfer, bytes", bytes);
     
@@ -278,7 +280,7 @@ Connector :: transfer ( unsigned long       bytes,
         unsigned int    e = 0;
 
         if ( source->canRead( sec, usec) ) {
-            d = source->read( buf, bufSize);
+            d = source->read( buf.get(), bufSize);
 
             // check for EOF
             if ( d == 0 ) {
@@ -291,7 +293,7 @@ Connector :: transfer ( unsigned long       bytes,
                 if ( sinks[u]->canWrite( sec, usec) ) {
                     try {
                         // we expect the sink to accept all data written
-                        e = sinks[u]->write( buf, d);
+                        e = sinks[u]->write( buf.get(), d);
                     } catch ( Exception     & e ) {
                         sinks[u]->close();
                         detach( sinks[u].get() );
@@ -303,7 +305,6 @@ Connector :: transfer ( unsigned long       bytes,
                         if ( numSinks == 0 ) {
                             reportEvent( 4,
                                         "Connector :: transfer, no more sinks");
-                            delete[] buf;
                             return b;
                         }
                         // with the call to detach, numSinks gets 1 lower,
@@ -320,7 +321,6 @@ Connector :: transfer ( unsigned long       bytes,
         }
     }
 
-    delete[] buf;
     return b;
 }
 
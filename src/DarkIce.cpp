@@ -40,6 +40,12 @@
 #error need stdlib.h
 #endif
 
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
 #ifdef HAVE_UNISTD_H
 #include <unistd.h>
 #else
@@ -77,6 +83,14 @@
 #include "IceCast2.h"
 #include "ShoutCast.h"
 #include "FileCast.h"
+#include "SpillSink.h"
+#include "BufferAllocator.h"
+#include "DnsCache.h"
+#include "HttpMount.h"
+#include "RtpSink.h"
+#include "MixerSource.h"
+#include "DriftSource.h"
+#include "SilenceGate.h"
 #include "MultiThreadedConnector.h"
 #include "DarkIce.h"
 
@@ -142,9 +156,10 @@ DarkIce :: init ( const Config      & config )              throw ( Exception )
     unsigned int             bitsPerSample;
     unsigned int             channel;
     bool                     reconnect;
-    const char             * device;
-    const char             * jackClientName;
-    const char             * paSourceName;
+    MixerSource            * mixer;
+    char                     input[]         = "input- ";
+    size_t                   inputLen        = Util::strLen( input);
+    unsigned int             u;
 
     // the [general] section
     if ( !(cs = config.get( "general")) ) {
@@ -161,6 +176,40 @@ DarkIce :: init ( const Config      & config )              throw ( Exception )
     str           = cs->get( "reconnect");
     reconnect     = str ? (Util::strEq( str, "yes") ? true : false) : true;
 
+    // buffer raw PCM in front of the encoders by default
+    str = cs->get( "bufferMode");
+    if ( !str || Util::strEq( str, "pcm") ) {
+        bufferMode = pcmBuffer;
+    } else if ( Util::strEq( str, "encoded") ) {
+        bufferMode = encodedBuffer;
+    } else {
+        throw Exception( __FILE__, __LINE__, "invalid buffer mode: ", str);
+    }
+
+    // how long resolved server addresses are reused, in seconds
+    str = cs->get( "dnsCacheTtl");
+    DnsCache::setTtl( str ? Util::strToL( str) : 300);
+
+    // where the audio buffers come from, this should be set before
+    // any of them is allocated
+    str = cs->get( "bufferMemory");
+    if ( !str || Util::strEq( str, "heap") ) {
+        BufferAllocator::setMode( BufferAllocator::heap);
+    } else if ( Util::strEq( str, "locked") ) {
+        BufferAllocator::setMode( BufferAllocator::locked);
+    } else if ( Util::strEq( str, "hugepages") ) {
+        BufferAllocator::setMode( BufferAllocator::hugePages);
+    } else {
+        throw Exception( __FILE__, __LINE__, "invalid buffer memory: ", str);
+    }
+
+    // with a buffer budget, all output buffers share one pool of memory
+    str = cs->get( "bufferBudget");
+    if ( str && Util::strToL( str) > 0 ) {
+        bufferPool = new BufferPool( Util::strToL( str) * 1024UL);
+        reportEvent( 3, "buffer budget (kB): ", Util::strToL( str));
+    }
+
     // real-time scheduling is enabled by default
     str = cs->get( "realtime" );
     enableRealTime = str ? (Util::strEq( str, "yes") ? true : false) : true;
@@ -184,16 +233,44 @@ DarkIce :: init ( const Config      & config )              throw ( Exception )
     bitsPerSample = Util::strToL( str);
     str           = cs->getForSure( "channel", " missing in section [input]");
     channel       = Util::strToL( str);
-    device        = cs->getForSure( "device", " missing in section [input]");
-    jackClientName = cs->get ( "jackClientName");
-    paSourceName = cs->get ( "paSourceName");
+    dsp           = newInput( cs, "input", sampleRate, bitsPerSample, channel);
+
+    // more inputs, [input-0], [input-1], ..., are mixed with [input]
+    mixer = 0;
+    for ( u = 0; u < MixerSource::maxInputs - 1; ++u ) {
+        const ConfigSection    * ics;
+
+        // ugly hack to change the section name to "input-0", "input-1", etc.
+        input[inputLen-1] = '0' + u;
+
+        if ( !(ics = config.get( input)) ) {
+            break;
+        }
+        if ( !mixer ) {
+            mixer = new MixerSource( sampleRate, bitsPerSample, channel);
+            str   = cs->get( "gain");
+            mixer->addInput( dsp.get(), str ? Util::strToD( str) : 0.0);
+            dsp   = mixer;
+        }
+        str = ics->get( "gain");
+        mixer->addInput( newInput( ics, input,
+                                   sampleRate, bitsPerSample, channel),
+                         str ? Util::strToD( str) : 0.0);
+    }
+
+    // watch the input for silence, so that outputs can be suspended
+    str = cs->get( "silenceDuration");
+    if ( str ) {
+        const char    * threshold = cs->get( "silenceThreshold");
+
+        silenceDetector = new SilenceDetector( dsp.get(),
+                                               threshold
+                                                ? Util::strToD( threshold)
+                                                : -60.0,
+                                               Util::strToD( str));
+        dsp             = silenceDetector.get();
+    }
 
-    dsp             = AudioSource::createDspSource( device,
-                                                    jackClientName,
-                                                    paSourceName,
-                                                    sampleRate,
-                                                    bitsPerSample,
-                                                    channel );
     encConnector    = new MultiThreadedConnector( dsp.get(), reconnect );
 
     noAudioOuts = 0;
@@ -201,6 +278,8 @@ DarkIce :: init ( const Config      & config )              throw ( Exception )
     configIceCast2( config, bufferSecs);
     configShoutCast( config, bufferSecs);
     configFileCast( config);
+    configServer( config);
+    configRtp( config);
 }
 
 
@@ -259,7 +338,7 @@ DarkIce :: configIceCast (  const Config      & config,
         bool                        fileAddDate     = false;
         const char                * fileDateFormat  = 0;
         AudioEncoder              * encoder         = 0;
-        int                         bufferSize      = 0;
+        Sink                      * encoderSink     = 0;
 
         str         = cs->get( "sampleRate");
         sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
@@ -328,9 +407,6 @@ DarkIce :: configIceCast (  const Config      & config,
         fileAddDate = str ? (Util::strEq( str, "yes") ? true : false) : false;
         fileDateFormat = cs->get("fileDateFormat");
 
-        bufferSize = dsp->getBitsPerSample() / 8 * dsp->getSampleRate() * dsp->getChannel() * bufferSecs;
-        reportEvent( 3, "buffer size: ", bufferSize);
-
         localDumpName = cs->get( "localDumpFile");
 
         // go on and create the things
@@ -360,7 +436,7 @@ DarkIce :: configIceCast (  const Config      & config,
             }
         }
         // streaming related stuff
-        audioOuts[u].socket = new TcpSocket( server, port);
+        audioOuts[u].socket = newTcpSocket( cs, server, port);
         audioOuts[u].server = new IceCast( audioOuts[u].socket.get(),
                                            password,
                                            mountPoint,
@@ -372,6 +448,12 @@ DarkIce :: configIceCast (  const Config      & config,
                                            isPublic,
                                            remoteDumpFile,
                                            localDumpFile);
+        configFailover( cs, audioOuts[u].server.get(), port);
+        encoderSink = encoderOutput( cs,
+                                     stream,
+                                     audioOuts[u].server.get(),
+                                     bitrate,
+                                     bufferSecs);
 
         str = cs->getForSure( "format", " missing in section ", stream);
 
@@ -383,7 +465,7 @@ DarkIce :: configIceCast (  const Config      & config,
 
 #ifdef HAVE_LAME_LIB
         if ( Util::strEq( str, "mp3") ) {
-            encoder = new LameLibEncoder( audioOuts[u].server.get(),
+            encoder = new LameLibEncoder( encoderSink,
                                           dsp.get(),
                                           bitrateMode,
                                           bitrate,
@@ -397,7 +479,7 @@ DarkIce :: configIceCast (  const Config      & config,
 #ifdef HAVE_TWOLAME_LIB
         if ( Util::strEq( str, "mp2") ) {
             encoder = new TwoLameLibEncoder(
-                                            audioOuts[u].server.get(),
+                                            encoderSink,
                                             dsp.get(),
                                             bitrateMode,
                                             bitrate,
@@ -406,8 +488,8 @@ DarkIce :: configIceCast (  const Config      & config,
         }
 #endif
 
-        audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getBitsPerSample() / 8);
-        encConnector->attach( audioOuts[u].encoder.get());
+        audioOuts[u].encoder = encoderInput( cs, encoder, bufferSecs);
+        encConnector->attach( silenceGate( cs, audioOuts[u].encoder.get()));
 #endif // HAVE_LAME_LIB || HAVE_TWOLAME_LIB
     }
 
@@ -441,13 +523,10 @@ DarkIce :: configIceCast2 (  const Config      & config,
 
         const char                * str;
 
+        const char                * formatName      = 0;
         IceCast2::StreamFormat      format;
-        unsigned int                sampleRate      = 0;
-        unsigned int                channel         = 0;
-        AudioEncoder::BitrateMode   bitrateMode;
         unsigned int                bitrate         = 0;
         unsigned int                maxBitrate      = 0;
-        double                      quality         = 0.0;
         const char                * server          = 0;
         unsigned int                port            = 0;
         const char                * password        = 0;
@@ -457,18 +536,31 @@ DarkIce :: configIceCast2 (  const Config      & config,
         const char                * url             = 0;
         const char                * genre           = 0;
         bool                        isPublic        = false;
-        int                         lowpass         = 0;
-        int                         highpass        = 0;
+        IceCast2::LoginMethod       loginMethod     = IceCast2::sourceMethod;
+        IceCast2                  * iceCast2        = 0;
         const char                * localDumpName   = 0;
         FileSink                  * localDumpFile   = 0;
         bool                        fileAddDate     = false;
         const char                * fileDateFormat  = 0;
         AudioEncoder              * encoder         = 0;
-        int                         bufferSize      = 0;
+        Sink                      * encoderSink     = 0;
 
-        str         = cs->getForSure( "format", " missing in section ", stream);
+        formatName  = cs->getForSure( "format", " missing in section ", stream);
+        str         = formatName;
         if ( Util::strEq( str, "vorbis") ) {
             format = IceCast2::oggVorbis;
+            // the Ogg headers are not re-sent when reconnecting
+            if ( cs->get( "spillFile") ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "spillFile not supported for vorbis, stream: ",
+                                 stream);
+            }
+            // nor when failing over to a standby server
+            if ( (str = cs->get( "hotStandby")) && Util::strEq( str, "yes") ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "hotStandby not supported for vorbis, stream: ",
+                                 stream);
+            }
         } else if ( Util::strEq( str, "mp3") ) {
             format = IceCast2::mp3;
         } else if ( Util::strEq( str, "mp2") ) {
@@ -482,47 +574,11 @@ DarkIce :: configIceCast2 (  const Config      & config,
                              "unsupported stream format: ", str);
         }
                 
-        str         = cs->get( "sampleRate");
-        sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
-        str         = cs->get( "channel");
-        channel     = str ? Util::strToL( str) : dsp->getChannel();
-
-        // determine fixed bitrate or variable bitrate quality
+        // the nominal bitrate, for the server and the output buffer
         str         = cs->get( "bitrate");
         bitrate     = str ? Util::strToL( str) : 0;
         str         = cs->get( "maxBitrate");
         maxBitrate  = str ? Util::strToL( str) : 0;
-        str         = cs->get( "quality");
-        quality     = str ? Util::strToD( str) : 0.0;
-        
-        str         = cs->getForSure( "bitrateMode",
-                                      " not specified in section ",
-                                      stream);
-        if ( Util::strEq( str, "cbr") ) {
-            bitrateMode = AudioEncoder::cbr;
-            
-            if ( bitrate == 0 ) {
-                throw Exception( __FILE__, __LINE__,
-                                 "bitrate not specified for CBR encoding");
-            }
-        } else if ( Util::strEq( str, "abr") ) {
-            bitrateMode = AudioEncoder::abr;
-
-            if ( bitrate == 0 ) {
-                throw Exception( __FILE__, __LINE__,
-                                 "bitrate not specified for ABR encoding");
-            }
-        } else if ( Util::strEq( str, "vbr") ) {
-            bitrateMode = AudioEncoder::vbr;
-
-            if ( cs->get( "quality" ) == 0 ) {
-                throw Exception( __FILE__, __LINE__,
-                                 "quality not specified for VBR encoding");
-            }
-        } else {
-            throw Exception( __FILE__, __LINE__,
-                             "invalid bitrate mode: ", str);
-        }
 
         server      = cs->getForSure( "server", " missing in section ", stream);
         str         = cs->getForSure( "port", " missing in section ", stream);
@@ -537,17 +593,19 @@ DarkIce :: configIceCast2 (  const Config      & config,
         genre       = cs->get( "genre");
         str         = cs->get( "public");
         isPublic    = str ? (Util::strEq( str, "yes") ? true : false) : false;
-        str         = cs->get( "lowpass");
-        lowpass     = str ? Util::strToL( str) : 0;
-        str         = cs->get( "highpass");
-        highpass    = str ? Util::strToL( str) : 0;
+        str         = cs->get( "loginMethod");
+        if ( !str || Util::strEq( str, "source") ) {
+            loginMethod = IceCast2::sourceMethod;
+        } else if ( Util::strEq( str, "put") ) {
+            loginMethod = IceCast2::putMethod;
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "unsupported login method: ", str);
+        }
         str         = cs->get( "fileAddDate");
         fileAddDate = str ? (Util::strEq( str, "yes") ? true : false) : false;
         fileDateFormat = cs->get( "fileDateFormat");
 
-        bufferSize = dsp->getBitsPerSample() / 8 * dsp->getSampleRate() * dsp->getChannel() * bufferSecs;
-        reportEvent( 3, "buffer size: ", bufferSize);
-        
         localDumpName = cs->get( "localDumpFile");
 
         // go on and create the things
@@ -578,132 +636,31 @@ DarkIce :: configIceCast2 (  const Config      & config,
         }
 
         // streaming related stuff
-        audioOuts[u].socket = new TcpSocket( server, port);
-        audioOuts[u].server = new IceCast2( audioOuts[u].socket.get(),
-                                            password,
-                                            mountPoint,
-                                            format,
-                                            bitrate,
-                                            name,
-                                            description,
-                                            url,
-                                            genre,
-                                            isPublic,
-                                            localDumpFile);
-
-        switch ( format ) {
-            case IceCast2::mp3:
-#ifndef HAVE_LAME_LIB
-                throw Exception( __FILE__, __LINE__,
-                                 "DarkIce not compiled with lame support, "
-                                 "thus can't create mp3 stream: ",
-                                 stream);
-#else
-                encoder = new LameLibEncoder(
-                                             audioOuts[u].server.get(),
-                                             dsp.get(),
-                                             bitrateMode,
-                                             bitrate,
-                                             quality,
-                                             sampleRate,
-                                             channel,
-                                             lowpass,
-                                             highpass );
-
-                audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getBitsPerSample() / 8);
-
-#endif // HAVE_LAME_LIB
-                break;
-
-
-            case IceCast2::oggVorbis:
-#ifndef HAVE_VORBIS_LIB
-                throw Exception( __FILE__, __LINE__,
-                                "DarkIce not compiled with Ogg Vorbis support, "
-                                "thus can't Ogg Vorbis stream: ",
-                                stream);
-#else
-
-                encoder = new VorbisLibEncoder(
-                                               audioOuts[u].server.get(),
-                                               dsp.get(),
-                                               bitrateMode,
-                                               bitrate,
-                                               quality,
-                                               sampleRate,
-                                               dsp->getChannel(),
-                                               maxBitrate);
-
-                audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getBitsPerSample() / 8);
-#endif // HAVE_VORBIS_LIB
-                break;
-
-            case IceCast2::mp2:
-#ifndef HAVE_TWOLAME_LIB
-                throw Exception( __FILE__, __LINE__,
-                                 "DarkIce not compiled with TwoLame support, "
-                                 "thus can't create mp2 stream: ",
-                                 stream);
-#else
-                encoder = new TwoLameLibEncoder(
-                                                audioOuts[u].server.get(),
-                                                dsp.get(),
-                                                bitrateMode,
-                                                bitrate,
-                                                sampleRate,
-                                                channel );
-
-                audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getBitsPerSample() / 8);
-#endif // HAVE_TWOLAME_LIB
-                break;
-
-
-            case IceCast2::aac:
-#ifndef HAVE_FAAC_LIB
-                throw Exception( __FILE__, __LINE__,
-                                "DarkIce not compiled with AAC support, "
-                                "thus can't aac stream: ",
-                                stream);
-#else
-                encoder = new FaacEncoder(
-                                          audioOuts[u].server.get(),
-                                          dsp.get(),
-                                          bitrateMode,
-                                          bitrate,
-                                          quality,
-                                          sampleRate,
-                                          dsp->getChannel());
-
-                audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getBitsPerSample() / 8);
-#endif // HAVE_FAAC_LIB
-                break;
-
-            case IceCast2::aacp:
-#ifndef HAVE_AACPLUS_LIB
-                throw Exception( __FILE__, __LINE__,
-                                "DarkIce not compiled with AAC+ support, "
-                                "thus can't aacp stream: ",
-                                stream);
-#else
-                encoder = new aacPlusEncoder(
-                                             audioOuts[u].server.get(),
-                                             dsp.get(),
-                                             bitrateMode,
-                                             bitrate,
-                                             quality,
-                                             sampleRate,
-                                             channel );
-
-                audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getBitsPerSample() / 8);
-#endif // HAVE_AACPLUS_LIB
-                break;
-
-            default:
-                throw Exception( __FILE__, __LINE__,
-                                "Illegal stream format: ", format);
-        }
-
-        encConnector->attach( audioOuts[u].encoder.get());
+        audioOuts[u].socket = newTcpSocket( cs, server, port);
+        iceCast2 = new IceCast2( audioOuts[u].socket.get(),
+                                 password,
+                                 mountPoint,
+                                 format,
+                                 bitrate,
+                                 name,
+                                 description,
+                                 url,
+                                 genre,
+                                 isPublic,
+                                 localDumpFile);
+        iceCast2->setLoginMethod( loginMethod);
+        audioOuts[u].server = iceCast2;
+        configFailover( cs, iceCast2, port);
+        encoderSink = encoderOutput( cs,
+                                     stream,
+                                     audioOuts[u].server.get(),
+                                     maxBitrate ? maxBitrate : bitrate,
+                                     bufferSecs);
+
+        encoder = newEncoder( cs, stream, formatName, encoderSink);
+        audioOuts[u].encoder = encoderInput( cs, encoder, bufferSecs);
+
+        encConnector->attach( silenceGate( cs, audioOuts[u].encoder.get()));
     }
 
     noAudioOuts += u;
@@ -761,12 +718,16 @@ DarkIce :: configShoutCast (    const Config      & config,
         const char                * irc             = 0;
         const char                * aim             = 0;
         const char                * icq             = 0;
+        unsigned int                protocol        = 1;
+        unsigned int                streamId        = 1;
+        const char                * user            = 0;
         const char                * localDumpName   = 0;
         FileSink                  * localDumpFile   = 0;
         bool                        fileAddDate     = false;
         const char                * fileDateFormat  = 0;
         AudioEncoder              * encoder         = 0;
-        int                         bufferSize      = 0;
+        Sink                      * encoderSink     = 0;
+        ShoutCast                 * shoutCast       = 0;
 
         str         = cs->get( "sampleRate");
         sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
@@ -828,13 +789,15 @@ DarkIce :: configShoutCast (    const Config      & config,
         irc         = cs->get( "irc");
         aim         = cs->get( "aim");
         icq         = cs->get( "icq");
+        str         = cs->get( "protocol");
+        protocol    = str ? Util::strToL( str) : 1;
+        str         = cs->get( "streamId");
+        streamId    = str ? Util::strToL( str) : 1;
+        user        = cs->get( "user");
         str         = cs->get("fileAddDate");
         fileAddDate = str ? (Util::strEq( str, "yes") ? true : false) : false;
         fileDateFormat = cs->get( "fileDateFormat");
 
-        bufferSize = dsp->getBitsPerSample() / 8 * dsp->getSampleRate() * dsp->getChannel() * bufferSecs;
-        reportEvent( 3, "buffer size: ", bufferSize);
-
         localDumpName = cs->get( "localDumpFile");
 
         // go on and create the things
@@ -865,22 +828,29 @@ DarkIce :: configShoutCast (    const Config      & config,
         }
 
         // streaming related stuff
-        audioOuts[u].socket = new TcpSocket( server, port);
-        audioOuts[u].server = new ShoutCast( audioOuts[u].socket.get(),
-                                             password,
-                                             mountPoint,
-                                             bitrate,
-                                             name,
-                                             url,
-                                             genre,
-                                             isPublic,
-                                             irc,
-                                             aim,
-                                             icq,
-                                             localDumpFile);
-
-        
-        encoder = new LameLibEncoder( audioOuts[u].server.get(),
+        audioOuts[u].socket = newTcpSocket( cs, server, port);
+        shoutCast = new ShoutCast( audioOuts[u].socket.get(),
+                                   password,
+                                   mountPoint,
+                                   bitrate,
+                                   name,
+                                   url,
+                                   genre,
+                                   isPublic,
+                                   irc,
+                                   aim,
+                                   icq,
+                                   localDumpFile);
+        audioOuts[u].server = shoutCast;
+        shoutCast->setProtocol( protocol, streamId, user);
+        configFailover( cs, audioOuts[u].server.get(), port);
+        encoderSink = encoderOutput( cs,
+                                     stream,
+                                     audioOuts[u].server.get(),
+                                     bitrate,
+                                     bufferSecs);
+
+        encoder = new LameLibEncoder( encoderSink,
                                       dsp.get(),
                                       bitrateMode,
                                       bitrate,
@@ -889,9 +859,9 @@ DarkIce :: configShoutCast (    const Config      & config,
                                       channel,
                                       lowpass,
                                       highpass );
-        audioOuts[u].encoder = new BufferedSink(encoder, bufferSize, dsp->getBitsPerSample() / 8);
+        audioOuts[u].encoder = encoderInput( cs, encoder, bufferSecs);
 
-        encConnector->attach( audioOuts[u].encoder.get());
+        encConnector->attach( silenceGate( cs, audioOuts[u].encoder.get()));
 #endif // HAVE_LAME_LIB
     }
 
@@ -1120,13 +1090,698 @@ DarkIce :: configFileCast (  const Config      & config )
                                 "Illegal stream format: ", format);
         }
 
-        encConnector->attach( audioOuts[u].encoder.get());
+        encConnector->attach( silenceGate( cs, audioOuts[u].encoder.get()));
     }
 
     noAudioOuts += u;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Look for the built-in server and its mounts in the config file
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configServer (   const Config      & config )
+                                                        throw ( Exception )
+{
+    const ConfigSection   * cs;
+    const char            * str;
+    const char            * bindAddress;
+    unsigned int            port;
+    unsigned int            maxListeners;
+    unsigned int            burstSize;
+    unsigned int            metaInt;
+    unsigned int            bufferSize;
+
+    // the [server] section
+    if ( !(cs = config.get( "server")) ) {
+        if ( config.get( "server-0") ) {
+            throw Exception( __FILE__, __LINE__,
+                             "section [server-0] needs a [server] section");
+        }
+        return;
+    }
+
+    str          = cs->getForSure( "port", " missing in section [server]");
+    port         = Util::strToL( str);
+    bindAddress  = cs->get( "bindAddress");
+    str          = cs->get( "maxListeners");
+    maxListeners = str ? Util::strToL( str) : 100;
+    str          = cs->get( "burstSize");
+    burstSize    = (str ? Util::strToL( str) : 64) * 1024;
+    str          = cs->get( "icyMetaInt");
+    metaInt      = str ? Util::strToL( str) : 16000;
+    str          = cs->get( "bufferSize");
+    bufferSize   = (str ? Util::strToL( str) : 256) * 1024;
+
+    if ( burstSize > bufferSize / 2 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "burstSize should be at most half of bufferSize");
+    }
+
+    httpServer = new HttpServer( bindAddress,
+                                 port,
+                                 maxListeners,
+                                 burstSize,
+                                 metaInt);
+
+    // look for the mounts of the server,
+    // sections [server-0], [server-1], ...
+    char            stream[]        = "server- ";
+    size_t          streamLen       = Util::strLen( stream);
+    unsigned int    u;
+
+    for ( u = noAudioOuts; u < maxOutput; ++u ) {
+        // ugly hack to change the section name to "stream0", "stream1", etc.
+        stream[streamLen-1] = '0' + (u - noAudioOuts);
+
+        if ( !(cs = config.get( stream)) ) {
+            break;
+        }
+
+        const char                * format          = 0;
+        const char                * contentType     = 0;
+        unsigned int                bitrate         = 0;
+        const char                * mountPoint      = 0;
+        HttpMount                 * mount           = 0;
+
+        // no Ogg Vorbis, as listeners joining later would miss the
+        // Ogg headers sent at the beginning of the stream
+        format      = cs->getForSure( "format", " missing in section ", stream);
+        if ( Util::strEq( format, "mp3") || Util::strEq( format, "mp2") ) {
+            contentType = "audio/mpeg";
+        } else if ( Util::strEq( format, "aac") ) {
+            contentType = "audio/aac";
+        } else if ( Util::strEq( format, "aacp") ) {
+            contentType = "audio/aacp";
+        } else {
+            throw Exception( __FILE__, __LINE__,
+                             "unsupported stream format: ", format);
+        }
+
+        str         = cs->get( "bitrate");
+        bitrate     = str ? Util::strToL( str) : 0;
+
+        str         = cs->getForSure( "bitrateMode",
+                                      " not specified in section ",
+                                      stream);
+        if (Util::strEq(format, "aac") && !Util::strEq(str, "abr")) {
+            throw Exception(__FILE__, __LINE__,
+                            "currently the AAC format only supports "
+                            "average bitrate mode");
+        }
+
+        if (Util::strEq(format, "aacp") && !Util::strEq(str, "cbr")) {
+            throw Exception(__FILE__, __LINE__,
+                            "currently the AAC+ format only supports "
+                            "constant bitrate mode");
+        }
+
+        mountPoint  = cs->getForSure( "mountPoint",
+                                      " missing in section ",
+                                      stream);
+
+        // go on and create the things
+
+        mount = new HttpMount( mountPoint,
+                               contentType,
+                               bitrate,
+                               bufferSize,
+                               cs->get( "name"),
+                               cs->get( "genre"),
+                               cs->get( "url"),
+                               cs->get( "description"));
+        httpServer->addMount( mount);
+
+        audioOuts[u].socket = 0;
+        audioOuts[u].server = 0;
+
+        audioOuts[u].encoder = newEncoder( cs, stream, format, mount);
+
+        encConnector->attach( silenceGate( cs, audioOuts[u].encoder.get()));
+    }
+
+    noAudioOuts = u;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Look for the RTP outputs in the config
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configRtp (  const Config      & config )
+                                                        throw ( Exception )
+{
+    // look for RTP config sections, [rtp-0], [rtp-1], ...
+    char            stream[]        = "rtp- ";
+    size_t          streamLen       = Util::strLen( stream);
+    unsigned int    u;
+
+    for ( u = noAudioOuts; u < maxOutput; ++u ) {
+        const ConfigSection    * cs;
+
+        // ugly hack to change the section name to "stream0", "stream1", etc.
+        stream[streamLen-1] = '0' + (u - noAudioOuts);
+
+        if ( !(cs = config.get( stream)) ) {
+            break;
+        }
+
+        const char                * str;
+        const char                * format          = 0;
+        const char                * server          = 0;
+        unsigned int                port            = 0;
+        unsigned int                ttl             = 1;
+        unsigned int                packetTime      = 20;
+        RtpSink                   * rtpSink         = 0;
+
+        format      = cs->getForSure( "format", " missing in section ", stream);
+        if ( !Util::strEq( format, "mp3") && !Util::strEq( format, "mp2")
+          && !Util::strEq( format, "l16") ) {
+            throw Exception( __FILE__, __LINE__,
+                             "unsupported stream format: ", format);
+        }
+
+        server      = cs->getForSure( "server", " missing in section ", stream);
+        str         = cs->getForSure( "port", " missing in section ", stream);
+        port        = Util::strToL( str);
+        str         = cs->get( "ttl");
+        ttl         = str ? Util::strToL( str) : 1;
+        str         = cs->get( "packetTime");
+        packetTime  = str ? Util::strToL( str) : 20;
+
+        if ( Util::strEq( format, "l16") ) {
+            // raw PCM, straight from the dsp
+            if ( dsp->getBitsPerSample() != 16 ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "l16 format needs 16 bits per sample: ",
+                                 stream);
+            }
+
+            rtpSink = new RtpSink( server,
+                                   port,
+                                   RtpSink::l16,
+                                   packetTime,
+                                   ttl,
+                                   dsp->getSampleRate(),
+                                   dsp->getChannel(),
+                                   dsp->isBigEndian(),
+                                   cs->get( "sdpFile"));
+
+            audioOuts[u].socket  = 0;
+            audioOuts[u].server  = 0;
+            audioOuts[u].encoder = rtpSink;
+
+            encConnector->attach( silenceGate( cs, audioOuts[u].encoder.get()));
+            continue;
+        }
+
+        // go on and create the things
+
+        rtpSink = new RtpSink( server,
+                               port,
+                               RtpSink::mpa,
+                               packetTime,
+                               ttl,
+                               0,
+                               0,
+                               false,
+                               cs->get( "sdpFile"));
+
+        audioOuts[u].socket = 0;
+        audioOuts[u].server = 0;
+
+        audioOuts[u].encoder = newEncoder( cs, stream, format, rtpSink);
+
+        encConnector->attach( silenceGate( cs, audioOuts[u].encoder.get()));
+    }
+
+    noAudioOuts = u;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Create the audio source of an input section
+ *----------------------------------------------------------------------------*/
+AudioSource *
+DarkIce :: newInput (   const ConfigSection   * cs,
+                        const char            * section,
+                        unsigned int            sampleRate,
+                        unsigned int            bitsPerSample,
+                        unsigned int            channel )
+                                                        throw ( Exception )
+{
+    const char     * str;
+    const char     * device;
+    const char     * jackClientName;
+    const char     * paSourceName;
+    bool             alsaMmap;
+    unsigned int     paFragSize;
+    unsigned int     paMaxLength;
+    bool             inputPacing;
+    bool             ossMmap;
+    AudioSource    * source;
+
+    device         = cs->getForSure( "device", " missing in section ", section);
+    jackClientName = cs->get( "jackClientName");
+    paSourceName   = cs->get( "paSourceName");
+    str            = cs->get( "alsaMmap");
+    alsaMmap       = str ? Util::strEq( str, "yes") : false;
+    str            = cs->get( "paFragSize");
+    paFragSize     = str ? Util::strToL( str) : 0;
+    str            = cs->get( "paMaxLength");
+    paMaxLength    = str ? Util::strToL( str) : 0;
+    // filePacing is the old name of inputPacing
+    str            = cs->get( "inputPacing");
+    if ( !str ) {
+        str        = cs->get( "filePacing");
+    }
+    inputPacing    = str ? Util::strEq( str, "yes") : true;
+    str            = cs->get( "ossMmap");
+    ossMmap        = str ? Util::strEq( str, "yes") : false;
+
+    source = AudioSource::createDspSource( device,
+                                           jackClientName,
+                                           paSourceName,
+                                           sampleRate,
+                                           bitsPerSample,
+                                           channel,
+                                           alsaMmap,
+                                           paFragSize,
+                                           paMaxLength,
+                                           inputPacing,
+                                           ossMmap );
+
+    // lock the sample rate of the input to the system clock
+    str = cs->get( "driftCompensation");
+    if ( str && Util::strEq( str, "yes") ) {
+        source = new DriftSource( source);
+    }
+
+    return source;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Create the socket of an output, with the TCP options configured
+ *----------------------------------------------------------------------------*/
+TcpSocket *
+DarkIce :: newTcpSocket (   const ConfigSection   * cs,
+                            const char            * server,
+                            unsigned int            port )
+                                                        throw ( Exception )
+{
+    const char    * str;
+    TcpSocket     * socket;
+    long            connectTimeout = 10;
+
+    if ( (str = cs->get( "connectTimeout")) ) {
+        connectTimeout = Util::strToL( str);
+        // with no time at all, not a single address could be tried
+        if ( connectTimeout <= 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "invalid connectTimeout: ", str);
+        }
+    }
+    socket = new TcpSocket( server, port, connectTimeout);
+
+    if ( (str = cs->get( "tcpSendBuffer")) ) {
+        socket->setSendBufferSize( Util::strToL( str));
+    }
+    if ( (str = cs->get( "tcpNoDelay")) ) {
+        socket->setNoDelay( Util::strEq( str, "yes"));
+    }
+    if ( (str = cs->get( "tcpNotSentLowat")) ) {
+        socket->setNotSentLowat( Util::strToL( str));
+    }
+    if ( (str = cs->get( "tcpCork")) ) {
+        socket->setCork( Util::strEq( str, "yes"));
+    }
+    if ( (str = cs->get( "tcpUserTimeout")) ) {
+        socket->setUserTimeout( Util::strToL( str));
+    }
+    socket->setCongestion( cs->get( "tcpCongestion"));
+    if ( cs->get( "pacing") || cs->get( "catchUpPacing") ) {
+        // pace at a multiple of the nominal bit rate, in bytes / sec
+        double      rate;
+        double      pacing;
+        double      catchUp;
+
+        if ( !(str = cs->get( "bitrate")) || !(rate = Util::strToL( str)) ) {
+            throw Exception( __FILE__, __LINE__,
+                             "pacing needs the bitrate of the stream");
+        }
+        rate *= 1000.0 / 8.0;
+
+        str         = cs->get( "pacing");
+        pacing      = str ? Util::strToD( str) * rate : 0.0;
+        str         = cs->get( "catchUpPacing");
+        catchUp     = str ? Util::strToD( str) * rate : 0.0;
+
+        socket->setPacingRate( (unsigned int) pacing, (unsigned int) catchUp);
+    }
+    str = cs->get( "tcpInfoInterval");
+    socket->setInfoInterval( str ? Util::strToL( str) : 10);
+    if ( (str = cs->get( "tcpRttAlarm")) ) {
+        socket->setRttAlarm( Util::strToL( str));
+    }
+
+    return socket;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Add the failover servers of an output
+ *----------------------------------------------------------------------------*/
+void
+DarkIce :: configFailover ( const ConfigSection   * cs,
+                            CastSink              * server,
+                            unsigned int            port )
+                                                        throw ( Exception )
+{
+    const char    * str;
+    char          * list;
+    char          * host;
+    char          * last;
+
+    // a list of host or host:port entries, the port of the output
+    // is used if not given
+    if ( (str = cs->get( "failoverServers")) ) {
+        list = Util::strDup( str);
+        for ( host = strtok_r( list, " \t,", &last);
+              host;
+              host = strtok_r( 0, " \t,", &last) ) {
+            char          * colon    = strrchr( host, ':');
+            unsigned int    hostPort = port;
+
+            // more than one colon is an IPv6 address without a port
+            if ( colon && colon == strchr( host, ':') ) {
+                *colon   = '\0';
+                hostPort = Util::strToL( colon + 1);
+            }
+            server->addServer( newTcpSocket( cs, host, hostPort));
+        }
+        delete[] list;
+    }
+
+    str = cs->get( "hotStandby");
+    server->setHotStandby( str && Util::strEq( str, "yes"));
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Create the encoder of an output
+ *----------------------------------------------------------------------------*/
+AudioEncoder *
+DarkIce :: newEncoder (     const ConfigSection   * cs,
+                            const char          * stream,
+                            const char          * format,
+                            Sink                * sink )
+                                                        throw ( Exception )
+{
+    const char                * str;
+    unsigned int                sampleRate      = 0;
+    unsigned int                channel         = 0;
+    AudioEncoder::BitrateMode   bitrateMode;
+    unsigned int                bitrate         = 0;
+    unsigned int                maxBitrate      = 0;
+    double                      quality         = 0.0;
+    int                         lowpass         = 0;
+    int                         highpass        = 0;
+
+    str         = cs->get( "sampleRate");
+    sampleRate  = str ? Util::strToL( str) : dsp->getSampleRate();
+    str         = cs->get( "channel");
+    channel     = str ? Util::strToL( str) : dsp->getChannel();
+
+    // determine fixed bitrate or variable bitrate quality
+    str         = cs->get( "bitrate");
+    bitrate     = str ? Util::strToL( str) : 0;
+    str         = cs->get( "maxBitrate");
+    maxBitrate  = str ? Util::strToL( str) : 0;
+    str         = cs->get( "quality");
+    quality     = str ? Util::strToD( str) : 0.0;
+
+    str         = cs->getForSure( "bitrateMode",
+                                  " not specified in section ",
+                                  stream);
+    if ( Util::strEq( str, "cbr") ) {
+        bitrateMode = AudioEncoder::cbr;
+
+        if ( bitrate == 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "bitrate not specified for CBR encoding");
+        }
+    } else if ( Util::strEq( str, "abr") ) {
+        bitrateMode = AudioEncoder::abr;
+
+        if ( bitrate == 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "bitrate not specified for ABR encoding");
+        }
+    } else if ( Util::strEq( str, "vbr") ) {
+        bitrateMode = AudioEncoder::vbr;
+
+        if ( cs->get( "quality" ) == 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "quality not specified for VBR encoding");
+        }
+    } else {
+        throw Exception( __FILE__, __LINE__,
+                         "invalid bitrate mode: ", str);
+    }
+
+    str         = cs->get( "lowpass");
+    lowpass     = str ? Util::strToL( str) : 0;
+    str         = cs->get( "highpass");
+    highpass    = str ? Util::strToL( str) : 0;
+
+    if ( Util::strEq( format, "mp3") ) {
+#ifndef HAVE_LAME_LIB
+        throw Exception( __FILE__, __LINE__,
+                         "DarkIce not compiled with lame support, "
+                         "thus can't create mp3 stream: ",
+                         stream);
+#else
+        return new LameLibEncoder( sink,
+                                   dsp.get(),
+                                   bitrateMode,
+                                   bitrate,
+                                   quality,
+                                   sampleRate,
+                                   channel,
+                                   lowpass,
+                                   highpass );
+#endif // HAVE_LAME_LIB
+
+    } else if ( Util::strEq( format, "vorbis") ) {
+#ifndef HAVE_VORBIS_LIB
+        throw Exception( __FILE__, __LINE__,
+                        "DarkIce not compiled with Ogg Vorbis support, "
+                        "thus can't Ogg Vorbis stream: ",
+                        stream);
+#else
+        return new VorbisLibEncoder( sink,
+                                     dsp.get(),
+                                     bitrateMode,
+                                     bitrate,
+                                     quality,
+                                     sampleRate,
+                                     dsp->getChannel(),
+                                     maxBitrate);
+#endif // HAVE_VORBIS_LIB
+
+    } else if ( Util::strEq( format, "mp2") ) {
+#ifndef HAVE_TWOLAME_LIB
+        throw Exception( __FILE__, __LINE__,
+                         "DarkIce not compiled with TwoLame support, "
+                         "thus can't create mp2 stream: ",
+                         stream);
+#else
+        return new TwoLameLibEncoder( sink,
+                                      dsp.get(),
+                                      bitrateMode,
+                                      bitrate,
+                                      sampleRate,
+                                      channel );
+#endif // HAVE_TWOLAME_LIB
+
+    } else if ( Util::strEq( format, "aac") ) {
+#ifndef HAVE_FAAC_LIB
+        throw Exception( __FILE__, __LINE__,
+                        "DarkIce not compiled with AAC support, "
+                        "thus can't aac stream: ",
+                        stream);
+#else
+        return new FaacEncoder( sink,
+                                dsp.get(),
+                                bitrateMode,
+                                bitrate,
+                                quality,
+                                sampleRate,
+                                dsp->getChannel());
+#endif // HAVE_FAAC_LIB
+
+    } else if ( Util::strEq( format, "aacp") ) {
+#ifndef HAVE_AACPLUS_LIB
+        throw Exception( __FILE__, __LINE__,
+                        "DarkIce not compiled with AAC+ support, "
+                        "thus can't aacp stream: ",
+                        stream);
+#else
+        return new aacPlusEncoder( sink,
+                                   dsp.get(),
+                                   bitrateMode,
+                                   bitrate,
+                                   quality,
+                                   sampleRate,
+                                   channel );
+#endif // HAVE_AACPLUS_LIB
+    }
+
+    throw Exception( __FILE__, __LINE__, "unsupported stream format: ", format);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the sink an encoder should write its output to
+ *----------------------------------------------------------------------------*/
+Sink *
+DarkIce :: encoderOutput (  const ConfigSection   * cs,
+                            const char          * stream,
+                            CastSink            * server,
+                            unsigned int          bitrate,
+                            unsigned int          bufferSecs )
+                                                        throw ( Exception )
+{
+    const char    * str;
+    const char    * spillFile;
+    unsigned int    spillSize;
+    unsigned int    catchUpRate;
+    bool            catchUp;
+    unsigned int    bufferSize;
+
+    spillFile = cs->get( "spillFile");
+    if ( spillFile && bufferMode != encodedBuffer ) {
+        throw Exception( __FILE__, __LINE__,
+                         "spillFile needs bufferMode = encoded, stream: ",
+                         stream);
+    }
+
+    if ( bufferMode != encodedBuffer ) {
+        return server;
+    }
+
+    // size the buffer by the nominal bitrate, for VBR streams without
+    // a known bitrate assume the highest usual mp3 bitrate
+    if ( bitrate == 0 ) {
+        bitrate = 320;
+    }
+    bufferSize = bitrate * 1000 / 8 * bufferSecs;
+    reportEvent( 3, "encoded buffer size: ", bufferSize);
+
+    if ( !spillFile ) {
+        return newBufferedSink( cs, server, bufferSize, 1);
+    }
+
+    str         = cs->get( "spillSize");
+    spillSize   = str ? Util::strToL( str) : 64;
+    str         = cs->get( "catchUpRate");
+    catchUpRate = str ? Util::strToL( str) : 0;
+    str         = cs->get( "catchUp");
+    catchUp     = str ? (Util::strEq( str, "yes") ? true : false) : true;
+    reportEvent( 3, "spill file size (MB): ", spillSize);
+
+    return new SpillSink( server,
+                          bufferSize,
+                          spillFile,
+                          spillSize * 1024UL * 1024UL,
+                          catchUpRate,
+                          catchUp );
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the sink the encoding connector should write PCM data to
+ *----------------------------------------------------------------------------*/
+Sink *
+DarkIce :: encoderInput (   const ConfigSection   * cs,
+                            AudioEncoder      * encoder,
+                            unsigned int        bufferSecs )
+                                                        throw ( Exception )
+{
+    unsigned int    bufferSize;
+
+    if ( bufferMode != pcmBuffer ) {
+        return encoder;
+    }
+
+    bufferSize = dsp->getBitsPerSample() / 8 * dsp->getSampleRate()
+               * dsp->getChannel() * bufferSecs;
+    reportEvent( 3, "buffer size: ", bufferSize);
+
+    return newBufferedSink( cs,
+                            encoder,
+                            bufferSize,
+                            dsp->getBitsPerSample() / 8);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the sink the encoding connector should write an output to
+ *----------------------------------------------------------------------------*/
+Sink *
+DarkIce :: silenceGate (    const ConfigSection   * cs,
+                            Sink                  * sink )
+                                                        throw ( Exception )
+{
+    const char        * str;
+    SilenceGate::Mode   mode;
+
+    str = cs->get( "silenceMode");
+    if ( !str || Util::strEq( str, "keep") ) {
+        return sink;
+    } else if ( Util::strEq( str, "silence") ) {
+        mode = SilenceGate::sendSilence;
+    } else if ( Util::strEq( str, "disconnect") ) {
+        mode = SilenceGate::disconnect;
+    } else {
+        throw Exception( __FILE__, __LINE__, "invalid silence mode: ", str);
+    }
+
+    if ( !silenceDetector.get() ) {
+        throw Exception( __FILE__, __LINE__,
+                         "silenceMode needs silenceDuration in [input]");
+    }
+
+    return new SilenceGate( sink, silenceDetector.get(), mode);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Create the buffer of an output, from the shared pool if there is one
+ *----------------------------------------------------------------------------*/
+BufferedSink *
+DarkIce :: newBufferedSink (    const ConfigSection   * cs,
+                                Sink                  * sink,
+                                unsigned int            size,
+                                unsigned int            chunkSize )
+                                                        throw ( Exception )
+{
+    const char    * str;
+    int             priority;
+
+    if ( !bufferPool.get() ) {
+        return new BufferedSink( sink, size, chunkSize);
+    }
+
+    str      = cs->get( "bufferPriority");
+    priority = str ? Util::strToL( str) : 0;
+
+    return new BufferedSink( sink, size, bufferPool.get(), priority, chunkSize);
+}
+
+
 /*------------------------------------------------------------------------------
  *  Set POSIX real-time scheduling
  *----------------------------------------------------------------------------*/
@@ -1236,6 +1891,9 @@ DarkIce :: encode ( void )                          throw ( Exception )
     len = encConnector->transfer( bytes, 4096, 1, 0 );
 
     reportEvent( 1, len, "bytes transfered to the encoders");
+    if ( dsp->getOverruns() ) {
+        reportEvent( 1, dsp->getOverruns(), "buffer overruns on the input");
+    }
 
     encConnector->close();
 
@@ -1250,6 +1908,12 @@ int
 DarkIce :: run ( void )                             throw ( Exception )
 {
     reportEvent( 3, "encoding");
+
+    // start the server before switching to real time scheduling,
+    // so that its thread does not inherit it
+    if ( httpServer.get() ) {
+        httpServer->start();
+    }
     
     if (enableRealTime) {
         setRealTimeScheduling();
@@ -1258,6 +1922,10 @@ DarkIce :: run ( void )                             throw ( Exception )
     if (enableRealTime) {
         setOriginalScheduling();
     }
+
+    if ( httpServer.get() ) {
+        httpServer->stop();
+    }
     reportEvent( 3, "encoding ends");
 
     return 0;
@@ -54,10 +54,13 @@
 #include "Ref.h"
 #include "AudioSource.h"
 #include "BufferedSink.h"
+#include "BufferPool.h"
+#include "HttpServer.h"
 #include "Connector.h"
 #include "AudioEncoder.h"
 #include "TcpSocket.h"
 #include "CastSink.h"
+#include "SilenceDetector.h"
 #include "DarkIceConfig.h"
 
 
@@ -83,7 +86,7 @@ class DarkIce : public virtual Referable, public virtual Reporter
          *  The maximum number of supported outputs. This should be
          *  <supported output types> * <outputs per type>
          */
-        static const unsigned int       maxOutput = 4 * 7;
+        static const unsigned int       maxOutput = 6 * 7;
         
         /**
          *  Type describing each lame library output.
@@ -109,11 +112,42 @@ class DarkIce : public virtual Referable, public virtual Reporter
          */
         unsigned int            duration;
 
+        /**
+         *  Type describing where the slip buffer of an output sits:
+         *  - pcmBuffer - in front of the encoder, holding raw PCM
+         *  - encodedBuffer - between the encoder and the server,
+         *                    holding the encoded stream
+         */
+        enum BufferMode { pcmBuffer, encodedBuffer };
+
+        /**
+         *  Where the slip buffer of each output sits.
+         */
+        BufferMode              bufferMode;
+
+        /**
+         *  The pool all output buffers draw their memory from,
+         *  if a global buffer budget is set.
+         */
+        Ref<BufferPool>         bufferPool;
+
+        /**
+         *  The built-in server, serving listeners directly,
+         *  if configured.
+         */
+        Ref<HttpServer>         httpServer;
+
         /**
          *  The dsp to record from.
          */
         Ref<AudioSource>        dsp;
 
+        /**
+         *  The detector watching the dsp for silence, if any output
+         *  is to be suspended while the input is silent.
+         */
+        Ref<SilenceDetector>    silenceDetector;
+
         /**
          *  The encoding Connector, connecting the dsp to the encoders.
          */
@@ -200,6 +234,165 @@ class DarkIce : public virtual Referable, public virtual Reporter
         configFileCast  (   const Config   & config )
                                                             throw ( Exception );
 
+        /**
+         *  Look for the built-in server and its mounts in the config.
+         *
+         *  @param config the config Object to read initialization
+         *                information from.
+         *  @exception Exception
+         */
+        void
+        configServer    (   const Config   & config )
+                                                            throw ( Exception );
+
+        /**
+         *  Look for the RTP outputs in the config.
+         *
+         *  @param config the config Object to read initialization
+         *                information from.
+         *  @exception Exception
+         */
+        void
+        configRtp       (   const Config   & config )
+                                                            throw ( Exception );
+
+        /**
+         *  Create the audio source of an input section.
+         *
+         *  @param cs the config section of the input.
+         *  @param section the name of the section, for error messages.
+         *  @param sampleRate samples per second.
+         *  @param bitsPerSample bits per sample.
+         *  @param channel number of channels.
+         *  @return a new AudioSource.
+         *  @exception Exception
+         */
+        AudioSource *
+        newInput (  const ConfigSection  * cs,
+                    const char     * section,
+                    unsigned int     sampleRate,
+                    unsigned int     bitsPerSample,
+                    unsigned int     channel )          throw ( Exception );
+
+        /**
+         *  Create the TcpSocket of an output, setting the TCP options
+         *  found in its config section.
+         *
+         *  @param cs the config section of the output.
+         *  @param server the server to connect to.
+         *  @param port the port to connect to.
+         *  @return a new TcpSocket.
+         *  @exception Exception
+         */
+        TcpSocket *
+        newTcpSocket (  const ConfigSection  * cs,
+                        const char     * server,
+                        unsigned int     port )             throw ( Exception );
+
+        /**
+         *  Add the failover servers found in the config section of
+         *  an output, and set if a standby server is kept logged in.
+         *
+         *  @param cs the config section of the output.
+         *  @param server the output to add the failover servers to.
+         *  @param port the default port of the failover servers.
+         *  @exception Exception
+         */
+        void
+        configFailover (    const ConfigSection  * cs,
+                            CastSink       * server,
+                            unsigned int     port )             throw ( Exception );
+
+        /**
+         *  Create the encoder of an output, as set by the sampleRate,
+         *  channel, bitrateMode, bitrate, maxBitrate, quality, lowpass
+         *  and highpass keys of its config section.
+         *
+         *  @param cs the config section of the output.
+         *  @param stream the name of the config section of the output.
+         *  @param format the format to encode to: "mp3", "mp2", "vorbis",
+         *                "aac" or "aacp".
+         *  @param sink the sink the encoder writes its output to.
+         *  @return a new AudioEncoder.
+         *  @exception Exception if the settings are invalid, or support
+         *             for the format is not compiled in.
+         */
+        AudioEncoder *
+        newEncoder (    const ConfigSection  * cs,
+                        const char     * stream,
+                        const char     * format,
+                        Sink           * sink )             throw ( Exception );
+
+        /**
+         *  Get the Sink an encoder should write its output to.
+         *  When buffering encoded data, this is a BufferedSink in front
+         *  of the server, or a SpillSink if the output has a spill file
+         *  configured. Otherwise it's the server itself.
+         *
+         *  @param cs the config section of the output.
+         *  @param stream the name of the config section of the output.
+         *  @param server the server the output is sent to.
+         *  @param bitrate the nominal bitrate of the output, in kbits/sec,
+         *                 0 if not known.
+         *  @param bufferSecs number of seconds to buffer audio for
+         *  @return the Sink to pass to the encoder.
+         *  @exception Exception
+         */
+        Sink *
+        encoderOutput ( const ConfigSection  * cs,
+                        const char     * stream,
+                        CastSink       * server,
+                        unsigned int     bitrate,
+                        unsigned int     bufferSecs )       throw ( Exception );
+
+        /**
+         *  Create the BufferedSink of an output, drawing its memory
+         *  from the buffer pool if there is one.
+         *
+         *  @param cs the config section of the output.
+         *  @param sink the sink to buffer data for.
+         *  @param size the maximum amount of data to buffer.
+         *  @param chunkSize the size of chunks to handle data in.
+         *  @return a new BufferedSink.
+         *  @exception Exception
+         */
+        BufferedSink *
+        newBufferedSink (   const ConfigSection  * cs,
+                            Sink           * sink,
+                            unsigned int     size,
+                            unsigned int     chunkSize )    throw ( Exception );
+
+        /**
+         *  Get the Sink the encoding connector should write PCM data to.
+         *  When buffering PCM data, this is a BufferedSink in front of
+         *  the encoder, otherwise it's the encoder itself.
+         *
+         *  @param cs the config section of the output.
+         *  @param encoder the encoder of the output.
+         *  @param bufferSecs number of seconds to buffer audio for
+         *  @return the Sink to attach to the encoding connector.
+         *  @exception Exception
+         */
+        Sink *
+        encoderInput (  const ConfigSection  * cs,
+                        AudioEncoder   * encoder,
+                        unsigned int     bufferSecs )       throw ( Exception );
+
+        /**
+         *  Get the Sink to attach to the encoding connector for an
+         *  output. This is a SilenceGate in front of the output if the
+         *  output is suspended while the input is silent, otherwise
+         *  it's the output itself.
+         *
+         *  @param cs the config section of the output.
+         *  @param sink the sink of the output.
+         *  @return the Sink to attach to the encoding connector.
+         *  @exception Exception
+         */
+        Sink *
+        silenceGate (   const ConfigSection  * cs,
+                        Sink           * sink )             throw ( Exception );
+
         /**
          *  Set POSIX real-time scheduling for the encoding process,
          *  if user permissions enable it.
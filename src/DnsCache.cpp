@@ -0,0 +1,359 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : DnsCache.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#else
+#error need netinet/in.h
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#else
+#error need netdb.h
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <map>
+#include <string>
+
+#include "Util.h"
+#include "DnsCache.h"
+
+
+/* ===================================================  local data structures */
+
+/*------------------------------------------------------------------------------
+ *  An entry in the cache
+ *----------------------------------------------------------------------------*/
+struct CacheEntry {
+    std::vector<DnsCache::Address>  addresses;
+    time_t                          expires;
+    bool                            refreshing;
+};
+
+/*------------------------------------------------------------------------------
+ *  A request to refresh an entry, passed to the refresh thread
+ *----------------------------------------------------------------------------*/
+struct RefreshRequest {
+    char                          * host;
+    unsigned short                  port;
+};
+
+/*------------------------------------------------------------------------------
+ *  The cache, by host:port
+ *----------------------------------------------------------------------------*/
+static std::map<std::string, CacheEntry>    cache;
+
+/*------------------------------------------------------------------------------
+ *  Mutex guarding the cache
+ *----------------------------------------------------------------------------*/
+static pthread_mutex_t                      cacheMutex =
+                                                    PTHREAD_MUTEX_INITIALIZER;
+
+#ifndef HAVE_GETADDRINFO
+/*------------------------------------------------------------------------------
+ *  Mutex guarding gethostbyname(), which is not reentrant
+ *----------------------------------------------------------------------------*/
+static pthread_mutex_t                      lookupMutex =
+                                                    PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Make the cache key of a host and port
+ *----------------------------------------------------------------------------*/
+static std::string
+cacheKey (  const char        * host,
+            unsigned short      port )                      throw ();
+
+
+/* =============================================================  module code */
+
+unsigned int    DnsCache::ttl = 300;
+
+
+/*------------------------------------------------------------------------------
+ *  Make the cache key of a host and port
+ *----------------------------------------------------------------------------*/
+static std::string
+cacheKey (  const char        * host,
+            unsigned short      port )                      throw ()
+{
+    char        portstr[8];
+
+    snprintf( portstr, sizeof(portstr), ":%u", port);
+
+    return std::string( host) + portstr;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Resolve a host name
+ *----------------------------------------------------------------------------*/
+bool
+DnsCache :: lookup (    const char            * host,
+                        unsigned short          port,
+                        std::vector<Address>  & addresses )     throw ()
+{
+    std::vector<Address>    first;
+    std::vector<Address>    second;
+    Address                 address;
+    size_t                  i;
+#ifdef HAVE_GETADDRINFO
+    struct addrinfo         hints;
+    struct addrinfo       * res;
+    struct addrinfo       * ptr;
+    char                    portstr[6];
+    int                     family;
+    int                     ret;
+
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_protocol = IPPROTO_TCP;
+#ifdef AI_ADDRCONFIG
+    hints.ai_flags    = AI_ADDRCONFIG;
+#endif
+    snprintf( portstr, sizeof(portstr), "%u", port);
+
+    if ( (ret = getaddrinfo( host, portstr, &hints, &res)) ) {
+        reportEvent( 3, "can't resolve", host, gai_strerror( ret));
+        return false;
+    }
+
+    // split by address family, keeping the order of preference
+    family = res->ai_family;
+    for ( ptr = res; ptr; ptr = ptr->ai_next ) {
+        if ( ptr->ai_addrlen > sizeof(address.addr) ) {
+            continue;
+        }
+        memset( &address, 0, sizeof(address));
+        memcpy( &address.addr, ptr->ai_addr, ptr->ai_addrlen);
+        address.len = ptr->ai_addrlen;
+        if ( ptr->ai_family == family ) {
+            first.push_back( address);
+        } else {
+            second.push_back( address);
+        }
+    }
+    freeaddrinfo( res);
+#else
+    struct hostent        * pHostEntry;
+    struct sockaddr_in    * addr;
+
+    pthread_mutex_lock( &lookupMutex);
+    if ( !(pHostEntry = gethostbyname( host)) ) {
+        pthread_mutex_unlock( &lookupMutex);
+        reportEvent( 3, "can't resolve", host);
+        return false;
+    }
+    for ( i = 0; pHostEntry->h_addr_list[i]; ++i ) {
+        memset( &address, 0, sizeof(address));
+        addr             = (struct sockaddr_in *) &address.addr;
+        addr->sin_family = AF_INET;
+        addr->sin_port   = htons( port);
+        memcpy( &addr->sin_addr,
+                pHostEntry->h_addr_list[i],
+                sizeof(addr->sin_addr));
+        address.len      = sizeof(struct sockaddr_in);
+        first.push_back( address);
+    }
+    pthread_mutex_unlock( &lookupMutex);
+#endif
+
+    // alternate the address families
+    addresses.clear();
+    for ( i = 0; i < first.size() || i < second.size(); ++i ) {
+        if ( i < first.size() ) {
+            addresses.push_back( first[i]);
+        }
+        if ( i < second.size() ) {
+            addresses.push_back( second[i]);
+        }
+    }
+
+    return !addresses.empty();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Refresh an entry in the background
+ *----------------------------------------------------------------------------*/
+void *
+DnsCache :: refreshThread (     void          * param )     throw ()
+{
+    RefreshRequest        * request = (RefreshRequest *) param;
+    std::vector<Address>    addresses;
+    bool                    found;
+
+    found = lookup( request->host, request->port, addresses);
+
+    pthread_mutex_lock( &cacheMutex);
+    std::map<std::string, CacheEntry>::iterator it =
+                            cache.find( cacheKey( request->host, request->port));
+    if ( it != cache.end() ) {
+        // on failure, keep the old addresses, and try again next time
+        if ( found ) {
+            it->second.addresses = addresses;
+            it->second.expires   = time( 0) + ttl;
+        }
+        it->second.refreshing = false;
+    }
+    pthread_mutex_unlock( &cacheMutex);
+
+    delete[] request->host;
+    delete request;
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the addresses of a host
+ *----------------------------------------------------------------------------*/
+void
+DnsCache :: resolve (   const char            * host,
+                        unsigned short          port,
+                        std::vector<Address>  & addresses )
+                                                        throw ( Exception )
+{
+    std::string     key = cacheKey( host, port);
+    time_t          now = time( 0);
+
+    if ( ttl ) {
+        std::map<std::string, CacheEntry>::iterator it;
+
+        pthread_mutex_lock( &cacheMutex);
+        it = cache.find( key);
+        if ( it != cache.end() ) {
+            addresses = it->second.addresses;
+
+            if ( now >= it->second.expires && !it->second.refreshing ) {
+                RefreshRequest    * request = new RefreshRequest;
+                pthread_attr_t      attr;
+                pthread_t           thread;
+
+                request->host = Util::strDup( host);
+                request->port = port;
+
+                pthread_attr_init( &attr);
+                pthread_attr_setdetachstate( &attr, PTHREAD_CREATE_DETACHED);
+                if ( pthread_create( &thread, &attr, refreshThread, request) ) {
+                    delete[] request->host;
+                    delete request;
+                } else {
+                    it->second.refreshing = true;
+                }
+                pthread_attr_destroy( &attr);
+            }
+
+            pthread_mutex_unlock( &cacheMutex);
+            return;
+        }
+        pthread_mutex_unlock( &cacheMutex);
+    }
+
+    if ( !lookup( host, port, addresses) ) {
+        throw Exception( __FILE__, __LINE__, "can't resolve host: ", host);
+    }
+
+    if ( ttl ) {
+        CacheEntry      entry;
+
+        entry.addresses  = addresses;
+        entry.expires    = now + ttl;
+        entry.refreshing = false;
+
+        pthread_mutex_lock( &cacheMutex);
+        cache[key] = entry;
+        pthread_mutex_unlock( &cacheMutex);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Drop a host from the cache
+ *----------------------------------------------------------------------------*/
+void
+DnsCache :: invalidate (    const char        * host,
+                            unsigned short      port )      throw ()
+{
+    std::map<std::string, CacheEntry>::iterator it;
+
+    pthread_mutex_lock( &cacheMutex);
+    it = cache.find( cacheKey( host, port));
+    // an entry being refreshed is left for the refresh thread to update
+    if ( it != cache.end() && !it->second.refreshing ) {
+        cache.erase( it);
+    }
+    pthread_mutex_unlock( &cacheMutex);
+}
+
@@ -0,0 +1,207 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : DnsCache.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef DNS_CACHE_H
+#define DNS_CACHE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#else
+#error need sys/types.h
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#else
+#error need sys/socket.h
+#endif
+
+#include <vector>
+
+#include "Reporter.h"
+#include "Exception.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A process wide cache of resolved host names, so that reconnecting
+ *  to a server does not block on name resolution every time.
+ *  When an entry is older than the time to live, it is still used,
+ *  while it is refreshed in the background.
+ *  This class can not be instantiated, it contains static functions
+ *  only. The functions are thread-safe.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class DnsCache : public virtual Reporter
+{
+    public:
+
+        /**
+         *  A resolved address.
+         */
+        struct Address {
+            /**
+             *  The socket address, including the port.
+             */
+            struct sockaddr_storage     addr;
+
+            /**
+             *  The length of the socket address.
+             */
+            socklen_t                   len;
+        };
+
+
+    private:
+
+        /**
+         *  The time to live of cache entries, in seconds.
+         */
+        static unsigned int     ttl;
+
+        /**
+         *  Resolve a host name, blocking.
+         *  The addresses are ordered so that address families alternate,
+         *  to try both IPv6 and IPv4 early when connecting.
+         *
+         *  @param host the name of the host.
+         *  @param port the port to put in the addresses.
+         *  @param addresses the addresses found (out parameter).
+         *  @return true if the host could be resolved, false otherwise.
+         */
+        static bool
+        lookup (    const char            * host,
+                    unsigned short          port,
+                    std::vector<Address>  & addresses )     throw ();
+
+        /**
+         *  The function of the thread refreshing an entry
+         *  in the background.
+         *
+         *  @param param the entry to refresh.
+         *  @return 0
+         */
+        static void *
+        refreshThread (     void          * param )         throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        DnsCache ( void )                                   throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Set the time to live of cache entries.
+         *
+         *  @param ttl the time to live, in seconds, 0 disables caching.
+         */
+        static inline void
+        setTtl (    unsigned int    ttl )                   throw ()
+        {
+            DnsCache::ttl = ttl;
+        }
+
+        /**
+         *  Get the time to live of cache entries.
+         *
+         *  @return the time to live, in seconds.
+         */
+        static inline unsigned int
+        getTtl ( void )                                     throw ()
+        {
+            return ttl;
+        }
+
+        /**
+         *  Get the addresses of a host. Blocks only if the host is
+         *  not in the cache.
+         *
+         *  @param host the name of the host.
+         *  @param port the port to put in the addresses.
+         *  @param addresses the addresses of the host (out parameter).
+         *  @exception Exception if the host can not be resolved.
+         */
+        static void
+        resolve (   const char            * host,
+                    unsigned short          port,
+                    std::vector<Address>  & addresses )
+                                                        throw ( Exception );
+
+        /**
+         *  Drop a host from the cache, for example when none of its
+         *  addresses could be connected to.
+         *
+         *  @param host the name of the host.
+         *  @param port the port the host was resolved for.
+         */
+        static void
+        invalidate (    const char        * host,
+                        unsigned short      port )          throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* DNS_CACHE_H */
+
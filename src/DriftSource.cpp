@@ -0,0 +1,324 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : DriftSource.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+#include "Exception.h"
+#include "DriftSource.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The number of frames read from the source at most at once
+ *----------------------------------------------------------------------------*/
+static const unsigned int maxFrames = 4096;
+
+/*------------------------------------------------------------------------------
+ *  Seconds of audio to skip before measuring, while the source delivers
+ *  what it buffered on opening
+ *----------------------------------------------------------------------------*/
+static const double warmUp = 2.0;
+
+/*------------------------------------------------------------------------------
+ *  The bandwidth of the loop filtering the block timestamps, in Hz
+ *----------------------------------------------------------------------------*/
+static const double loopBandwidth = 0.01;
+
+/*------------------------------------------------------------------------------
+ *  The time constant for correcting the accumulated error, in seconds
+ *----------------------------------------------------------------------------*/
+static const double errorTimeConstant = 30.0;
+
+/*------------------------------------------------------------------------------
+ *  The largest drift compensated, as a fraction of the sample rate
+ *----------------------------------------------------------------------------*/
+static const double maxDrift = 0.002;
+
+/*------------------------------------------------------------------------------
+ *  A timestamp error above this, in seconds, means the source lost data
+ *----------------------------------------------------------------------------*/
+static const double maxTimeError = 0.5;
+
+/*------------------------------------------------------------------------------
+ *  How often the drift is reported, in seconds
+ *----------------------------------------------------------------------------*/
+static const double reportInterval = 60.0;
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Get the seconds elapsed since a point in time
+ *----------------------------------------------------------------------------*/
+static double
+secondsSince (  const struct timespec   * since )       throw ();
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Get the seconds elapsed since a point in time
+ *----------------------------------------------------------------------------*/
+static double
+secondsSince (  const struct timespec   * since )       throw ()
+{
+    struct timespec     now;
+
+    clock_gettime( CLOCK_MONOTONIC, &now);
+
+    return (now.tv_sec - since->tv_sec)
+         + (now.tv_nsec - since->tv_nsec) / 1000000000.0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+DriftSource :: init (   AudioSource   * source )        throw ( Exception )
+{
+    if ( getBitsPerSample() != 16 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "drift compensation supports 16 bit samples only",
+                         getBitsPerSample());
+    }
+
+    this->source   = source;
+    this->inFrames = maxFrames;
+    this->inBuffer = new short[(inFrames + 1) * getChannel()];
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+DriftSource :: strip ( void )                           throw ( Exception )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    source = 0;
+    delete[] inBuffer;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the underlying source
+ *----------------------------------------------------------------------------*/
+bool
+DriftSource :: open ( void )                            throw ( Exception )
+{
+    if ( !source->open() ) {
+        return false;
+    }
+
+    memset( inBuffer, 0, getChannel() * sizeof(short));
+    position     = 0.0;
+    step         = 1.0;
+    period       = 1.0 / getSampleRate();
+    filteredTime = 0.0;
+    measuring    = false;
+    framesIn     = 0.0;
+    framesOut    = 0.0;
+    lastReport   = 0.0;
+    clock_gettime( CLOCK_MONOTONIC, &startTime);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Update the drift estimate and the resampling ratio
+ *
+ *  The arrival times of the blocks are filtered by a second order delay
+ *  locked loop, which gives the real duration of a frame of the source.
+ *  The frames delivered are compared to the frames due at the nominal
+ *  rate over the filtered time, and the difference is corrected slowly.
+ *----------------------------------------------------------------------------*/
+void
+DriftSource :: track (  unsigned int    in,
+                        unsigned int    out )           throw ()
+{
+    double          nominal = 1.0 / getSampleRate();
+    double          now     = secondsSince( &startTime);
+    double          omega;
+    double          error;
+    double          ratio;
+
+    framesIn  += in;
+    framesOut += out;
+
+    if ( !measuring ) {
+        if ( framesIn * nominal < warmUp ) {
+            return;
+        }
+        // start measuring from here
+        measuring    = true;
+        period       = nominal;
+        filteredTime = 0.0;
+        framesIn     = 0.0;
+        framesOut    = 0.0;
+        lastReport   = 0.0;
+        clock_gettime( CLOCK_MONOTONIC, &startTime);
+        return;
+    }
+
+    // the time this block should have arrived at, and how far off it is
+    error = now - (filteredTime + period * in);
+    if ( fabs( error) > maxTimeError ) {
+        // the source lost data or stalled, start over from here
+        reportEvent( 3, "drift compensation, input clock jumped (s):", error);
+        filteredTime = now;
+        framesOut    = getSampleRate() * now;
+        return;
+    }
+
+    omega         = 2.0 * M_PI * loopBandwidth * in * nominal;
+    filteredTime += period * in + sqrt( 2.0) * omega * error;
+    period       += omega * omega * error / in;
+
+    // the frames delivered ahead of the nominal rate are consumed slowly
+    ratio = nominal / period;
+    error = framesOut - getSampleRate() * filteredTime;
+    step  = ratio * (1.0 + error / (getSampleRate() * errorTimeConstant));
+    if ( step > 1.0 + maxDrift ) {
+        step = 1.0 + maxDrift;
+    } else if ( step < 1.0 - maxDrift ) {
+        step = 1.0 - maxDrift;
+    }
+
+    reportEvent( 8, "drift compensation, ratio, error (frames):", step, error);
+    if ( now - lastReport >= reportInterval ) {
+        lastReport = now;
+        reportEvent( 4, "input clock drift (ppm):", (ratio - 1.0) * 1000000.0);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read from the source, resampled to the nominal rate
+ *----------------------------------------------------------------------------*/
+unsigned int
+DriftSource :: read (   void          * buf,
+                        unsigned int    len )           throw ( Exception )
+{
+    unsigned int    channel   = getChannel();
+    unsigned int    frameSize = channel * sizeof(short);
+    unsigned int    maxOut    = len / frameSize;
+    unsigned int    want;
+    unsigned int    got;
+    unsigned int    out;
+    short         * output    = (short *) buf;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+    if ( maxOut < 2 ) {
+        return source->read( buf, len);
+    }
+
+    // read no more than what makes at most maxOut frames
+    want = (unsigned int) ((maxOut - 1) * step);
+    if ( want > inFrames ) {
+        want = inFrames;
+    }
+    if ( want == 0 ) {
+        want = 1;
+    }
+
+    got = source->read( inBuffer + channel, want * frameSize) / frameSize;
+    if ( got == 0 ) {
+        return 0;
+    }
+
+    // inBuffer holds the last frame of the previous read, then the new ones
+    for ( out = 0; out < maxOut; ++out ) {
+        unsigned int    i    = (unsigned int) position;
+        double          frac = position - i;
+        const short   * a;
+        const short   * b;
+        unsigned int    c;
+
+        if ( i + 1 > got ) {
+            break;
+        }
+        a = inBuffer + i * channel;
+        b = a + channel;
+        for ( c = 0; c < channel; ++c ) {
+            output[out * channel + c] = (short)
+                                floor( a[c] + (b[c] - a[c]) * frac + 0.5);
+        }
+        position += step;
+    }
+    position -= got;
+    memcpy( inBuffer, inBuffer + got * channel, frameSize);
+
+    track( got, out);
+
+    return out * frameSize;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the measured drift of the source clock
+ *----------------------------------------------------------------------------*/
+double
+DriftSource :: getDrift ( void ) const                  throw ()
+{
+    return measuring ? (1.0 / (period * getSampleRate()) - 1.0) * 1000000.0
+                     : 0.0;
+}
+
@@ -0,0 +1,331 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : DriftSource.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef DRIFT_SOURCE_H
+#define DRIFT_SOURCE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+#include "Ref.h"
+#include "Reporter.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An audio source compensating the drift between the clock of another
+ *  audio source and the system clock.
+ *
+ *  Each block read from the underlying source is timestamped against
+ *  CLOCK_MONOTONIC, which NTP keeps in step with the reference clock.
+ *  From these, the real sample rate of the source is estimated, and the
+ *  audio is resampled by linear interpolation to the nominal rate. The
+ *  difference between the samples delivered and the samples due at the
+ *  nominal rate is fed back into the resampling ratio, so that the long
+ *  term throughput is exactly the nominal rate.
+ *
+ *  Only 16 bit samples are supported.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class DriftSource : public AudioSource, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The source whose drift is compensated.
+         */
+        Ref<AudioSource>        source;
+
+        /**
+         *  The buffer samples are read into from the source, with the
+         *  last frame of the previous read in front.
+         */
+        short                 * inBuffer;
+
+        /**
+         *  The number of frames inBuffer holds, besides the previous one.
+         */
+        unsigned int            inFrames;
+
+        /**
+         *  The position of the next output frame in inBuffer, in frames.
+         */
+        double                  position;
+
+        /**
+         *  The number of input frames consumed for each output frame.
+         */
+        double                  step;
+
+        /**
+         *  The filtered duration of a frame of the source, in seconds.
+         */
+        double                  period;
+
+        /**
+         *  The filtered arrival time of the last block, in seconds
+         *  since startTime.
+         */
+        double                  filteredTime;
+
+        /**
+         *  The time of the first block after the warm up.
+         */
+        struct timespec         startTime;
+
+        /**
+         *  Marks if the warm up period is over, and drift is measured.
+         */
+        bool                    measuring;
+
+        /**
+         *  Frames read from the source since startTime.
+         */
+        double                  framesIn;
+
+        /**
+         *  Frames delivered since startTime.
+         */
+        double                  framesOut;
+
+        /**
+         *  The time the drift was last reported, in seconds since startTime.
+         */
+        double                  lastReport;
+
+        /**
+         *  Initialize the object
+         *
+         *  @param source the source to compensate.
+         *  @exception Exception
+         */
+        void
+        init (  AudioSource   * source )            throw ( Exception );
+
+        /**
+         *  De-initialize the object
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Update the drift estimate and the resampling ratio after
+         *  a block was read.
+         *
+         *  @param in the number of frames read from the source.
+         *  @param out the number of frames delivered.
+         */
+        void
+        track ( unsigned int    in,
+                unsigned int    out )               throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        DriftSource ( void )                            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param source the source to compensate, with 16 bit samples.
+         *  @exception Exception
+         */
+        inline
+        DriftSource (   AudioSource   * source )        throw ( Exception )
+                    : AudioSource( source->getSampleRate(),
+                                   source->getBitsPerSample(),
+                                   source->getChannel() )
+        {
+            init( source);
+        }
+
+        /**
+         *  Copy Constructor.
+         *
+         *  @param ds the object to copy.
+         *  @exception Exception
+         */
+        inline
+        DriftSource (   const DriftSource &   ds )      throw ( Exception )
+                    : AudioSource( ds )
+        {
+            throw Exception( __FILE__, __LINE__, "DriftSource doesn't copy");
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~DriftSource ( void )                           throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator.
+         *
+         *  @param ds the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual DriftSource &
+        operator= (     const DriftSource &     ds )    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__, "DriftSource doesn't assign");
+        }
+
+        /**
+         *  Open the underlying source, and start measuring anew.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                                   throw ( Exception );
+
+        /**
+         *  Check if the DriftSource is open.
+         *
+         *  @return true if the underlying source is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return source->isOpen();
+        }
+
+        /**
+         *  Check if the DriftSource can be read from.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the underlying source can be read from,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canRead (               unsigned int    sec,
+                                unsigned int    usec )  throw ( Exception )
+        {
+            return source->canRead( sec, usec);
+        }
+
+        /**
+         *  Read from the underlying source, resampled to the nominal rate.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the number of bytes to read into buf
+         *  @return the number of bytes read (may be less than len).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        read (                  void          * buf,
+                                unsigned int    len )   throw ( Exception );
+
+        /**
+         *  Close the underlying source.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        close ( void )                                  throw ( Exception )
+        {
+            source->close();
+        }
+
+        /**
+         *  Get the number of buffer overruns of the underlying source.
+         *
+         *  @return the number of buffer overruns.
+         */
+        inline virtual unsigned int
+        getOverruns ( void ) const                      throw ()
+        {
+            return source->getOverruns();
+        }
+
+        /**
+         *  Get the measured drift of the source clock.
+         *
+         *  @return the drift in parts per million, positive if the
+         *          source runs fast. 0 until measured.
+         */
+        double
+        getDrift ( void ) const                         throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* DRIFT_SOURCE_H */
+
@@ -40,6 +40,7 @@
 
 #include "Exception.h"
 #include "Util.h"
+#include "BufferAllocator.h"
 #include "FaacEncoder.h"
 
 
@@ -86,6 +87,13 @@ FaacEncoder :: open ( void )
                                 &inputSamples,
                                 &maxOutputBytes);
 
+    // the scratch buffers used by write()
+    faacBuffer = (unsigned char *) BufferAllocator::allocate( maxOutputBytes);
+#ifdef HAVE_SRC_LIB
+    shortBuffer = (short *) BufferAllocator::allocate(
+                                            inputSamples * sizeof(short));
+#endif
+
     faacEncConfiguration      * faacConfig;
 
     faacConfig = faacEncGetCurrentConfiguration(encoderHandle);
@@ -155,7 +163,6 @@ FaacEncoder :: write (  const void    * buf,
     unsigned char * b                = (unsigned char*) buf;
     unsigned int    processed        = len - (len % sampleSize);
     unsigned int    nSamples         = processed / sampleSize;
-    unsigned char * faacBuf          = new unsigned char[maxOutputBytes];
     int             samples          = (int) nSamples * channels;
     int             processedSamples = 0;
 
@@ -188,23 +195,21 @@ FaacEncoder :: write (  const void    * buf,
         while(resampledOffsetSize - processedSamples >= inputSamples/channels) {
             int outputBytes;
 #ifdef HAVE_SRC_LIB
-            short *shortData = new short[inputSamples];
             src_float_to_short_array(resampledOffset + (processedSamples * channels),
-                                     shortData, inputSamples) ;
+                                     shortBuffer, inputSamples) ;
             outputBytes = faacEncEncode(encoderHandle,
-                                       (int32_t*) shortData,
+                                       (int32_t*) shortBuffer,
                                         inputSamples,
-                                        faacBuf,
+                                        faacBuffer,
                                         maxOutputBytes);
-            delete [] shortData;
 #else
             outputBytes = faacEncEncode(encoderHandle,
                                        (int32_t*) &resampledOffset[processedSamples*channels],
                                         inputSamples,
-                                        faacBuf,
+                                        faacBuffer,
                                         maxOutputBytes);
 #endif
-            getSink()->write(faacBuf, outputBytes);
+            getSink()->write(faacBuffer, outputBytes);
             processedSamples+=inputSamples/channels;
         }
 
@@ -230,16 +235,14 @@ FaacEncoder :: write (  const void    * buf,
             outputBytes = faacEncEncode(encoderHandle,
                                        (int32_t*) (b + processedSamples/sampleSize),
                                         inSamples,
-                                        faacBuf,
+                                        faacBuffer,
                                         maxOutputBytes);
-            getSink()->write(faacBuf, outputBytes);
+            getSink()->write(faacBuffer, outputBytes);
 
             processedSamples += inSamples;
         }
     }
 
-    delete[] faacBuf;
-
     return samples * sampleSize;
 }
 
@@ -270,6 +273,13 @@ FaacEncoder :: close ( void )                           throw ( Exception )
         faacEncClose(encoderHandle);
         faacOpen = false;
 
+        BufferAllocator::release( faacBuffer);
+        faacBuffer = 0;
+#ifdef HAVE_SRC_LIB
+        BufferAllocator::release( shortBuffer);
+        shortBuffer = 0;
+#endif
+
         getSink()->close();
     }
 }
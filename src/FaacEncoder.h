@@ -97,6 +97,19 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
          */
         unsigned long               maxOutputBytes;
 
+        /**
+         *  Scratch buffer for the encoded data, maxOutputBytes long.
+         */
+        unsigned char             * faacBuffer;
+
+#ifdef HAVE_SRC_LIB
+        /**
+         *  Scratch buffer for the resampled input converted to shorts,
+         *  inputSamples long.
+         */
+        short                     * shortBuffer;
+#endif
+
         /**
          *  Lowpass filter. Sound frequency in Hz, from where up the
          *  input is cut.
@@ -135,6 +148,10 @@ class FaacEncoder : public AudioEncoder, public virtual Reporter
         {
             this->faacOpen        = false;
             this->lowpass         = lowpass;
+            this->faacBuffer      = 0;
+#ifdef HAVE_SRC_LIB
+            this->shortBuffer     = 0;
+#endif
 
             if ( getInBitsPerSample() != 16 && getInBitsPerSample() != 8 ) {
                 throw Exception( __FILE__, __LINE__,
@@ -110,11 +110,12 @@ class FileCast : public CastSink
          *  Log in to the server using the socket avialable.
          *  No need to log in to a file.
          *
+         *  @param socket not used.
          *  @return true if login was successful, false otherwise.
          *  @exception Exception
          */
         inline virtual bool
-        sendLogin ( void )              throw ( Exception )
+        sendLogin ( TcpSocket     * socket )    throw ( Exception )
         {
             return true;
         }
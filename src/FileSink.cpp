@@ -310,6 +310,34 @@ FileSink :: write (    const void    * buf,
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Write several buffers to the FileSink
+ *----------------------------------------------------------------------------*/
+unsigned int
+FileSink :: writev (    const struct iovec    * iov,
+                        unsigned int            iovcnt )
+                                                    throw ( Exception )
+{
+    ssize_t     ret;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    ret = ::writev( fileDescriptor, iov, iovcnt);
+
+    if ( ret == -1 ) {
+        if ( errno == EAGAIN ) {
+            ret = 0;
+        } else {
+            throw Exception( __FILE__, __LINE__, "writev error", errno);
+        }
+    }
+
+    return ret;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Get the file name to where to move the data saved so far.
  *  The trick is to read the file name from a file named
@@ -239,6 +239,20 @@ class FileSink : public Sink, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception );
 
+        /**
+         *  Write data from several buffers to the FileSink,
+         *  with a single system call.
+         *
+         *  @param iov the buffers to write.
+         *  @param iovcnt the number of buffers in iov.
+         *  @return the number of bytes written.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writev (       const struct iovec    * iov,
+                       unsigned int            iovcnt )
+                                                    throw ( Exception );
+
         /**
          *  This is a no-op in this FileSink.
          *
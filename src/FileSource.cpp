@@ -29,8 +29,13 @@
 
 /* ============================================================ include files */
 
+#include "AudioSource.h"
+
+#ifdef SUPPORT_FILE_SOURCE
+// only compile this code if there is support for it
+
 #ifdef HAVE_CONFIG_H
-#include "configure.h"
+#include "config.h"
 #endif
 
 #ifdef HAVE_UNISTD_H
@@ -39,12 +44,6 @@
 #error need unistd.h
 #endif
 
-#ifdef HAVE_SYS_TYPES_H
-#include <sys/types.h>
-#else
-#error need sys/types.h
-#endif
-
 #ifdef HAVE_SYS_STAT_H
 #include <sys/stat.h>
 #else
@@ -57,22 +56,22 @@
 #error need fcntl.h
 #endif
 
-#ifdef HAVE_SYS_TIME_H
-#include <sys/time.h>
-#else
-#error need sys/time.h
-#endif
-
 #ifdef HAVE_STRING_H
 #include <string.h>
 #else
 #error need string.h
 #endif
 
-#ifdef HAVE_SIGNAL_H
-#include <signal.h>
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
 #else
-#error need signal.h
+#error need sys/mman.h
 #endif
 
 
@@ -91,103 +90,215 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  How far the read ahead thread goes ahead of the reading position
+ *----------------------------------------------------------------------------*/
+static const size_t readAheadWindow = 4 * 1024 * 1024;
+
+/*------------------------------------------------------------------------------
+ *  How much the read ahead thread faults in at once
+ *----------------------------------------------------------------------------*/
+static const size_t readAheadChunk = 256 * 1024;
+
 
 /* ===============================================  local function prototypes */
 
+/*------------------------------------------------------------------------------
+ *  Read a little endian 16 bit value
+ *----------------------------------------------------------------------------*/
+static unsigned int
+readLe16 (  const unsigned char   * p )                 throw ();
+
+/*------------------------------------------------------------------------------
+ *  Read a little endian 32 bit value
+ *----------------------------------------------------------------------------*/
+static unsigned long
+readLe32 (  const unsigned char   * p )                 throw ();
+
 
 /* =============================================================  module code */
 
 /*------------------------------------------------------------------------------
- *  Initialize the object
+ *  Read a little endian 16 bit value
  *----------------------------------------------------------------------------*/
-void
-FileSource :: init (    const char    * name )          throw ( Exception )
+static unsigned int
+readLe16 (  const unsigned char   * p )                 throw ()
 {
-    fileName = Util::strDup( name);
-    fileDescriptor = 0;
+    return p[0] | (p[1] << 8);
 }
 
 
 /*------------------------------------------------------------------------------
- *  De-initialize the object
+ *  Read a little endian 32 bit value
  *----------------------------------------------------------------------------*/
-void
-FileSource :: strip ( void )                            throw ( Exception )
+static unsigned long
+readLe32 (  const unsigned char   * p )                 throw ()
 {
-    if ( isOpen() ) {
-        close();
-    }
-    
-    delete[] fileName;
-    fileDescriptor = 0;
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((unsigned long) p[3] << 24);
 }
 
 
 /*------------------------------------------------------------------------------
- *  Copy Constructor
+ *  Initialize the object
  *----------------------------------------------------------------------------*/
-FileSource :: FileSource ( const FileSource &     fs )      throw ( Exception )
+void
+FileSource :: init (    const char    * name,
+                        bool            pacing )        throw ( Exception )
 {
-    init( fs.fileName);
-
-    fileDescriptor = fs.fileDescriptor ? dup( fs.fileDescriptor) : 0;
-
-    if ( fileDescriptor == -1 ) {
-        strip();
-        throw Exception( __FILE__, __LINE__, "dup failure");
+    if ( !name || !*name ) {
+        throw Exception( __FILE__, __LINE__, "no file name specified");
     }
+
+    this->fileName       = Util::strDup( name);
+    this->pacing         = pacing;
+    this->fileDescriptor = -1;
+    this->map            = 0;
+    this->mapSize        = 0;
+    this->dataOffset     = 0;
+    this->dataLength     = 0;
+    this->position       = 0;
+    this->readAhead      = 0;
+    this->running        = false;
+
+    pthread_mutex_init( &mutex, 0);
+    pthread_cond_init( &cond, 0);
 }
 
 
 /*------------------------------------------------------------------------------
- *  Assignment operator
+ *  De-initialize the object
  *----------------------------------------------------------------------------*/
-FileSource &
-FileSource :: operator= ( const FileSource &     fs )       throw ( Exception )
+void
+FileSource :: strip ( void )                            throw ( Exception )
 {
-    if ( this != &fs ) {
-        init( fs.fileName);
-
-        fileDescriptor = fs.fileDescriptor ? dup( fs.fileDescriptor) : 0;
-
-        if ( fileDescriptor == -1 ) {
-            strip();
-            throw Exception( __FILE__, __LINE__, "dup failure");
-        }
+    if ( isOpen() ) {
+        close();
     }
 
-    return *this;
+    pthread_cond_destroy( &cond);
+    pthread_mutex_destroy( &mutex);
+
+    delete[] fileName;
 }
 
 
 /*------------------------------------------------------------------------------
- *  Check wether a file exists
+ *  Find the samples in a mapped WAV file
  *----------------------------------------------------------------------------*/
-bool
-FileSource :: exists ( void ) const               throw ()
+void
+FileSource :: parseWavHeader ( void )                   throw ( Exception )
 {
-    struct stat     st;
+    size_t          pos       = 12;
+    bool            foundFmt  = false;
+
+    while ( pos + 8 <= mapSize ) {
+        const unsigned char   * chunk = map + pos;
+        unsigned long           size  = readLe32( chunk + 4);
+
+        if ( !memcmp( chunk, "fmt ", 4) && pos + 8 + 16 <= mapSize ) {
+            unsigned int    format   = readLe16( chunk + 8);
+            unsigned int    channels = readLe16( chunk + 10);
+            unsigned long   rate     = readLe32( chunk + 12);
+            unsigned int    bits     = readLe16( chunk + 22);
+
+            // plain PCM, or WAVE_FORMAT_EXTENSIBLE
+            if ( format != 1 && format != 0xfffe ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "not a PCM WAV file", fileName, format);
+            }
+            if ( channels != getChannel()
+              || rate     != getSampleRate()
+              || bits     != getBitsPerSample() ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "WAV file format doesn't match [input]",
+                                 fileName);
+            }
+            foundFmt = true;
+        } else if ( !memcmp( chunk, "data", 4) ) {
+            if ( !foundFmt ) {
+                throw Exception( __FILE__, __LINE__,
+                                 "no format chunk before data in WAV file",
+                                 fileName);
+            }
+            dataOffset = pos + 8;
+            dataLength = mapSize - dataOffset;
+            // files written while streaming may have no proper length
+            if ( size && size < dataLength ) {
+                dataLength = size;
+            }
+            return;
+        }
 
-    if ( stat( (const char*)fileName, &st) == -1 ) {
-        return false;
+        // chunks are padded to an even length
+        pos += 8 + size + (size & 1);
     }
 
-    return true;
+    throw Exception( __FILE__, __LINE__, "no data in WAV file", fileName);
 }
 
 
 /*------------------------------------------------------------------------------
- *  Open the source
+ *  Open the file
  *----------------------------------------------------------------------------*/
 bool
 FileSource :: open ( void )                             throw ( Exception )
 {
+    struct stat     st;
+    unsigned int    frameSize;
+    void          * m;
+
     if ( isOpen() ) {
         return false;
     }
 
     if ( (fileDescriptor = ::open( fileName, O_RDONLY)) == -1 ) {
-        fileDescriptor = 0;
+        throw Exception( __FILE__, __LINE__, "can't open file", fileName,
+                         errno);
+    }
+    if ( fstat( fileDescriptor, &st) == -1 || st.st_size == 0 ) {
+        close();
+        throw Exception( __FILE__, __LINE__, "can't read file", fileName);
+    }
+
+    mapSize = st.st_size;
+    m       = mmap( 0, mapSize, PROT_READ, MAP_PRIVATE, fileDescriptor, 0);
+    if ( m == MAP_FAILED ) {
+        mapSize = 0;
+        close();
+        throw Exception( __FILE__, __LINE__, "can't map file", fileName,
+                         errno);
+    }
+    map = (unsigned char *) m;
+    madvise( map, mapSize, MADV_SEQUENTIAL);
+
+    try {
+        if ( mapSize >= 12
+          && !memcmp( map, "RIFF", 4) && !memcmp( map + 8, "WAVE", 4) ) {
+            parseWavHeader();
+        } else {
+            dataOffset = 0;
+            dataLength = mapSize;
+        }
+    } catch ( Exception & e ) {
+        close();
+        throw;
+    }
+
+    // only read whole frames
+    frameSize   = getChannel() * ((getBitsPerSample() + 7) / 8);
+    dataLength -= dataLength % frameSize;
+
+    reportEvent( 2, "Reading file", fileName);
+    reportEvent( 3, "bytes of samples in the file:", dataLength);
+
+    position  = 0;
+    readAhead = 0;
+    gettimeofday( &startTime, 0);
+
+    running = true;
+    if ( pthread_create( &thread, 0, threadFunction, this) ) {
+        running = false;
+        close();
         return false;
     }
 
@@ -202,69 +313,144 @@ bool
 FileSource :: canRead (     unsigned int    sec,
                             unsigned int    usec )      throw ( Exception )
 {
-    fd_set              fdset;
-    struct timespec     timespec;
-    sigset_t            sigset;
-    int                 ret;
-
     if ( !isOpen() ) {
         return false;
     }
 
-    FD_ZERO( &fdset);
-    FD_SET( fileDescriptor, &fdset);
-
-    timespec.tv_sec  = sec;
-    timespec.tv_nsec = usec * 1000L;
-
-    // mask out SIGUSR1, as we're expecting that signal for other reasons
-    sigemptyset(&sigset);
-    sigaddset(&sigset, SIGUSR1);
-
-    ret = pselect( fileDescriptor + 1, &fdset, NULL, NULL, &timespec, &sigset);
-    
-    if ( ret == -1 ) {
-        throw Exception( __FILE__, __LINE__, "select error");
+    // at the end, read() reports EOF
+    if ( !pacing || position >= dataLength ) {
+        return true;
     }
 
-    return ret > 0;
+    // the time at which the next samples would have been recorded
+    return pace( startTime,
+                 (double) position / ( getSampleRate() * getChannel()
+                                       * ((getBitsPerSample() + 7) / 8) ),
+                 sec,
+                 usec);
 }
 
 
 /*------------------------------------------------------------------------------
- *  Read from the audio source
+ *  Read from the file
  *----------------------------------------------------------------------------*/
 unsigned int
 FileSource :: read (        void          * buf,
                             unsigned int    len )       throw ( Exception )
 {
-    ssize_t     ret;
+    unsigned int    sampleSize = (getBitsPerSample() + 7) / 8;
+    unsigned int    frameSize  = getChannel() * sampleSize;
+    unsigned char * b          = (unsigned char *) buf;
 
     if ( !isOpen() ) {
         return 0;
     }
 
-    ret = ::read( fileDescriptor, buf, len);
+    len -= len % frameSize;
+    if ( len > dataLength - position ) {
+        len = dataLength - position;
+    }
 
-    if ( ret == -1 ) {
-        throw Exception( __FILE__, __LINE__, "read error");
+    memcpy( b, map + dataOffset + position, len);
+
+    // the pipeline takes samples in the byte order of the host, and WAV
+    // files are little endian
+    if ( isBigEndian() && dataOffset && sampleSize > 1 ) {
+        unsigned int    i;
+        unsigned int    j;
+
+        for ( i = 0; i < len; i += sampleSize ) {
+            for ( j = 0; j < sampleSize / 2; ++j ) {
+                unsigned char   c          = b[i + j];
+                b[i + j]                   = b[i + sampleSize - 1 - j];
+                b[i + sampleSize - 1 - j]  = c;
+            }
+        }
     }
 
-    return ret;
+    pthread_mutex_lock( &mutex);
+    position += len;
+    pthread_cond_signal( &cond);
+    pthread_mutex_unlock( &mutex);
+
+    return len;
 }
 
 
 /*------------------------------------------------------------------------------
- *  Close the audio source
+ *  Have the pages of the file ahead of the reading position read in
+ *----------------------------------------------------------------------------*/
+void
+FileSource :: readAheadLoop ( void )                    throw ()
+{
+    size_t              pageSize = sysconf( _SC_PAGESIZE);
+
+    pthread_mutex_lock( &mutex);
+    while ( running && readAhead < dataLength ) {
+        size_t      from;
+        size_t      to;
+
+        if ( readAhead >= position + readAheadWindow ) {
+            pthread_cond_wait( &cond, &mutex);
+            continue;
+        }
+
+        from = dataOffset + readAhead;
+        from = from - from % pageSize;
+        to   = readAhead + readAheadChunk < dataLength
+             ? dataOffset + readAhead + readAheadChunk
+             : dataOffset + dataLength;
+        pthread_mutex_unlock( &mutex);
+
+        madvise( map + from, to - from, MADV_WILLNEED);
+
+        pthread_mutex_lock( &mutex);
+        readAhead = to - dataOffset;
+    }
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The read ahead thread function
+ *----------------------------------------------------------------------------*/
+void *
+FileSource :: threadFunction( void     * param )
+{
+    FileSource    * fileSource = (FileSource *) param;
+
+    fileSource->readAheadLoop();
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the file
  *----------------------------------------------------------------------------*/
 void
 FileSource :: close ( void )                            throw ( Exception )
 {
-    if ( !isOpen() ) {
-        return;
+    if ( running ) {
+        pthread_mutex_lock( &mutex);
+        running = false;
+        pthread_cond_broadcast( &cond);
+        pthread_mutex_unlock( &mutex);
+
+        pthread_join( thread, 0);
     }
 
-    ::close( fileDescriptor);
-    fileDescriptor = 0;
+    if ( map ) {
+        munmap( map, mapSize);
+        map     = 0;
+        mapSize = 0;
+    }
+    if ( fileDescriptor != -1 ) {
+        ::close( fileDescriptor);
+        fileDescriptor = -1;
+    }
 }
 
+
+#endif // SUPPORT_FILE_SOURCE
+
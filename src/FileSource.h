@@ -0,0 +1,350 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : FileSource.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef FILE_SOURCE_H
+#define FILE_SOURCE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#else
+#error need sys/types.h
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#error need sys/time.h
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include "Reporter.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An audio input reading a WAV or a raw PCM file.
+ *  The file is memory mapped, and a separate thread faults the pages
+ *  ahead of the reading position in, so that reading never waits for
+ *  the disk. Raw files have to be in the format given for the source,
+ *  in the byte order of the host. The format of WAV files has to match
+ *  the format given for the source.
+ *
+ *  With pacing turned on, the file is read at the speed it would be
+ *  recorded at. Without pacing, it's read as fast as the sinks accept it.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class FileSource : public AudioSource, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The name of the file.
+         */
+        char              * fileName;
+
+        /**
+         *  Read the file at the speed of the audio it holds.
+         */
+        bool                pacing;
+
+        /**
+         *  The file descriptor of the open file, -1 if closed.
+         */
+        int                 fileDescriptor;
+
+        /**
+         *  The memory mapped file.
+         */
+        unsigned char     * map;
+
+        /**
+         *  The size of the mapping.
+         */
+        size_t              mapSize;
+
+        /**
+         *  The offset of the first sample in the file.
+         */
+        size_t              dataOffset;
+
+        /**
+         *  The number of bytes of samples in the file.
+         */
+        size_t              dataLength;
+
+        /**
+         *  The number of bytes of samples read so far.
+         */
+        size_t              position;
+
+        /**
+         *  The number of bytes of samples the read ahead thread has
+         *  faulted in so far.
+         */
+        size_t              readAhead;
+
+        /**
+         *  The time reading started, for pacing.
+         */
+        struct timeval      startTime;
+
+        /**
+         *  Signal if the read ahead thread is running.
+         */
+        bool                running;
+
+        /**
+         *  The mutex guarding position, readAhead and running.
+         */
+        pthread_mutex_t     mutex;
+
+        /**
+         *  The conditional variable for waking the read ahead thread.
+         */
+        pthread_cond_t      cond;
+
+        /**
+         *  The read ahead thread.
+         */
+        pthread_t           thread;
+
+        /**
+         *  Initialize the object
+         *
+         *  @param name the name of the file.
+         *  @param pacing read the file at the speed of the audio it holds.
+         *  @exception Exception
+         */
+        void
+        init (  const char    * name,
+                bool            pacing )            throw ( Exception );
+
+        /**
+         *  De-initialize the object
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Find the samples in a mapped WAV file, and check that
+         *  their format matches the source.
+         *
+         *  @exception Exception
+         */
+        void
+        parseWavHeader ( void )                     throw ( Exception );
+
+        /**
+         *  The loop of the read ahead thread.
+         */
+        void
+        readAheadLoop ( void )                      throw ();
+
+        /**
+         *  The thread function.
+         *
+         *  @param param thread parameter, a pointer to the FileSource.
+         *  @return always 0.
+         */
+        static void *
+        threadFunction( void      * param );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        FileSource ( void )                             throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param name the name of the file.
+         *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
+         *  @param bitsPerSample bits per sample (e.g. 16 bits).
+         *  @param channel number of channels of the audio source
+         *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @param pacing read the file at the speed of the audio it holds,
+         *                or as fast as possible.
+         *  @exception Exception
+         */
+        inline
+        FileSource (    const char    * name,
+                        int             sampleRate    = 44100,
+                        int             bitsPerSample = 16,
+                        int             channel       = 2,
+                        bool            pacing        = true )
+                                                        throw ( Exception )
+                    : AudioSource( sampleRate, bitsPerSample, channel)
+        {
+            init( name, pacing);
+        }
+
+        /**
+         *  Copy Constructor.
+         *
+         *  @param fs the object to copy.
+         *  @exception Exception
+         */
+        inline
+        FileSource (    const FileSource &    fs )      throw ( Exception )
+                    : AudioSource( fs )
+        {
+            throw Exception( __FILE__, __LINE__, "FileSource doesn't copy");
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~FileSource ( void )                            throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator.
+         *
+         *  @param fs the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual FileSource &
+        operator= (     const FileSource &      fs )    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__, "FileSource doesn't assign");
+        }
+
+        /**
+         *  Open the file, and start the read ahead thread.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                                   throw ( Exception );
+
+        /**
+         *  Check if the FileSource is open.
+         *
+         *  @return true if the FileSource is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return fileDescriptor != -1;
+        }
+
+        /**
+         *  Check if the FileSource can be read from.
+         *  With pacing, blocks until the next samples are due.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the FileSource is ready to be read from,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        canRead (               unsigned int    sec,
+                                unsigned int    usec )  throw ( Exception );
+
+        /**
+         *  Read from the FileSource.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the number of bytes to read into buf
+         *  @return the number of bytes read (may be less than len),
+         *          0 at the end of the file.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        read (                  void          * buf,
+                                unsigned int    len )   throw ( Exception );
+
+        /**
+         *  Close the FileSource.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                                  throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* FILE_SOURCE_H */
+
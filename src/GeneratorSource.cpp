@@ -0,0 +1,335 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : GeneratorSource.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+
+#include "Exception.h"
+#include "Util.h"
+#include "GeneratorSource.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The length of a sine sweep in seconds
+ *----------------------------------------------------------------------------*/
+static const unsigned int sweepSeconds = 10;
+
+/*------------------------------------------------------------------------------
+ *  The lowest and the highest frequency of a sine sweep
+ *----------------------------------------------------------------------------*/
+static const double sweepLow  = 20.0;
+static const double sweepHigh = 20000.0;
+
+/*------------------------------------------------------------------------------
+ *  The number of values in the state of the pink noise filter
+ *----------------------------------------------------------------------------*/
+static const unsigned int pinkSize = 7;
+
+/*------------------------------------------------------------------------------
+ *  The peak level of the signals, leaving room for the encoders
+ *----------------------------------------------------------------------------*/
+static const double level = 0.5;
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Tell which signal a name stands for
+ *----------------------------------------------------------------------------*/
+GeneratorSource :: Signal
+GeneratorSource :: parseSignal (    const char    * name )  throw ( Exception )
+{
+    if ( Util::strEq( name, "sweep") ) {
+        return sweep;
+    } else if ( Util::strEq( name, "white") ) {
+        return white;
+    } else if ( Util::strEq( name, "pink") ) {
+        return pink;
+    } else if ( Util::strEq( name, "silence") ) {
+        return silence;
+    } else if ( Util::strEq( name, "click") ) {
+        return click;
+    }
+
+    throw Exception( __FILE__, __LINE__, "unknown generator signal", name);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: init (   Signal          signal,
+                            bool            pacing )    throw ( Exception )
+{
+    this->signal     = signal;
+    this->pacing     = pacing;
+    this->opened     = false;
+    this->position   = 0;
+    this->firstClick = 0;
+    this->phase      = 0.0;
+    this->noiseState = 22222;
+    this->pinkState  = new double[getChannel() * pinkSize];
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: strip ( void )                       throw ( Exception )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    delete[] pinkState;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start generating the signal
+ *----------------------------------------------------------------------------*/
+bool
+GeneratorSource :: open ( void )                        throw ( Exception )
+{
+    unsigned int    i;
+
+    if ( isOpen() ) {
+        return false;
+    }
+
+    position = 0;
+    phase    = 0.0;
+    for ( i = 0; i < getChannel() * pinkSize; ++i ) {
+        pinkState[i] = 0.0;
+    }
+
+    gettimeofday( &startTime, 0);
+    // click at the start of each second of the system clock
+    firstClick = (unsigned long) ((1000000 - startTime.tv_usec)
+                                  * (double) getSampleRate() / 1000000.0);
+
+    opened = true;
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Check wether read() would return anything
+ *----------------------------------------------------------------------------*/
+bool
+GeneratorSource :: canRead (    unsigned int    sec,
+                                unsigned int    usec )  throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return false;
+    }
+
+    if ( !pacing ) {
+        return true;
+    }
+
+    // the time at which the next samples would have been recorded
+    return pace( startTime, (double) position / getSampleRate(), sec, usec);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Generate the next value of the white noise, with xorshift
+ *----------------------------------------------------------------------------*/
+double
+GeneratorSource :: nextRandom ( void )                  throw ()
+{
+    noiseState ^= noiseState << 13;
+    noiseState ^= noiseState >> 17;
+    noiseState ^= noiseState << 5;
+
+    return (double) (int) noiseState / 2147483648.0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Generate the value of the signal for the current frame and a channel
+ *----------------------------------------------------------------------------*/
+double
+GeneratorSource :: nextValue (  unsigned int    channel )   throw ()
+{
+    switch ( signal ) {
+        case sweep:
+            return sin( 2.0 * M_PI * phase) * level;
+
+        case white:
+            return nextRandom() * level;
+
+        case pink: {
+            // Paul Kellet's refined pink noise filter
+            double    * b = pinkState + channel * pinkSize;
+            double      w = nextRandom();
+            double      p;
+
+            b[0] = 0.99886 * b[0] + w * 0.0555179;
+            b[1] = 0.99332 * b[1] + w * 0.0750759;
+            b[2] = 0.96900 * b[2] + w * 0.1538520;
+            b[3] = 0.86650 * b[3] + w * 0.3104856;
+            b[4] = 0.55000 * b[4] + w * 0.5329522;
+            b[5] = -0.7616 * b[5] - w * 0.0168980;
+            p    = b[0] + b[1] + b[2] + b[3] + b[4] + b[5] + b[6]
+                 + w * 0.5362;
+            b[6] = w * 0.115926;
+            return p * 0.11 * level;
+        }
+
+        case click:
+            if ( position >= firstClick
+              && (position - firstClick) % getSampleRate()
+                                                < getSampleRate() / 1000 ) {
+                return 0.9;
+            }
+            return 0.0;
+
+        case silence:
+        default:
+            return 0.0;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Generate samples
+ *----------------------------------------------------------------------------*/
+unsigned int
+GeneratorSource :: read (   void          * buf,
+                            unsigned int    len )       throw ( Exception )
+{
+    unsigned int    sampleSize = (getBitsPerSample() + 7) / 8;
+    unsigned int    frameSize  = getChannel() * sampleSize;
+    double          maxValue   = (1UL << (getBitsPerSample() - 1)) - 1;
+    unsigned char * b          = (unsigned char *) buf;
+    unsigned int    frames;
+    unsigned int    i;
+    unsigned int    c;
+    unsigned int    k;
+    double          high       = sweepHigh;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    // stay a little below the Nyquist frequency
+    if ( high > 0.45 * getSampleRate() ) {
+        high = 0.45 * getSampleRate();
+    }
+
+    frames = len / frameSize;
+    for ( i = 0; i < frames; ++i, ++position ) {
+        if ( signal == click && position >= firstClick
+          && (position - firstClick) % getSampleRate() == 0 ) {
+            reportEvent( 6, "click at second",
+                         startTime.tv_sec + 1
+                         + (position - firstClick) / getSampleRate());
+        }
+
+        for ( c = 0; c < getChannel(); ++c ) {
+            double  x = nextValue( c);
+            long    v;
+
+            if ( x > 1.0 ) {
+                x = 1.0;
+            } else if ( x < -1.0 ) {
+                x = -1.0;
+            }
+            v = (long) floor( x * maxValue + 0.5);
+            if ( sampleSize == 1 ) {
+                // 8 bit samples are unsigned
+                v += 128;
+            }
+
+            for ( k = 0; k < sampleSize; ++k ) {
+#ifdef WORDS_BIGENDIAN
+                b[sampleSize - 1 - k] = (unsigned char) (v >> (8 * k));
+#else
+                b[k]                  = (unsigned char) (v >> (8 * k));
+#endif
+            }
+            b += sampleSize;
+        }
+
+        if ( signal == sweep ) {
+            double  t = (double) (position % (sweepSeconds * getSampleRate()))
+                      / (sweepSeconds * getSampleRate());
+
+            phase += sweepLow * pow( high / sweepLow, t)
+                   / getSampleRate();
+            phase -= floor( phase);
+        }
+    }
+
+    return frames * frameSize;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop generating the signal
+ *----------------------------------------------------------------------------*/
+void
+GeneratorSource :: close ( void )                       throw ( Exception )
+{
+    opened = false;
+}
+
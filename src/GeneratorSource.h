@@ -0,0 +1,341 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : GeneratorSource.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef GENERATOR_SOURCE_H
+#define GENERATOR_SOURCE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#error need sys/time.h
+#endif
+
+#include "Reporter.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An audio input generating a test signal, for load and latency tests
+ *  without a sound card. The signals are:
+ *
+ *  <ul>
+ *      <li>sweep - a logarithmic sine sweep from 20 Hz up to 20 kHz,
+ *          or a little below the Nyquist frequency, every 10 seconds</li>
+ *      <li>white - white noise</li>
+ *      <li>pink - pink noise</li>
+ *      <li>silence - digital silence</li>
+ *      <li>click - a 1 millisecond click at the start of each second
+ *          of the system clock, with the time of each click reported</li>
+ *  </ul>
+ *
+ *  Noise is generated independently for each channel, all other
+ *  signals are the same on all channels. Samples are signed, except for
+ *  8 bit samples, in the byte order of the host.
+ *
+ *  With pacing turned on, the samples are generated at the speed they
+ *  would be recorded at. Without pacing, they're generated as fast as
+ *  the sinks accept them.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class GeneratorSource : public AudioSource, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The kinds of signals generated.
+         */
+        enum Signal { sweep, white, pink, silence, click };
+
+
+    private:
+
+        /**
+         *  The signal generated.
+         */
+        Signal              signal;
+
+        /**
+         *  Generate the samples at the speed they would be recorded at.
+         */
+        bool                pacing;
+
+        /**
+         *  Signal if the source is open.
+         */
+        bool                opened;
+
+        /**
+         *  The number of frames generated so far.
+         */
+        unsigned long       position;
+
+        /**
+         *  The time generating started, for pacing and click times.
+         */
+        struct timeval      startTime;
+
+        /**
+         *  The number of frames before the first click, at the start
+         *  of the next second of the system clock.
+         */
+        unsigned long       firstClick;
+
+        /**
+         *  The phase of the sweep, in cycles.
+         */
+        double              phase;
+
+        /**
+         *  The state of the random number generator for noise.
+         */
+        unsigned int        noiseState;
+
+        /**
+         *  The state of the pink noise filters, 7 values for each channel.
+         */
+        double            * pinkState;
+
+        /**
+         *  Initialize the object
+         *
+         *  @param signal the signal to generate.
+         *  @param pacing generate the samples at the speed they would
+         *                be recorded at.
+         *  @exception Exception
+         */
+        void
+        init (  Signal          signal,
+                bool            pacing )            throw ( Exception );
+
+        /**
+         *  De-initialize the object
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Tell which signal a name stands for.
+         *
+         *  @param name the name of the signal.
+         *  @return the signal.
+         *  @exception Exception if the name is not a known signal.
+         */
+        static Signal
+        parseSignal (   const char    * name )      throw ( Exception );
+
+        /**
+         *  Generate the next value of the white noise.
+         *
+         *  @return a random value between -1.0 and 1.0.
+         */
+        double
+        nextRandom ( void )                         throw ();
+
+        /**
+         *  Generate the value of the signal for the current frame
+         *  and a channel.
+         *
+         *  @param channel the channel.
+         *  @return the value, between -1.0 and 1.0.
+         */
+        double
+        nextValue ( unsigned int    channel )       throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        GeneratorSource ( void )                        throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param name the name of the signal: sweep, white, pink,
+         *              silence or click.
+         *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
+         *  @param bitsPerSample bits per sample (e.g. 16 bits).
+         *  @param channel number of channels of the audio source
+         *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @param pacing generate the samples at the speed they would be
+         *                recorded at, or as fast as possible.
+         *  @exception Exception
+         */
+        inline
+        GeneratorSource (   const char    * name,
+                            int             sampleRate    = 44100,
+                            int             bitsPerSample = 16,
+                            int             channel       = 2,
+                            bool            pacing        = true )
+                                                        throw ( Exception )
+                    : AudioSource( sampleRate, bitsPerSample, channel)
+        {
+            init( parseSignal( name), pacing);
+        }
+
+        /**
+         *  Copy Constructor.
+         *
+         *  @param gs the object to copy.
+         *  @exception Exception
+         */
+        inline
+        GeneratorSource (   const GeneratorSource &   gs )
+                                                        throw ( Exception )
+                    : AudioSource( gs )
+        {
+            init( gs.signal, gs.pacing);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~GeneratorSource ( void )                       throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator.
+         *
+         *  @param gs the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual GeneratorSource &
+        operator= (     const GeneratorSource &     gs )    throw ( Exception )
+        {
+            if ( this != &gs ) {
+                strip();
+                AudioSource::operator=( gs);
+                init( gs.signal, gs.pacing);
+            }
+            return *this;
+        }
+
+        /**
+         *  Start generating the signal.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                                   throw ( Exception );
+
+        /**
+         *  Check if the GeneratorSource is open.
+         *
+         *  @return true if the GeneratorSource is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Check if the GeneratorSource can be read from.
+         *  With pacing, blocks until the next samples are due.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the GeneratorSource is ready to be read from,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        canRead (               unsigned int    sec,
+                                unsigned int    usec )  throw ( Exception );
+
+        /**
+         *  Generate samples.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the number of bytes to read into buf
+         *  @return the number of bytes read (may be less than len).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        read (                  void          * buf,
+                                unsigned int    len )   throw ( Exception );
+
+        /**
+         *  Stop generating the signal.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                                  throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* GENERATOR_SOURCE_H */
+
@@ -0,0 +1,195 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : Handle.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef HANDLE_H
+#define HANDLE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  The sole owner of an array allocated with new[], such as a buffer
+ *  passed along the pipeline. Unlike Ref, there is no reference count:
+ *  copying or assigning a Handle moves the array to the new Handle,
+ *  leaving the old one empty. The array is deleted with the last
+ *  Handle holding it.
+ *
+ *  sample usage:
+ *
+ *  <pre>
+ *  #include "Handle.h"
+ *
+ *  Handle<unsigned char>   buf( new unsigned char[size]);
+ *  Handle<unsigned char>   other = buf;    // buf is empty now
+ *
+ *  read( other.get(), size);
+ *  // the array is deleted when other goes out of scope
+ *  </pre>
+ *
+ *  @ref Ref
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+template <class T>
+class Handle
+{
+    private:
+
+        /**
+         *  The array owned by this Handle.
+         */
+        T* array;
+
+
+    public:
+
+        /**
+         *  Constructor based on the array to own.
+         *
+         *  @param array the array to own, allocated with new[].
+         */
+        inline
+        Handle ( T        * array = 0 )         throw ()
+        {
+            this->array = array;
+        }
+
+        /**
+         *  Copy constructor. Moves the array from the other Handle.
+         *
+         *  @param other the Handle to move the array from.
+         */
+        inline
+        Handle ( Handle<T> &    other )         throw ()
+        {
+            array = other.release();
+        }
+
+        /**
+         *  Destructor. Deletes the array owned.
+         */
+        inline
+        ~Handle ( void )                        throw ()
+        {
+            delete[] array;
+        }
+
+        /**
+         *  Assignment operator. Moves the array from the other Handle,
+         *  deleting the array owned before.
+         *
+         *  @param other the Handle to move the array from.
+         *  @return a reference to this Handle.
+         */
+        inline Handle<T> &
+        operator= ( Handle<T> &     other )     throw ()
+        {
+            if ( this != &other ) {
+                reset( other.release());
+            }
+            return *this;
+        }
+
+        /**
+         *  Assignment operator. Takes ownership of an array, deleting
+         *  the array owned before.
+         *
+         *  @param array the array to own, allocated with new[].
+         *  @return a reference to this Handle.
+         */
+        inline Handle<T> &
+        operator= ( T         * array )         throw ()
+        {
+            reset( array);
+            return *this;
+        }
+
+        /**
+         *  Own a new array, deleting the array owned before.
+         *
+         *  @param newArray the array to own, allocated with new[].
+         */
+        inline void
+        reset ( T         * newArray )          throw ()
+        {
+            if ( newArray != array ) {
+                delete[] array;
+                array = newArray;
+            }
+        }
+
+        /**
+         *  Give up ownership of the array, without deleting it.
+         *
+         *  @return the array owned so far, or NULL.
+         */
+        inline T*
+        release ( void )                        throw ()
+        {
+            T     * ret = array;
+
+            array = 0;
+            return ret;
+        }
+
+        /**
+         *  Return the array, keeping ownership of it.
+         *
+         *  @return the array owned, or NULL.
+         */
+        inline T*
+        get ( void ) const                      throw ()
+        {
+            return array;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* HANDLE_H */
+
@@ -0,0 +1,204 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpMount.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+
+#include "Exception.h"
+#include "Util.h"
+#include "BufferAllocator.h"
+#include "HttpMount.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: init ( const char        * mountPoint,
+                    const char        * contentType,
+                    unsigned int        bitRate,
+                    unsigned int        bufferSize,
+                    const char        * name,
+                    const char        * genre,
+                    const char        * url,
+                    const char        * description )   throw ( Exception )
+{
+    if ( !mountPoint || *mountPoint != '/' ) {
+        throw Exception( __FILE__, __LINE__,
+                         "mount point should start with /: ", mountPoint);
+    }
+    if ( !bufferSize || bufferSize > 0x40000000 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "invalid mount buffer size", bufferSize);
+    }
+
+    this->mountPoint  = Util::strDup( mountPoint);
+    this->contentType = Util::strDup( contentType);
+    this->bitRate     = bitRate;
+    this->name        = name        ? Util::strDup( name)        : 0;
+    this->genre       = genre       ? Util::strDup( genre)       : 0;
+    this->url         = url         ? Util::strDup( url)         : 0;
+    this->description = description ? Util::strDup( description) : 0;
+
+    // round up to a power of two, so that positions wrapping around
+    // the range of an unsigned long still map to the right place
+    for ( this->bufferSize = 1;
+          this->bufferSize < bufferSize;
+          this->bufferSize <<= 1 );
+
+    buffer   = (unsigned char *) BufferAllocator::allocate( this->bufferSize);
+    written  = 0;
+    opened   = false;
+    wakeupFd = -1;
+
+    pthread_mutex_init( &mutex, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HttpMount :: strip ( void )                         throw ( Exception )
+{
+    pthread_mutex_destroy( &mutex);
+
+    BufferAllocator::release( buffer);
+    delete[] mountPoint;
+    delete[] contentType;
+    if ( name ) {
+        delete[] name;
+    }
+    if ( genre ) {
+        delete[] genre;
+    }
+    if ( url ) {
+        delete[] url;
+    }
+    if ( description ) {
+        delete[] description;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data into the ring buffer
+ *----------------------------------------------------------------------------*/
+unsigned int
+HttpMount :: write (    const void    * buf,
+                        unsigned int    len )           throw ( Exception )
+{
+    const unsigned char   * b = (const unsigned char *) buf;
+    unsigned int            l = len;
+    unsigned int            start;
+    unsigned int            size;
+    char                    c = 0;
+
+    if ( !opened ) {
+        return 0;
+    }
+
+    pthread_mutex_lock( &mutex);
+
+    // only the last bufferSize bytes would remain anyway
+    if ( l > bufferSize ) {
+        written += l - bufferSize;
+        b       += l - bufferSize;
+        l        = bufferSize;
+    }
+
+    start = written & (bufferSize - 1);
+    size  = bufferSize - start;
+    if ( size > l ) {
+        size = l;
+    }
+    memcpy( buffer + start, b, size);
+    memcpy( buffer, b + size, l - size);
+    written += l;
+
+    // the wakeup pipe is non-blocking, and if it is full, the server
+    // will wake up anyway. it is written under the lock, so that the
+    // server can't close it in between, see setWakeupFd()
+    if ( wakeupFd >= 0 && ::write( wakeupFd, &c, 1) < 0 ) {
+        reportEvent( 6, "HttpMount :: write, wakeup pipe full");
+    }
+
+    pthread_mutex_unlock( &mutex);
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the write position
+ *----------------------------------------------------------------------------*/
+unsigned long
+HttpMount :: getWritten ( void ) const              throw ()
+{
+    unsigned long   w;
+
+    pthread_mutex_lock( &mutex);
+    w = written;
+    pthread_mutex_unlock( &mutex);
+
+    return w;
+}
+
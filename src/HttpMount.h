@@ -0,0 +1,486 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpMount.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef HTTP_MOUNT_H
+#define HTTP_MOUNT_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include "Reporter.h"
+#include "Sink.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A mount point of the built-in HTTP server.
+ *  The encoder writes the stream into a ring buffer, which all the
+ *  listeners of the mount read from, each at its own position.
+ *  Positions are counted in bytes written since the mount was created,
+ *  modulo the range of an unsigned long, and the ring buffer size is a
+ *  power of two, so that a position always maps to the same place in
+ *  the ring buffer.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class HttpMount : public Sink, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The path listeners request the stream on, e.g. "/live.mp3".
+         */
+        char              * mountPoint;
+
+        /**
+         *  The MIME type of the stream.
+         */
+        char              * contentType;
+
+        /**
+         *  Name of the stream.
+         */
+        char              * name;
+
+        /**
+         *  Genre of the stream.
+         */
+        char              * genre;
+
+        /**
+         *  URL associated with the stream.
+         */
+        char              * url;
+
+        /**
+         *  Description of the stream.
+         */
+        char              * description;
+
+        /**
+         *  Bitrate of the stream, in kbps.
+         */
+        unsigned int        bitRate;
+
+        /**
+         *  The ring buffer.
+         */
+        unsigned char     * buffer;
+
+        /**
+         *  Size of the ring buffer, a power of two.
+         */
+        unsigned int        bufferSize;
+
+        /**
+         *  The position the next byte will be written to.
+         */
+        unsigned long       written;
+
+        /**
+         *  Is the mount open.
+         */
+        bool                opened;
+
+        /**
+         *  File descriptor to write a byte to after each write,
+         *  to wake up the server, or -1.
+         */
+        int                 wakeupFd;
+
+        /**
+         *  Mutex guarding written, wakeupFd and the contents of the buffer.
+         */
+        mutable pthread_mutex_t     mutex;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param mountPoint the path of the stream on the server.
+         *  @param contentType the MIME type of the stream.
+         *  @param bitRate bitrate of the stream, in kbps.
+         *  @param bufferSize the minimum size of the ring buffer.
+         *  @param name name of the stream.
+         *  @param genre genre of the stream.
+         *  @param url URL associated with the stream.
+         *  @param description description of the stream.
+         *  @exception Exception
+         */
+        void
+        init (  const char        * mountPoint,
+                const char        * contentType,
+                unsigned int        bitRate,
+                unsigned int        bufferSize,
+                const char        * name,
+                const char        * genre,
+                const char        * url,
+                const char        * description )   throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        HttpMount ( void )                          throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  listeners are tied to the ring buffer of this mount.
+         *
+         *  @param mount the object to copy.
+         *  @exception Exception
+         */
+        inline
+        HttpMount ( const HttpMount &   mount )     throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Assignment operator. Always throws an Exception, as the
+         *  listeners are tied to the ring buffer of this mount.
+         *
+         *  @param mount the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual HttpMount &
+        operator= ( const HttpMount &   mount )     throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param mountPoint the path of the stream on the server.
+         *  @param contentType the MIME type of the stream.
+         *  @param bitRate bitrate of the stream, in kbps.
+         *  @param bufferSize the minimum size of the ring buffer,
+         *                    rounded up to a power of two.
+         *  @param name name of the stream.
+         *  @param genre genre of the stream.
+         *  @param url URL associated with the stream.
+         *  @param description description of the stream.
+         *  @exception Exception
+         */
+        inline
+        HttpMount ( const char        * mountPoint,
+                    const char        * contentType,
+                    unsigned int        bitRate,
+                    unsigned int        bufferSize,
+                    const char        * name          = 0,
+                    const char        * genre         = 0,
+                    const char        * url           = 0,
+                    const char        * description   = 0 )
+                                                    throw ( Exception )
+        {
+            init( mountPoint,
+                  contentType,
+                  bitRate,
+                  bufferSize,
+                  name,
+                  genre,
+                  url,
+                  description);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~HttpMount ( void )                         throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Open the mount. Listeners are served even while it is closed,
+         *  they just don't get any new data.
+         *
+         *  @return true
+         *  @exception Exception
+         */
+        inline virtual bool
+        open ( void )                               throw ( Exception )
+        {
+            opened = true;
+            return true;
+        }
+
+        /**
+         *  Check if the mount is open.
+         *
+         *  @return true if the mount is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                       throw ()
+        {
+            return opened;
+        }
+
+        /**
+         *  Check if the mount is ready to accept data. Always true,
+         *  as the ring buffer overwrites the oldest data.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (     unsigned int    sec,
+                       unsigned int    usec )       throw ( Exception )
+        {
+            return true;
+        }
+
+        /**
+         *  Write data into the ring buffer, and wake up the server.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return len
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write (        const void    * buf,
+                       unsigned int    len )        throw ( Exception );
+
+        /**
+         *  Flush all data that was written to the mount.
+         *  Nothing to do, as the server is woken up by each write.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                              throw ( Exception )
+        {
+        }
+
+        /**
+         *  Cut what the sink has been doing so far, and start anew.
+         *  Nothing to do for a mount.
+         */
+        inline virtual void
+        cut ( void )                                throw ()
+        {
+        }
+
+        /**
+         *  Close the mount.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        close ( void )                              throw ( Exception )
+        {
+            opened = false;
+        }
+
+        /**
+         *  Set the file descriptor to write a byte to after each write.
+         *  Once this returns, the previous one is not written to any more,
+         *  so it can be closed.
+         *
+         *  @param fd the file descriptor, or -1 for none.
+         */
+        inline void
+        setWakeupFd ( int   fd )                    throw ()
+        {
+            pthread_mutex_lock( &mutex);
+            wakeupFd = fd;
+            pthread_mutex_unlock( &mutex);
+        }
+
+        /**
+         *  Get the position the next byte will be written to.
+         *  Data before this position, but not before it minus the
+         *  buffer size, is available in the ring buffer.
+         *
+         *  @return the write position.
+         */
+        unsigned long
+        getWritten ( void ) const                   throw ();
+
+        /**
+         *  Get the ring buffer. The data may be sent from it without
+         *  holding any lock, as long as getWritten() afterwards shows
+         *  that it was not overwritten in the meantime.
+         *
+         *  @return the ring buffer.
+         */
+        inline const unsigned char *
+        getBuffer ( void ) const                    throw ()
+        {
+            return buffer;
+        }
+
+        /**
+         *  Get the size of the ring buffer.
+         *
+         *  @return the size of the ring buffer, a power of two.
+         */
+        inline unsigned int
+        getBufferSize ( void ) const                throw ()
+        {
+            return bufferSize;
+        }
+
+        /**
+         *  Get the path of the stream on the server.
+         *
+         *  @return the mount point.
+         */
+        inline const char *
+        getMountPoint ( void ) const                throw ()
+        {
+            return mountPoint;
+        }
+
+        /**
+         *  Get the MIME type of the stream.
+         *
+         *  @return the MIME type of the stream.
+         */
+        inline const char *
+        getContentType ( void ) const               throw ()
+        {
+            return contentType;
+        }
+
+        /**
+         *  Get the bitrate of the stream.
+         *
+         *  @return the bitrate of the stream, in kbps.
+         */
+        inline unsigned int
+        getBitRate ( void ) const                   throw ()
+        {
+            return bitRate;
+        }
+
+        /**
+         *  Get the name of the stream.
+         *
+         *  @return the name of the stream, may be NULL.
+         */
+        inline const char *
+        getName ( void ) const                      throw ()
+        {
+            return name;
+        }
+
+        /**
+         *  Get the genre of the stream.
+         *
+         *  @return the genre of the stream, may be NULL.
+         */
+        inline const char *
+        getGenre ( void ) const                     throw ()
+        {
+            return genre;
+        }
+
+        /**
+         *  Get the URL associated with the stream.
+         *
+         *  @return the URL associated with the stream, may be NULL.
+         */
+        inline const char *
+        getUrl ( void ) const                       throw ()
+        {
+            return url;
+        }
+
+        /**
+         *  Get the description of the stream.
+         *
+         *  @return the description of the stream, may be NULL.
+         */
+        inline const char *
+        getDescription ( void ) const               throw ()
+        {
+            return description;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* HTTP_MOUNT_H */
+
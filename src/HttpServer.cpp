@@ -0,0 +1,941 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpServer.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include "HttpServer.h"
+
+// the server is built on epoll, so it is only available where that is
+#ifdef HAVE_SYS_EPOLL_H
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#else
+#error need sys/types.h
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#else
+#error need sys/socket.h
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#else
+#error need netdb.h
+#endif
+
+#include <sys/epoll.h>
+
+#include <string>
+
+#include "Util.h"
+
+
+/* ===================================================  local data structures */
+
+/*------------------------------------------------------------------------------
+ *  A connection to a listener
+ *----------------------------------------------------------------------------*/
+struct HttpServer :: Client {
+    /**
+     *  The socket of the connection.
+     */
+    int             fd;
+
+    /**
+     *  The time the connection was accepted.
+     */
+    time_t          connected;
+
+    /**
+     *  The mount streamed to the listener, NULL while reading
+     *  the request.
+     */
+    HttpMount     * mount;
+
+    /**
+     *  The request read so far.
+     */
+    std::string     request;
+
+    /**
+     *  Data to send before any more of the stream: the response
+     *  header, or an ICY metadata block.
+     */
+    std::string     pending;
+
+    /**
+     *  The number of bytes of pending already sent.
+     */
+    unsigned int    pendingSent;
+
+    /**
+     *  The position of the next byte to send in the ring buffer
+     *  of the mount.
+     */
+    unsigned long   position;
+
+    /**
+     *  The number of stream bytes between ICY metadata blocks,
+     *  0 if the listener did not ask for metadata.
+     */
+    unsigned int    metaInt;
+
+    /**
+     *  The number of stream bytes until the next ICY metadata block.
+     */
+    unsigned int    untilMeta;
+
+    /**
+     *  Was the full metadata already sent, so that only empty
+     *  blocks need to follow.
+     */
+    bool            metaSent;
+
+    /**
+     *  Is the server waiting for the connection to become writable.
+     */
+    bool            writable;
+};
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  Maximum size of a request
+ *----------------------------------------------------------------------------*/
+static const unsigned int maxRequest = 4096;
+
+/*------------------------------------------------------------------------------
+ *  Seconds a listener has to send its request in
+ *----------------------------------------------------------------------------*/
+static const unsigned int requestTimeout = 10;
+
+/*------------------------------------------------------------------------------
+ *  Maximum number of events handled at once
+ *----------------------------------------------------------------------------*/
+static const unsigned int maxEvents = 64;
+
+/*------------------------------------------------------------------------------
+ *  Flags to send with
+ *----------------------------------------------------------------------------*/
+#ifdef HAVE_MSG_NOSIGNAL
+#define SEND_FLAGS      (MSG_NOSIGNAL | MSG_DONTWAIT)
+#else
+#define SEND_FLAGS      MSG_DONTWAIT
+#endif
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Put a file descriptor into non-blocking mode
+ *----------------------------------------------------------------------------*/
+static bool
+setNonBlocking (    int     fd )                    throw ();
+
+/*------------------------------------------------------------------------------
+ *  Build an ICY metadata block
+ *----------------------------------------------------------------------------*/
+static std::string
+icyMetadata (       const char    * title )         throw ();
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Put a file descriptor into non-blocking mode
+ *----------------------------------------------------------------------------*/
+static bool
+setNonBlocking (    int     fd )                    throw ()
+{
+    int     flags = fcntl( fd, F_GETFL, 0);
+
+    return flags != -1 && fcntl( fd, F_SETFL, flags | O_NONBLOCK) != -1;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Build an ICY metadata block: a length byte, counting 16 byte units,
+ *  followed by the metadata padded with zeros
+ *----------------------------------------------------------------------------*/
+static std::string
+icyMetadata (       const char    * title )         throw ()
+{
+    std::string     meta;
+    std::string     block;
+    unsigned int    units;
+
+    meta  = "StreamTitle='";
+    meta += std::string( title ? title : "").substr( 0, 1024);
+    meta += "';";
+
+    units = (meta.size() + 15) / 16;
+    block.append( 1, (char) units);
+    block += meta;
+    block.append( units * 16 - meta.size(), '\0');
+
+    return block;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: init (    const char        * bindAddress,
+                        unsigned int        port,
+                        unsigned int        maxClients,
+                        unsigned int        burstSize,
+                        unsigned int        metaInt )   throw ( Exception )
+{
+    if ( !port ) {
+        throw Exception( __FILE__, __LINE__, "no port for the server");
+    }
+
+    this->bindAddress = bindAddress ? Util::strDup( bindAddress) : 0;
+    this->port        = port;
+    this->maxClients  = maxClients;
+    this->burstSize   = burstSize;
+    this->metaInt     = metaInt;
+
+    listenFd      = -1;
+    epollFd       = -1;
+    wakeupPipe[0] = -1;
+    wakeupPipe[1] = -1;
+    running       = false;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: strip ( void )                        throw ( Exception )
+{
+    stop();
+
+    if ( bindAddress ) {
+        delete[] bindAddress;
+    }
+    mounts.clear();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Add a mount to serve
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: addMount (    HttpMount     * mount )     throw ( Exception )
+{
+    unsigned int    i;
+
+    for ( i = 0; i < mounts.size(); ++i ) {
+        if ( Util::strEq( mounts[i]->getMountPoint(),
+                          mount->getMountPoint()) ) {
+            throw Exception( __FILE__, __LINE__,
+                             "mount point used twice: ",
+                             mount->getMountPoint());
+        }
+    }
+
+    mounts.push_back( mount);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Start the server
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: start ( void )                        throw ( Exception )
+{
+    struct addrinfo         hints;
+    struct addrinfo       * result;
+    struct addrinfo       * ai;
+    struct epoll_event      event;
+    char                    service[16];
+    int                     optval = 1;
+    unsigned int            i;
+
+    if ( running ) {
+        return;
+    }
+
+    memset( &hints, 0, sizeof(hints));
+    hints.ai_family   = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags    = AI_PASSIVE;
+    sprintf( service, "%u", port);
+
+    if ( (i = getaddrinfo( bindAddress, service, &hints, &result)) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "can't resolve server address: ", gai_strerror( i));
+    }
+
+    for ( ai = result; ai; ai = ai->ai_next ) {
+        listenFd = socket( ai->ai_family, ai->ai_socktype, ai->ai_protocol);
+        if ( listenFd == -1 ) {
+            continue;
+        }
+        setsockopt( listenFd, SOL_SOCKET, SO_REUSEADDR,
+                    &optval, sizeof(optval));
+        if ( bind( listenFd, ai->ai_addr, ai->ai_addrlen) == 0
+          && listen( listenFd, 128) == 0
+          && setNonBlocking( listenFd) ) {
+            break;
+        }
+        ::close( listenFd);
+        listenFd = -1;
+    }
+    freeaddrinfo( result);
+
+    if ( listenFd == -1 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "can't listen on server port", port);
+    }
+
+    if ( pipe( wakeupPipe) == -1
+      || !setNonBlocking( wakeupPipe[0])
+      || !setNonBlocking( wakeupPipe[1])
+      || (epollFd = epoll_create( maxEvents)) == -1 ) {
+        int     err = errno;
+
+        stop();
+        throw Exception( __FILE__, __LINE__, "can't set up server", err);
+    }
+
+    // the listening socket and the pipe are told apart from the
+    // listeners by the address of their file descriptor
+    memset( &event, 0, sizeof(event));
+    event.events   = EPOLLIN;
+    event.data.ptr = &listenFd;
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, listenFd, &event);
+    event.data.ptr = wakeupPipe;
+    epoll_ctl( epollFd, EPOLL_CTL_ADD, wakeupPipe[0], &event);
+
+    for ( i = 0; i < mounts.size(); ++i ) {
+        mounts[i]->setWakeupFd( wakeupPipe[1]);
+    }
+
+    running = true;
+    if ( pthread_create( &thread, 0, threadFunction, this) ) {
+        int     err = errno;
+
+        running = false;
+        stop();
+        throw Exception( __FILE__, __LINE__, "can't create server thread",
+                         err);
+    }
+
+    reportEvent( 2, "server listening on port", port);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop the server
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: stop ( void )                         throw ( Exception )
+{
+    std::list<Client*>::iterator    it;
+    unsigned int                    i;
+
+    if ( running ) {
+        char    c = 0;
+
+        running = false;
+        if ( ::write( wakeupPipe[1], &c, 1) < 0 ) {
+            // the pipe is full, the thread will wake up anyway
+        }
+        pthread_join( thread, 0);
+    }
+
+    for ( i = 0; i < mounts.size(); ++i ) {
+        mounts[i]->setWakeupFd( -1);
+    }
+
+    for ( it = clients.begin(); it != clients.end(); ++it ) {
+        if ( (*it)->fd != -1 ) {
+            ::close( (*it)->fd);
+        }
+        delete *it;
+    }
+    clients.clear();
+
+    if ( epollFd != -1 ) {
+        ::close( epollFd);
+        epollFd = -1;
+    }
+    if ( listenFd != -1 ) {
+        ::close( listenFd);
+        listenFd = -1;
+    }
+    for ( i = 0; i < 2; ++i ) {
+        if ( wakeupPipe[i] != -1 ) {
+            ::close( wakeupPipe[i]);
+            wakeupPipe[i] = -1;
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The function the server thread starts with
+ *----------------------------------------------------------------------------*/
+void *
+HttpServer :: threadFunction (  void      * param )     throw ()
+{
+    ((HttpServer *) param)->serve();
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The body of the server thread
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: serve ( void )                        throw ()
+{
+    struct epoll_event              events[maxEvents];
+    std::list<Client*>::iterator    it;
+    time_t                          lastCheck = time( 0);
+
+    while ( running ) {
+        int     n = epoll_wait( epollFd, events, maxEvents, 1000);
+        bool    wakeup = false;
+        int     i;
+
+        if ( n == -1 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            reportEvent( 1, "server epoll error", errno);
+            break;
+        }
+
+        for ( i = 0; i < n; ++i ) {
+            void      * ptr = events[i].data.ptr;
+
+            if ( ptr == &listenFd ) {
+                acceptClients();
+            } else if ( ptr == wakeupPipe ) {
+                char    buf[256];
+
+                while ( read( wakeupPipe[0], buf, sizeof(buf)) > 0 );
+                wakeup = true;
+            } else {
+                Client    * client = (Client *) ptr;
+
+                if ( client->fd == -1 ) {
+                    // dropped while handling an earlier event
+                } else if ( events[i].events & (EPOLLERR | EPOLLHUP) ) {
+                    dropClient( client, "listener disconnected");
+                } else if ( !client->mount ) {
+                    readRequest( client);
+                } else {
+                    if ( events[i].events & EPOLLIN ) {
+                        char    buf[256];
+
+                        // listeners should not say anything after
+                        // the request, a read of 0 means they are gone
+                        if ( recv( client->fd, buf, sizeof(buf),
+                                   MSG_DONTWAIT) == 0 ) {
+                            dropClient( client, "listener disconnected");
+                            continue;
+                        }
+                    }
+                    if ( events[i].events & EPOLLOUT ) {
+                        sendData( client);
+                    }
+                }
+            }
+        }
+
+        // new data in the mounts, send it to all who are not
+        // waiting for their connection to become writable anyway
+        if ( wakeup ) {
+            for ( it = clients.begin(); it != clients.end(); ++it ) {
+                if ( (*it)->fd != -1 && (*it)->mount && !(*it)->writable ) {
+                    sendData( *it);
+                }
+            }
+        }
+
+        // drop the ones that did not send a request in time
+        if ( time( 0) != lastCheck ) {
+            lastCheck = time( 0);
+            for ( it = clients.begin(); it != clients.end(); ++it ) {
+                if ( (*it)->fd != -1 && !(*it)->mount
+                  && lastCheck - (*it)->connected
+                                            > (time_t) requestTimeout ) {
+                    dropClient( *it, "listener request timed out");
+                }
+            }
+        }
+
+        // delete the clients dropped
+        for ( it = clients.begin(); it != clients.end(); ) {
+            if ( (*it)->fd == -1 ) {
+                delete *it;
+                it = clients.erase( it);
+            } else {
+                ++it;
+            }
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Accept new connections
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: acceptClients ( void )                throw ()
+{
+    static const char   busy[] = "HTTP/1.0 503 Service Unavailable\r\n\r\n";
+    struct epoll_event  event;
+    int                 fd;
+
+    while ( (fd = accept( listenFd, 0, 0)) != -1 ) {
+        Client    * client;
+
+        if ( clients.size() >= maxClients ) {
+            reportEvent( 3, "server full, listener refused");
+            if ( send( fd, busy, sizeof(busy) - 1, SEND_FLAGS) < 0 ) {
+                // don't care, closing it anyway
+            }
+            ::close( fd);
+            continue;
+        }
+        if ( !setNonBlocking( fd) ) {
+            ::close( fd);
+            continue;
+        }
+
+        client              = new Client;
+        client->fd          = fd;
+        client->connected   = time( 0);
+        client->mount       = 0;
+        client->pendingSent = 0;
+        client->position    = 0;
+        client->metaInt     = 0;
+        client->untilMeta   = 0;
+        client->metaSent    = false;
+        client->writable    = false;
+
+        memset( &event, 0, sizeof(event));
+        event.events   = EPOLLIN;
+        event.data.ptr = client;
+        if ( epoll_ctl( epollFd, EPOLL_CTL_ADD, fd, &event) == -1 ) {
+            ::close( fd);
+            delete client;
+            continue;
+        }
+
+        clients.push_back( client);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read the request of a listener
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: readRequest ( Client    * client )    throw ()
+{
+    static const char   notFound[]   = "HTTP/1.0 404 Not Found\r\n\r\n";
+    static const char   badRequest[] = "HTTP/1.0 400 Bad Request\r\n\r\n";
+    char                buf[1024];
+    int                 len;
+    std::string         path;
+    std::string         header;
+    std::string::size_type  end;
+    HttpMount         * mount = 0;
+    unsigned long       written;
+    unsigned int        burst;
+    unsigned int        i;
+
+    while ( (len = recv( client->fd, buf, sizeof(buf), MSG_DONTWAIT)) > 0 ) {
+        client->request.append( buf, len);
+    }
+    if ( len == 0 || (len == -1 && errno != EAGAIN && errno != EWOULDBLOCK) ) {
+        dropClient( client, "listener disconnected");
+        return;
+    }
+
+    if ( client->request.find( "\r\n\r\n") == std::string::npos
+      && client->request.find( "\n\n") == std::string::npos ) {
+        if ( client->request.size() > maxRequest ) {
+            if ( send( client->fd, badRequest, sizeof(badRequest) - 1,
+                       SEND_FLAGS) < 0 ) {
+                // don't care, closing it anyway
+            }
+            dropClient( client, "listener request too long");
+        }
+        return;
+    }
+
+    // the request line is "GET <path> HTTP/1.x", ignore any query string
+    if ( client->request.compare( 0, 4, "GET ") == 0 ) {
+        end  = client->request.find_first_of( " ?\r\n", 4);
+        path = client->request.substr( 4, end - 4);
+        for ( i = 0; i < mounts.size(); ++i ) {
+            if ( path == mounts[i]->getMountPoint() ) {
+                mount = mounts[i].get();
+                break;
+            }
+        }
+    }
+    if ( !mount ) {
+        if ( send( client->fd, notFound, sizeof(notFound) - 1,
+                   SEND_FLAGS) < 0 ) {
+            // don't care, closing it anyway
+        }
+        dropClient( client, "listener asked for unknown mount");
+        return;
+    }
+
+    // header names are case insensitive
+    for ( i = 0; i < client->request.size(); ++i ) {
+        char    c = client->request[i];
+
+        if ( c >= 'A' && c <= 'Z' ) {
+            client->request[i] = c - 'A' + 'a';
+        }
+    }
+    if ( metaInt
+      && (client->request.find( "\nicy-metadata: 1") != std::string::npos
+       || client->request.find( "\nicy-metadata:1") != std::string::npos) ) {
+        client->metaInt   = metaInt;
+        client->untilMeta = metaInt;
+    }
+
+    header  = "HTTP/1.0 200 OK\r\n";
+    header += "Content-Type: ";
+    header += mount->getContentType();
+    header += "\r\nCache-Control: no-cache\r\n";
+    header += "Server: DarkIce/" VERSION "\r\n";
+    sprintf( buf, "icy-br: %u\r\n", mount->getBitRate());
+    header += buf;
+    if ( mount->getName() ) {
+        header += "icy-name: ";
+        header += mount->getName();
+        header += "\r\n";
+    }
+    if ( mount->getGenre() ) {
+        header += "icy-genre: ";
+        header += mount->getGenre();
+        header += "\r\n";
+    }
+    if ( mount->getUrl() ) {
+        header += "icy-url: ";
+        header += mount->getUrl();
+        header += "\r\n";
+    }
+    if ( mount->getDescription() ) {
+        header += "icy-description: ";
+        header += mount->getDescription();
+        header += "\r\n";
+    }
+    if ( client->metaInt ) {
+        sprintf( buf, "icy-metaint: %u\r\n", client->metaInt);
+        header += buf;
+    }
+    header += "\r\n";
+
+    // start some way back in the ring buffer, so that the player of the
+    // listener can fill its buffer right away
+    written = mount->getWritten();
+    burst   = burstSize;
+    if ( burst > mount->getBufferSize() / 2 ) {
+        burst = mount->getBufferSize() / 2;
+    }
+    if ( written < burst ) {
+        burst = written;
+    }
+
+    client->mount       = mount;
+    client->pending     = header;
+    client->pendingSent = 0;
+    client->position    = written - burst;
+    client->request.clear();
+
+    reportEvent( 4, "listener connected to", mount->getMountPoint());
+
+    sendData( client);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send a listener what it takes without blocking
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: sendData (    Client    * client )    throw ()
+{
+    const unsigned char   * ring = client->mount->getBuffer();
+    unsigned long           size = client->mount->getBufferSize();
+    unsigned long           mask = size - 1;
+
+    while ( true ) {
+        struct iovec        iov[3];
+        struct msghdr       msg;
+        unsigned int        iovcnt  = 0;
+        unsigned long       written = client->mount->getWritten();
+        unsigned long       start   = client->position;
+        unsigned long       audio   = written - start;
+        unsigned int        pendingLen;
+        unsigned long       total;
+        ssize_t             ret;
+        ssize_t             sent;
+
+        if ( audio > size ) {
+            dropClient( client, "listener too slow");
+            return;
+        }
+
+        pendingLen = client->pending.size() - client->pendingSent;
+        if ( pendingLen ) {
+            iov[iovcnt].iov_base = (void *) (client->pending.data()
+                                             + client->pendingSent);
+            iov[iovcnt].iov_len  = pendingLen;
+            ++iovcnt;
+        }
+
+        if ( client->metaInt && audio > client->untilMeta ) {
+            audio = client->untilMeta;
+        }
+        if ( audio ) {
+            unsigned long   offset = start & mask;
+            unsigned long   first  = size - offset;
+
+            if ( first > audio ) {
+                first = audio;
+            }
+            iov[iovcnt].iov_base = (void *) (ring + offset);
+            iov[iovcnt].iov_len  = first;
+            ++iovcnt;
+            if ( audio > first ) {
+                iov[iovcnt].iov_base = (void *) ring;
+                iov[iovcnt].iov_len  = audio - first;
+                ++iovcnt;
+            }
+        }
+
+        if ( !iovcnt ) {
+            // caught up with the mount
+            setWritable( client, false);
+            return;
+        }
+        total = pendingLen + audio;
+
+        memset( &msg, 0, sizeof(msg));
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ret = sendmsg( client->fd, &msg, SEND_FLAGS);
+        if ( ret == -1 ) {
+            if ( errno == EAGAIN || errno == EWOULDBLOCK ) {
+                setWritable( client, true);
+            } else if ( errno != EINTR ) {
+                dropClient( client, "listener disconnected");
+            }
+            return;
+        }
+        sent = ret;
+
+        if ( pendingLen ) {
+            unsigned int    n = (unsigned long) ret < pendingLen
+                              ? ret : pendingLen;
+
+            client->pendingSent += n;
+            if ( client->pendingSent == client->pending.size() ) {
+                client->pending.clear();
+                client->pendingSent = 0;
+            }
+            ret -= n;
+        }
+
+        if ( ret > 0 ) {
+            client->position += ret;
+
+            // the data was sent straight from the ring buffer, it is only
+            // good if the mount did not overwrite it in the meantime
+            if ( client->mount->getWritten() - start > size ) {
+                dropClient( client, "listener too slow");
+                return;
+            }
+
+            if ( client->metaInt ) {
+                client->untilMeta -= ret;
+                if ( client->untilMeta == 0 ) {
+                    client->untilMeta = client->metaInt;
+                    if ( client->metaSent ) {
+                        client->pending.assign( 1, '\0');
+                    } else {
+                        client->pending  = icyMetadata(
+                                                client->mount->getName());
+                        client->metaSent = true;
+                    }
+                }
+            }
+        }
+
+        if ( (unsigned long) sent < total ) {
+            // the connection took less than offered
+            setWritable( client, true);
+            return;
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set if the server should wait for the connection to become writable
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: setWritable ( Client    * client,
+                            bool        writable )      throw ()
+{
+    struct epoll_event      event;
+
+    if ( client->writable == writable ) {
+        return;
+    }
+
+    memset( &event, 0, sizeof(event));
+    event.events   = writable ? EPOLLIN | EPOLLOUT : EPOLLIN;
+    event.data.ptr = client;
+    epoll_ctl( epollFd, EPOLL_CTL_MOD, client->fd, &event);
+
+    client->writable = writable;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the connection to a listener
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: dropClient (  Client        * client,
+                            const char    * reason )    throw ()
+{
+    reportEvent( 4, reason);
+
+    // closing the socket removes it from the epoll set
+    ::close( client->fd);
+    client->fd = -1;
+}
+
+
+#else   // HAVE_SYS_EPOLL_H
+
+/*------------------------------------------------------------------------------
+ *  Without epoll there is no server, fail when one is configured
+ *----------------------------------------------------------------------------*/
+void
+HttpServer :: init (    const char        * bindAddress,
+                        unsigned int        port,
+                        unsigned int        maxClients,
+                        unsigned int        burstSize,
+                        unsigned int        metaInt )   throw ( Exception )
+{
+    throw Exception( __FILE__, __LINE__,
+                     "DarkIce not compiled with epoll support, "
+                     "thus can't run the built-in server");
+}
+
+void
+HttpServer :: strip ( void )                        throw ( Exception )
+{
+}
+
+void
+HttpServer :: addMount (    HttpMount     * mount )     throw ( Exception )
+{
+}
+
+void
+HttpServer :: start ( void )                        throw ( Exception )
+{
+}
+
+void
+HttpServer :: stop ( void )                         throw ( Exception )
+{
+}
+
+#endif  // HAVE_SYS_EPOLL_H
+
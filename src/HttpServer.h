@@ -0,0 +1,351 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : HttpServer.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef HTTP_SERVER_H
+#define HTTP_SERVER_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include <list>
+#include <vector>
+
+#include "Referable.h"
+#include "Reporter.h"
+#include "Exception.h"
+#include "Ref.h"
+#include "HttpMount.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A small HTTP server, serving the streams written into its mounts
+ *  directly to listeners.
+ *  A single thread waits for events on all connections with epoll.
+ *  Each listener has its own position in the ring buffer of its
+ *  mount, and is sent data straight from the ring buffer, so that
+ *  the encoded stream is never copied per listener.
+ *  New listeners start some way back in the ring buffer (burst on
+ *  connect), to fill up their player's buffer quickly.
+ *  Listeners asking for it get ICY metadata interleaved in the stream.
+ *  Listeners falling behind by more than the ring buffer are dropped.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class HttpServer : public virtual Referable, public virtual Reporter
+{
+    private:
+
+        /**
+         *  A connection to a listener, defined in HttpServer.cpp
+         */
+        struct Client;
+
+        /**
+         *  The address to listen on, or NULL for all addresses.
+         */
+        char                      * bindAddress;
+
+        /**
+         *  The port to listen on.
+         */
+        unsigned int                port;
+
+        /**
+         *  Maximum number of listeners served at the same time.
+         */
+        unsigned int                maxClients;
+
+        /**
+         *  Number of bytes sent to a new listener right away.
+         */
+        unsigned int                burstSize;
+
+        /**
+         *  Number of stream bytes between ICY metadata blocks.
+         */
+        unsigned int                metaInt;
+
+        /**
+         *  The mounts served.
+         */
+        std::vector< Ref<HttpMount> >   mounts;
+
+        /**
+         *  The listeners connected.
+         */
+        std::list< Client * >       clients;
+
+        /**
+         *  The listening socket.
+         */
+        int                         listenFd;
+
+        /**
+         *  The epoll file descriptor.
+         */
+        int                         epollFd;
+
+        /**
+         *  The pipe the mounts wake the server thread up with.
+         */
+        int                         wakeupPipe[2];
+
+        /**
+         *  Should the server thread keep running.
+         */
+        bool                        running;
+
+        /**
+         *  The server thread.
+         */
+        pthread_t                   thread;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param bindAddress the address to listen on, or NULL.
+         *  @param port the port to listen on.
+         *  @param maxClients maximum number of listeners.
+         *  @param burstSize number of bytes sent to a new listener at once.
+         *  @param metaInt number of stream bytes between ICY metadata.
+         *  @exception Exception
+         */
+        void
+        init (  const char        * bindAddress,
+                unsigned int        port,
+                unsigned int        maxClients,
+                unsigned int        burstSize,
+                unsigned int        metaInt )       throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Accept the new connections on the listening socket.
+         */
+        void
+        acceptClients ( void )                      throw ();
+
+        /**
+         *  Read the request of a listener, and start streaming to it.
+         *
+         *  @param client the listener.
+         */
+        void
+        readRequest (   Client    * client )        throw ();
+
+        /**
+         *  Send a listener as much of its pending data as it takes
+         *  without blocking.
+         *
+         *  @param client the listener.
+         */
+        void
+        sendData (      Client    * client )        throw ();
+
+        /**
+         *  Set if the server should wait for a listener's connection
+         *  to become writable.
+         *
+         *  @param client the listener.
+         *  @param writable true to wait for the connection to be writable.
+         */
+        void
+        setWritable (   Client    * client,
+                        bool        writable )      throw ();
+
+        /**
+         *  Close the connection to a listener. The Client is deleted
+         *  after the events at hand are handled.
+         *
+         *  @param client the listener.
+         *  @param reason the reason to report.
+         */
+        void
+        dropClient (    Client        * client,
+                        const char    * reason )    throw ();
+
+        /**
+         *  The body of the server thread.
+         */
+        void
+        serve ( void )                              throw ();
+
+        /**
+         *  The function the server thread starts with.
+         *
+         *  @param param the HttpServer to run.
+         *  @return NULL
+         */
+        static void *
+        threadFunction (    void      * param )     throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        HttpServer ( void )                         throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  connections can't be shared.
+         *
+         *  @param server the object to copy.
+         *  @exception Exception
+         */
+        inline
+        HttpServer ( const HttpServer &     server )    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Assignment operator. Always throws an Exception, as the
+         *  connections can't be shared.
+         *
+         *  @param server the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual HttpServer &
+        operator= ( const HttpServer &      server )    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param bindAddress the address to listen on, or NULL for all.
+         *  @param port the port to listen on.
+         *  @param maxClients maximum number of listeners.
+         *  @param burstSize number of bytes sent to a new listener at once.
+         *  @param metaInt number of stream bytes between ICY metadata,
+         *                 0 to never send ICY metadata.
+         *  @exception Exception
+         */
+        inline
+        HttpServer (    const char        * bindAddress,
+                        unsigned int        port,
+                        unsigned int        maxClients  = 100,
+                        unsigned int        burstSize   = 65536,
+                        unsigned int        metaInt     = 16000 )
+                                                    throw ( Exception )
+        {
+            init( bindAddress, port, maxClients, burstSize, metaInt);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~HttpServer ( void )                        throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Add a mount to serve. All mounts should be added before
+         *  the server is started.
+         *
+         *  @param mount the mount.
+         *  @exception Exception
+         */
+        void
+        addMount (  HttpMount     * mount )         throw ( Exception );
+
+        /**
+         *  Start listening, and serving listeners in a new thread.
+         *
+         *  @exception Exception
+         */
+        void
+        start ( void )                              throw ( Exception );
+
+        /**
+         *  Stop the server thread, and drop all listeners.
+         *
+         *  @exception Exception
+         */
+        void
+        stop ( void )                               throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* HTTP_SERVER_H */
+
@@ -116,10 +116,10 @@ IceCast :: strip ( void )                           throw ( Exception )
  *  Log in to the IceCast server
  *----------------------------------------------------------------------------*/
 bool
-IceCast :: sendLogin ( void )                           throw ( Exception )
+IceCast :: sendLogin ( TcpSocket     * socket )            throw ( Exception )
 {
-    Sink          * sink   = getSink();
-    Source        * source = getSocket();
+    Sink          * sink   = socket;
+    Source        * source = socket;
     const char    * str;
     char            resp[STRBUF_SIZE];
     unsigned int    len;
@@ -112,13 +112,14 @@ class IceCast : public CastSink
         }
 
         /**
-         *  Log in to the server using the socket avialable.
+         *  Log in to a server.
          *
+         *  @param socket the connection to the server, already open.
          *  @return true if login was successful, false otherwise.
          *  @exception Exception
          */
         virtual bool
-        sendLogin ( void )              throw ( Exception );
+        sendLogin ( TcpSocket     * socket )    throw ( Exception );
 
 
     public:
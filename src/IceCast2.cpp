@@ -39,6 +39,12 @@
 #error need stdio.h
 #endif
 
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#else
+#error need stdlib.h
+#endif
+
 #ifdef HAVE_STRING_H
 #include <string.h>
 #else
@@ -52,6 +58,8 @@
 #endif
 
 
+#include <string>
+
 #include "Exception.h"
 #include "Source.h"
 #include "Sink.h"
@@ -76,14 +84,13 @@ static const char fileid[] = "$Id$";
 #define STRBUF_SIZE         32
 
 
+/* ===============================================  local function prototypes */
+
 /*------------------------------------------------------------------------------
- *  Expected positive response from server begins like this.
+ *  Get the status code of an HTTP response
  *----------------------------------------------------------------------------*/
-static const char responseOK[] = "HTTP/1.0 200";
-static const char responseWrongPasswd[] = "HTTP/1.0 401";
-static const char responseForbidden[] = "HTTP/1.0 403";
-
-/* ===============================================  local function prototypes */
+static int
+httpStatus (    const char        * resp )              throw ();
 
 
 /* =============================================================  module code */
@@ -100,6 +107,7 @@ IceCast2 :: init (  StreamFormat            format,
     this->format         = format;
     this->mountPoint     = Util::strDup( mountPoint);
     this->description    = description    ? Util::strDup( description) : 0;
+    this->method         = sourceMethod;
 }
 
 
@@ -116,18 +124,36 @@ IceCast2 :: strip ( void )                           throw ( Exception )
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Get the status code of an HTTP response, 0 if not an HTTP response
+ *----------------------------------------------------------------------------*/
+static int
+httpStatus (    const char        * resp )              throw ()
+{
+    const char    * p;
+
+    if ( strncmp( resp, "HTTP/", 5) || !(p = strchr( resp, ' ')) ) {
+        return 0;
+    }
+
+    return atoi( p + 1);
+}
+
+
 /*------------------------------------------------------------------------------
  *  Log in to the IceCast2 server
  *----------------------------------------------------------------------------*/
 bool
-IceCast2 :: sendLogin ( void )                           throw ( Exception )
+IceCast2 :: sendLogin ( TcpSocket     * socket )            throw ( Exception )
 {
-    Sink          * sink   = getSink();
-    Source        * source = getSocket();
+    Sink          * sink   = socket;
+    Source        * source = socket;
+    const char    * eol    = method == putMethod ? "\r\n" : "\n";
     const char    * str;
     char            resp[STRBUF_SIZE];
+    std::string     request;
     unsigned int    len;
-    unsigned int    lenExpected;
+    int             status;
 
     if ( !source->isOpen() ) {
         return false;
@@ -136,18 +162,33 @@ IceCast2 :: sendLogin ( void )                           throw ( Exception )
         return false;
     }
 
-    // send the request, a string like:
-    // "SOURCE <mountpoint> ICE/1.0"
-    str = "SOURCE /";
-    sink->write( str, strlen( str));
-    str = getMountPoint();
-    sink->write( str, strlen( str));
-    str = " HTTP/1.0";
-    sink->write( str, strlen( str));
-
-    // send the content type, Ogg Vorbis
-    str = "\nContent-type: ";
-    sink->write( str, strlen( str));
+    // build the whole request in one buffer, the request line is either
+    // "PUT /<mountpoint> HTTP/1.1" for Icecast 2.4 and later, or the
+    // legacy "SOURCE /<mountpoint> HTTP/1.0"
+    if ( method == putMethod ) {
+        request += "PUT /";
+        request += getMountPoint();
+        request += " HTTP/1.1";
+        request += eol;
+        sprintf( resp, ":%u", socket->getPort());
+        request += "Host: ";
+        // an IPv6 address literal goes in brackets, as in an URL
+        if ( strchr( socket->getHost(), ':') ) {
+            request += "[";
+            request += socket->getHost();
+            request += "]";
+        } else {
+            request += socket->getHost();
+        }
+        request += resp;
+    } else {
+        request += "SOURCE /";
+        request += getMountPoint();
+        request += " HTTP/1.0";
+    }
+    request += eol;
+
+    // the content type
     switch ( format ) {
         case mp3:
         case mp2:
@@ -171,11 +212,11 @@ IceCast2 :: sendLogin ( void )                           throw ( Exception )
                              "unsupported stream format", format);
             break;
     }
-    sink->write( str, strlen( str));
+    request += "Content-type: ";
+    request += str;
+    request += eol;
 
-    // send the authentication info
-    str = "\nAuthorization: Basic ";
-    sink->write( str, strlen(str));
+    // the authentication info
     {
         // send source:<password> encoded as base64
         char        * source = "source:";
@@ -186,81 +227,98 @@ IceCast2 :: sendLogin ( void )                           throw ( Exception )
         Util::strCat( tmp, pwd);
         char  * base64 = Util::base64Encode( tmp);
         delete[] tmp;
-        sink->write( base64, strlen(base64));
+        request += "Authorization: Basic ";
+        request += base64;
+        request += eol;
         delete[] base64;
     }
 
-    // send user agent info
-    str = "\nUser-Agent: DarkIce/" VERSION " (http://code.google.com/p/darkice/)";
-    sink->write( str, strlen( str));
+    // user agent info
+    request += "User-Agent: DarkIce/" VERSION " (http://code.google.com/p/darkice/)";
+    request += eol;
 
-    // send the ice- headers
-    str = "\nice-bitrate: ";
-    sink->write( str, strlen( str));
+    // the ice- headers
     if ( log10(getBitRate()) >= (STRBUF_SIZE-2) ) {
         throw Exception( __FILE__, __LINE__,
                          "bitrate does not fit string buffer", getBitRate());
     }
     sprintf( resp, "%d", getBitRate());
-    sink->write( resp, strlen( resp));
+    request += "ice-bitrate: ";
+    request += resp;
+    request += eol;
 
-    str = "\nice-public: ";
-    sink->write( str, strlen( str));
-    str = getIsPublic() ? "1" : "0";
-    sink->write( str, strlen( str));
+    request += "ice-public: ";
+    request += getIsPublic() ? "1" : "0";
+    request += eol;
 
     if ( getName() ) {
-        str = "\nice-name: ";
-        sink->write( str, strlen( str));
-        str = getName();
-        sink->write( str, strlen( str));
+        request += "ice-name: ";
+        request += getName();
+        request += eol;
     }
 
     if ( getDescription() ) {
-        str = "\nice-description: ";
-        sink->write( str, strlen( str));
-        str = getDescription();
-        sink->write( str, strlen( str));
+        request += "ice-description: ";
+        request += getDescription();
+        request += eol;
     }
 
     if ( getUrl() ) {
-        str = "\nice-url: ";
-        sink->write( str, strlen( str));
-        str = getUrl();
-        sink->write( str, strlen( str));
+        request += "ice-url: ";
+        request += getUrl();
+        request += eol;
     }
 
     if ( getGenre() ) {
-        str = "\nice-genre: ";
-        sink->write( str, strlen( str));
-        str = getGenre();
-        sink->write( str, strlen( str));
+        request += "ice-genre: ";
+        request += getGenre();
+        request += eol;
+    }
+
+    // with PUT, wait for the server to accept the stream before sending it
+    if ( method == putMethod ) {
+        request += "Expect: 100-continue";
+        request += eol;
     }
 
-    str = "\n\n";
-    sink->write( str, strlen( str));
+    request += eol;
+
+    sink->write( request.data(), request.size());
     sink->flush();
 
-    // read the response, expected response begins with responseOK
-    lenExpected = Util::strLen( responseOK);
-    if ( (len = source->read( resp, STRBUF_SIZE-1)) < lenExpected ) {
+    // read the response, don't wait forever for a PUT to be answered
+    if ( method == putMethod
+      && !source->canRead( socket->getConnectTimeout(), 0) ) {
+        reportEvent( 2, "no response from the server to PUT");
+        return false;
+    }
+    if ( (len = source->read( resp, STRBUF_SIZE-1)) == 0 ) {
         return false;
     }
-    resp[lenExpected] = 0;
+    resp[len] = 0;
 
     reportEvent(5,resp);
 
-    if ( Util::strEq( resp, responseWrongPasswd) ) {
+    status = httpStatus( resp);
+
+    if ( status == 401 ) {
 	throw Exception( __FILE__, __LINE__,
                          "Icecast2 - wrong password");
     }
 
-    if ( Util::strEq( resp, responseForbidden) ) {
+    if ( status == 403 ) {
 	throw Exception( __FILE__, __LINE__,
                          "Icecast2 - forbidden. Is the mountpoint occupied, or maximum sources reached?");
     }
 
-    if ( !Util::strEq( resp, responseOK) ) {
+    if ( method == putMethod
+      && (status == 400 || status == 405 || status == 501) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "Icecast2 - PUT not supported by the server, "
+                         "use loginMethod = source");
+    }
+
+    if ( status != 200 && !(method == putMethod && status == 100) ) {
         return false;
     }
     
@@ -65,6 +65,13 @@ class IceCast2 : public CastSink
          */
        enum StreamFormat { mp3, mp2, oggVorbis, aac, aacp };
 
+        /**
+         *  Type for specifying how to log in to the server:
+         *  the legacy SOURCE request, or an HTTP/1.1 PUT with
+         *  Expect: 100-continue, as supported by Icecast 2.4 and later.
+         */
+       enum LoginMethod { sourceMethod, putMethod };
+
 
     private:
 
@@ -83,6 +90,11 @@ class IceCast2 : public CastSink
          */
         char              * description;
 
+        /**
+         *  The method used to log in to the server.
+         */
+        LoginMethod         method;
+
         /**
          *  Initalize the object.
          *
@@ -120,13 +132,14 @@ class IceCast2 : public CastSink
         }
 
         /**
-         *  Log in to the server using the socket avialable.
+         *  Log in to a server.
          *
+         *  @param socket the connection to the server, already open.
          *  @return true if login was successful, false otherwise.
          *  @exception Exception
          */
         virtual bool
-        sendLogin ( void )              throw ( Exception );
+        sendLogin ( TcpSocket     * socket )    throw ( Exception );
 
 
     public:
@@ -187,6 +200,7 @@ class IceCast2 : public CastSink
             init( cs.getFormat(),
                   cs.getMountPoint(),
                   cs.getDescription() );
+            method = cs.getLoginMethod();
         }
 
         /**
@@ -216,6 +230,7 @@ class IceCast2 : public CastSink
                 init( cs.getFormat(),
                       cs.getMountPoint(),
                       cs.getDescription() );
+                method = cs.getLoginMethod();
             }
             return *this;
         }
@@ -253,6 +268,29 @@ class IceCast2 : public CastSink
             return description;
         }
 
+        /**
+         *  Set the method used to log in to the server.
+         *  Takes effect at the next connection.
+         *
+         *  @param method the login method.
+         */
+        inline void
+        setLoginMethod ( LoginMethod    method )    throw ()
+        {
+            this->method = method;
+        }
+
+        /**
+         *  Get the method used to log in to the server.
+         *
+         *  @return the login method.
+         */
+        inline LoginMethod
+        getLoginMethod ( void ) const               throw ()
+        {
+            return method;
+        }
+
 };
 
 
@@ -83,6 +83,7 @@
 #endif
 
 #include "Util.h"
+#include "BufferAllocator.h"
 #include "Exception.h"
 #include "JackDspSource.h"
 
@@ -110,13 +111,15 @@ void
 JackDspSource :: init ( const char* name )           throw ( Exception )
 {
     // Set defaults
-    ports[0]     = NULL;        // Left Port
-    ports[1]     = NULL;        // Right Port
-    rb[0]        = NULL;        // Left Ring Buffer
-    rb[1]        = NULL;        // Right Ring Buffer
+    ports        = NULL;        // One port for each channel
+    rb           = NULL;        // One ring buffer for each channel
     client       = NULL;
     auto_connect = false;       // Default is to not auto connect the JACK ports
     tmp_buffer   = NULL;        // Buffer big enough for one 'read' of audio
+    tmp_frames   = 0;
+    xruns        = 0;
+    overflows    = 0;
+    zombie       = false;
 
     // Auto connect the ports ?
     if ( Util::strEq( name, "jack_auto", 9) ) {
@@ -141,18 +144,11 @@ JackDspSource :: strip ( void )                      throw ( Exception )
     if ( isOpen() ) {
         close();
     }
-    
-    // Free the temporary buffer
-    if (tmp_buffer) {
-        free(tmp_buffer);
-        tmp_buffer = NULL;
-    }
-
 }
 
 /*------------------------------------------------------------------------------
  *  Attempt to connect up the JACK ports automatically
- *   - Just connect left&right to the first two output ports we find
+ *   - Just connect our ports to the first output ports we find
  *----------------------------------------------------------------------------*/
 void
 JackDspSource :: do_auto_connect ( void )                   throw ( Exception )
@@ -165,7 +161,7 @@ JackDspSource :: do_auto_connect ( void )                   throw ( Exception )
     
     // Get a list of all the jack ports
     all_ports = jack_get_ports (client, NULL, NULL, JackPortIsOutput);
-    if (!ports) {
+    if (!all_ports) {
         throw Exception( __FILE__, __LINE__, "jack_get_ports() returned NULL.");
     }
     
@@ -198,6 +194,7 @@ bool
 JackDspSource :: open ( void )                       throw ( Exception )
 {
     char         client_name[255];
+    char         port_name[32];
     size_t       rb_size;
     unsigned int c;
     
@@ -226,35 +223,35 @@ JackDspSource :: open ( void )                       throw ( Exception )
     }
 
 
-    // Register ports with Jack
-    if (getChannel() == 1) {
-        if (!(ports[0] = jack_port_register(client,
-                                            "mono",
-                                            JACK_DEFAULT_AUDIO_TYPE,
-                                            JackPortIsInput,
-                                            0))) {
-            throw Exception( __FILE__, __LINE__,
-                            "Cannot register input port", "mono");
+    // Register ports with Jack, one for each channel
+    if (getChannel() < 1) {
+        throw Exception( __FILE__, __LINE__,
+                        "Invalid number of channels", getChannel());
+    }
+    ports = new jack_port_t*[getChannel()];
+    rb    = new jack_ringbuffer_t*[getChannel()];
+    for (c=0; c<getChannel(); c++) {
+        ports[c] = NULL;
+        rb[c]    = NULL;
+    }
+
+    for (c=0; c<getChannel(); c++) {
+        if (getChannel() == 1) {
+            snprintf(port_name, sizeof(port_name), "mono");
+        } else if (getChannel() == 2) {
+            snprintf(port_name, sizeof(port_name), c ? "right" : "left");
+        } else {
+            snprintf(port_name, sizeof(port_name), "in_%u", c + 1);
         }
-    } else if (getChannel() == 2) {
-        if (!(ports[0] = jack_port_register(client,
-                                            "left",
+
+        if (!(ports[c] = jack_port_register(client,
+                                            port_name,
                                             JACK_DEFAULT_AUDIO_TYPE,
                                             JackPortIsInput,
                                             0))) {
             throw Exception( __FILE__, __LINE__,
-                            "Cannot register input port", "left");
+                            "Cannot register input port", port_name);
         }
-        if (!(ports[1] = jack_port_register(client,
-                                            "right",
-                                            JACK_DEFAULT_AUDIO_TYPE,
-                                            JackPortIsInput, 0))) {
-            throw Exception( __FILE__, __LINE__,
-                            "Cannot register input port", "right");
-        }
-    } else {
-        throw Exception( __FILE__, __LINE__,
-                        "Invalid number of channels", getChannel());
     }
 
 
@@ -268,11 +265,29 @@ JackDspSource :: open ( void )                       throw ( Exception )
             throw Exception( __FILE__, __LINE__,
                             "Failed to create ringbuffer for", "channel", c);
         }
+        // keep the ring buffers in memory, as the jack thread uses them
+        if (BufferAllocator::getMode() != BufferAllocator::heap
+            && jack_ringbuffer_mlock(rb[c])) {
+            Reporter::reportEvent(2, "Can't lock ringbuffer for channel", c);
+        }
     }
 
+    // The conversion buffer holds a quarter of a second of one channel,
+    // so that read() never has to allocate
+    tmp_frames = getSampleRate() / 4;
+    tmp_buffer = new jack_default_audio_sample_t[tmp_frames];
+    xruns      = 0;
+    overflows  = 0;
+    zombie     = false;
+
 
     // Set the callbacks
     jack_on_shutdown(client, JackDspSource::shutdown_callback, (void*)this);
+    if (jack_set_xrun_callback(client,
+                               JackDspSource::xrun_callback,
+                               (void*)this)) {
+        throw Exception( __FILE__, __LINE__, "Failed to set xrun callback");
+    }
     if (jack_set_process_callback(client,
                                   JackDspSource::process_callback,
                                   (void*)this)) {
@@ -307,6 +322,9 @@ JackDspSource :: canRead ( unsigned int   sec,
     if ( !isOpen() ) {
         return false;
     }
+    if ( zombie ) {
+        throw Exception( __FILE__, __LINE__, "JACK server has shut down");
+    }
 
     while (max_wait_time > cur_wait) {
         bool canRead = true;
@@ -343,64 +361,69 @@ unsigned int
 JackDspSource :: read (   void          * buf,
                           unsigned int    len )     throw ( Exception )
 {
-    jack_nframes_t samples         = len / 2 / getChannel();
-    jack_nframes_t samples_read[2] = {0,0};
-    short        * output          = (short*)buf;
-    unsigned int c, n;
+    jack_nframes_t samples = len / 2 / getChannel();
+    short        * output  = (short*)buf;
+    size_t         bytes;
+    unsigned int   c;
 
     if ( !isOpen() ) {
         return 0;
     }
-
-
-    // Ensure the temporary buffer is big enough
-    tmp_buffer = (jack_default_audio_sample_t*)realloc(tmp_buffer,
-                             samples * sizeof( jack_default_audio_sample_t ) );
-    if (!tmp_buffer) {
-        throw Exception( __FILE__, __LINE__, "realloc on tmp_buffer failed");
+    if ( zombie ) {
+        throw Exception( __FILE__, __LINE__, "JACK server has shut down");
     }
 
-    // We must be sure to fetch as many data on both channels
-    int minBytesAvailable = samples * sizeof( jack_default_audio_sample_t );
+    if (samples > tmp_frames) {
+        samples = tmp_frames;
+    }
 
+    // We must be sure to fetch as many data on all channels
+    bytes = samples * sizeof( jack_default_audio_sample_t );
     for (c=0; c<getChannel(); c++) {
-        int readable = jack_ringbuffer_read_space(rb[c]);
-        if (readable < minBytesAvailable) {
-            minBytesAvailable = readable;
+        size_t readable = jack_ringbuffer_read_space(rb[c]);
+        if (readable < bytes) {
+            bytes = readable;
         }
     }
+    samples = bytes / sizeof( jack_default_audio_sample_t );
+    bytes   = samples * sizeof( jack_default_audio_sample_t );
 
-    for (c=0; c<getChannel(); c++) {    
+    for (c=0; c<getChannel(); c++) {
         // Copy frames from ring buffer to temporary buffer
         // and then convert samples to output buffer
-        int bytes_read = jack_ringbuffer_read(rb[c],
-                                             (char*)tmp_buffer,
-                              minBytesAvailable);
-        samples_read[c] = bytes_read / sizeof( jack_default_audio_sample_t );
-        
-
-        // Convert samples from float to short and put in output buffer
-        for(n=0; n<samples_read[c]; n++) {
-            int tmp = lrintf(tmp_buffer[n] * 32768.0f);
-            if (tmp > SHRT_MAX) {
-                output[n*getChannel()+c] = SHRT_MAX;
-            } else if (tmp < SHRT_MIN) {
-                output[n*getChannel()+c] = SHRT_MIN;
-            } else {
-                output[n*getChannel()+c] = (short) tmp;
-            }
-        }
-    }
-
-    // Didn't get as many samples as we wanted ?
-    if (getChannel() == 2 && samples_read[0] != samples_read[1]) {
-        Reporter::reportEvent( 2,
-                              "Warning: Read a different number of samples "
-                              "for left and right channels");
+        jack_ringbuffer_read(rb[c], (char*)tmp_buffer, bytes);
+        convert(tmp_buffer, output + c, getChannel(), samples);
     }
 
     // Return the number of bytes put in the output buffer
-    return samples_read[0] * 2 * getChannel();
+    return samples * 2 * getChannel();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Convert a block of float samples into one channel of 16 bit samples
+ *----------------------------------------------------------------------------*/
+void
+JackDspSource :: convert ( const jack_default_audio_sample_t  * in,
+                           short                              * out,
+                           unsigned int                         stride,
+                           jack_nframes_t                       frames )
+                                                                    throw ()
+{
+    const jack_default_audio_sample_t * end = in + frames;
+
+    // clip, scale and round to nearest, without a call for each sample
+    for ( ; in < end; ++in, out += stride ) {
+        jack_default_audio_sample_t v = *in * 32768.0f;
+
+        if ( v >= 32767.0f ) {
+            *out = SHRT_MAX;
+        } else if ( v <= -32768.0f ) {
+            *out = SHRT_MIN;
+        } else {
+            *out = (short) (v < 0.0f ? v - 0.5f : v + 0.5f);
+        }
+    }
 }
 
 
@@ -416,13 +439,26 @@ JackDspSource :: close ( void )                  throw ( Exception )
         return;
     }
 
-    for(i = 0; i < getChannel(); i++) {
+    // Leave the jack graph first, so that the process callback
+    // doesn't run anymore when the ring buffers are freed
+    if (client) {
+        jack_deactivate(client);
+    }
+
+    for(i = 0; ports && i < getChannel(); i++) {
         // Close the port for channel
         if ( ports[i] ) {
             jack_port_unregister( client, ports[i] );
             ports[i] = NULL;
         }
-        
+    }
+
+    if (client) {
+        jack_client_close(client);
+        client = NULL;
+    }
+
+    for(i = 0; rb && i < getChannel(); i++) {
         // Free up the ring buffer for channel
         if ( rb[i] ) {
             jack_ringbuffer_free( rb[i] );
@@ -430,11 +466,13 @@ JackDspSource :: close ( void )                  throw ( Exception )
         }
     }
 
-    /* Leave the jack graph */
-    if (client) {
-        jack_client_close(client);
-        client = NULL;
-    }
+    delete[] ports;
+    ports = NULL;
+    delete[] rb;
+    rb = NULL;
+    delete[] tmp_buffer;
+    tmp_buffer = NULL;
+    tmp_frames = 0;
 
 }
 
@@ -442,8 +480,8 @@ JackDspSource :: close ( void )                  throw ( Exception )
 /*------------------------------------------------------------------------------
  *  Callback called by JACK when audio is available
  *
- *  Don't do anything too expensive here
- *      - just shove audio samples in ring buffer
+ *  This runs in the JACK realtime thread, so don't log, allocate or block
+ *  here - just shove audio samples in the ring buffers
  *----------------------------------------------------------------------------*/
 int
 JackDspSource :: process_callback( jack_nframes_t nframes, void *arg )
@@ -453,33 +491,60 @@ JackDspSource :: process_callback( jack_nframes_t nframes, void *arg )
     unsigned int   c;
     
     // Wait until it is ready
-    if (self->client == NULL) {
+    if (self->client == NULL || self->rb == NULL) {
         return 0;
     }
 
+    // write all channels or none, so that they stay aligned
+    for (c=0; c < self->getChannel(); c++) {
+        if (jack_ringbuffer_write_space(self->rb[c]) < to_write) {
+#ifdef HAVE_SYNC_BUILTINS
+            __sync_add_and_fetch( &self->overflows, 1);
+#else
+            ++self->overflows;
+#endif
+            return 0;
+        }
+    }
+
     /* copy data to ringbuffer; one per channel */
     for (c=0; c < self->getChannel(); c++) {    
         char *buf  = (char*)jack_port_get_buffer(self->ports[c], nframes);
-        size_t len = jack_ringbuffer_write(self->rb[c], buf, to_write);
-        if (len < to_write) {
-            Reporter::reportEvent( 1, "failed to write to ring ruffer");
-            return 1;
-         }
+        jack_ringbuffer_write(self->rb[c], buf, to_write);
     }
 
     // Success
     return 0;
 }
 
+
+/*------------------------------------------------------------------------------
+ *  Callback called by JACK when an xrun occured
+ *----------------------------------------------------------------------------*/
+int
+JackDspSource :: xrun_callback( void *arg )
+{
+    JackDspSource* self = (JackDspSource*)arg;
+
+#ifdef HAVE_SYNC_BUILTINS
+    __sync_add_and_fetch( &self->xruns, 1);
+#else
+    ++self->xruns;
+#endif
+    return 0;
+}
+
+
 /*------------------------------------------------------------------------------
- *  Callback called when 
+ *  Callback called when the JACK server shuts the client down
  *----------------------------------------------------------------------------*/
 void
 JackDspSource :: shutdown_callback( void *arg )
 {
-    //JackDspSource* self = (JackDspSource*)arg;
+    JackDspSource* self = (JackDspSource*)arg;
 
-    Reporter::reportEvent( 1, "JackDspSource :: shutdown_callback");
+    // reported from the reading thread, in canRead() or read()
+    self->zombie = true;
 }
 
 
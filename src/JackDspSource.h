@@ -73,14 +73,14 @@ class JackDspSource : public AudioSource, public virtual Reporter
         const char                   * jack_client_name;
 
         /**
-         *  The jack port
+         *  The jack ports, one for each channel.
          */
-        jack_port_t                  * ports[2];
+        jack_port_t                 ** ports;
 
         /**
-         *  The jack ring buffer.
+         *  The jack ring buffers, one for each channel.
          */
-        jack_ringbuffer_t            * rb[2];
+        jack_ringbuffer_t           ** rb;
 
         /**
          *  The jack client.
@@ -88,9 +88,31 @@ class JackDspSource : public AudioSource, public virtual Reporter
         jack_client_t                * client;
 
         /**
-         *  The jack audio sample buffer.
+         *  The jack audio sample buffer, allocated when opening.
          */
         jack_default_audio_sample_t * tmp_buffer;
+
+        /**
+         *  The number of samples tmp_buffer holds.
+         */
+        jack_nframes_t                tmp_frames;
+
+        /**
+         *  The number of xruns reported by the JACK server since opening.
+         *  Only changed atomically, from the JACK thread.
+         */
+        volatile unsigned int         xruns;
+
+        /**
+         *  The number of process cycles the ring buffers could not
+         *  hold since opening. Only changed atomically, from the JACK thread.
+         */
+        volatile unsigned int         overflows;
+
+        /**
+         *  Set by the JACK thread when the server shuts the client down.
+         */
+        volatile bool                 zombie;
         
          /**
          *  Automatically connect the jack ports ? (default is to not)
@@ -146,6 +168,27 @@ class JackDspSource : public AudioSource, public virtual Reporter
         static void
         shutdown_callback( void *arg );
 
+        /**
+         *  Callback called by JACK when an xrun occured
+         */
+        static int
+        xrun_callback( void *arg );
+
+        /**
+         *  Convert a block of float samples into one channel of an
+         *  interleaved 16 bit buffer.
+         *
+         *  @param in the float samples.
+         *  @param out the first sample of the channel in the output buffer.
+         *  @param stride the distance of two samples of the channel in out.
+         *  @param frames the number of samples to convert.
+         */
+        static void
+        convert ( const jack_default_audio_sample_t   * in,
+                  short                               * out,
+                  unsigned int                          stride,
+                  jack_nframes_t                        frames ) throw ();
+
     public:
 
         /**
@@ -270,6 +313,29 @@ class JackDspSource : public AudioSource, public virtual Reporter
         virtual void
         close ( void )                                  throw ( Exception );
 
+        /**
+         *  Get the number of xruns reported by the JACK server since opening.
+         *
+         *  @return the number of xruns.
+         */
+        inline unsigned int
+        getXruns ( void ) const                         throw ()
+        {
+            return xruns;
+        }
+
+        /**
+         *  Get the number of process cycles lost since opening because
+         *  the ring buffers were full.
+         *
+         *  @return the number of ring buffer overflows.
+         */
+        inline virtual unsigned int
+        getOverruns ( void ) const                      throw ()
+        {
+            return overflows;
+        }
+
 };
 
 
@@ -40,6 +40,7 @@
 
 #include "Exception.h"
 #include "Util.h"
+#include "BufferAllocator.h"
 #include "LameLibEncoder.h"
 
 
@@ -53,6 +54,11 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  The number of samples per channel encoded in one go
+ *----------------------------------------------------------------------------*/
+static const unsigned int scratchSamples = 8192;
+
 
 /* ===============================================  local function prototypes */
 
@@ -262,6 +268,16 @@ LameLibEncoder :: open ( void )
                          "lame lib initializing params error" );
     }
 
+    // the scratch buffers used by write(), for a block of scratchSamples,
+    // only now that the encoder counts as open, so that close() releases them
+    leftBuffer    = (short int *) BufferAllocator::allocate(
+                                            scratchSamples * sizeof(short int));
+    rightBuffer   = (short int *) BufferAllocator::allocate(
+                                            scratchSamples * sizeof(short int));
+    // data chunk size estimate according to lame documentation
+    mp3BufferSize = (unsigned int) (1.25 * scratchSamples + 7200);
+    mp3Buffer     = (unsigned char *) BufferAllocator::allocate( mp3BufferSize);
+
 	if (getReportVerbosity() >= 3) {
  	   lame_print_config( lameGlobalFlags);
 	}
@@ -287,57 +303,58 @@ LameLibEncoder :: write (   const void    * buf,
     unsigned int    sampleSize = (bitsPerSample / 8) * inChannels;
     unsigned char * b = (unsigned char*) buf;
     unsigned int    processed = len - (len % sampleSize);
-    unsigned int    nSamples = processed / sampleSize;
-    short int     * leftBuffer  = new short int[nSamples];
-    short int     * rightBuffer = new short int[nSamples];
-
-    if ( bitsPerSample == 8 ) {
-        Util::conv8( b, processed, leftBuffer, rightBuffer, inChannels);
-    } else if ( bitsPerSample == 16 ) {
-        Util::conv16( b,
-                      processed,
-                      leftBuffer,
-                      rightBuffer,
-                      inChannels,
-                      isInBigEndian());
-    } else {
-        delete[] leftBuffer;
-        delete[] rightBuffer;
+    unsigned int    offset = 0;
+
+    if ( bitsPerSample != 8 && bitsPerSample != 16 ) {
         throw Exception( __FILE__, __LINE__,
                         "unsupported number of bits per sample for the encoder",
                          bitsPerSample );
     }
 
-    // data chunk size estimate according to lame documentation
-    // NOTE: mp3Size is calculated based on the number of input channels
-    //       which may be bigger than need, as output channels can be less
-    unsigned int    mp3Size = (unsigned int) (1.25 * nSamples + 7200);
-    unsigned char * mp3Buf  = new unsigned char[mp3Size];
-    int             ret;
-
-    ret = lame_encode_buffer( lameGlobalFlags,
-                              leftBuffer,
-                              inChannels == 2 ? rightBuffer : leftBuffer,
-                              nSamples,
-                              mp3Buf,
-                              mp3Size );
-
-    delete[] leftBuffer;
-    delete[] rightBuffer;
-
-    if ( ret < 0 ) {
-        reportEvent( 3, "lame encoding error", ret);
-        delete[] mp3Buf;
-        return 0;
-    }
-
-    unsigned int    written = getSink()->write( mp3Buf, ret);
-    delete[] mp3Buf;
-    // just let go data that could not be written
-    if ( written < (unsigned int) ret ) {
-        reportEvent( 2,
-                     "couldn't write all from encoder to underlying sink",
-                     ret - written);
+    // encode in blocks that fit the scratch buffers
+    while ( offset < processed ) {
+        unsigned int    nSamples = (processed - offset) / sampleSize;
+        unsigned int    size;
+        unsigned int    written;
+        int             ret;
+
+        if ( nSamples > scratchSamples ) {
+            nSamples = scratchSamples;
+        }
+        size = nSamples * sampleSize;
+
+        if ( bitsPerSample == 8 ) {
+            Util::conv8( b + offset, size, leftBuffer, rightBuffer, inChannels);
+        } else {
+            Util::conv16( b + offset,
+                          size,
+                          leftBuffer,
+                          rightBuffer,
+                          inChannels,
+                          isInBigEndian());
+        }
+
+        ret = lame_encode_buffer( lameGlobalFlags,
+                                  leftBuffer,
+                                  inChannels == 2 ? rightBuffer : leftBuffer,
+                                  nSamples,
+                                  mp3Buffer,
+                                  mp3BufferSize );
+
+        if ( ret < 0 ) {
+            reportEvent( 3, "lame encoding error", ret);
+            return 0;
+        }
+
+        written = getSink()->write( mp3Buffer, ret);
+        // just let go data that could not be written
+        if ( written < (unsigned int) ret ) {
+            reportEvent( 2,
+                         "couldn't write all from encoder to underlying sink",
+                         ret - written);
+        }
+
+        offset += size;
     }
 
     return processed;
@@ -355,15 +372,11 @@ LameLibEncoder :: flush ( void )
         return;
     }
 
-    // data chunk size estimate according to lame documentation
-    unsigned int    mp3Size = 7200;
-    unsigned char * mp3Buf  = new unsigned char[mp3Size];
     int             ret;
 
-    ret = lame_encode_flush( lameGlobalFlags, mp3Buf, mp3Size );
+    ret = lame_encode_flush( lameGlobalFlags, mp3Buffer, mp3BufferSize );
 
-    unsigned int    written = getSink()->write( mp3Buf, ret);
-    delete[] mp3Buf;
+    unsigned int    written = getSink()->write( mp3Buffer, ret);
 
     // just let go data that could not be written
     if ( written < (unsigned int) ret ) {
@@ -387,6 +400,13 @@ LameLibEncoder :: close ( void )                    throw ( Exception )
         lame_close( lameGlobalFlags);
         lameGlobalFlags = 0;
 
+        BufferAllocator::release( leftBuffer);
+        BufferAllocator::release( rightBuffer);
+        BufferAllocator::release( mp3Buffer);
+        leftBuffer  = 0;
+        rightBuffer = 0;
+        mp3Buffer   = 0;
+
         getSink()->close();
     }
 }
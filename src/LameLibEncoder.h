@@ -78,6 +78,26 @@ class LameLibEncoder : public AudioEncoder, public virtual Reporter
          */
         lame_global_flags             * lameGlobalFlags;
 
+        /**
+         *  Scratch buffer for the samples of the left channel.
+         */
+        short int                     * leftBuffer;
+
+        /**
+         *  Scratch buffer for the samples of the right channel.
+         */
+        short int                     * rightBuffer;
+
+        /**
+         *  Scratch buffer for the encoded data.
+         */
+        unsigned char                 * mp3Buffer;
+
+        /**
+         *  The size of mp3Buffer, in bytes.
+         */
+        unsigned int                    mp3BufferSize;
+
         /**
          *  Lowpass filter. Sound frequency in Hz, from where up the
          *  input is cut.
@@ -108,6 +128,10 @@ class LameLibEncoder : public AudioEncoder, public virtual Reporter
                int              highpass )              throw ( Exception )
         {
             this->lameGlobalFlags = NULL;
+            this->leftBuffer      = 0;
+            this->rightBuffer     = 0;
+            this->mp3Buffer       = 0;
+            this->mp3BufferSize   = 0;
             this->lowpass         = lowpass;
             this->highpass        = highpass;
 
@@ -0,0 +1,496 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : MixerSource.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#error need sys/time.h
+#endif
+
+#include "Exception.h"
+#include "BufferAllocator.h"
+#include "MixerSource.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+/*------------------------------------------------------------------------------
+ *  The number of bytes a capture thread reads at once
+ *----------------------------------------------------------------------------*/
+static const unsigned int readSize = 4096;
+
+/*------------------------------------------------------------------------------
+ *  The number of fractional bits of the gains
+ *----------------------------------------------------------------------------*/
+#define GAIN_SHIFT      12
+
+/*------------------------------------------------------------------------------
+ *  A full memory barrier, ordering the queue data and the queue indexes
+ *----------------------------------------------------------------------------*/
+#ifdef HAVE_SYNC_BUILTINS
+#define MEMORY_BARRIER()    __sync_synchronize()
+#else
+static pthread_mutex_t  barrierMutex = PTHREAD_MUTEX_INITIALIZER;
+#define MEMORY_BARRIER()    do { pthread_mutex_lock( &barrierMutex); \
+                                 pthread_mutex_unlock( &barrierMutex); \
+                            } while ( 0 )
+#endif
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+MixerSource :: init ( void )                            throw ( Exception )
+{
+    if ( getBitsPerSample() != 16 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "MixerSource supports 16 bit samples only",
+                         getBitsPerSample());
+    }
+
+    noInputs     = 0;
+    running      = false;
+    mixSamples   = readSize / sizeof(short);
+    mixBuffer    = new int[mixSamples];
+    sampleBuffer = new short[mixSamples];
+
+    pthread_mutex_init( &mutex, 0);
+    pthread_cond_init( &cond, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+MixerSource :: strip ( void )                           throw ( Exception )
+{
+    unsigned int    i;
+
+    if ( isOpen() ) {
+        close();
+    }
+
+    for ( i = 0; i < noInputs; ++i ) {
+        inputs[i].source = 0;
+        BufferAllocator::release( inputs[i].queue);
+        delete[] inputs[i].readBuffer;
+    }
+    noInputs = 0;
+
+    delete[] mixBuffer;
+    delete[] sampleBuffer;
+
+    pthread_cond_destroy( &cond);
+    pthread_mutex_destroy( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Add an input to the mixer
+ *----------------------------------------------------------------------------*/
+void
+MixerSource :: addInput (   AudioSource   * source,
+                            double          gain )      throw ( Exception )
+{
+    Input         * input;
+    double          linear;
+    unsigned long   size;
+
+    if ( isOpen() ) {
+        throw Exception( __FILE__, __LINE__, "can't add inputs while open");
+    }
+    if ( noInputs >= maxInputs ) {
+        throw Exception( __FILE__, __LINE__, "too many mixer inputs",
+                         maxInputs);
+    }
+    if ( source->getSampleRate() != getSampleRate()
+      || source->getBitsPerSample() != getBitsPerSample()
+      || source->getChannel() != getChannel() ) {
+        throw Exception( __FILE__, __LINE__,
+                         "mixer input format differs from the mix");
+    }
+
+    // keep the gain below 8, so that the products fit into an int
+    linear = pow( 10.0, gain / 20.0);
+    if ( linear > 7.99 ) {
+        linear = 7.99;
+    }
+
+    // queue half a second, in a power of 2 bytes
+    for ( size = 4096;
+          size < getSampleRate() * getChannel() * sizeof(short) / 2;
+          size <<= 1 );
+
+    input             = &inputs[noInputs];
+    input->mixer      = this;
+    input->ixInput    = noInputs;
+    input->source     = source;
+    input->gain       = (int) (linear * (1 << GAIN_SHIFT) + 0.5);
+    input->queueSize  = size;
+    input->queue      = (unsigned char *) BufferAllocator::allocate( size);
+    input->readBuffer = new unsigned char[readSize];
+    ++noInputs;
+
+    reportEvent( 3, "mixer input, gain (dB):", noInputs, gain);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open all the inputs, and start their capture threads
+ *----------------------------------------------------------------------------*/
+bool
+MixerSource :: open ( void )                            throw ( Exception )
+{
+    unsigned int    i;
+
+    if ( isOpen() ) {
+        return false;
+    }
+    if ( noInputs == 0 ) {
+        throw Exception( __FILE__, __LINE__, "no inputs to mix");
+    }
+
+    for ( i = 0; i < noInputs; ++i ) {
+        Input     * input = &inputs[i];
+
+        if ( !input->source->isOpen() && !input->source->open() ) {
+            reportEvent( 1, "can't open mixer input", i + 1);
+            close();
+            return false;
+        }
+        input->head      = 0;
+        input->tail      = 0;
+        input->ended     = false;
+        input->overflows = 0;
+        input->underruns = 0;
+    }
+
+    running = true;
+    for ( i = 0; i < noInputs; ++i ) {
+        Input     * input = &inputs[i];
+
+        if ( pthread_create( &input->thread, 0, Input::threadFunction, input) ) {
+            close();
+            return false;
+        }
+        input->started = true;
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read an input into its queue
+ *----------------------------------------------------------------------------*/
+void
+MixerSource :: captureLoop (    unsigned int    ixInput )   throw ()
+{
+    Input         * input     = &inputs[ixInput];
+    unsigned int    frameSize = getChannel() * sizeof(short);
+    unsigned long   mask      = input->queueSize - 1;
+
+    while ( running ) {
+        unsigned long   len;
+        unsigned long   space;
+        unsigned long   offset;
+        unsigned long   first;
+
+        try {
+            if ( !input->source->canRead( 1, 0) ) {
+                continue;
+            }
+            len = input->source->read( input->readBuffer, readSize);
+        } catch ( Exception & e ) {
+            reportEvent( 1, "mixer input failed", ixInput + 1, e.getDescription());
+            break;
+        }
+        if ( len == 0 ) {
+            reportEvent( 2, "mixer input ended", ixInput + 1);
+            break;
+        }
+        len -= len % frameSize;
+
+        // only the mixing thread changes the tail, and only the capture
+        // thread the head, so no lock is needed
+        space = input->queueSize - (input->head - input->tail);
+        MEMORY_BARRIER();
+        if ( len > space ) {
+            ++input->overflows;
+            len = space - space % frameSize;
+        }
+
+        offset = input->head & mask;
+        first  = input->queueSize - offset;
+        if ( first > len ) {
+            first = len;
+        }
+        memcpy( input->queue + offset, input->readBuffer, first);
+        memcpy( input->queue, input->readBuffer + first, len - first);
+        MEMORY_BARRIER();
+        input->head += len;
+
+        if ( ixInput == 0 ) {
+            pthread_mutex_lock( &mutex);
+            pthread_cond_signal( &cond);
+            pthread_mutex_unlock( &mutex);
+        }
+    }
+
+    input->ended = true;
+    pthread_mutex_lock( &mutex);
+    pthread_cond_signal( &cond);
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The capture thread function
+ *----------------------------------------------------------------------------*/
+void *
+MixerSource :: Input :: threadFunction( void     * param )
+{
+    Input     * input = (Input *) param;
+
+    input->mixer->captureLoop( input->ixInput);
+
+    return 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Check wether read() would return anything
+ *----------------------------------------------------------------------------*/
+bool
+MixerSource :: canRead (    unsigned int    sec,
+                            unsigned int    usec )      throw ( Exception )
+{
+    Input             * master = &inputs[0];
+    struct timeval      now;
+    struct timespec     timeout;
+    bool                ready;
+
+    if ( !isOpen() ) {
+        return false;
+    }
+
+    gettimeofday( &now, 0);
+    timeout.tv_sec  = now.tv_sec + sec + (now.tv_usec + usec) / 1000000;
+    timeout.tv_nsec = ((now.tv_usec + usec) % 1000000) * 1000;
+
+    pthread_mutex_lock( &mutex);
+    while ( master->head == master->tail && !master->ended ) {
+        if ( pthread_cond_timedwait( &cond, &mutex, &timeout) ) {
+            break;
+        }
+    }
+    // at the end of the first input read() reports EOF
+    ready = master->head != master->tail || master->ended;
+    pthread_mutex_unlock( &mutex);
+
+    return ready;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Take samples from the queue of an input, and mix them
+ *----------------------------------------------------------------------------*/
+void
+MixerSource :: mixInput (   Input         * input,
+                            unsigned int    samples )   throw ()
+{
+    unsigned long   len    = samples * sizeof(short);
+    unsigned long   offset = input->tail & (input->queueSize - 1);
+    unsigned long   first  = input->queueSize - offset;
+    const short   * in     = sampleBuffer;
+    int           * mix    = mixBuffer;
+    int             gain   = input->gain;
+    unsigned int    i;
+
+    if ( first > len ) {
+        first = len;
+    }
+    MEMORY_BARRIER();
+    memcpy( sampleBuffer, input->queue + offset, first);
+    memcpy( (unsigned char *) sampleBuffer + first, input->queue, len - first);
+    MEMORY_BARRIER();
+    input->tail += len;
+
+    // a plain loop over contiguous buffers, which the compiler vectorizes
+    for ( i = 0; i < samples; ++i ) {
+        mix[i] += (in[i] * gain) >> GAIN_SHIFT;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read the mix of the inputs
+ *----------------------------------------------------------------------------*/
+unsigned int
+MixerSource :: read (       void          * buf,
+                            unsigned int    len )       throw ( Exception )
+{
+    short         * out     = (short *) buf;
+    unsigned int    samples = len / sizeof(short);
+    unsigned int    queued;
+    unsigned int    i;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    // the first input sets how much is mixed
+    queued = (inputs[0].head - inputs[0].tail) / sizeof(short);
+    if ( samples > queued ) {
+        samples = queued;
+    }
+    if ( samples > mixSamples ) {
+        samples = mixSamples;
+    }
+    samples -= samples % getChannel();
+
+    memset( mixBuffer, 0, samples * sizeof(int));
+
+    for ( i = 0; i < noInputs; ++i ) {
+        Input         * input = &inputs[i];
+        unsigned int    n     = samples;
+
+        queued = (input->head - input->tail) / sizeof(short);
+        if ( n > queued ) {
+            // missing samples of the other inputs are left silent
+            if ( !input->ended ) {
+                ++input->underruns;
+            }
+            n = queued - queued % getChannel();
+        }
+        mixInput( input, n);
+    }
+
+    for ( i = 0; i < samples; ++i ) {
+        int     s = mixBuffer[i];
+
+        out[i] = s > 32767 ? 32767 : s < -32768 ? -32768 : s;
+    }
+
+    return samples * sizeof(short);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Stop the capture threads, and close the inputs
+ *----------------------------------------------------------------------------*/
+void
+MixerSource :: close ( void )                           throw ( Exception )
+{
+    unsigned int    i;
+
+    running = false;
+
+    // the capture threads notice within a second, when canRead() returns
+    for ( i = 0; i < noInputs; ++i ) {
+        if ( inputs[i].started ) {
+            pthread_join( inputs[i].thread, 0);
+            inputs[i].started = false;
+        }
+    }
+
+    for ( i = 0; i < noInputs; ++i ) {
+        if ( inputs[i].source->isOpen() ) {
+            inputs[i].source->close();
+        }
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the number of buffer overruns since opening
+ *----------------------------------------------------------------------------*/
+unsigned int
+MixerSource :: getOverruns ( void ) const               throw ()
+{
+    unsigned int    overruns = 0;
+    unsigned int    i;
+
+    for ( i = 0; i < noInputs; ++i ) {
+        overruns += inputs[i].overflows + inputs[i].source->getOverruns();
+    }
+
+    return overruns;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the number of underruns since opening
+ *----------------------------------------------------------------------------*/
+unsigned int
+MixerSource :: getUnderruns ( void ) const              throw ()
+{
+    unsigned int    underruns = 0;
+    unsigned int    i;
+
+    for ( i = 1; i < noInputs; ++i ) {
+        underruns += inputs[i].underruns;
+    }
+
+    return underruns;
+}
+
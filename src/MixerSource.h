@@ -0,0 +1,455 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : MixerSource.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef MIXER_SOURCE_H
+#define MIXER_SOURCE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include "Ref.h"
+#include "Reporter.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An audio source mixing several other audio sources, each with its
+ *  own gain. Each input is read by its own thread into a lock-free
+ *  queue. The first input sets the pace: when another input has less
+ *  data queued, silence is mixed in its place, and when it has more than
+ *  its queue holds, the excess is dropped.
+ *
+ *  All inputs have to be in the same format, with 16 bit samples.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class MixerSource : public AudioSource, public virtual Reporter
+{
+    public:
+
+        /**
+         *  The maximum number of inputs.
+         */
+        static const unsigned int       maxInputs = 8;
+
+    private:
+
+        /**
+         *  An input of the mixer, with its queue and capture thread.
+         */
+        class Input
+        {
+            public:
+                /**
+                 *  The mixer this is an input of.
+                 */
+                MixerSource           * mixer;
+
+                /**
+                 *  The index of the input.
+                 */
+                unsigned int            ixInput;
+
+                /**
+                 *  The audio source.
+                 */
+                Ref<AudioSource>        source;
+
+                /**
+                 *  The gain, as a fixed point number with 12 fractional
+                 *  bits.
+                 */
+                int                     gain;
+
+                /**
+                 *  The queue, of queueSize bytes, a power of 2.
+                 */
+                unsigned char         * queue;
+
+                /**
+                 *  The size of the queue.
+                 */
+                unsigned long           queueSize;
+
+                /**
+                 *  The number of bytes ever put into the queue.
+                 *  Only changed by the capture thread.
+                 */
+                volatile unsigned long  head;
+
+                /**
+                 *  The number of bytes ever taken from the queue.
+                 *  Only changed by the mixing thread.
+                 */
+                volatile unsigned long  tail;
+
+                /**
+                 *  The buffer the capture thread reads into.
+                 */
+                unsigned char         * readBuffer;
+
+                /**
+                 *  The capture thread.
+                 */
+                pthread_t               thread;
+
+                /**
+                 *  Marks if the capture thread was started.
+                 */
+                bool                    started;
+
+                /**
+                 *  Marks if the source has ended or failed.
+                 */
+                volatile bool           ended;
+
+                /**
+                 *  The number of times data was dropped as the queue
+                 *  was full.
+                 */
+                unsigned int            overflows;
+
+                /**
+                 *  The number of times there was not enough data queued
+                 *  for the mix.
+                 */
+                unsigned int            underruns;
+
+                /**
+                 *  Default constructor.
+                 */
+                inline
+                Input()
+                {
+                    this->mixer      = 0;
+                    this->ixInput    = 0;
+                    this->gain       = 0;
+                    this->queue      = 0;
+                    this->queueSize  = 0;
+                    this->head       = 0;
+                    this->tail       = 0;
+                    this->readBuffer = 0;
+                    this->thread     = 0;
+                    this->started    = false;
+                    this->ended      = false;
+                    this->overflows  = 0;
+                    this->underruns  = 0;
+                }
+
+                /**
+                 *  The thread function.
+                 *
+                 *  @param param thread parameter, a pointer to an Input.
+                 *  @return nothing
+                 */
+                static void *
+                threadFunction( void      * param );
+        };
+
+        /**
+         *  The inputs.
+         */
+        Input                   inputs[maxInputs];
+
+        /**
+         *  The number of inputs.
+         */
+        unsigned int            noInputs;
+
+        /**
+         *  Signal if the capture threads should run.
+         */
+        volatile bool           running;
+
+        /**
+         *  The mutex for waiting on the first input.
+         */
+        pthread_mutex_t         mutex;
+
+        /**
+         *  The conditional variable signalled when data is queued.
+         */
+        pthread_cond_t          cond;
+
+        /**
+         *  The buffer the inputs are mixed in.
+         */
+        int                   * mixBuffer;
+
+        /**
+         *  The buffer samples are taken from the queues into.
+         */
+        short                 * sampleBuffer;
+
+        /**
+         *  The number of samples mixBuffer and sampleBuffer hold.
+         */
+        unsigned int            mixSamples;
+
+        /**
+         *  Initialize the object
+         *
+         *  @exception Exception
+         */
+        void
+        init ( void )                               throw ( Exception );
+
+        /**
+         *  De-initialize the object
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  The loop of a capture thread.
+         *
+         *  @param ixInput the index of the input to capture.
+         */
+        void
+        captureLoop (   unsigned int    ixInput )   throw ();
+
+        /**
+         *  Take samples from the queue of an input, and mix them into
+         *  mixBuffer.
+         *
+         *  @param input the input.
+         *  @param samples the number of samples to take.
+         */
+        void
+        mixInput (      Input         * input,
+                        unsigned int    samples )   throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        MixerSource ( void )                            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
+         *  @param bitsPerSample bits per sample, only 16 is supported.
+         *  @param channel number of channels of the audio source
+         *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @exception Exception
+         */
+        inline
+        MixerSource (   int             sampleRate    = 44100,
+                        int             bitsPerSample = 16,
+                        int             channel       = 2 )
+                                                        throw ( Exception )
+                    : AudioSource( sampleRate, bitsPerSample, channel)
+        {
+            init();
+        }
+
+        /**
+         *  Copy Constructor.
+         *
+         *  @param ms the object to copy.
+         *  @exception Exception
+         */
+        inline
+        MixerSource (   const MixerSource &   ms )      throw ( Exception )
+                    : AudioSource( ms )
+        {
+            throw Exception( __FILE__, __LINE__, "MixerSource doesn't copy");
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~MixerSource ( void )                           throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator.
+         *
+         *  @param ms the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual MixerSource &
+        operator= (     const MixerSource &     ms )    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__, "MixerSource doesn't assign");
+        }
+
+        /**
+         *  Add an input to the mixer. The first input added sets the
+         *  pace of the mix. Inputs can only be added while the mixer
+         *  is closed.
+         *
+         *  @param source the audio source to mix, in the format of the mixer.
+         *  @param gain the gain of the input, in dB.
+         *  @exception Exception
+         */
+        void
+        addInput (  AudioSource   * source,
+                    double          gain )          throw ( Exception );
+
+        /**
+         *  Get the number of inputs.
+         *
+         *  @return the number of inputs.
+         */
+        inline unsigned int
+        getNoInputs ( void ) const                      throw ()
+        {
+            return noInputs;
+        }
+
+        /**
+         *  Open all the inputs, and start their capture threads.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                                   throw ( Exception );
+
+        /**
+         *  Check if the MixerSource is open.
+         *
+         *  @return true if the MixerSource is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return running;
+        }
+
+        /**
+         *  Check if the MixerSource can be read from, that is if the
+         *  first input has data queued. Blocks until the specified time
+         *  for data to be available.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the MixerSource is ready to be read from,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        canRead (               unsigned int    sec,
+                                unsigned int    usec )  throw ( Exception );
+
+        /**
+         *  Read the mix of the inputs.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the number of bytes to read into buf
+         *  @return the number of bytes read (may be less than len),
+         *          0 when the first input has ended.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        read (                  void          * buf,
+                                unsigned int    len )   throw ( Exception );
+
+        /**
+         *  Stop the capture threads, and close the inputs.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                                  throw ( Exception );
+
+        /**
+         *  Get the number of buffer overruns since opening, of the
+         *  inputs and of the queues of the mixer together.
+         *
+         *  @return the number of buffer overruns.
+         */
+        virtual unsigned int
+        getOverruns ( void ) const                      throw ();
+
+        /**
+         *  Get the number of times an input had less data queued than
+         *  the first one, and silence was mixed in its place.
+         *
+         *  @return the number of underruns.
+         */
+        unsigned int
+        getUnderruns ( void ) const                     throw ();
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* MIXER_SOURCE_H */
+
@@ -43,6 +43,7 @@
 #include "Exception.h"
 #include "MultiThreadedConnector.h"
 #include "Util.h"
+#include "BufferAllocator.h"
 
 
 /* ===================================================  local data structures */
@@ -226,7 +227,7 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
         return 0;
     }
 
-    dataBuffer   = new unsigned char[bufSize];
+    dataBuffer   = (unsigned char *) BufferAllocator::allocate( bufSize);
     dataSize     = 0;
 
     reportEvent( 6, "MultiThreadedConnector :: tranfer, bytes", bytes);
@@ -268,7 +269,7 @@ MultiThreadedConnector :: transfer ( unsigned long       bytes,
         }
     }
 
-    delete[] dataBuffer;
+    BufferAllocator::release( dataBuffer);
     return b;
 }
 
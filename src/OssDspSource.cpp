@@ -86,6 +86,18 @@
 #error need signal.h
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#else
+#error need sys/mman.h
+#endif
+
 #ifdef HAVE_SYS_SOUNDCARD_H
 #include <sys/soundcard.h>
 #else
@@ -140,11 +152,20 @@ OssDspSource :: isBigEndian ( void ) const                  throw ()
  *  Initialize the object
  *----------------------------------------------------------------------------*/
 void
-OssDspSource :: init (  const char      * name )    throw ( Exception )
+OssDspSource :: init (  const char      * name,
+                        bool              useMmap ) throw ( Exception )
 {
     fileName       = Util::strDup( name);
     fileDescriptor = 0;
     running        = false;
+    this->useMmap  = useMmap;
+    map            = 0;
+    mapSize        = 0;
+    fragmentSize   = 0;
+    readPosition   = 0;
+    available      = 0;
+    lastBytes      = 0;
+    overruns       = 0;
 }
 
 
@@ -224,10 +245,93 @@ OssDspSource :: open ( void )                       throw ( Exception )
                         "drift in the sound card driver");
     }
 
+    if ( useMmap && !openMmap() ) {
+        reportEvent( 2, "mmap access not supported by", fileName);
+        useMmap = false;
+    }
+
     return true;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Map the DMA buffer of the device, and start capturing into it
+ *----------------------------------------------------------------------------*/
+bool
+OssDspSource :: openMmap ( void )                   throw ( Exception )
+{
+    int             caps;
+    int             trigger;
+    audio_buf_info  bufInfo;
+    count_info      countInfo;
+    void          * m;
+
+    if ( ioctl( fileDescriptor, SNDCTL_DSP_GETCAPS, &caps) == -1
+      || !(caps & DSP_CAP_MMAP)
+      || !(caps & DSP_CAP_TRIGGER) ) {
+        return false;
+    }
+
+    if ( ioctl( fileDescriptor, SNDCTL_DSP_GETISPACE, &bufInfo) == -1 ) {
+        close();
+        throw Exception( __FILE__, __LINE__,
+                         "can't get input buffer size", errno);
+    }
+    fragmentSize = bufInfo.fragsize;
+    mapSize      = bufInfo.fragstotal * bufInfo.fragsize;
+
+    m = mmap( 0, mapSize, PROT_READ, MAP_SHARED, fileDescriptor, 0);
+    if ( m == MAP_FAILED ) {
+        return false;
+    }
+    map = (unsigned char *) m;
+
+    // capturing into a mapped buffer has to be started explicitly
+    trigger = 0;
+    ioctl( fileDescriptor, SNDCTL_DSP_SETTRIGGER, &trigger);
+    trigger = PCM_ENABLE_INPUT;
+    if ( ioctl( fileDescriptor, SNDCTL_DSP_SETTRIGGER, &trigger) == -1
+      || ioctl( fileDescriptor, SNDCTL_DSP_GETIPTR, &countInfo) == -1 ) {
+        close();
+        throw Exception( __FILE__, __LINE__, "can't start capturing", errno);
+    }
+
+    readPosition = countInfo.ptr;
+    lastBytes    = countInfo.bytes;
+    available    = 0;
+    running      = true;
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Update the number of bytes captured, but not read yet
+ *----------------------------------------------------------------------------*/
+void
+OssDspSource :: updateAvailable ( void )            throw ( Exception )
+{
+    count_info      countInfo;
+
+    if ( ioctl( fileDescriptor, SNDCTL_DSP_GETIPTR, &countInfo) == -1 ) {
+        throw Exception( __FILE__, __LINE__, "can't get input pointer", errno);
+    }
+
+    // the byte counter is an int, and some drivers wrap it at 2^31
+    available += ((unsigned int) countInfo.bytes - lastBytes) & 0x7fffffff;
+    lastBytes  = countInfo.bytes;
+
+    // the device is writing into the fragment at its pointer, so
+    // the oldest fragment not read yet may be overwritten already
+    if ( available > mapSize - fragmentSize ) {
+        ++overruns;
+        reportEvent( 1, "Buffer overrun! overruns so far:", overruns);
+        readPosition = countInfo.ptr;
+        available    = 0;
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Check wether read() would return anything
  *----------------------------------------------------------------------------*/
@@ -244,6 +348,32 @@ OssDspSource :: canRead ( unsigned int    sec,
         return false;
     }
 
+    if ( useMmap ) {
+        double  bytesPerSec = getSampleRate() * getChannel()
+                            * getBitsPerSample() / 8.0;
+        double  timeout     = sec + usec / 1000000.0;
+        double  wait;
+
+        // wait for a fragment to fill up, as the pointer of the device
+        // only moves a fragment at a time
+        while ( true ) {
+            updateAvailable();
+            if ( available >= fragmentSize ) {
+                return true;
+            }
+            if ( timeout <= 0.0 ) {
+                return available > 0;
+            }
+
+            wait = (fragmentSize - available) / bytesPerSec;
+            if ( wait > timeout ) {
+                wait = timeout;
+            }
+            usleep( (useconds_t) (wait * 1000000.0));
+            timeout -= wait;
+        }
+    }
+
     if ( !running ) {
         /* ugly workaround to get the dsp into recording state */
         unsigned char * b =
@@ -285,6 +415,33 @@ OssDspSource :: read (    void          * buf,
         return 0;
     }
 
+    if ( useMmap ) {
+        unsigned int    frameSize = getChannel() * getBitsPerSample() / 8;
+        unsigned int    first;
+
+        // never return nothing, as that means the end
+        while ( !canRead( 1, 0) || available < frameSize ) {
+        }
+
+        if ( len > available ) {
+            len = available;
+        }
+        len -= len % frameSize;
+
+        // copy straight from the DMA buffer, wrapping around its end
+        first = mapSize - readPosition;
+        if ( first > len ) {
+            first = len;
+        }
+        memcpy( buf, map + readPosition, first);
+        memcpy( (unsigned char *) buf + first, map, len - first);
+
+        readPosition = (readPosition + len) % mapSize;
+        available   -= len;
+
+        return len;
+    }
+
     ret = ::read( fileDescriptor, buf, len);
 
     if ( ret == -1 ) {
@@ -306,6 +463,11 @@ OssDspSource :: close ( void )                  throw ( Exception )
         return;
     }
 
+    if ( map ) {
+        munmap( map, mapSize);
+        map = 0;
+    }
+
     ::close( fileDescriptor);
     fileDescriptor = 0;
     running        = false;
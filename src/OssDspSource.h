@@ -74,6 +74,70 @@ class OssDspSource : public AudioSource, public virtual Reporter
          */
         bool        running;
 
+        /**
+         *  Read the samples straight from the DMA buffer of the device,
+         *  mapped into memory, instead of through read().
+         */
+        bool        useMmap;
+
+        /**
+         *  The DMA buffer of the device, when mapped into memory.
+         */
+        unsigned char * map;
+
+        /**
+         *  The size of the DMA buffer in bytes.
+         */
+        unsigned int    mapSize;
+
+        /**
+         *  The size of a fragment of the DMA buffer in bytes.
+         */
+        unsigned int    fragmentSize;
+
+        /**
+         *  The offset in the DMA buffer of the first byte not read yet.
+         */
+        unsigned int    readPosition;
+
+        /**
+         *  The number of bytes captured into the DMA buffer, but not
+         *  read yet.
+         */
+        unsigned int    available;
+
+        /**
+         *  The byte counter of the device, as last reported by
+         *  SNDCTL_DSP_GETIPTR.
+         */
+        unsigned int    lastBytes;
+
+        /**
+         *  The number of DMA buffer overruns since opening.
+         */
+        unsigned int    overruns;
+
+        /**
+         *  Map the DMA buffer of the device into memory, and start
+         *  capturing into it.
+         *
+         *  @return true if mapping was successful, false if the device
+         *          does not support it.
+         *  @exception Exception
+         */
+        bool
+        openMmap ( void )                           throw ( Exception );
+
+        /**
+         *  Update the number of bytes available in the DMA buffer,
+         *  from the pointer of the device.
+         *  Buffer overruns are counted, and the samples lost skipped.
+         *
+         *  @exception Exception
+         */
+        void
+        updateAvailable ( void )                    throw ( Exception );
+
 
     protected:
 
@@ -92,10 +156,13 @@ class OssDspSource : public AudioSource, public virtual Reporter
          *  Initialize the object
          *
          *  @param name the file name of the OSS DSP device.
+         *  @param useMmap read the samples straight from the DMA buffer
+         *                 of the device.
          *  @exception Exception
          */
         void
-        init (  const char    * name )              throw ( Exception );
+        init (  const char    * name,
+                bool            useMmap )           throw ( Exception );
 
         /**
          *  De-iitialize the object
@@ -117,18 +184,22 @@ class OssDspSource : public AudioSource, public virtual Reporter
          *  @param bitsPerSample bits per sample (e.g. 16 bits).
          *  @param channel number of channels of the audio source
          *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @param useMmap read the samples straight from the DMA buffer
+         *                 of the device (mmap access), if the device
+         *                 supports it.
          *  @exception Exception
          */
         inline
         OssDspSource (  const char    * name,
                         int             sampleRate    = 44100,
                         int             bitsPerSample = 16,
-                        int             channel       = 2 )
+                        int             channel       = 2,
+                        bool            useMmap       = false )
                                                         throw ( Exception )
 
                     : AudioSource( sampleRate, bitsPerSample, channel)
         {
-            init( name);
+            init( name, useMmap);
         }
 
         /**
@@ -141,7 +212,7 @@ class OssDspSource : public AudioSource, public virtual Reporter
         OssDspSource (  const OssDspSource &    ods )   throw ( Exception )
                     : AudioSource( ods )
         {
-            init( ods.fileName);
+            init( ods.fileName, ods.useMmap);
         }
 
         /**
@@ -168,7 +239,7 @@ class OssDspSource : public AudioSource, public virtual Reporter
             if ( this != &ds ) {
                 strip();
                 AudioSource::operator=( ds);
-                init( ds.fileName);
+                init( ds.fileName, ds.useMmap);
             }
             return *this;
         }
@@ -241,6 +312,18 @@ class OssDspSource : public AudioSource, public virtual Reporter
          */
         virtual void
         close ( void )                                  throw ( Exception );
+
+        /**
+         *  Get the number of DMA buffer overruns since opening, when
+         *  reading with mmap access.
+         *
+         *  @return the number of buffer overruns.
+         */
+        inline virtual unsigned int
+        getOverruns ( void ) const                      throw ()
+        {
+            return overruns;
+        }
 };
 
 
@@ -43,6 +43,24 @@
 #include "config.h"
 #endif
 
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
 #include "Util.h"
 #include "Exception.h"
 #include "PulseAudioDspSource.h"
@@ -58,6 +76,11 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id: PulseAudioDspSource.cpp 461 2009-12-01 12:57:31Z rafael@riseup.net $";
 
+/*------------------------------------------------------------------------------
+ *  The seconds read() waits for audio data, when it has none at all
+ *----------------------------------------------------------------------------*/
+static const unsigned int readTimeout = 1;
+
 
 /* ===============================================  local function prototypes */
 
@@ -69,15 +92,30 @@ static const char fileid[] = "$Id: PulseAudioDspSource.cpp 461 2009-12-01 12:57:
  *  Initialize the object
  *----------------------------------------------------------------------------*/
 void
-PulseAudioDspSource :: init (  const char      * paSourceName )    throw ( Exception )
+PulseAudioDspSource :: init (  const char      * paSourceName,
+                               unsigned int      fragSize,
+                               unsigned int      maxLength )
+                                                            throw ( Exception )
 {
+    this->fragSize     = fragSize;
+    this->maxLength    = maxLength;
+    this->mainloop     = NULL;
+    this->context      = NULL;
+    this->stream       = NULL;
+    this->peekData     = NULL;
+    this->peekLength   = 0;
+    this->peekOffset   = 0;
+    this->timedOut     = false;
+    this->overflows    = 0;
+    this->latencyBytes = 0;
+    this->latency      = 0;
+    this->peakLatency  = 0;
 
     if (paSourceName == NULL)
     {
         throw Exception( __FILE__, __LINE__, "no paSourceName specified");
     }
     Reporter::reportEvent( 1, "Using PulseAudio source: ", paSourceName);
-    Util::strEq( paSourceName , "default" );
     if (Util::strEq( paSourceName , "default" ))
     {
         sourceName = NULL;
@@ -147,21 +185,282 @@ PulseAudioDspSource :: strip ( void )                      throw ( Exception )
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Callback called when the state of the context changes
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: contextStateCallback (   pa_context    * c,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource *) userdata;
+
+    pa_threaded_mainloop_signal( self->mainloop, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Callback called when the state of the stream changes
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamStateCallback (    pa_stream     * s,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource *) userdata;
+
+    pa_threaded_mainloop_signal( self->mainloop, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Callback called when new data is available on the stream
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamReadCallback (     pa_stream     * s,
+                                                size_t          length,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource *) userdata;
+
+    pa_threaded_mainloop_signal( self->mainloop, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Callback called when the server dropped data of the stream
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: streamOverflowCallback ( pa_stream     * s,
+                                                void          * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource *) userdata;
+
+    // called in the mainloop thread, with the mainloop locked
+    ++self->overflows;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Callback called when waiting for data timed out
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: timeoutCallback (    pa_mainloop_api       * api,
+                                            pa_time_event         * e,
+                                            const struct timeval  * tv,
+                                            void                  * userdata )
+{
+    PulseAudioDspSource   * self = (PulseAudioDspSource *) userdata;
+
+    self->timedOut = true;
+    pa_threaded_mainloop_signal( self->mainloop, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Throw an exception if the stream or the context failed
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: checkState ( void )              throw ( Exception )
+{
+    if ( !PA_CONTEXT_IS_GOOD( pa_context_get_state( context)) ) {
+        throw Exception( __FILE__, __LINE__, "PulseAudio connection failed",
+                         pa_strerror( pa_context_errno( context)));
+    }
+    if ( stream && !PA_STREAM_IS_GOOD( pa_stream_get_state( stream)) ) {
+        throw Exception( __FILE__, __LINE__, "PulseAudio stream failed",
+                         pa_strerror( pa_context_errno( context)));
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Peek the next fragment of audio data, skipping the holes in the stream
+ *----------------------------------------------------------------------------*/
+bool
+PulseAudioDspSource :: peekFragment (   unsigned int    sec,
+                                        unsigned int    usec )
+                                                        throw ( Exception )
+{
+    pa_mainloop_api   * api     = pa_threaded_mainloop_get_api( mainloop);
+    pa_time_event     * timeout = NULL;
+    struct timeval      tv;
+    const void        * data;
+    size_t              size;
+
+    timedOut = false;
+
+    try {
+        while ( !peekLength ) {
+            if ( pa_stream_peek( stream, &data, &size) < 0 ) {
+                throw Exception( __FILE__, __LINE__, "pa_stream_peek failed",
+                                 pa_strerror( pa_context_errno( context)));
+            }
+            if ( size == 0 ) {
+                // nothing has arrived, wait for it until the time is up
+                if ( timedOut || (sec == 0 && usec == 0) ) {
+                    break;
+                }
+                if ( !timeout ) {
+                    pa_gettimeofday( &tv);
+                    pa_timeval_add( &tv, sec * PA_USEC_PER_SEC + usec);
+                    timeout = api->time_new( api, &tv, timeoutCallback, this);
+                }
+                pa_threaded_mainloop_wait( mainloop);
+                checkState();
+                continue;
+            }
+            if ( !data ) {
+                // a hole in the stream, skip it
+                pa_stream_drop( stream);
+                continue;
+            }
+            peekData   = (const char *) data;
+            peekLength = size;
+            peekOffset = 0;
+        }
+    } catch ( Exception & e ) {
+        if ( timeout ) {
+            api->time_free( timeout);
+        }
+        throw;
+    }
+
+    if ( timeout ) {
+        api->time_free( timeout);
+    }
+
+    return peekLength > 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Measure the latency of the source, and report it
+ *----------------------------------------------------------------------------*/
+void
+PulseAudioDspSource :: measureLatency ( void )          throw ()
+{
+    pa_usec_t   usec;
+    int         negative;
+
+    // the timing info is kept up to date by the server, this doesn't block
+    if ( pa_stream_get_latency( stream, &usec, &negative) < 0 ) {
+        return;
+    }
+    latency = negative ? 0 : usec;
+
+    reportEvent( 6, "PulseAudio source latency (us):", latency);
+    if ( peakLatency < latency ) {
+        peakLatency = latency;
+        reportEvent( 4, "PulseAudio source, new latency peak (us):",
+                        peakLatency);
+    }
+}
+
+
 /*------------------------------------------------------------------------------
  *  Open the audio source
  *----------------------------------------------------------------------------*/
 bool
 PulseAudioDspSource :: open ( void )                       throw ( Exception )
 {
-    char         client_name[255];
+    char                    client_name[255];
+    pa_buffer_attr          attr;
+    const pa_buffer_attr  * actual;
+    int                     flags;
+
+    if ( isOpen() ) {
+        return false;
+    }
 
     //to identify each darkice on pulseaudio server
     snprintf(client_name, 255, "darkice-%d", getpid());
 
-    if (!(s = pa_simple_new(NULL, client_name, PA_STREAM_RECORD, sourceName, "darkice record", &ss, NULL, NULL, &error))) {
-        throw Exception( __FILE__, __LINE__, ": pa_simple_new() failed: %s\n", pa_strerror(error));
+    if ( !pa_sample_spec_valid( &ss) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "unsupported sample format for PulseAudio",
+                         getBitsPerSample());
+    }
+
+    if ( !(mainloop = pa_threaded_mainloop_new()) ) {
+        throw Exception( __FILE__, __LINE__, "pa_threaded_mainloop_new failed");
+    }
+    if ( !(context = pa_context_new( pa_threaded_mainloop_get_api( mainloop),
+                                     client_name)) ) {
+        pa_threaded_mainloop_free( mainloop);
+        mainloop = NULL;
+        throw Exception( __FILE__, __LINE__, "pa_context_new failed");
+    }
+    pa_context_set_state_callback( context, contextStateCallback, this);
+
+    pa_threaded_mainloop_lock( mainloop);
+
+    try {
+        if ( pa_context_connect( context, NULL, PA_CONTEXT_NOFLAGS, NULL) < 0
+          || pa_threaded_mainloop_start( mainloop) < 0 ) {
+            throw Exception( __FILE__, __LINE__, "pa_context_connect failed",
+                             pa_strerror( pa_context_errno( context)));
+        }
+
+        // wait for the connection to the server
+        while ( pa_context_get_state( context) != PA_CONTEXT_READY ) {
+            checkState();
+            pa_threaded_mainloop_wait( mainloop);
+        }
+
+        if ( !(stream = pa_stream_new( context, "darkice record", &ss, NULL)) ) {
+            throw Exception( __FILE__, __LINE__, "pa_stream_new failed",
+                             pa_strerror( pa_context_errno( context)));
+        }
+        pa_stream_set_state_callback( stream, streamStateCallback, this);
+        pa_stream_set_read_callback( stream, streamReadCallback, this);
+        pa_stream_set_overflow_callback( stream, streamOverflowCallback, this);
+
+        // (uint32_t) -1 lets the server choose
+        attr.maxlength = maxLength ? pa_usec_to_bytes( maxLength * 1000UL, &ss)
+                                   : (uint32_t) -1;
+        attr.fragsize  = fragSize  ? pa_usec_to_bytes( fragSize * 1000UL, &ss)
+                                   : (uint32_t) -1;
+        attr.tlength   = (uint32_t) -1;
+        attr.prebuf    = (uint32_t) -1;
+        attr.minreq    = (uint32_t) -1;
+
+        flags = PA_STREAM_INTERPOLATE_TIMING | PA_STREAM_AUTO_TIMING_UPDATE;
+        if ( fragSize ) {
+            // make the source run with a latency matching the fragment size
+            flags |= PA_STREAM_ADJUST_LATENCY;
+        }
+
+        if ( pa_stream_connect_record( stream,
+                                       sourceName,
+                                       &attr,
+                                       (pa_stream_flags_t) flags) < 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "pa_stream_connect_record failed",
+                             pa_strerror( pa_context_errno( context)));
+        }
+
+        while ( pa_stream_get_state( stream) != PA_STREAM_READY ) {
+            checkState();
+            pa_threaded_mainloop_wait( mainloop);
+        }
+    } catch ( Exception & e ) {
+        pa_threaded_mainloop_unlock( mainloop);
+        close();
+        throw;
+    }
+
+    if ( (actual = pa_stream_get_buffer_attr( stream)) ) {
+        reportEvent( 3, "PulseAudio fragment size (bytes):", actual->fragsize);
+        reportEvent( 3, "PulseAudio maximum length (bytes):",
+                        actual->maxlength);
     }
 
+    overflows    = 0;
+    latencyBytes = 0;
+    latency      = 0;
+    peakLatency  = 0;
+
+    pa_threaded_mainloop_unlock( mainloop);
+
     return true;
 }
 
@@ -173,17 +472,26 @@ bool
 PulseAudioDspSource :: canRead ( unsigned int    sec,
                            unsigned int    usec )    throw ( Exception )
 {
-//this seems to be a problem. 
-//to explore in the future
-/*    if ( !isOpen() ) {
+    bool                ready;
+
+    if ( !isOpen() ) {
         return false;
     }
-*/
 
-    /*
-     * FIXME How to check if it can read?
-     */
-    return true; // bad!!
+    pa_threaded_mainloop_lock( mainloop);
+
+    try {
+        checkState();
+        // a hole alone is nothing to read, so look past the holes
+        ready = peekFragment( sec, usec);
+    } catch ( Exception & e ) {
+        pa_threaded_mainloop_unlock( mainloop);
+        throw;
+    }
+
+    pa_threaded_mainloop_unlock( mainloop);
+
+    return ready;
 }
 
 
@@ -194,13 +502,61 @@ unsigned int
 PulseAudioDspSource :: read (    void          * buf,
                            unsigned int    len )     throw ( Exception )
 {
-    int ret;
+    unsigned int    frameSize = pa_frame_size( &ss);
+    unsigned int    done      = 0;
+    size_t          size;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    // fragments hold whole frames, so only read whole frames
+    len -= len % frameSize;
+
+    pa_threaded_mainloop_lock( mainloop);
+
+    while ( done < len ) {
+        bool        peeked;
+
+        try {
+            // returning nothing would be taken for the end of the input,
+            // so wait for data while there is none at all
+            peeked = peekLength || peekFragment( done ? 0 : readTimeout, 0);
+        } catch ( Exception & e ) {
+            pa_threaded_mainloop_unlock( mainloop);
+            throw;
+        }
+        if ( !peeked ) {
+            // nothing more has arrived
+            break;
+        }
+
+        size = peekLength - peekOffset;
+        if ( size > len - done ) {
+            size = len - done;
+        }
+        memcpy( (char *) buf + done, peekData + peekOffset, size);
+        done       += size;
+        peekOffset += size;
+
+        if ( peekOffset == peekLength ) {
+            pa_stream_drop( stream);
+            peekData   = NULL;
+            peekLength = 0;
+            peekOffset = 0;
+        }
+    }
 
-    ret = pa_simple_read(s, buf, len, &error);
-    if ( ret < 0) {
-        throw Exception(__FILE__, __LINE__, ": pa_simple_read() failed: %s\n", pa_strerror(error));
+    // measure the latency about once a second
+    latencyBytes += done;
+    if ( latencyBytes >= pa_bytes_per_second( &ss) ) {
+        latencyBytes = 0;
+        measureLatency();
     }
-    return len;
+
+    pa_threaded_mainloop_unlock( mainloop);
+
+    return done;
 }
 
 
@@ -210,11 +566,28 @@ PulseAudioDspSource :: read (    void          * buf,
 void
 PulseAudioDspSource :: close ( void )                  throw ( Exception )
 {
-    if ( !isOpen() ) {
+    if ( !mainloop ) {
         return;
     }
 
-    pa_simple_free(s);
+    pa_threaded_mainloop_stop( mainloop);
+
+    if ( stream ) {
+        pa_stream_disconnect( stream);
+        pa_stream_unref( stream);
+        stream = NULL;
+    }
+    if ( context ) {
+        pa_context_disconnect( context);
+        pa_context_unref( context);
+        context = NULL;
+    }
+
+    pa_threaded_mainloop_free( mainloop);
+    mainloop   = NULL;
+    peekData   = NULL;
+    peekLength = 0;
+    peekOffset = 0;
 }
 
 #endif // HAVE_PULSEAUDIO_LIB
@@ -49,9 +49,7 @@
 
 #ifdef HAVE_PULSEAUDIO_LIB
 
-#include <pulse/simple.h>
-#include <pulse/error.h>
-#include <pulse/gccmacro.h>
+#include <pulse/pulseaudio.h>
 #else
 #error configure for PULSEAUDIO 
 #endif
@@ -63,7 +61,10 @@
 /* =============================================================== data types */
 
 /**
- *  An audio input based on the PULSEAUDIO sound system 
+ *  An audio input based on the PULSEAUDIO sound system.
+ *  Uses the asynchronous API with a threaded mainloop, so that the
+ *  fragment size and the maximum buffer length of the capture stream
+ *  can be set, and data is read as soon as it arrives.
  *
  *  @author  $Author: darkeye $
  *  @version $Revision: 394 $
@@ -78,263 +79,165 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         char *sourceName;
 
         /**
-         *  Handle for PulseAudio 
+         *  The requested fragment size, in milliseconds.
+         *  0 for the server default.
          */
-        pa_simple *s ;
+        unsigned int            fragSize;
+
+        /**
+         *  The requested maximum buffer length, in milliseconds.
+         *  0 for the server default.
+         */
+        unsigned int            maxLength;
+
+        /**
+         *  The mainloop thread, running the callbacks.
+         */
+        pa_threaded_mainloop  * mainloop;
+
+        /**
+         *  The connection to the PulseAudio server.
+         */
+        pa_context            * context;
+
+        /**
+         *  The capture stream.
+         */
+        pa_stream             * stream;
 
         /**
          * format definitions for pulseaudio
           */
         pa_sample_spec ss;
 
-        int error;
-
-    protected:
-
         /**
-         *  Default constructor. Always throws an Exception.
-         *
-         *  @exception Exception
+         *  The fragment of the stream being read, as returned by
+         *  pa_stream_peek().
          */
-        inline
-        PulseAudioDspSource ( void )                       throw ( Exception )
-        {
-            throw Exception( __FILE__, __LINE__);
-        }
+        const char            * peekData;
 
         /**
-         *  Initialize the object
-         *
-         *  @param name the PCM to open.
-         *  @exception Exception
+         *  The size of the fragment being read, 0 if there is none.
          */
-        void
-        init (  const char    * name )              throw ( Exception );
+        size_t                  peekLength;
 
         /**
-         *  De-iitialize the object
-         *
-         *  @exception Exception
+         *  The number of bytes already read of the fragment.
          */
-        void
-        strip ( void )                              throw ( Exception );
+        size_t                  peekOffset;
 
+        /**
+         *  Set when the time to wait for data has elapsed.
+         */
+        bool                    timedOut;
 
-    public:
+        /**
+         *  The number of overflows reported by the server since opening.
+         */
+        unsigned int            overflows;
 
         /**
-         *  Constructor.
-         *
-         *  @param name the PCM (e.g. "hwplug:0,0").
-         *  @param sampleRate samples per second (e.g. 44100 for 44.1kHz).
-         *  @param bitsPerSample bits per sample (e.g. 16 bits).
-         *  @param channel number of channels of the audio source
-         *                 (e.g. 1 for mono, 2 for stereo, etc.).
-         *  @exception Exception
+         *  Bytes read since the latency was last measured.
          */
-        inline
-        PulseAudioDspSource (  const char    * paSourceName,
-                         int             sampleRate    = 44100,
-                         int             bitsPerSample = 16,
-                         int             channel       = 2 )
-                                                        throw ( Exception )
-                    : AudioSource( sampleRate, bitsPerSample, channel)
-        {
-            init( paSourceName);
-        }
+        unsigned long           latencyBytes;
 
         /**
-         *  Copy Constructor.
-         *
-         *  @param ds the object to copy.
-         *  @exception Exception
+         *  The last measured latency of the source, in microseconds.
          */
-        inline
-        PulseAudioDspSource (  const PulseAudioDspSource &    ds )    throw ( Exception )
-                    : AudioSource( ds )
-        {
-            init( ds.sourceName);
-        }
+        pa_usec_t               latency;
 
         /**
-         *  Destructor.
-         *
-         *  @exception Exception
+         *  The highest measured latency since opening, in microseconds.
          */
-        inline virtual
-        ~PulseAudioDspSource ( void )                          throw ( Exception )
-        {
-            strip();
-        }
+        pa_usec_t               peakLatency;
 
         /**
-         *  Assignment operator.
+         *  Callback called when the state of the context changes.
          *
-         *  @param ds the object to assign to this one.
-         *  @return a reference to this object.
-         *  @exception Exception
+         *  @param c the context.
+         *  @param userdata the PulseAudioDspSource.
          */
-        inline virtual PulseAudioDspSource &
-        operator= (     const PulseAudioDspSource &     ds )   throw ( Exception )
-        {
-            if ( this != &ds ) {
-                strip();
-                AudioSource::operator=( ds);
-                init( ds.sourceName);
-            }
-            return *this;
-        }
+        static void
+        contextStateCallback (  pa_context    * c,
+                                void          * userdata );
 
         /**
-         *  Open the PulseAudioDspSource.
+         *  Callback called when the state of the stream changes.
          *
-         *  @return true if opening was successful, false otherwise
-         *  @exception Exception
+         *  @param s the stream.
+         *  @param userdata the PulseAudioDspSource.
          */
-        virtual bool
-        open ( void )                                   throw ( Exception );
+        static void
+        streamStateCallback (   pa_stream     * s,
+                                void          * userdata );
 
         /**
-         *  Check if the PulseAudioDspSource is open.
+         *  Callback called when new data is available on the stream.
          *
-         *  @return true if the PulseAudioDspSource is open, false otherwise.
+         *  @param s the stream.
+         *  @param length the number of bytes available.
+         *  @param userdata the PulseAudioDspSource.
          */
-        inline virtual bool
-        isOpen ( void ) const                           throw ()
-        {
-            return s==NULL;
-        }
+        static void
+        streamReadCallback (    pa_stream     * s,
+                                size_t          length,
+                                void          * userdata );
 
         /**
-         *  Check if the PulseAudioDspSource can be read from.
+         *  Callback called when the server dropped data of the stream.
          *
-         *  @param sec the maximum seconds to block.
-         *  @param usec micro seconds to block after the full seconds.
-         *  @return true if the PulseAudioDspSource is ready to be read from,
-         *          false otherwise.
-         *  @exception Exception
+         *  @param s the stream.
+         *  @param userdata the PulseAudioDspSource.
          */
-        virtual bool
-        canRead (               unsigned int    sec,
-                                unsigned int    usec )  throw ( Exception );
+        static void
+        streamOverflowCallback (    pa_stream     * s,
+                                    void          * userdata );
 
         /**
-         *  Read from the PulseAudioDspSource.
+         *  Callback called when waiting for data timed out.
          *
-         *  @param buf the buffer to read into.
-         *  @param len the number of bytes to read into buf
-         *  @return the number of bytes read (may be less than len).
-         *  @exception Exception
+         *  @param api the mainloop api.
+         *  @param e the time event.
+         *  @param tv the time the event was due.
+         *  @param userdata the PulseAudioDspSource.
          */
-        virtual unsigned int
-        read (                  void          * buf,
-                                unsigned int    len )   throw ( Exception );
+        static void
+        timeoutCallback (       pa_mainloop_api       * api,
+                                pa_time_event         * e,
+                                const struct timeval  * tv,
+                                void                  * userdata );
 
         /**
-         *  Close the PulseAudioDspSource.
+         *  Throw an exception if the stream or the context failed.
+         *  Call with the mainloop locked.
          *
          *  @exception Exception
          */
-        virtual void
-        close ( void )                                  throw ( Exception );
-
-};
-
-/* ================================================= external data structures */
-
-/* ====================================================== function prototypes */
-
-#endif  /* PULSEAUDIO_SOURCE_H */
-/*------------------------------------------------------------------------------
-
-   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
-
-   Copyright (c) 2004 
-   LS Informationstechnik (LIKE)
-   University of Erlangen Nuremberg
-   All rights reserved.
-
-   Tyrell DarkIce
-
-   File     : PulseAudioDspSource.h
-   Version  : $Revision: 394 $
-   Author   : $Author: darkeye $
-   Location : $HeadURL$
-   
-   Copyright notice:
-
-    This program is free software; you can redistribute it and/or
-    modify it under the terms of the GNU General Public License  
-    as published by the Free Software Foundation; either version 2
-    of the License, or (at your option) any later version.
-   
-    This program is distributed in the hope that it will be useful,
-    but WITHOUT ANY WARRANTY; without even the implied warranty of 
-    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
-    GNU General Public License for more details.
-   
-    You should have received a copy of the GNU General Public License
-    along with this program; if not, write to the Free Software
-    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
-
-------------------------------------------------------------------------------*/
-#ifndef PULSEAUDIO_SOURCE_H
-#define PULSEAUDIO_SOURCE_H
-
-#ifndef __cplusplus
-#error This is a C++ include file
-#endif
-
-/* ============================================================ include files */
-
-#ifdef HAVE_CONFIG_H
-#include "config.h"
-#endif
-
-#include "Reporter.h"
-#include "AudioSource.h"
-
-#ifdef HAVE_PULSEAUDIO_LIB
-
-#include <pulse/simple.h>
-#include <pulse/error.h>
-#include <pulse/gccmacro.h>
-#else
-#error configure for PULSEAUDIO 
-#endif
-
-/* ================================================================ constants */
-
-/* =================================================================== macros */
-
-/* =============================================================== data types */
-
-/**
- *  An audio input based on the PULSEAUDIO sound system 
- *
- *  @author  $Author: darkeye $
- *  @version $Revision: 394 $
- */
-class PulseAudioDspSource : public AudioSource, public virtual Reporter
-{
-    private:
+        void
+        checkState ( void )                         throw ( Exception );
 
         /**
-         *  Name of the capture PCM stream.
+         *  Peek the next fragment of audio data, dropping the holes in
+         *  the stream on the way. Wait for data to arrive, if there is
+         *  none yet, for at most the time given.
+         *  Call with the mainloop locked.
+         *
+         *  @param sec the maximum seconds to wait.
+         *  @param usec micro seconds to wait in addition to sec.
+         *  @return true if a fragment of audio data is peeked,
+         *          false if none arrived in time.
+         *  @exception Exception
          */
-        char *sourceName;
+        bool
+        peekFragment (  unsigned int    sec,
+                        unsigned int    usec )      throw ( Exception );
 
         /**
-         *  Handle for PulseAudio 
+         *  Measure the latency of the source, and report it.
+         *  Call with the mainloop locked.
          */
-        pa_simple *s ;
-
-        /**
-         * format definitions for pulseaudio
-          */
-        pa_sample_spec ss;
-
-        int error;
+        void
+        measureLatency ( void )                     throw ();
 
     protected:
 
@@ -353,10 +256,15 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
          *  Initialize the object
          *
          *  @param name the PCM to open.
+         *  @param fragSize the fragment size in milliseconds, 0 for default.
+         *  @param maxLength the maximum buffer length in milliseconds,
+         *                   0 for default.
          *  @exception Exception
          */
         void
-        init (  const char    * name )              throw ( Exception );
+        init (  const char    * name,
+                unsigned int    fragSize,
+                unsigned int    maxLength )         throw ( Exception );
 
         /**
          *  De-iitialize the object
@@ -377,17 +285,24 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
          *  @param bitsPerSample bits per sample (e.g. 16 bits).
          *  @param channel number of channels of the audio source
          *                 (e.g. 1 for mono, 2 for stereo, etc.).
+         *  @param fragSize the fragment size in milliseconds: the server
+         *                  sends data in chunks of this size.
+         *                  0 for the server default.
+         *  @param maxLength the maximum length of the server side buffer
+         *                   in milliseconds. 0 for the server default.
          *  @exception Exception
          */
         inline
         PulseAudioDspSource (  const char    * paSourceName,
                          int             sampleRate    = 44100,
                          int             bitsPerSample = 16,
-                         int             channel       = 2 )
+                         int             channel       = 2,
+                         unsigned int    fragSize      = 0,
+                         unsigned int    maxLength     = 0 )
                                                         throw ( Exception )
                     : AudioSource( sampleRate, bitsPerSample, channel)
         {
-            init( paSourceName);
+            init( paSourceName, fragSize, maxLength);
         }
 
         /**
@@ -400,7 +315,7 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         PulseAudioDspSource (  const PulseAudioDspSource &    ds )    throw ( Exception )
                     : AudioSource( ds )
         {
-            init( ds.sourceName);
+            init( ds.sourceName, ds.fragSize, ds.maxLength);
         }
 
         /**
@@ -427,7 +342,7 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
             if ( this != &ds ) {
                 strip();
                 AudioSource::operator=( ds);
-                init( ds.sourceName);
+                init( ds.sourceName, ds.fragSize, ds.maxLength);
             }
             return *this;
         }
@@ -449,11 +364,12 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         inline virtual bool
         isOpen ( void ) const                           throw ()
         {
-            return s==NULL;
+            return stream != NULL;
         }
 
         /**
          *  Check if the PulseAudioDspSource can be read from.
+         *  Blocks until the specified time for data to be available.
          *
          *  @param sec the maximum seconds to block.
          *  @param usec micro seconds to block after the full seconds.
@@ -467,6 +383,7 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
 
         /**
          *  Read from the PulseAudioDspSource.
+         *  Returns what has arrived so far, without blocking.
          *
          *  @param buf the buffer to read into.
          *  @param len the number of bytes to read into buf
@@ -485,6 +402,40 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
         virtual void
         close ( void )                                  throw ( Exception );
 
+        /**
+         *  Get the number of overflows reported by the server since
+         *  opening, when captured samples were dropped because they
+         *  were not read in time.
+         *
+         *  @return the number of overflows.
+         */
+        inline virtual unsigned int
+        getOverruns ( void ) const                      throw ()
+        {
+            return overflows;
+        }
+
+        /**
+         *  Get the last measured latency of the source.
+         *
+         *  @return the latency in microseconds.
+         */
+        inline unsigned long
+        getLatency ( void ) const                       throw ()
+        {
+            return latency;
+        }
+
+        /**
+         *  Get the highest measured latency of the source since opening.
+         *
+         *  @return the latency in microseconds.
+         */
+        inline unsigned long
+        getPeakLatency ( void ) const                   throw ()
+        {
+            return peakLatency;
+        }
 };
 
 /* ================================================= external data structures */
@@ -492,3 +443,4 @@ class PulseAudioDspSource : public AudioSource, public virtual Reporter
 /* ====================================================== function prototypes */
 
 #endif  /* PULSEAUDIO_SOURCE_H */
+
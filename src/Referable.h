@@ -36,6 +36,10 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
 #include "Exception.h"
 
 
@@ -50,6 +54,9 @@
 /**
  *  Base class for an object for which references can be made
  *  with the reference class Ref.
+ *  The reference count is updated atomically where the compiler
+ *  provides atomic builtins, so Refs to the same object may be
+ *  copied and released from several threads.
  *
  *  usage:
  * 
@@ -72,13 +79,7 @@ class Referable
         /**
          *  Number of references to the object.
          */
-        unsigned int    referenceCount;
-
-        /**
-         *  Maximum number of references before an overflow occurs.
-         */
-        static const
-        unsigned int    maxCount = ~((unsigned int)0);
+        volatile unsigned int   referenceCount;
 
 
     protected:
@@ -115,18 +116,15 @@ class Referable
          *  Increase reference count.
          *
          *  @return the new reference count.
-         *  @exception Exception
          */
         inline unsigned int
-        increaseReferenceCount ( void )                 throw ( Exception )
+        increaseReferenceCount ( void )                 throw ()
         {
-            if ( referenceCount >= maxCount ) {
-                throw Exception( __FILE__,
-                                 __LINE__,
-                                 "reference count overflow",
-                                 referenceCount );
-            }
+#ifdef HAVE_SYNC_BUILTINS
+            return __sync_add_and_fetch( &referenceCount, 1);
+#else
             return ++referenceCount;
+#endif
         }
 
         /**
@@ -138,12 +136,19 @@ class Referable
         inline unsigned int
         decreaseReferenceCount ( void )                 throw ( Exception )
         {
-            if ( referenceCount == 0 ) {
+            unsigned int    count;
+
+#ifdef HAVE_SYNC_BUILTINS
+            count = __sync_sub_and_fetch( &referenceCount, 1);
+#else
+            count = --referenceCount;
+#endif
+            // the count wrapped around, it was 0 before
+            if ( count == ~((unsigned int)0) ) {
                 throw Exception( __FILE__, __LINE__,
-                                 "reference count underflow",
-                                 referenceCount );
+                                 "reference count underflow");
             }
-            return --referenceCount;
+            return count;
         }
 
         /**
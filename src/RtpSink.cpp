@@ -0,0 +1,652 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RtpSink.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STDLIB_H
+#include <stdlib.h>
+#else
+#error need stdlib.h
+#endif
+
+#ifdef HAVE_STDIO_H
+#include <stdio.h>
+#else
+#error need stdio.h
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_SYS_TYPES_H
+#include <sys/types.h>
+#else
+#error need sys/types.h
+#endif
+
+#ifdef HAVE_SYS_SOCKET_H
+#include <sys/socket.h>
+#else
+#error need sys/socket.h
+#endif
+
+#ifdef HAVE_NETINET_IN_H
+#include <netinet/in.h>
+#else
+#error need netinet/in.h
+#endif
+
+#ifdef HAVE_NETDB_H
+#include <netdb.h>
+#else
+#error need netdb.h
+#endif
+
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
+#include <vector>
+
+#include "Exception.h"
+#include "Util.h"
+#include "DnsCache.h"
+#include "RtpSink.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/*------------------------------------------------------------------------------
+ *  The size of the RTP header
+ *----------------------------------------------------------------------------*/
+#define RTP_HEADER_SIZE     12
+
+/*------------------------------------------------------------------------------
+ *  The size of the MPEG audio specific header, RFC 2250 section 3.5
+ *----------------------------------------------------------------------------*/
+#define MPA_HEADER_SIZE     4
+
+/*------------------------------------------------------------------------------
+ *  The static payload types of RFC 3551
+ *----------------------------------------------------------------------------*/
+#define PT_L16_STEREO       10
+#define PT_L16_MONO         11
+#define PT_MPA              14
+#define PT_DYNAMIC          96
+
+/*------------------------------------------------------------------------------
+ *  MPEG audio bitrates in kbps, by version (1 or 2 and 2.5), layer and index
+ *----------------------------------------------------------------------------*/
+static const unsigned int mpegBitrates[2][3][15] = {
+    { { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+      { 0, 32, 48, 56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320, 384 },
+      { 0, 32, 40, 48,  56,  64,  80,  96, 112, 128, 160, 192, 224, 256, 320 }},
+    { { 0, 32, 48, 56,  64,  80,  96, 112, 128, 144, 160, 176, 192, 224, 256 },
+      { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 },
+      { 0,  8, 16, 24,  32,  40,  48,  56,  64,  80,  96, 112, 128, 144, 160 }}
+};
+
+/*------------------------------------------------------------------------------
+ *  MPEG audio sample rates, by version (1, 2, 2.5) and index
+ *----------------------------------------------------------------------------*/
+static const unsigned int mpegSampleRates[3][3] = {
+    { 44100, 48000, 32000 },
+    { 22050, 24000, 16000 },
+    { 11025, 12000,  8000 }
+};
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: init (   const char        * host,
+                    unsigned int        port,
+                    PayloadFormat       format,
+                    unsigned int        packetTime,
+                    unsigned int        ttl,
+                    unsigned int        sampleRate,
+                    unsigned int        channel,
+                    bool                inBigEndian,
+                    const char        * sdpFile )       throw ( Exception )
+{
+    if ( !host ) {
+        throw Exception( __FILE__, __LINE__, "no host");
+    }
+    if ( !port || port > 65535 ) {
+        throw Exception( __FILE__, __LINE__, "bad port", port);
+    }
+    if ( !packetTime ) {
+        throw Exception( __FILE__, __LINE__, "bad packet time", packetTime);
+    }
+    if ( format == l16 && (!sampleRate || !channel) ) {
+        throw Exception( __FILE__, __LINE__,
+                         "L16 needs the sample rate and channels");
+    }
+
+    this->host          = Util::strDup( host);
+    this->port          = port;
+    this->format        = format;
+    this->packetTime    = packetTime;
+    this->ttl           = ttl;
+    this->sampleRate    = sampleRate;
+    this->channel       = channel;
+    this->inBigEndian   = inBigEndian;
+    this->sdpFile       = sdpFile ? Util::strDup( sdpFile) : 0;
+
+    if ( format == mpa ) {
+        payloadType = PT_MPA;
+    } else if ( sampleRate == 44100 && channel == 2 ) {
+        payloadType = PT_L16_STEREO;
+    } else if ( sampleRate == 44100 && channel == 1 ) {
+        payloadType = PT_L16_MONO;
+    } else {
+        payloadType = PT_DYNAMIC;
+    }
+
+    sockfd          = 0;
+    sequence        = 0;
+    timestamp       = 0;
+    tickRemainder   = 0;
+    ssrc            = 0;
+    marker          = true;
+    packetTicks     = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: strip ( void )                       throw ( Exception )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    delete[] host;
+    if ( sdpFile ) {
+        delete[] sdpFile;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the socket
+ *----------------------------------------------------------------------------*/
+bool
+RtpSink :: open ( void )                        throw ( Exception )
+{
+    std::vector<DnsCache::Address>      addresses;
+    const struct sockaddr             * addr;
+    bool                                isMulticast;
+    int                                 hops;
+    unsigned int                        seed;
+
+    if ( isOpen() ) {
+        return false;
+    }
+
+    DnsCache::resolve( host, port, addresses);
+    addr = (const struct sockaddr *) &addresses[0].addr;
+
+    if ( (sockfd = socket( addr->sa_family, SOCK_DGRAM, IPPROTO_UDP)) == -1 ) {
+        sockfd = 0;
+        throw Exception( __FILE__, __LINE__, "socket error", errno);
+    }
+
+    if ( connect( sockfd, addr, addresses[0].len) == -1 ) {
+        ::close( sockfd);
+        sockfd = 0;
+        throw Exception( __FILE__, __LINE__, "connect error", errno);
+    }
+
+    hops = ttl;
+    if ( addr->sa_family == AF_INET6 ) {
+        const struct sockaddr_in6 * addr6 = (const struct sockaddr_in6 *) addr;
+
+        isMulticast = IN6_IS_ADDR_MULTICAST( &addr6->sin6_addr);
+        if ( isMulticast ) {
+            setsockopt( sockfd, IPPROTO_IPV6, IPV6_MULTICAST_HOPS,
+                        &hops, sizeof(hops));
+        }
+    } else {
+        const struct sockaddr_in  * addr4 = (const struct sockaddr_in *) addr;
+
+        isMulticast = IN_MULTICAST( ntohl( addr4->sin_addr.s_addr));
+        if ( isMulticast ) {
+            setsockopt( sockfd, IPPROTO_IP, IP_MULTICAST_TTL,
+                        &hops, sizeof(hops));
+        }
+    }
+
+    // the SSRC, the first sequence number and timestamp should be random
+    seed        = time( 0) ^ (getpid() << 16) ^ (unsigned long) this;
+    ssrc        = (rand_r( &seed) << 16) ^ rand_r( &seed);
+    sequence    = rand_r( &seed);
+    timestamp   = rand_r( &seed);
+    marker      = true;
+
+    pending.clear();
+    packet.clear();
+    packetTicks   = 0;
+    tickRemainder = 0;
+
+    if ( sdpFile ) {
+        writeSdp( addr->sa_family, isMulticast);
+    }
+
+    reportEvent( 4, "RtpSink sending to", host, port);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write the session description
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: writeSdp (   int             family,
+                        bool            isMulticast )   throw ()
+{
+    std::vector<DnsCache::Address>      addresses;
+    char                                addrStr[NI_MAXHOST];
+    const char                        * ipVer;
+    FILE                              * file;
+
+    try {
+        DnsCache::resolve( host, port, addresses);
+    } catch ( Exception & e ) {
+        reportEvent( 2, e);
+        return;
+    }
+    if ( getnameinfo( (const struct sockaddr *) &addresses[0].addr,
+                      addresses[0].len,
+                      addrStr, sizeof(addrStr), 0, 0, NI_NUMERICHOST) ) {
+        reportEvent( 2, "can't write SDP for", host);
+        return;
+    }
+    ipVer = family == AF_INET6 ? "IP6" : "IP4";
+
+    if ( !(file = fopen( sdpFile, "w")) ) {
+        reportEvent( 2, "can't open SDP file", sdpFile, strerror( errno));
+        return;
+    }
+
+    fprintf( file, "v=0\r\n");
+    fprintf( file, "o=- %u 0 IN %s %s\r\n", ssrc, ipVer, addrStr);
+    fprintf( file, "s=DarkIce\r\n");
+    if ( isMulticast && family != AF_INET6 ) {
+        fprintf( file, "c=IN %s %s/%u\r\n", ipVer, addrStr, ttl);
+    } else {
+        fprintf( file, "c=IN %s %s\r\n", ipVer, addrStr);
+    }
+    fprintf( file, "t=0 0\r\n");
+    fprintf( file, "m=audio %u RTP/AVP %u\r\n", port, payloadType);
+    if ( format == mpa ) {
+        fprintf( file, "a=rtpmap:%u MPA/90000\r\n", payloadType);
+    } else {
+        fprintf( file, "a=rtpmap:%u L16/%u/%u\r\n",
+                 payloadType, sampleRate, channel);
+    }
+    fprintf( file, "a=ptime:%u\r\n", packetTime);
+
+    fclose( file);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Parse an MPEG audio frame header
+ *----------------------------------------------------------------------------*/
+bool
+RtpSink :: parseMpegHeader (    const unsigned char   * header,
+                                unsigned int          & length,
+                                unsigned int          & samples,
+                                unsigned int          & rate )  throw ()
+{
+    unsigned int    version;
+    unsigned int    layer;
+    unsigned int    bitrateIndex;
+    unsigned int    rateIndex;
+    unsigned int    padding;
+    unsigned int    bitrate;
+
+    if ( header[0] != 0xff || (header[1] & 0xe0) != 0xe0 ) {
+        return false;
+    }
+
+    // version: 0 - MPEG 1, 1 - MPEG 2, 2 - MPEG 2.5
+    switch ( (header[1] >> 3) & 0x03 ) {
+        case 3:     version = 0;    break;
+        case 2:     version = 1;    break;
+        case 0:     version = 2;    break;
+        default:    return false;
+    }
+    // layer: 0 - layer I, 1 - layer II, 2 - layer III
+    layer = 3 - ((header[1] >> 1) & 0x03);
+    if ( layer > 2 ) {
+        return false;
+    }
+
+    bitrateIndex = header[2] >> 4;
+    rateIndex    = (header[2] >> 2) & 0x03;
+    padding      = (header[2] >> 1) & 0x01;
+    // free format frames have no length in the header, skip them as well
+    if ( bitrateIndex == 0 || bitrateIndex == 15 || rateIndex == 3 ) {
+        return false;
+    }
+
+    bitrate = mpegBitrates[version ? 1 : 0][layer][bitrateIndex] * 1000;
+    rate    = mpegSampleRates[version][rateIndex];
+
+    if ( layer == 0 ) {
+        samples = 384;
+        length  = (12 * bitrate / rate + padding) * 4;
+    } else if ( layer == 2 && version ) {
+        samples = 576;
+        length  = 72 * bitrate / rate + padding;
+    } else {
+        samples = 1152;
+        length  = 144 * bitrate / rate + padding;
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send a packet
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: sendPacket ( const char    * payload,
+                        unsigned int    len,
+                        unsigned int    fragOffset )
+                                                    throw ( Exception )
+{
+    unsigned char       header[RTP_HEADER_SIZE + MPA_HEADER_SIZE];
+    unsigned int        headerLen;
+    struct iovec        iov[2];
+    struct msghdr       msg;
+    int                 ret;
+
+    header[0]  = 0x80;                  // version 2, no padding nor extension
+    header[1]  = (marker ? 0x80 : 0x00) | payloadType;
+    header[2]  = sequence >> 8;
+    header[3]  = sequence;
+    header[4]  = timestamp >> 24;
+    header[5]  = timestamp >> 16;
+    header[6]  = timestamp >> 8;
+    header[7]  = timestamp;
+    header[8]  = ssrc >> 24;
+    header[9]  = ssrc >> 16;
+    header[10] = ssrc >> 8;
+    header[11] = ssrc;
+    headerLen  = RTP_HEADER_SIZE;
+
+    if ( format == mpa ) {
+        header[12] = 0;
+        header[13] = 0;
+        header[14] = fragOffset >> 8;
+        header[15] = fragOffset;
+        headerLen += MPA_HEADER_SIZE;
+    }
+
+    iov[0].iov_base = header;
+    iov[0].iov_len  = headerLen;
+    iov[1].iov_base = (void *) payload;
+    iov[1].iov_len  = len;
+
+    memset( &msg, 0, sizeof(msg));
+    msg.msg_iov    = iov;
+    msg.msg_iovlen = 2;
+
+#ifdef HAVE_MSG_NOSIGNAL
+    ret = sendmsg( sockfd, &msg, MSG_NOSIGNAL);
+#else
+    ret = sendmsg( sockfd, &msg, 0);
+#endif
+
+    // a refused connection is reported for an earlier packet, when no one
+    // is listening on a unicast address. this is not an error for us.
+    if ( ret == -1 && errno != ECONNREFUSED && errno != EAGAIN ) {
+        throw Exception( __FILE__, __LINE__, "sendmsg error", errno);
+    }
+
+    ++sequence;
+    marker = false;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send the collected MPEG frames
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: sendFrames ( void )                  throw ( Exception )
+{
+    if ( packet.empty() ) {
+        return;
+    }
+
+    sendPacket( packet.data(), packet.size(), 0);
+    timestamp   += packetTicks;
+    packetTicks  = 0;
+    packet.clear();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send the whole MPEG frames written so far
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: writeMpa ( void )                    throw ( Exception )
+{
+    const unsigned int      maxLen = maxPayload - MPA_HEADER_SIZE;
+    unsigned int            offset = 0;
+    unsigned int            length;
+    unsigned int            samples;
+    unsigned int            rate;
+    unsigned int            ticks;
+
+    while ( pending.size() - offset >= 4 ) {
+        const unsigned char * frame = (const unsigned char *)
+                                      pending.data() + offset;
+
+        if ( !parseMpegHeader( frame, length, samples, rate) ) {
+            // not at a frame boundary, look for the next one
+            ++offset;
+            continue;
+        }
+        if ( pending.size() - offset < length ) {
+            break;
+        }
+
+        ticks          = samples * 90000 + tickRemainder;
+        tickRemainder  = ticks % rate;
+        ticks         /= rate;
+
+        if ( length > maxLen ) {
+            // a frame larger than a packet, send it in fragments
+            unsigned int    frag;
+
+            sendFrames();
+            for ( frag = 0; frag < length; frag += maxLen ) {
+                sendPacket( (const char *) frame + frag,
+                            length - frag > maxLen ? maxLen : length - frag,
+                            frag);
+            }
+            timestamp += ticks;
+        } else {
+            if ( packet.size() + length > maxLen ) {
+                sendFrames();
+            }
+            packet.append( (const char *) frame, length);
+            packetTicks += ticks;
+            if ( packetTicks >= packetTime * 90 ) {
+                sendFrames();
+            }
+        }
+
+        offset += length;
+    }
+
+    pending.erase( 0, offset);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send the whole packets of PCM samples written so far
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: writeL16 ( void )                    throw ( Exception )
+{
+    unsigned int    samples;
+    unsigned int    len;
+    unsigned int    offset = 0;
+    unsigned int    i;
+
+    samples = sampleRate * packetTime / 1000;
+    if ( samples * 2 * channel > maxPayload ) {
+        samples = maxPayload / (2 * channel);
+    }
+    if ( !samples ) {
+        samples = 1;
+    }
+    len = samples * 2 * channel;
+
+    while ( pending.size() - offset >= len ) {
+        packet.assign( pending, offset, len);
+        if ( !inBigEndian ) {
+            // L16 is in network byte order
+            for ( i = 0; i < len; i += 2 ) {
+                char    c = packet[i];
+                packet[i]     = packet[i + 1];
+                packet[i + 1] = c;
+            }
+        }
+
+        sendPacket( packet.data(), len, 0);
+        timestamp += samples;
+        offset    += len;
+    }
+    packet.clear();
+
+    pending.erase( 0, offset);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data to the sink
+ *----------------------------------------------------------------------------*/
+unsigned int
+RtpSink :: write (  const void    * buf,
+                    unsigned int    len )       throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    pending.append( (const char *) buf, len);
+
+    if ( format == mpa ) {
+        writeMpa();
+    } else {
+        writeL16();
+    }
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Flush the data collected so far
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: flush ( void )                       throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return;
+    }
+
+    if ( format == mpa ) {
+        sendFrames();
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the sink
+ *----------------------------------------------------------------------------*/
+void
+RtpSink :: close ( void )                       throw ( Exception )
+{
+    if ( !isOpen() ) {
+        return;
+    }
+
+    flush();
+    ::close( sockfd);
+    sockfd = 0;
+    pending.clear();
+}
+
@@ -0,0 +1,496 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : RtpSink.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef RTP_SINK_H
+#define RTP_SINK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#include <string>
+
+#include "Reporter.h"
+#include "Sink.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A Sink sending its data as RTP packets over UDP, to a unicast or
+ *  multicast address.
+ *  MPEG audio (mp3, mp2) is sent as described in RFC 2250, with as many
+ *  whole frames in each packet as fit in the packet time, and 16 bit
+ *  PCM is sent as L16, as described in RFC 3551.
+ *  Nothing is retransmitted and nothing waits for the network, so data
+ *  lost is simply lost.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class RtpSink : public Sink, public virtual Reporter
+{
+    public:
+
+        /**
+         *  Type for specifying the payload of the packets.
+         *  - mpa - MPEG audio frames, RFC 2250
+         *  - l16 - 16 bit PCM samples in network byte order, RFC 3551
+         */
+        enum PayloadFormat { mpa, l16 };
+
+
+    private:
+
+        /**
+         *  The host to send the packets to, a unicast or multicast address.
+         */
+        char              * host;
+
+        /**
+         *  The UDP port to send the packets to.
+         */
+        unsigned int        port;
+
+        /**
+         *  The time to live of multicast packets.
+         */
+        unsigned int        ttl;
+
+        /**
+         *  The duration of audio in a packet, in milliseconds.
+         */
+        unsigned int        packetTime;
+
+        /**
+         *  The format of the payload.
+         */
+        PayloadFormat       format;
+
+        /**
+         *  The sample rate of L16 data.
+         */
+        unsigned int        sampleRate;
+
+        /**
+         *  The number of channels of L16 data.
+         */
+        unsigned int        channel;
+
+        /**
+         *  Is the L16 data written to the sink big endian.
+         */
+        bool                inBigEndian;
+
+        /**
+         *  The RTP payload type.
+         */
+        unsigned int        payloadType;
+
+        /**
+         *  File to write a session description to when opening, or NULL.
+         */
+        char              * sdpFile;
+
+        /**
+         *  The UDP socket, 0 if closed.
+         */
+        int                 sockfd;
+
+        /**
+         *  The sequence number of the next packet.
+         */
+        unsigned short      sequence;
+
+        /**
+         *  The RTP timestamp of the next packet.
+         */
+        unsigned int        timestamp;
+
+        /**
+         *  The remainder of converting MPEG frame durations to the
+         *  90 kHz RTP clock, in 1 / sample rate units.
+         */
+        unsigned int        tickRemainder;
+
+        /**
+         *  The synchronization source identifier of the stream.
+         */
+        unsigned int        ssrc;
+
+        /**
+         *  Set the marker bit on the next packet.
+         */
+        bool                marker;
+
+        /**
+         *  Data written but not yet sent.
+         */
+        std::string         pending;
+
+        /**
+         *  The payload of the packet being collected.
+         */
+        std::string         packet;
+
+        /**
+         *  The duration of the MPEG frames in the packet being collected,
+         *  in 90 kHz RTP clock ticks.
+         */
+        unsigned int        packetTicks;
+
+        /**
+         *  The maximum size of the payload of a packet, so that packets
+         *  are not fragmented on an ethernet network.
+         */
+        static const unsigned int   maxPayload = 1400;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param host the host to send the packets to.
+         *  @param port the UDP port to send the packets to.
+         *  @param format the format of the payload.
+         *  @param packetTime the duration of audio in a packet, in ms.
+         *  @param ttl the time to live of multicast packets.
+         *  @param sampleRate the sample rate of L16 data.
+         *  @param channel the number of channels of L16 data.
+         *  @param inBigEndian is the L16 data big endian.
+         *  @param sdpFile file to write a session description to, or NULL.
+         *  @exception Exception
+         */
+        void
+        init (  const char        * host,
+                unsigned int        port,
+                PayloadFormat       format,
+                unsigned int        packetTime,
+                unsigned int        ttl,
+                unsigned int        sampleRate,
+                unsigned int        channel,
+                bool                inBigEndian,
+                const char        * sdpFile )       throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Parse an MPEG audio frame header.
+         *
+         *  @param header the 4 bytes of the frame header.
+         *  @param length the length of the frame in bytes (out parameter).
+         *  @param samples the number of samples in the frame
+         *                 (out parameter).
+         *  @param rate the sample rate of the frame (out parameter).
+         *  @return true if header is a valid frame header,
+         *          false otherwise.
+         */
+        static bool
+        parseMpegHeader (   const unsigned char   * header,
+                            unsigned int          & length,
+                            unsigned int          & samples,
+                            unsigned int          & rate )  throw ();
+
+        /**
+         *  Send a packet.
+         *
+         *  @param payload the payload of the packet.
+         *  @param len the length of the payload.
+         *  @param fragOffset the offset of the payload in the MPEG frame,
+         *                    only used for mpa payloads.
+         *  @exception Exception
+         */
+        void
+        sendPacket (    const char    * payload,
+                        unsigned int    len,
+                        unsigned int    fragOffset )
+                                                    throw ( Exception );
+
+        /**
+         *  Send the MPEG frames collected in packet, and advance the
+         *  timestamp by their duration.
+         *
+         *  @exception Exception
+         */
+        void
+        sendFrames ( void )                         throw ( Exception );
+
+        /**
+         *  Send the whole MPEG frames in pending.
+         *
+         *  @exception Exception
+         */
+        void
+        writeMpa ( void )                           throw ( Exception );
+
+        /**
+         *  Send the whole packets of PCM samples in pending.
+         *
+         *  @exception Exception
+         */
+        void
+        writeL16 ( void )                           throw ( Exception );
+
+        /**
+         *  Write the session description to sdpFile.
+         *
+         *  @param family the address family of host.
+         *  @param isMulticast is host a multicast address.
+         */
+        void
+        writeSdp (      int             family,
+                        bool            isMulticast )   throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        RtpSink ( void )                            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param host the host to send the packets to, a unicast or
+         *              multicast address.
+         *  @param port the UDP port to send the packets to.
+         *  @param format the format of the payload.
+         *  @param packetTime the duration of audio in a packet, in ms.
+         *  @param ttl the time to live of multicast packets.
+         *  @param sampleRate the sample rate of L16 data.
+         *  @param channel the number of channels of L16 data.
+         *  @param inBigEndian is the L16 data big endian.
+         *  @param sdpFile file to write a session description to, or NULL.
+         *  @exception Exception
+         */
+        inline
+        RtpSink (   const char        * host,
+                    unsigned int        port,
+                    PayloadFormat       format,
+                    unsigned int        packetTime  = 20,
+                    unsigned int        ttl         = 1,
+                    unsigned int        sampleRate  = 0,
+                    unsigned int        channel     = 0,
+                    bool                inBigEndian = false,
+                    const char        * sdpFile     = 0 )
+                                                    throw ( Exception )
+        {
+            init( host,
+                  port,
+                  format,
+                  packetTime,
+                  ttl,
+                  sampleRate,
+                  channel,
+                  inBigEndian,
+                  sdpFile);
+        }
+
+        /**
+         *  Copy constructor.
+         *
+         *  @param sink the RtpSink to copy.
+         *  @exception Exception
+         */
+        inline
+        RtpSink (   const RtpSink &     sink )      throw ( Exception )
+                : Sink( sink )
+        {
+            init( sink.host,
+                  sink.port,
+                  sink.format,
+                  sink.packetTime,
+                  sink.ttl,
+                  sink.sampleRate,
+                  sink.channel,
+                  sink.inBigEndian,
+                  sink.sdpFile);
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~RtpSink ( void )                           throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator.
+         *
+         *  @param sink the RtpSink to assign this to.
+         *  @return a reference to this RtpSink.
+         *  @exception Exception
+         */
+        inline virtual RtpSink &
+        operator= ( const RtpSink &     sink )      throw ( Exception )
+        {
+            if ( this != &sink ) {
+                strip();
+                Sink::operator=( sink );
+                init( sink.host,
+                      sink.port,
+                      sink.format,
+                      sink.packetTime,
+                      sink.ttl,
+                      sink.sampleRate,
+                      sink.channel,
+                      sink.inBigEndian,
+                      sink.sdpFile);
+            }
+            return *this;
+        }
+
+        /**
+         *  Open the socket, and write the session description if needed.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                               throw ( Exception );
+
+        /**
+         *  Check if the RtpSink is open.
+         *
+         *  @return true if the RtpSink is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                       throw ()
+        {
+            return sockfd != 0;
+        }
+
+        /**
+         *  Check if the RtpSink is ready to accept data.
+         *  Always true when open, as UDP does not wait for the network.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the RtpSink is open, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (     unsigned int    sec,
+                       unsigned int    usec )       throw ( Exception )
+        {
+            return isOpen();
+        }
+
+        /**
+         *  Write data to the RtpSink. Whole packets are sent right away,
+         *  the rest is kept until more data arrives.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return len
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write (        const void    * buf,
+                       unsigned int    len )        throw ( Exception );
+
+        /**
+         *  Flush all data that was written to the RtpSink.
+         *  Sends the MPEG frames collected so far, even if they don't
+         *  fill a packet time.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        flush ( void )                              throw ( Exception );
+
+        /**
+         *  Cut what the sink has been doing so far, and start anew.
+         *  Nothing to do for an RtpSink.
+         */
+        inline virtual void
+        cut ( void )                                throw ()
+        {
+        }
+
+        /**
+         *  Close the RtpSink.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                              throw ( Exception );
+
+        /**
+         *  Get the RTP payload type used.
+         *
+         *  @return the RTP payload type.
+         */
+        inline unsigned int
+        getPayloadType ( void ) const               throw ()
+        {
+            return payloadType;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* RTP_SINK_H */
+
@@ -88,6 +88,12 @@
 #error need sys/ioctl.h
 #endif
 
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
 #ifdef HAVE_TERMIOS_H
 #include <termios.h>
 #else
@@ -112,9 +118,9 @@ static const char fileid[] = "$Id$";
 
 
 /*------------------------------------------------------------------------------
- *  Ulaw decode table
+ *  Ulaw decode table, to 16 bit samples in the byte order of the host
  *----------------------------------------------------------------------------*/
-static unsigned int ulawdecode[256] =
+static const unsigned short ulawdecode[256] =
 {
     0x8284,0x8684,0x8a84,0x8e84,0x9284,0x9684,0x9a84,0x9e84,
     0xa284,0xa684,0xaa84,0xae84,0xb284,0xb684,0xba84,0xbe84,
@@ -162,7 +168,8 @@ static unsigned int ulawdecode[256] =
 bool
 SerialUlaw :: isBigEndian ( void ) const                  throw ()
 {
-    return false;
+    // the samples are decoded in the byte order of the host
+    return AudioSource::isBigEndian();
 }
 
 
@@ -234,6 +241,10 @@ SerialUlaw :: open ( void )                       throw ( Exception )
     cfsetispeed(&ts, B115200);
     cfmakeraw(&ts);
     ts.c_cflag |= CLOCAL;
+    // return reads in batches: when 255 bytes have arrived, or 0.1 seconds
+    // after the last byte
+    ts.c_cc[VMIN]  = 255;
+    ts.c_cc[VTIME] = 1;
     if(tcsetattr(fileDescriptor, TCSANOW, &ts) < 0) {
         close();
         throw Exception( __FILE__, __LINE__, "can't set tty settings");
@@ -282,36 +293,33 @@ unsigned int
 SerialUlaw :: read (    void          * buf,
                           unsigned int    len )     throw ( Exception )
 {
-    ssize_t         ret;
-    unsigned char    ubuf[256], * ptr;
-    int                i, plen;
+    unsigned short    * out = (unsigned short *) buf;
+    unsigned char     * in;
+    ssize_t             ret;
+    ssize_t             i;
 
     if ( !isOpen() ) {
         return 0;
     }
 
-    ret = 0;
-    ptr = (unsigned char *)buf;
-    while(len > 1) {
-        plen = sizeof(ubuf);
-        if (plen > (int)len/2) {
-            plen = len/2;
-        }
-        plen = ::read( fileDescriptor, ubuf, plen);
-        if(plen < 0) {
-            perror("read");
-            throw Exception( __FILE__, __LINE__, "read error");
-        }
-        for(i = 0 ; i != plen ; i++) {
-            *ptr++ = ulawdecode[ubuf[i]] & 0xFF;
-            *ptr++ = ulawdecode[ubuf[i]] >> 8;
-        }
-        len -= plen*2;
-        ret += plen*2;
+    // read the ulaw bytes into the second half of buf, and decode them
+    // in place: sample i is written at bytes 2i and 2i+1, which is never
+    // beyond byte i of the second half, so no byte is overwritten unread
+    len /= 2;
+    in   = (unsigned char *) buf + len;
+
+    // VMIN and VTIME make this return a batch of bytes at once
+    ret = ::read( fileDescriptor, in, len);
+    if ( ret < 0 ) {
+        throw Exception( __FILE__, __LINE__, "read error", errno);
+    }
+
+    for ( i = 0; i < ret; ++i ) {
+        out[i] = ulawdecode[in[i]];
     }
 
     running = true;
-    return ret;
+    return ret * 2;
 }
 
 
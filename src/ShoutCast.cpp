@@ -78,8 +78,46 @@ static const char fileid[] = "$Id$";
 #define STRBUF_SIZE         32
 #define HEADERLINE_LENGTH     50
 
+/*------------------------------------------------------------------------------
+ *  The SHOUTcast 2 (Ultravox 2.1) uplink: the message framing
+ *----------------------------------------------------------------------------*/
+#define UV_SYNC                 0x5a
+#define UV_HEADER_SIZE          6
+#define UV_MAX_PAYLOAD          16377
+
+/*------------------------------------------------------------------------------
+ *  The SHOUTcast 2 (Ultravox 2.1) uplink: the message types used
+ *----------------------------------------------------------------------------*/
+#define UV_AUTHENTICATE         0x1001
+#define UV_BROADCAST_SETUP      0x1002
+#define UV_NEGOTIATE_BUFFER     0x1003
+#define UV_STANDBY              0x1004
+#define UV_MAX_PAYLOAD_SIZE     0x1008
+#define UV_CIPHER_KEY           0x1009
+#define UV_MIME_TYPE            0x1040
+#define UV_ICY_NAME             0x1100
+#define UV_ICY_GENRE            0x1101
+#define UV_ICY_URL              0x1102
+#define UV_ICY_PUB              0x1103
+#define UV_XML_METADATA         0x3902
+#define UV_MP3_DATA             0x7000
+
 /* ===============================================  local function prototypes */
 
+/*------------------------------------------------------------------------------
+ *  Encrypt a string with XTEA, as SHOUTcast 2 expects the user name
+ *  and password, hex encoded
+ *----------------------------------------------------------------------------*/
+static std::string
+xteaEncrypt (   const std::string     & key,
+                const char            * text )          throw ();
+
+/*------------------------------------------------------------------------------
+ *  Escape a string for XML
+ *----------------------------------------------------------------------------*/
+static std::string
+xmlEscape ( const char    * str )                       throw ();
+
 
 /* =============================================================  module code */
 
@@ -97,6 +135,10 @@ ShoutCast :: init ( const char            * irc,
     this->aim    = aim   ? Util::strDup( aim) : 0;
     this->icq    = icq   ? Util::strDup( icq) : 0;
     this->mountPoint = mountPoint ? Util::strDup( mountPoint ) : 0;
+    this->protocol   = 1;
+    this->streamId   = 1;
+    this->user       = 0;
+    this->pendingOffset = 0;
 }
 
 
@@ -118,6 +160,31 @@ ShoutCast :: strip ( void )                             throw ( Exception )
     if (mountPoint ){
         delete[] mountPoint;
     }
+    if ( user ) {
+        delete[] user;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the uplink protocol
+ *----------------------------------------------------------------------------*/
+void
+ShoutCast :: setProtocol (  unsigned int        protocol,
+                            unsigned int        streamId,
+                            const char        * user )  throw ( Exception )
+{
+    if ( protocol != 1 && protocol != 2 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "unsupported ShoutCast protocol version", protocol);
+    }
+
+    if ( this->user ) {
+        delete[] this->user;
+    }
+    this->protocol = protocol;
+    this->streamId = streamId;
+    this->user     = user ? Util::strDup( user) : 0;
 }
 
 
@@ -125,10 +192,10 @@ ShoutCast :: strip ( void )                             throw ( Exception )
  *  Log in to the ShoutCast server using the icy login scheme
  *----------------------------------------------------------------------------*/
 bool
-ShoutCast :: sendLogin ( void )                           throw ( Exception )
+ShoutCast :: sendLogin ( TcpSocket     * socket )            throw ( Exception )
 {
-    Sink          * sink   = getSink();
-    Source        * source = getSocket();
+    Sink          * sink   = socket;
+    Source        * source = socket;
     const char    * str;
     char            resp[STRBUF_SIZE];
     unsigned int    len;
@@ -143,6 +210,10 @@ ShoutCast :: sendLogin ( void )                           throw ( Exception )
         return false;
     }
 
+    if ( protocol == 2 ) {
+        return sendLoginV2( socket);
+    }
+
     // We will add SOURCE only if really needed: if the mountPoint is not null
     // and is different of "/". This is to keep maximum compatibility with
     // NullSoft Shoutcast server.
@@ -251,3 +322,366 @@ ShoutCast :: sendLogin ( void )                           throw ( Exception )
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Encrypt a string with XTEA
+ *----------------------------------------------------------------------------*/
+static std::string
+xteaEncrypt (   const std::string     & key,
+                const char            * text )          throw ()
+{
+    unsigned char   keyBytes[16];
+    unsigned int    k[4];
+    unsigned int    len = strlen( text);
+    unsigned int    i;
+    unsigned int    j;
+    char            hex[STRBUF_SIZE];
+    std::string     result;
+
+    // the key is the cipher sent by the server, padded with zeros
+    memset( keyBytes, 0, sizeof(keyBytes));
+    memcpy( keyBytes, key.data(), key.size() < 16 ? key.size() : 16);
+    for ( i = 0; i < 4; ++i ) {
+        k[i] = (keyBytes[4*i] << 24) | (keyBytes[4*i + 1] << 16)
+             | (keyBytes[4*i + 2] << 8) | keyBytes[4*i + 3];
+    }
+
+    for ( i = 0; i < len; i += 8 ) {
+        unsigned char   block[8];
+        unsigned int    v0;
+        unsigned int    v1;
+        unsigned int    sum = 0;
+
+        memset( block, 0, sizeof(block));
+        memcpy( block, text + i, len - i < 8 ? len - i : 8);
+        v0 = (block[0] << 24) | (block[1] << 16) | (block[2] << 8) | block[3];
+        v1 = (block[4] << 24) | (block[5] << 16) | (block[6] << 8) | block[7];
+
+        for ( j = 0; j < 32; ++j ) {
+            v0  += (((v1 << 4) ^ (v1 >> 5)) + v1) ^ (sum + k[sum & 3]);
+            sum += 0x9e3779b9;
+            v1  += (((v0 << 4) ^ (v0 >> 5)) + v0) ^ (sum + k[(sum >> 11) & 3]);
+        }
+
+        snprintf( hex, sizeof(hex), "%08x%08x", v0, v1);
+        result += hex;
+    }
+
+    return result;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Escape a string for XML
+ *----------------------------------------------------------------------------*/
+static std::string
+xmlEscape ( const char    * str )                       throw ()
+{
+    std::string     result;
+
+    for ( ; str && *str; ++str ) {
+        switch ( *str ) {
+            case '&':   result += "&amp;";  break;
+            case '<':   result += "&lt;";   break;
+            case '>':   result += "&gt;";   break;
+            case '"':   result += "&quot;"; break;
+            case '\'':  result += "&apos;"; break;
+            default:    result += *str;     break;
+        }
+    }
+
+    return result;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Build a SHOUTcast 2 message
+ *----------------------------------------------------------------------------*/
+void
+ShoutCast :: buildMessage ( unsigned int        type,
+                            const void        * payload,
+                            unsigned int        len,
+                            std::string       & message )   throw ()
+{
+    char        header[UV_HEADER_SIZE];
+
+    header[0] = UV_SYNC;
+    header[1] = 0;                      // no QoS flags
+    header[2] = type >> 8;
+    header[3] = type;
+    header[4] = len >> 8;
+    header[5] = len;
+
+    message.assign( header, UV_HEADER_SIZE);
+    message.append( (const char *) payload, len);
+    message += '\0';
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read a message from a SHOUTcast 2 server
+ *----------------------------------------------------------------------------*/
+bool
+ShoutCast :: readMessage (  TcpSocket             * socket,
+                            unsigned int          & type,
+                            std::string           & payload )
+                                                    throw ( Exception )
+{
+    char            buf[STRBUF_SIZE];
+    std::string     message;
+    unsigned int    size = UV_HEADER_SIZE;
+    unsigned int    len;
+
+    while ( message.size() < size ) {
+        if ( !socket->canRead( socket->getConnectTimeout(), 0) ) {
+            reportEvent( 3, "ShoutCast - no reply from server");
+            return false;
+        }
+        len = size - message.size();
+        len = socket->read( buf, len < STRBUF_SIZE ? len : STRBUF_SIZE);
+        if ( len == 0 ) {
+            return false;
+        }
+        message.append( buf, len);
+
+        if ( message.size() == UV_HEADER_SIZE && size == UV_HEADER_SIZE ) {
+            if ( (unsigned char) message[0] != UV_SYNC ) {
+                reportEvent( 2, "ShoutCast - server does not speak protocol 2");
+                return false;
+            }
+            // the payload, and the terminating zero
+            size += (((unsigned char) message[4] << 8)
+                   | (unsigned char) message[5]) + 1;
+        }
+    }
+
+    type = ((unsigned char) message[2] << 8) | (unsigned char) message[3];
+    payload.assign( message, UV_HEADER_SIZE, size - UV_HEADER_SIZE - 1);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send a message to a SHOUTcast 2 server, and read the reply
+ *----------------------------------------------------------------------------*/
+bool
+ShoutCast :: sendCommand (  TcpSocket             * socket,
+                            unsigned int            type,
+                            const std::string     & payload,
+                            std::string           & reply )
+                                                    throw ( Exception )
+{
+    std::string     message;
+    unsigned int    replyType;
+    unsigned int    sent = 0;
+
+    buildMessage( type, payload.data(), payload.size(), message);
+    while ( sent < message.size() ) {
+        if ( !socket->canWrite( socket->getConnectTimeout(), 0) ) {
+            return false;
+        }
+        sent += socket->write( message.data() + sent, message.size() - sent);
+    }
+
+    if ( !readMessage( socket, replyType, reply) ) {
+        return false;
+    }
+    reportEvent( 8, "ShoutCast - server reply:", reply);
+
+    return replyType == type && reply.compare( 0, 3, "ACK") == 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Log in to a SHOUTcast 2 server
+ *----------------------------------------------------------------------------*/
+bool
+ShoutCast :: sendLoginV2 (  TcpSocket             * socket )
+                                                    throw ( Exception )
+{
+    std::ostringstream  os;
+    std::string         reply;
+    std::string         cipher;
+    std::string         xml;
+    std::string         metadata;
+    std::string         message;
+    unsigned int        sent = 0;
+    const char          metaHeader[6] = { 0, 1, 0, 1, 0, 1 };
+
+    if ( !sendCommand( socket, UV_CIPHER_KEY, "2.1", reply) ) {
+        return false;
+    }
+    // the reply is ACK:<cipher key>
+    cipher = reply.size() > 4 ? reply.substr( 4) : "";
+
+    os << "2.1:" << streamId << ":"
+       << xteaEncrypt( cipher, user ? user : "") << ":"
+       << xteaEncrypt( cipher, getPassword());
+    if ( !sendCommand( socket, UV_AUTHENTICATE, os.str(), reply) ) {
+        if ( reply.compare( 0, 3, "NAK") == 0 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "ShoutCast - login refused:", reply.c_str());
+        }
+        return false;
+    }
+
+    if ( !sendCommand( socket, UV_MIME_TYPE, "audio/mpeg", reply) ) {
+        return false;
+    }
+
+    os.str( "");
+    os << getBitRate() * 1000 << ":" << getBitRate() * 1000;
+    if ( !sendCommand( socket, UV_BROADCAST_SETUP, os.str(), reply) ) {
+        return false;
+    }
+
+    // buffer size in kilobytes: desired and minimum
+    os.str( "");
+    os << (getBitRate() * 1000 / 8 * 2 + 1023) / 1024 << ":0";
+    if ( !sendCommand( socket, UV_NEGOTIATE_BUFFER, os.str(), reply) ) {
+        return false;
+    }
+
+    os.str( "");
+    os << UV_MAX_PAYLOAD << ":0";
+    if ( !sendCommand( socket, UV_MAX_PAYLOAD_SIZE, os.str(), reply) ) {
+        return false;
+    }
+
+    if ( getName()
+      && !sendCommand( socket, UV_ICY_NAME, getName(), reply) ) {
+        return false;
+    }
+    if ( getGenre()
+      && !sendCommand( socket, UV_ICY_GENRE, getGenre(), reply) ) {
+        return false;
+    }
+    if ( getUrl()
+      && !sendCommand( socket, UV_ICY_URL, getUrl(), reply) ) {
+        return false;
+    }
+    if ( !sendCommand( socket, UV_ICY_PUB, getIsPublic() ? "1" : "0",
+                       reply) ) {
+        return false;
+    }
+
+    if ( !sendCommand( socket, UV_STANDBY, "", reply) ) {
+        return false;
+    }
+
+    // the title of the stream, as metadata in a single part:
+    // metadata id 1, span 1, index 1
+    if ( getName() ) {
+        xml  = "<?xml version=\"1.0\" encoding=\"UTF-8\" ?><metadata><TIT2>";
+        xml += xmlEscape( getName());
+        xml += "</TIT2></metadata>";
+        if ( xml.size() + sizeof(metaHeader) <= UV_MAX_PAYLOAD ) {
+            metadata.assign( metaHeader, sizeof(metaHeader));
+            metadata += xml;
+            buildMessage( UV_XML_METADATA, metadata.data(), metadata.size(),
+                          message);
+            while ( sent < message.size() ) {
+                sent += socket->write( message.data() + sent,
+                                       message.size() - sent);
+            }
+        }
+    }
+
+    reportEvent( 4, "ShoutCast - logged in to stream id", streamId);
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send what is left of the pending message
+ *----------------------------------------------------------------------------*/
+bool
+ShoutCast :: sendPending ( void )                   throw ( Exception )
+{
+    if ( pendingOffset == pending.size() ) {
+        return true;
+    }
+
+    try {
+        pendingOffset += getSink()->write( pending.data() + pendingOffset,
+                                           pending.size() - pendingOffset);
+    } catch ( Exception     & e ) {
+        // a message cut in half can't be finished on another connection,
+        // be it the standby server or a reconnect
+        pending.clear();
+        pendingOffset = 0;
+        if ( !failover() ) {
+            throw;
+        }
+        return false;
+    }
+
+    return pendingOffset == pending.size();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data to the server
+ *----------------------------------------------------------------------------*/
+unsigned int
+ShoutCast :: write (    const void    * buf,
+                        unsigned int    len )       throw ( Exception )
+{
+    if ( protocol != 2 ) {
+        return CastSink::write( buf, len);
+    }
+
+    if ( !sendPending() ) {
+        return 0;
+    }
+
+    if ( len > UV_MAX_PAYLOAD ) {
+        len = UV_MAX_PAYLOAD;
+    }
+    if ( getStreamDump() ) {
+        getStreamDump()->write( buf, len);
+    }
+
+    buildMessage( UV_MP3_DATA, buf, len, pending);
+    pendingOffset = 0;
+    sendPending();
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data from several buffers to the server
+ *----------------------------------------------------------------------------*/
+unsigned int
+ShoutCast :: writev (   const struct iovec    * iov,
+                        unsigned int            iovcnt )
+                                                    throw ( Exception )
+{
+    if ( protocol != 2 ) {
+        return CastSink::writev( iov, iovcnt);
+    }
+
+    // one message for each buffer, through write()
+    return Sink::writev( iov, iovcnt);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Flush the data written to the server
+ *----------------------------------------------------------------------------*/
+void
+ShoutCast :: flush ( void )                         throw ( Exception )
+{
+    if ( protocol == 2 ) {
+        while ( isOpen() && !sendPending() ) {
+            if ( !getSink()->canWrite( 1, 0) ) {
+                break;
+            }
+        }
+    }
+
+    CastSink::flush();
+}
+
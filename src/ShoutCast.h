@@ -36,6 +36,8 @@
 
 /* ============================================================ include files */
 
+#include <string>
+
 #include "Sink.h"
 #include "TcpSocket.h"
 #include "CastSink.h"
@@ -51,7 +53,7 @@
 
 /**
  *  Class representing output to a ShoutCast server with
- *  icy login
+ *  icy login, or with the framed Ultravox 2.1 uplink of SHOUTcast 2
  *
  *  @author  $Author$
  *  @version $Revision$
@@ -80,6 +82,31 @@ class ShoutCast : public CastSink
          */
         char              * mountPoint;
 
+        /**
+         *  The version of the uplink protocol, 1 or 2.
+         */
+        unsigned int        protocol;
+
+        /**
+         *  The stream id on a SHOUTcast 2 server.
+         */
+        unsigned int        streamId;
+
+        /**
+         *  The user name on a SHOUTcast 2 server, or NULL.
+         */
+        char              * user;
+
+        /**
+         *  The message being sent to a SHOUTcast 2 server.
+         */
+        std::string         pending;
+
+        /**
+         *  The bytes of the pending message already sent.
+         */
+        unsigned int        pendingOffset;
+
         /**
          *  Initalize the object.
          *
@@ -96,6 +123,76 @@ class ShoutCast : public CastSink
                 const char            * mountPoint )
                                                     throw ( Exception );
 
+        /**
+         *  Build a SHOUTcast 2 (Ultravox 2.1) message.
+         *
+         *  @param type the class and type of the message.
+         *  @param payload the payload of the message.
+         *  @param len the length of the payload.
+         *  @param message the message (out parameter).
+         */
+        static void
+        buildMessage (  unsigned int        type,
+                        const void        * payload,
+                        unsigned int        len,
+                        std::string       & message )   throw ();
+
+        /**
+         *  Send a message to a SHOUTcast 2 server, and read the reply.
+         *  Used while logging in.
+         *
+         *  @param socket the connection to the server.
+         *  @param type the class and type of the message.
+         *  @param payload the payload of the message.
+         *  @param reply the payload of the reply (out parameter).
+         *  @return true if the server acknowledged the message,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        bool
+        sendCommand (   TcpSocket             * socket,
+                        unsigned int            type,
+                        const std::string     & payload,
+                        std::string           & reply )
+                                                    throw ( Exception );
+
+        /**
+         *  Read a message from a SHOUTcast 2 server.
+         *
+         *  @param socket the connection to the server.
+         *  @param type the class and type of the message (out parameter).
+         *  @param payload the payload of the message (out parameter).
+         *  @return true if a message was read, false on timeout or
+         *          if the connection is not a SHOUTcast 2 uplink.
+         *  @exception Exception
+         */
+        bool
+        readMessage (   TcpSocket             * socket,
+                        unsigned int          & type,
+                        std::string           & payload )
+                                                    throw ( Exception );
+
+        /**
+         *  Log in to a SHOUTcast 2 server.
+         *
+         *  @param socket the connection to the server, already open.
+         *  @return true if login was successful, false otherwise.
+         *  @exception Exception
+         */
+        bool
+        sendLoginV2 (   TcpSocket             * socket )
+                                                    throw ( Exception );
+
+        /**
+         *  Send what is left of the pending message.
+         *
+         *  @return true if the whole message has been sent,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        bool
+        sendPending ( void )                        throw ( Exception );
+
         /**
          *  De-initalize the object.
          *
@@ -119,13 +216,14 @@ class ShoutCast : public CastSink
         }
 
         /**
-         *  Log in to the server using the socket avialable.
+         *  Log in to a server.
          *
+         *  @param socket the connection to the server, already open.
          *  @return true if login was successful, false otherwise.
          *  @exception Exception
          */
         virtual bool
-        sendLogin ( void )              throw ( Exception );
+        sendLogin ( TcpSocket     * socket )    throw ( Exception );
 
 
     public:
@@ -186,6 +284,7 @@ class ShoutCast : public CastSink
                 : CastSink( cs )
         {
             init( cs.getIrc(), cs.getAim(), cs.getIcq(), cs.getMountPoint());
+            setProtocol( cs.getProtocol(), cs.getStreamId(), cs.getUser());
         }
 
         /**
@@ -213,6 +312,7 @@ class ShoutCast : public CastSink
                 strip();
                 CastSink::operator=( cs );
                 init( cs.getIrc(), cs.getAim(), cs.getIcq(), getMountPoint());
+                setProtocol( cs.getProtocol(), cs.getStreamId(), cs.getUser());
             }
             return *this;
         }
@@ -265,6 +365,90 @@ class ShoutCast : public CastSink
             return icq;
         }
 
+        /**
+         *  Set the uplink protocol to use.
+         *  Version 1 is the password line of SHOUTcast 1. Version 2 is
+         *  the framed Ultravox 2.1 uplink of SHOUTcast 2, where the
+         *  server holds several streams, identified by their stream id.
+         *
+         *  @param protocol the version of the uplink protocol, 1 or 2.
+         *  @param streamId the stream id on a SHOUTcast 2 server.
+         *  @param user the user name on a SHOUTcast 2 server, or NULL.
+         *  @exception Exception
+         */
+        void
+        setProtocol (   unsigned int        protocol,
+                        unsigned int        streamId,
+                        const char        * user )  throw ( Exception );
+
+        /**
+         *  Get the version of the uplink protocol.
+         *
+         *  @return the version of the uplink protocol, 1 or 2.
+         */
+        inline unsigned int
+        getProtocol ( void ) const              throw ()
+        {
+            return protocol;
+        }
+
+        /**
+         *  Get the stream id on a SHOUTcast 2 server.
+         *
+         *  @return the stream id.
+         */
+        inline unsigned int
+        getStreamId ( void ) const              throw ()
+        {
+            return streamId;
+        }
+
+        /**
+         *  Get the user name on a SHOUTcast 2 server.
+         *
+         *  @return the user name, or NULL.
+         */
+        inline const char *
+        getUser ( void ) const                  throw ()
+        {
+            return user;
+        }
+
+        /**
+         *  Write data to the server. With the SHOUTcast 2 uplink,
+         *  the data is sent in messages, and a message is always
+         *  sent whole.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write (         const void    * buf,
+                        unsigned int    len )       throw ( Exception );
+
+        /**
+         *  Write data from several buffers to the server.
+         *
+         *  @param iov the buffers to write.
+         *  @param iovcnt the number of buffers in iov.
+         *  @return the number of bytes written.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writev (        const struct iovec    * iov,
+                        unsigned int            iovcnt )
+                                                    throw ( Exception );
+
+        /**
+         *  Flush all data that was written to the server.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        flush ( void )                              throw ( Exception );
+
 };
 
 
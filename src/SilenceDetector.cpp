@@ -0,0 +1,172 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SilenceDetector.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_MATH_H
+#include <math.h>
+#else
+#error need math.h
+#endif
+
+#include "Exception.h"
+#include "SilenceDetector.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+SilenceDetector :: init (   AudioSource   * source,
+                            double          threshold,
+                            double          duration )  throw ( Exception )
+{
+    if ( getBitsPerSample() != 8 && getBitsPerSample() != 16 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "silence detection supports 8 and 16 bit samples only",
+                         getBitsPerSample());
+    }
+    if ( duration <= 0.0 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "silence duration has to be positive");
+    }
+
+    this->source       = source;
+    this->threshold    = (unsigned int) ((1 << (getBitsPerSample() - 1))
+                                         * pow( 10.0, threshold / 20.0));
+    this->duration     = (unsigned long) (duration * getSampleRate());
+    this->silentFrames = 0;
+    this->silent       = false;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the underlying source
+ *----------------------------------------------------------------------------*/
+bool
+SilenceDetector :: open ( void )                        throw ( Exception )
+{
+    silentFrames = 0;
+    silent       = false;
+
+    return source->open();
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Get the peak level of a block of samples.
+ *  The loops are kept simple, so that the compiler vectorizes them.
+ *----------------------------------------------------------------------------*/
+unsigned int
+SilenceDetector :: peak (   const void    * buf,
+                            unsigned int    len ) const     throw ()
+{
+    int             max = 0;
+    unsigned int    i;
+
+    if ( getBitsPerSample() == 8 ) {
+        const unsigned char   * s = (const unsigned char *) buf;
+
+        // 8 bit samples are unsigned
+        for ( i = 0; i < len; ++i ) {
+            int     v = s[i] - 128;
+
+            v   = v < 0 ? -v : v;
+            max = v > max ? v : max;
+        }
+    } else {
+        const short           * s = (const short *) buf;
+
+        len /= 2;
+        for ( i = 0; i < len; ++i ) {
+            int     v = s[i];
+
+            v   = v < 0 ? -v : v;
+            max = v > max ? v : max;
+        }
+    }
+
+    return max;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Read from the underlying source, and measure the level
+ *----------------------------------------------------------------------------*/
+unsigned int
+SilenceDetector :: read (   void          * buf,
+                            unsigned int    len )       throw ( Exception )
+{
+    unsigned int    ret;
+
+    ret = source->read( buf, len);
+    if ( ret == 0 ) {
+        return 0;
+    }
+
+    if ( peak( buf, ret) > threshold ) {
+        if ( silent ) {
+            reportEvent( 2, "audio is back after seconds of silence:",
+                         silentFrames / getSampleRate());
+        }
+        silentFrames = 0;
+        silent       = false;
+        return ret;
+    }
+
+    silentFrames += ret / (getChannel() * getBitsPerSample() / 8);
+    if ( !silent && silentFrames >= duration ) {
+        reportEvent( 2, "input silent for seconds:",
+                     silentFrames / getSampleRate());
+        silent = true;
+    }
+
+    return ret;
+}
+
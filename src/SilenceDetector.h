@@ -0,0 +1,302 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SilenceDetector.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef SILENCE_DETECTOR_H
+#define SILENCE_DETECTOR_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Ref.h"
+#include "Reporter.h"
+#include "AudioSource.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  An audio source telling when another audio source has been silent
+ *  for a while. The peak level of each block read from the underlying
+ *  source is compared to a threshold. Once the level stayed below the
+ *  threshold for the given duration, the source counts as silent, until
+ *  the first block above the threshold.
+ *
+ *  The samples are passed on unchanged. Only 8 and 16 bit samples are
+ *  supported.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class SilenceDetector : public AudioSource, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The source whose level is watched.
+         */
+        Ref<AudioSource>        source;
+
+        /**
+         *  The peak sample value at or below which a block is silent,
+         *  as an offset from the zero level.
+         */
+        unsigned int            threshold;
+
+        /**
+         *  The number of silent frames after which the source is silent.
+         */
+        unsigned long           duration;
+
+        /**
+         *  The number of silent frames read since the last loud block.
+         */
+        unsigned long           silentFrames;
+
+        /**
+         *  Tells if the source has been silent for duration.
+         */
+        volatile bool           silent;
+
+        /**
+         *  Initialize the object
+         *
+         *  @param source the source to watch.
+         *  @param threshold the level below which the source is silent,
+         *                   in dB relative to full scale.
+         *  @param duration the seconds the source has to stay below the
+         *                  threshold to be silent.
+         *  @exception Exception
+         */
+        void
+        init (  AudioSource   * source,
+                double          threshold,
+                double          duration )          throw ( Exception );
+
+        /**
+         *  Get the peak level of a block of samples.
+         *
+         *  @param buf the samples.
+         *  @param len the number of bytes in buf.
+         *  @return the largest distance of a sample from the zero level.
+         */
+        unsigned int
+        peak (  const void    * buf,
+                unsigned int    len ) const         throw ();
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        SilenceDetector ( void )                        throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param source the source to watch, with 8 or 16 bit samples.
+         *  @param threshold the level below which the source is silent,
+         *                   in dB relative to full scale (e.g. -60).
+         *  @param duration the seconds the source has to stay below the
+         *                  threshold to be silent.
+         *  @exception Exception
+         */
+        inline
+        SilenceDetector (   AudioSource   * source,
+                            double          threshold,
+                            double          duration )  throw ( Exception )
+                    : AudioSource( source->getSampleRate(),
+                                   source->getBitsPerSample(),
+                                   source->getChannel() )
+        {
+            init( source, threshold, duration);
+        }
+
+        /**
+         *  Copy Constructor.
+         *
+         *  @param sd the object to copy.
+         *  @exception Exception
+         */
+        inline
+        SilenceDetector (   const SilenceDetector &   sd )  throw ( Exception )
+                    : AudioSource( sd )
+        {
+            throw Exception( __FILE__, __LINE__,
+                             "SilenceDetector doesn't copy");
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~SilenceDetector ( void )                       throw ( Exception )
+        {
+        }
+
+        /**
+         *  Assignment operator.
+         *
+         *  @param sd the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual SilenceDetector &
+        operator= (     const SilenceDetector &     sd )    throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__,
+                             "SilenceDetector doesn't assign");
+        }
+
+        /**
+         *  Tell if the data from the underlying source comes in big or
+         *  little endian.
+         *
+         *  @return true if the source is big endian, false otherwise
+         */
+        inline virtual bool
+        isBigEndian ( void ) const                      throw ()
+        {
+            return source->isBigEndian();
+        }
+
+        /**
+         *  Open the underlying source, which is not silent until
+         *  measured so.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                                   throw ( Exception );
+
+        /**
+         *  Check if the SilenceDetector is open.
+         *
+         *  @return true if the underlying source is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return source->isOpen();
+        }
+
+        /**
+         *  Check if the SilenceDetector can be read from.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the underlying source can be read from,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canRead (               unsigned int    sec,
+                                unsigned int    usec )  throw ( Exception )
+        {
+            return source->canRead( sec, usec);
+        }
+
+        /**
+         *  Read from the underlying source, and measure the level.
+         *
+         *  @param buf the buffer to read into.
+         *  @param len the number of bytes to read into buf
+         *  @return the number of bytes read (may be less than len).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        read (                  void          * buf,
+                                unsigned int    len )   throw ( Exception );
+
+        /**
+         *  Close the underlying source.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        close ( void )                                  throw ( Exception )
+        {
+            source->close();
+        }
+
+        /**
+         *  Get the number of buffer overruns of the underlying source.
+         *
+         *  @return the number of buffer overruns.
+         */
+        inline virtual unsigned int
+        getOverruns ( void ) const                      throw ()
+        {
+            return source->getOverruns();
+        }
+
+        /**
+         *  Tell if the underlying source has been silent for the given
+         *  duration, up to the last block read.
+         *
+         *  @return true if the source is silent, false otherwise.
+         */
+        inline bool
+        isSilent ( void ) const                         throw ()
+        {
+            return silent;
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* SILENCE_DETECTOR_H */
+
@@ -0,0 +1,155 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SilenceGate.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#include "Exception.h"
+#include "SilenceGate.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/* ===============================================  local function prototypes */
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+SilenceGate :: init (   Sink              * sink,
+                        SilenceDetector   * detector,
+                        Mode                mode )      throw ( Exception )
+{
+    this->sink        = sink;
+    this->detector    = detector;
+    this->mode        = mode;
+    this->suspended   = false;
+    this->silence     = 0;
+    this->silenceSize = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initialize the object
+ *----------------------------------------------------------------------------*/
+void
+SilenceGate :: strip ( void )                           throw ( Exception )
+{
+    delete[] silence;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Suspend the output
+ *----------------------------------------------------------------------------*/
+void
+SilenceGate :: suspend ( void )                         throw ( Exception )
+{
+    suspended = true;
+
+    if ( mode == disconnect ) {
+        reportEvent( 2, "input is silent, disconnecting output");
+        sink->close();
+    } else {
+        reportEvent( 2, "input is silent, sending silence to output");
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Resume the output
+ *----------------------------------------------------------------------------*/
+void
+SilenceGate :: resume ( void )                          throw ( Exception )
+{
+    suspended = false;
+
+    reportEvent( 2, "input is not silent anymore, resuming output");
+    if ( mode == disconnect && !sink->open() ) {
+        throw Exception( __FILE__, __LINE__,
+                         "can't reopen output after silence");
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Write data to the output
+ *----------------------------------------------------------------------------*/
+unsigned int
+SilenceGate :: write (  const void    * buf,
+                        unsigned int    len )           throw ( Exception )
+{
+    if ( !detector->isSilent() ) {
+        if ( suspended ) {
+            resume();
+        }
+        return sink->write( buf, len);
+    }
+
+    if ( !suspended ) {
+        suspend();
+    }
+    if ( mode == disconnect ) {
+        return len;
+    }
+
+    if ( len > silenceSize ) {
+        delete[] silence;
+        silence     = new unsigned char[len];
+        silenceSize = len;
+        // 8 bit samples are unsigned
+        memset( silence,
+                detector->getBitsPerSample() == 8 ? 0x80 : 0,
+                silenceSize);
+    }
+
+    return sink->write( silence, len);
+}
+
@@ -0,0 +1,318 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SilenceGate.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef SILENCE_GATE_H
+#define SILENCE_GATE_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#include "Ref.h"
+#include "Reporter.h"
+#include "Sink.h"
+#include "SilenceDetector.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A sink in front of an output, suspending the output while a
+ *  SilenceDetector tells that the input is silent. The output is
+ *  resumed with the first block written after the input is not silent
+ *  anymore.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class SilenceGate : public Sink, public virtual Reporter
+{
+    public:
+
+        /**
+         *  Type describing what happens to the output while suspended:
+         *  - sendSilence - digital silence is written instead of the
+         *                  input, which encoders turn into their
+         *                  smallest frames
+         *  - disconnect - the output is closed, and reopened on resuming
+         */
+        enum Mode { sendSilence, disconnect };
+
+
+    private:
+
+        /**
+         *  The sink of the output.
+         */
+        Ref<Sink>               sink;
+
+        /**
+         *  The detector telling if the input is silent.
+         */
+        Ref<SilenceDetector>    detector;
+
+        /**
+         *  What happens to the output while suspended.
+         */
+        Mode                    mode;
+
+        /**
+         *  Tells if the output is suspended.
+         */
+        bool                    suspended;
+
+        /**
+         *  A buffer of digital silence, for sendSilence.
+         */
+        unsigned char         * silence;
+
+        /**
+         *  The size of the silence buffer.
+         */
+        unsigned int            silenceSize;
+
+        /**
+         *  Initialize the object
+         *
+         *  @param sink the sink of the output.
+         *  @param detector the detector telling if the input is silent.
+         *  @param mode what happens to the output while suspended.
+         *  @exception Exception
+         */
+        void
+        init (  Sink              * sink,
+                SilenceDetector   * detector,
+                Mode                mode )          throw ( Exception );
+
+        /**
+         *  De-initialize the object
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                              throw ( Exception );
+
+        /**
+         *  Suspend the output.
+         *
+         *  @exception Exception
+         */
+        void
+        suspend ( void )                            throw ( Exception );
+
+        /**
+         *  Resume the output.
+         *
+         *  @exception Exception if the output could not be reopened.
+         */
+        void
+        resume ( void )                             throw ( Exception );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *
+         *  @exception Exception
+         */
+        inline
+        SilenceGate ( void )                            throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor.
+         *
+         *  @param sink the sink of the output.
+         *  @param detector the detector telling if the input is silent.
+         *  @param mode what happens to the output while suspended.
+         *  @exception Exception
+         */
+        inline
+        SilenceGate (   Sink              * sink,
+                        SilenceDetector   * detector,
+                        Mode                mode )      throw ( Exception )
+        {
+            init( sink, detector, mode);
+        }
+
+        /**
+         *  Copy Constructor.
+         *
+         *  @param gate the object to copy.
+         *  @exception Exception
+         */
+        inline
+        SilenceGate (   const SilenceGate &   gate )    throw ( Exception )
+                    : Sink( gate )
+        {
+            throw Exception( __FILE__, __LINE__, "SilenceGate doesn't copy");
+        }
+
+        /**
+         *  Destructor.
+         *
+         *  @exception Exception
+         */
+        inline virtual
+        ~SilenceGate ( void )                           throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Assignment operator.
+         *
+         *  @param gate the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual SilenceGate &
+        operator= (     const SilenceGate &     gate )  throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__, "SilenceGate doesn't assign");
+        }
+
+        /**
+         *  Open the output.
+         *
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        open ( void )                                   throw ( Exception )
+        {
+            suspended = false;
+            return sink->open();
+        }
+
+        /**
+         *  Check if the SilenceGate is open.
+         *
+         *  @return true if the output is open, or closed while
+         *          suspended, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                           throw ()
+        {
+            return (suspended && mode == disconnect) || sink->isOpen();
+        }
+
+        /**
+         *  Check if the SilenceGate is ready to accept data.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true if the SilenceGate is ready to accept data,
+         *          false otherwise.
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (              unsigned int    sec,
+                                unsigned int    usec )  throw ( Exception )
+        {
+            if ( suspended && mode == disconnect ) {
+                return true;
+            }
+            return sink->canWrite( sec, usec);
+        }
+
+        /**
+         *  Write data to the output, or suspend or resume the output,
+         *  depending on the input being silent.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written (may be less than len).
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write (                 const void    * buf,
+                                unsigned int    len )   throw ( Exception );
+
+        /**
+         *  Flush all data that was written to the output.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                                  throw ( Exception )
+        {
+            if ( sink->isOpen() ) {
+                sink->flush();
+            }
+        }
+
+        /**
+         *  Cut what the output has done so far, and start anew.
+         */
+        inline virtual void
+        cut ( void )                                    throw ()
+        {
+            sink->cut();
+        }
+
+        /**
+         *  Close the output.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        close ( void )                                  throw ( Exception )
+        {
+            suspended = false;
+            if ( sink->isOpen() ) {
+                sink->close();
+            }
+        }
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* SILENCE_GATE_H */
+
@@ -36,6 +36,16 @@
 
 /* ============================================================ include files */
 
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#else
+#error need sys/uio.h
+#endif
+
 #include "Referable.h"
 #include "Exception.h"
 
@@ -147,6 +157,38 @@ class Sink : public virtual Referable
         write (                 const void    * buf,
                                 unsigned int    len )   throw ( Exception ) = 0;
 
+        /**
+         *  Write data from several buffers to the Sink, in one go
+         *  where the Sink supports it.
+         *  This default implementation writes the buffers one by one,
+         *  and stops at the first one not written fully.
+         *
+         *  @param iov the buffers to write.
+         *  @param iovcnt the number of buffers in iov.
+         *  @return the number of bytes written (may be less than the
+         *          total length of the buffers).
+         *  @exception Exception
+         */
+        inline virtual unsigned int
+        writev (        const struct iovec    * iov,
+                        unsigned int            iovcnt )
+                                                        throw ( Exception )
+        {
+            unsigned int    total = 0;
+            unsigned int    i;
+
+            for ( i = 0; i < iovcnt; ++i ) {
+                unsigned int    ret = write( iov[i].iov_base, iov[i].iov_len);
+
+                total += ret;
+                if ( ret < iov[i].iov_len ) {
+                    break;
+                }
+            }
+
+            return total;
+        }
+
         /**
          *  Flush all data that was written to the Sink to the underlying
          *  construct.
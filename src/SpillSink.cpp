@@ -0,0 +1,551 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SpillSink.cpp
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+#ifdef HAVE_STRING_H
+#include <string.h>
+#else
+#error need string.h
+#endif
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#else
+#error need unistd.h
+#endif
+
+#ifdef HAVE_ERRNO_H
+#include <errno.h>
+#else
+#error need errno.h
+#endif
+
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_SYS_STAT_H
+#include <sys/stat.h>
+#else
+#error need sys/stat.h
+#endif
+
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#else
+#error need sys/time.h
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#else
+#error need sys/mman.h
+#endif
+
+
+#include "Util.h"
+#include "Exception.h"
+#include "SpillSink.h"
+
+
+/* ===================================================  local data structures */
+
+
+/* ================================================  local constants & macros */
+
+/*------------------------------------------------------------------------------
+ *  File identity
+ *----------------------------------------------------------------------------*/
+static const char fileid[] = "$Id$";
+
+
+/*------------------------------------------------------------------------------
+ *  The maximum number of bytes sent to the underlying sink in one go
+ *----------------------------------------------------------------------------*/
+static const unsigned long sendChunkSize = 16384;
+
+
+/* ===============================================  local function prototypes */
+
+/*------------------------------------------------------------------------------
+ *  Append len bytes to a ring buffer, which has room for them
+ *----------------------------------------------------------------------------*/
+static void
+ringWrite ( unsigned char         * ring,
+            unsigned long           size,
+            unsigned long           head,
+            unsigned long         & fill,
+            const unsigned char   * buf,
+            unsigned long           len )
+{
+    unsigned long   pos   = (head + fill) % size;
+    unsigned long   first = size - pos < len ? size - pos : len;
+
+    memcpy( ring + pos, buf, first);
+    memcpy( ring, buf + first, len - first);
+    fill += len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Copy len bytes from the start of a ring buffer, which holds them
+ *----------------------------------------------------------------------------*/
+static void
+ringRead (  const unsigned char   * ring,
+            unsigned long           size,
+            unsigned long           head,
+            unsigned char         * buf,
+            unsigned long           len )
+{
+    unsigned long   first = size - head < len ? size - head : len;
+
+    memcpy( buf, ring + head, first);
+    memcpy( buf + first, ring, len - first);
+}
+
+
+/* =============================================================  module code */
+
+/*------------------------------------------------------------------------------
+ *  Initialize the object
+ *----------------------------------------------------------------------------*/
+void
+SpillSink :: init ( Sink              * sink,
+                    unsigned long       memSize,
+                    const char        * spillFileName,
+                    unsigned long       spillSize,
+                    unsigned int        catchUpRate,
+                    bool                catchUp )       throw ( Exception )
+{
+    if ( !sink ) {
+        throw Exception( __FILE__, __LINE__, "no sink");
+    }
+    if ( !memSize ) {
+        throw Exception( __FILE__, __LINE__, "no memory buffer");
+    }
+
+    this->sink          = sink;
+    this->memSize       = memSize;
+    this->memBuffer     = new unsigned char[memSize];
+    this->memHead       = 0;
+    this->memFill       = 0;
+    this->spillFileName = spillFileName ? Util::strDup( spillFileName) : 0;
+    this->spillFd       = -1;
+    this->spillBuffer   = 0;
+    this->spillSize     = spillFileName ? spillSize : 0;
+    this->spillHead     = 0;
+    this->spillFill     = 0;
+    this->catchUpRate   = catchUpRate * 1000 / 8;
+    this->catchUp       = catchUp;
+    this->dropped       = 0;
+    this->sendBuffer    = new unsigned char[sendChunkSize];
+    this->running       = false;
+
+    pthread_mutex_init( &mutex, 0);
+    pthread_cond_init( &cond, 0);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  De-initalize the object
+ *----------------------------------------------------------------------------*/
+void
+SpillSink :: strip ( void )                         throw ( Exception )
+{
+    if ( isOpen() ) {
+        close();
+    }
+
+    pthread_cond_destroy( &cond);
+    pthread_mutex_destroy( &mutex);
+
+    sink = 0;                                   // delete the reference
+    delete[] memBuffer;
+    delete[] sendBuffer;
+    if ( spillFileName ) {
+        delete[] spillFileName;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Append data to the queue
+ *  The memory buffer is the head of the queue, the spill file its tail.
+ *  As long as there is anything in the spill file, the memory buffer is
+ *  kept full and new data goes to the spill file.
+ *----------------------------------------------------------------------------*/
+void
+SpillSink :: put (  const unsigned char   * buf,
+                    unsigned long           len )   throw ()
+{
+    unsigned long   capacity = memSize + spillSize;
+    unsigned long   free;
+    unsigned long   n;
+
+    // cut the front of the supplied buffer if it wouldn't fit
+    if ( len > capacity ) {
+        dropped += len - capacity;
+        buf     += len - capacity;
+        len      = capacity;
+    }
+
+    // lose the oldest data if needed
+    free = capacity - memFill - spillFill;
+    if ( len > free ) {
+        consume( len - free);
+        dropped += len - free;
+        reportEvent( 4, "SpillSink, queue full, bytes dropped:", dropped);
+    }
+
+    // move the start of the spill file into the memory buffer, so that
+    // all free space is at the end of the queue
+    while ( spillFill && memFill < memSize ) {
+        n = memSize - memFill < spillFill ? memSize - memFill : spillFill;
+        n = spillSize - spillHead < n ? spillSize - spillHead : n;
+        ringWrite( memBuffer, memSize, memHead, memFill,
+                   spillBuffer + spillHead, n);
+        spillHead  = (spillHead + n) % spillSize;
+        spillFill -= n;
+    }
+
+    if ( spillFill == 0 ) {
+        n = memSize - memFill < len ? memSize - memFill : len;
+        ringWrite( memBuffer, memSize, memHead, memFill, buf, n);
+        buf += n;
+        len -= n;
+
+        if ( len ) {
+            reportEvent( 3, "SpillSink, spilling to", spillFileName);
+        }
+    }
+
+    if ( len ) {
+        ringWrite( spillBuffer, spillSize, spillHead, spillFill, buf, len);
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Copy data from the start of the queue
+ *----------------------------------------------------------------------------*/
+unsigned long
+SpillSink :: peek ( unsigned char         * buf,
+                    unsigned long           len ) const     throw ()
+{
+    if ( memFill ) {
+        len = len < memFill ? len : memFill;
+        ringRead( memBuffer, memSize, memHead, buf, len);
+    } else {
+        len = len < spillFill ? len : spillFill;
+        if ( len ) {
+            ringRead( spillBuffer, spillSize, spillHead, buf, len);
+        }
+    }
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Remove data from the start of the queue
+ *----------------------------------------------------------------------------*/
+void
+SpillSink :: consume (  unsigned long       len )   throw ()
+{
+    unsigned long   n;
+
+    n        = len < memFill ? len : memFill;
+    memHead  = (memHead + n) % memSize;
+    memFill -= n;
+    len     -= n;
+
+    if ( len && spillFill ) {
+        n          = len < spillFill ? len : spillFill;
+        spillHead  = (spillHead + n) % spillSize;
+        spillFill -= n;
+    }
+
+    // start spilling from the beginning of the file, to keep the
+    // kernel from writing back pages all over it
+    if ( spillFill == 0 ) {
+        spillHead = 0;
+    }
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Wait for new data or for the sending thread to stop
+ *----------------------------------------------------------------------------*/
+void
+SpillSink :: waitFor (  unsigned long       usec )  throw ()
+{
+    struct timeval      now;
+    struct timespec     until;
+
+    gettimeofday( &now, 0);
+    usec          += now.tv_usec;
+    until.tv_sec   = now.tv_sec + usec / 1000000L;
+    until.tv_nsec  = (usec % 1000000L) * 1000L;
+
+    pthread_cond_timedwait( &cond, &mutex, &until);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the sink: create the spill file and start the sending thread
+ *----------------------------------------------------------------------------*/
+bool
+SpillSink :: open ( void )                          throw ( Exception )
+{
+    void  * map;
+    int     ret;
+
+    if ( isOpen() ) {
+        return false;
+    }
+
+    if ( spillFileName ) {
+        if ( (spillFd = ::open( spillFileName,
+                                O_RDWR | O_CREAT | O_TRUNC,
+                                S_IRUSR | S_IWUSR)) == -1 ) {
+            throw Exception( __FILE__, __LINE__,
+                             "can't create spill file", spillFileName, errno);
+        }
+        // reserve the blocks up front: a sparse file mapped shared would
+        // raise SIGBUS on the first write to a page the disk can't hold
+        if ( (ret = posix_fallocate( spillFd, 0, spillSize)) ) {
+            ::close( spillFd);
+            spillFd = -1;
+            throw Exception( __FILE__, __LINE__,
+                             "can't allocate spill file", spillFileName, ret);
+        }
+        map = mmap( 0, spillSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                    spillFd, 0);
+        if ( map == MAP_FAILED ) {
+            ::close( spillFd);
+            spillFd = -1;
+            throw Exception( __FILE__, __LINE__,
+                             "can't map spill file", spillFileName, errno);
+        }
+        spillBuffer = (unsigned char *) map;
+    }
+
+    memHead   = memFill   = 0;
+    spillHead = spillFill = 0;
+
+    running = true;
+    if ( pthread_create( &thread, 0, threadFunction, this) ) {
+        running = false;
+        close();
+        return false;
+    }
+
+    return true;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Queue some data, to be sent by the sending thread
+ *----------------------------------------------------------------------------*/
+unsigned int
+SpillSink :: write (    const void    * buf,
+                        unsigned int    len )       throw ( Exception )
+{
+    if ( !buf ) {
+        throw Exception( __FILE__, __LINE__, "buf is null");
+    }
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    pthread_mutex_lock( &mutex);
+    put( (const unsigned char *) buf, len);
+    pthread_cond_signal( &cond);
+    pthread_mutex_unlock( &mutex);
+
+    return len;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Send the queued data to the underlying sink, re-open it when closed
+ *----------------------------------------------------------------------------*/
+void
+SpillSink :: sendLoop ( void )                      throw ()
+{
+    struct timeval      last;
+    struct timeval      now;
+    double              allowance = 0.0;
+
+    gettimeofday( &last, 0);
+
+    pthread_mutex_lock( &mutex);
+    while ( running ) {
+        unsigned long   len;
+        unsigned long   droppedBefore;
+        unsigned int    written;
+
+        if ( !sink->isOpen() ) {
+            bool    opened = false;
+
+            pthread_mutex_unlock( &mutex);
+            try {
+                opened = sink->open();
+            } catch ( Exception   & e ) {
+                reportEvent( 4, "SpillSink, can't re-open sink:", e);
+            }
+            pthread_mutex_lock( &mutex);
+
+            if ( !opened ) {
+                if ( running ) {
+                    waitFor( 1000000L);
+                }
+                continue;
+            }
+
+            reportEvent( 3, "SpillSink, sink open, backlog:",
+                            memFill + spillFill);
+            if ( !catchUp ) {
+                consume( memFill + spillFill);
+            }
+            gettimeofday( &last, 0);
+            allowance = 0.0;
+            continue;
+        }
+
+        if ( memFill + spillFill == 0 ) {
+            pthread_cond_wait( &cond, &mutex);
+            continue;
+        }
+
+        len = sendChunkSize;
+        if ( catchUpRate ) {
+            // a token bucket, holding at most one second worth of data
+            gettimeofday( &now, 0);
+            allowance += catchUpRate * ((now.tv_sec - last.tv_sec)
+                                   + (now.tv_usec - last.tv_usec) / 1000000.0);
+            if ( allowance > catchUpRate ) {
+                allowance = catchUpRate;
+            }
+            last = now;
+
+            if ( allowance < 1.0 ) {
+                waitFor( (unsigned long)
+                            ((1.0 - allowance) * 1000000.0 / catchUpRate) + 1);
+                continue;
+            }
+            if ( len > allowance ) {
+                len = (unsigned long) allowance;
+            }
+        }
+
+        droppedBefore = dropped;
+        len           = peek( sendBuffer, len);
+        pthread_mutex_unlock( &mutex);
+
+        written = 0;
+        try {
+            if ( sink->canWrite( 1, 0) ) {
+                written = sink->write( sendBuffer, len);
+            }
+        } catch ( Exception   & e ) {
+            reportEvent( 2, "SpillSink, sink error, re-opening:", e);
+            try {
+                sink->close();
+            } catch ( Exception   & e ) {
+            }
+        }
+
+        pthread_mutex_lock( &mutex);
+        // the writer might have dropped the data we've just sent
+        // from the queue meanwhile
+        if ( written > dropped - droppedBefore ) {
+            consume( written - (dropped - droppedBefore));
+        }
+        allowance -= written;
+    }
+    pthread_mutex_unlock( &mutex);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Close the sink, lose all pending data
+ *----------------------------------------------------------------------------*/
+void
+SpillSink :: close ( void )                         throw ( Exception )
+{
+    if ( running ) {
+        pthread_mutex_lock( &mutex);
+        running = false;
+        pthread_cond_broadcast( &cond);
+        pthread_mutex_unlock( &mutex);
+
+        pthread_join( thread, 0);
+    }
+
+    if ( sink->isOpen() ) {
+        sink->close();
+    }
+
+    if ( spillBuffer ) {
+        munmap( spillBuffer, spillSize);
+        spillBuffer = 0;
+    }
+    if ( spillFd != -1 ) {
+        ::close( spillFd);
+        spillFd = -1;
+        unlink( spillFileName);
+    }
+
+    memHead   = memFill   = 0;
+    spillHead = spillFill = 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The thread function
+ *----------------------------------------------------------------------------*/
+void *
+SpillSink :: threadFunction( void     * param )
+{
+    SpillSink     * spillSink = (SpillSink *) param;
+
+    spillSink->sendLoop();
+
+    return 0;
+}
+
@@ -0,0 +1,451 @@
+/*------------------------------------------------------------------------------
+
+   Copyright (c) 2000-2007 Tyrell Corporation. All rights reserved.
+
+   Tyrell DarkIce
+
+   File     : SpillSink.h
+   Version  : $Revision$
+   Author   : $Author$
+   Location : $HeadURL$
+   
+   Copyright notice:
+
+    This program is free software; you can redistribute it and/or
+    modify it under the terms of the GNU General Public License  
+    as published by the Free Software Foundation; either version 3
+    of the License, or (at your option) any later version.
+   
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of 
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the 
+    GNU General Public License for more details.
+   
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA  02111-1307, USA.
+
+------------------------------------------------------------------------------*/
+#ifndef SPILL_SINK_H
+#define SPILL_SINK_H
+
+#ifndef __cplusplus
+#error This is a C++ include file
+#endif
+
+
+/* ============================================================ include files */
+
+#ifdef HAVE_CONFIG_H
+#include "config.h"
+#endif
+
+// check for __NetBSD__ because it won't be found by AC_CHECK_HEADER on NetBSD
+// as pthread.h is in /usr/pkg/include, not /usr/include
+#if defined( HAVE_PTHREAD_H ) || defined( __NetBSD__ )
+#include <pthread.h>
+#else
+#error need pthread.h
+#endif
+
+#include "Ref.h"
+#include "Reporter.h"
+#include "Sink.h"
+
+
+/* ================================================================ constants */
+
+
+/* =================================================================== macros */
+
+
+/* =============================================================== data types */
+
+/**
+ *  A Sink First-In First-Out buffer that survives the loss of the
+ *  underlying Sink.
+ *  Data written is queued in memory, and when the memory buffer is full,
+ *  in a memory-mapped spill file. A separate thread sends the queued data
+ *  to the underlying Sink, re-opening it when it gets closed. After
+ *  re-opening, the backlog is either sent at a limited rate, or thrown
+ *  away to skip to the live stream.
+ *  Only when both the memory buffer and the spill file are full is
+ *  the oldest data discarded.
+ *
+ *  @author  $Author$
+ *  @version $Revision$
+ */
+class SpillSink : public Sink, public virtual Reporter
+{
+    private:
+
+        /**
+         *  The underlying Sink.
+         */
+        Ref<Sink>           sink;
+
+        /**
+         *  The in-memory buffer, the head of the queue.
+         */
+        unsigned char     * memBuffer;
+
+        /**
+         *  The size of the in-memory buffer.
+         */
+        unsigned long       memSize;
+
+        /**
+         *  Start of the queued data in the in-memory buffer.
+         */
+        unsigned long       memHead;
+
+        /**
+         *  Number of bytes queued in the in-memory buffer.
+         */
+        unsigned long       memFill;
+
+        /**
+         *  Name of the spill file, or 0 if not spilling to disk.
+         */
+        char              * spillFileName;
+
+        /**
+         *  The file descriptor of the spill file.
+         */
+        int                 spillFd;
+
+        /**
+         *  The memory-mapped spill file, the tail of the queue.
+         */
+        unsigned char     * spillBuffer;
+
+        /**
+         *  The size of the spill file.
+         */
+        unsigned long       spillSize;
+
+        /**
+         *  Start of the queued data in the spill file.
+         */
+        unsigned long       spillHead;
+
+        /**
+         *  Number of bytes queued in the spill file.
+         */
+        unsigned long       spillFill;
+
+        /**
+         *  The maximum rate to send data at, in bytes / sec.
+         *  0 if not limited.
+         */
+        unsigned int        catchUpRate;
+
+        /**
+         *  Send the backlog after re-opening the underlying Sink,
+         *  or skip to the live stream.
+         */
+        bool                catchUp;
+
+        /**
+         *  Total number of bytes discarded because the queue was full.
+         */
+        unsigned long       dropped;
+
+        /**
+         *  Buffer to send data from, in the sending thread.
+         */
+        unsigned char     * sendBuffer;
+
+        /**
+         *  Signal if the sending thread is running.
+         */
+        bool                running;
+
+        /**
+         *  The mutex guarding the queue.
+         */
+        pthread_mutex_t     mutex;
+
+        /**
+         *  The conditional variable for presenting new data.
+         */
+        pthread_cond_t      cond;
+
+        /**
+         *  The sending thread.
+         */
+        pthread_t           thread;
+
+        /**
+         *  Initialize the object.
+         *
+         *  @param sink the Sink to attach this SpillSink to.
+         *  @param memSize the size of the in-memory buffer.
+         *  @param spillFileName the name of the spill file, 0 if none.
+         *  @param spillSize the size of the spill file.
+         *  @param catchUpRate the maximum rate to send data at,
+         *                     in kbits / sec, 0 for no limit.
+         *  @param catchUp send the backlog after re-opening the
+         *                 underlying Sink, or discard it.
+         *  @exception Exception
+         */
+        void
+        init (  Sink              * sink,
+                unsigned long       memSize,
+                const char        * spillFileName,
+                unsigned long       spillSize,
+                unsigned int        catchUpRate,
+                bool                catchUp )           throw ( Exception );
+
+        /**
+         *  De-initialize the object.
+         *
+         *  @exception Exception
+         */
+        void
+        strip ( void )                                  throw ( Exception );
+
+        /**
+         *  Append data to the end of the queue, discarding the oldest
+         *  data if needed. Call with the mutex locked.
+         *
+         *  @param buf the data to append.
+         *  @param len the number of bytes to append.
+         */
+        void
+        put (   const unsigned char   * buf,
+                unsigned long           len )           throw ();
+
+        /**
+         *  Copy data from the start of the queue, without removing it.
+         *  Call with the mutex locked.
+         *
+         *  @param buf the buffer to copy into.
+         *  @param len the maximum number of bytes to copy.
+         *  @return the number of bytes copied.
+         */
+        unsigned long
+        peek (  unsigned char         * buf,
+                unsigned long           len ) const     throw ();
+
+        /**
+         *  Remove data from the start of the queue.
+         *  Call with the mutex locked.
+         *
+         *  @param len the number of bytes to remove.
+         */
+        void
+        consume (   unsigned long       len )           throw ();
+
+        /**
+         *  Wait on the conditional variable for a given amount of time.
+         *  Call with the mutex locked.
+         *
+         *  @param usec the number of micro seconds to wait for.
+         */
+        void
+        waitFor (   unsigned long       usec )          throw ();
+
+        /**
+         *  The loop of the sending thread.
+         */
+        void
+        sendLoop ( void )                               throw ();
+
+        /**
+         *  The thread function.
+         *
+         *  @param param thread parameter, a pointer to the SpillSink.
+         *  @return nothing
+         */
+        static void *
+        threadFunction( void      * param );
+
+
+    protected:
+
+        /**
+         *  Default constructor. Always throws an Exception.
+         *  
+         *  @exception Exception
+         */
+        inline
+        SpillSink ( void )                          throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Copy constructor. Always throws an Exception, as the
+         *  sending thread and the spill file can't be shared.
+         *  
+         *  @param ss the object to copy.
+         *  @exception Exception
+         */
+        inline
+        SpillSink ( const SpillSink &   ss )        throw ( Exception )
+                : Sink( ss )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+        /**
+         *  Assignment operator. Always throws an Exception, as the
+         *  sending thread and the spill file can't be shared.
+         *  
+         *  @param ss the object to assign to this one.
+         *  @return a reference to this object.
+         *  @exception Exception
+         */
+        inline virtual SpillSink &
+        operator= ( const SpillSink &   ss )        throw ( Exception )
+        {
+            throw Exception( __FILE__, __LINE__);
+        }
+
+
+    public:
+
+        /**
+         *  Constructor by an underlying Sink and the queue parameters.
+         *  
+         *  @param sink the Sink to attach this SpillSink to.
+         *  @param memSize the size of the in-memory buffer.
+         *  @param spillFileName the name of the spill file, 0 if none.
+         *  @param spillSize the size of the spill file.
+         *  @param catchUpRate the maximum rate to send data at,
+         *                     in kbits / sec, 0 for no limit.
+         *  @param catchUp send the backlog after re-opening the
+         *                 underlying Sink, or discard it.
+         *  @exception Exception
+         */
+        inline 
+        SpillSink ( Sink              * sink,
+                    unsigned long       memSize,
+                    const char        * spillFileName,
+                    unsigned long       spillSize,
+                    unsigned int        catchUpRate = 0,
+                    bool                catchUp     = true )
+                                                        throw ( Exception )
+        {
+            init( sink, memSize, spillFileName, spillSize,
+                  catchUpRate, catchUp);
+        }
+
+        /**
+         *  Destructor.
+         *  
+         *  @exception Exception
+         */
+        inline virtual
+        ~SpillSink ( void )                         throw ( Exception )
+        {
+            strip();
+        }
+
+        /**
+         *  Get the number of bytes discarded so far because the queue
+         *  was full.
+         *  
+         *  @return the number of bytes discarded.
+         */
+        inline unsigned long
+        getDropped ( void ) const                   throw ()
+        {
+            return dropped;
+        }
+
+        /**
+         *  Open the SpillSink. Creates the spill file and starts the
+         *  sending thread, which opens the underlying Sink.
+         *  
+         *  @return true if opening was successful, false otherwise.
+         *  @exception Exception
+         */
+        virtual bool
+        open ( void )                               throw ( Exception );
+
+        /**
+         *  Check if a SpillSink is open.
+         *  This does not depend on the underlying Sink being open.
+         *
+         *  @return true if the SpillSink is open, false otherwise.
+         */
+        inline virtual bool
+        isOpen ( void ) const                       throw ()
+        {
+            return running;
+        }
+
+        /**
+         *  Check if the SpillSink is ready to accept data.
+         *  Always returns true immediately.
+         *
+         *  @param sec the maximum seconds to block.
+         *  @param usec micro seconds to block after the full seconds.
+         *  @return true
+         *  @exception Exception
+         */
+        inline virtual bool
+        canWrite (     unsigned int    sec,
+                       unsigned int    usec )       throw ( Exception )
+        {
+            return true;
+        }
+
+        /**
+         *  Write data to the SpillSink.
+         *  The data is queued, and sent by the sending thread.
+         *
+         *  @param buf the data to write.
+         *  @param len number of bytes to write from buf.
+         *  @return the number of bytes written.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        write (    const void    * buf,
+                   unsigned int    len )            throw ( Exception );
+
+        /**
+         *  Flush all data that was written to the SpillSink.
+         *  The data is sent by the sending thread, so this is a no-op.
+         *
+         *  @exception Exception
+         */
+        inline virtual void
+        flush ( void )                              throw ( Exception )
+        {
+        }
+
+        /**
+         *  Cut what the sink has been doing so far, and start anew.
+         *  This usually means separating the data sent to the sink up
+         *  until now, and start saving a new chunk of data.
+         */
+        inline virtual void
+        cut ( void )                                throw ()
+        {
+            sink->cut();
+        }
+
+        /**
+         *  Close the SpillSink. Stops the sending thread, closes the
+         *  underlying Sink and removes the spill file.
+         *  All data still queued is lost.
+         *
+         *  @exception Exception
+         */
+        virtual void
+        close ( void )                              throw ( Exception );
+};
+
+
+/* ================================================= external data structures */
+
+
+/* ====================================================== function prototypes */
+
+
+
+#endif  /* SPILL_SINK_H */
+
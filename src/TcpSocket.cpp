@@ -63,6 +63,12 @@
 #error need netinet/in.h
 #endif
 
+#ifdef HAVE_NETINET_TCP_H
+#include <netinet/tcp.h>
+#else
+#error need netinet/tcp.h
+#endif
+
 #ifdef HAVE_NETDB_H
 #include <netdb.h>
 #else
@@ -81,12 +87,30 @@
 #error need sys/time.h
 #endif
 
+#ifdef HAVE_TIME_H
+#include <time.h>
+#else
+#error need time.h
+#endif
+
 #ifdef HAVE_SIGNAL_H
 #include <signal.h>
 #else
 #error need signal.h
 #endif
 
+#ifdef HAVE_FCNTL_H
+#include <fcntl.h>
+#else
+#error need fcntl.h
+#endif
+
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#else
+#error need sys/ioctl.h
+#endif
+
 
 #include "Util.h"
 #include "Exception.h"
@@ -106,6 +130,12 @@ static const char fileid[] = "$Id$";
 
 /* ===============================================  local function prototypes */
 
+/*------------------------------------------------------------------------------
+ *  The current time, in milliseconds
+ *----------------------------------------------------------------------------*/
+static double
+msecsNow ( void )                                       throw ();
+
 
 /* =============================================================  module code */
 
@@ -114,11 +144,32 @@ static const char fileid[] = "$Id$";
  *----------------------------------------------------------------------------*/
 void
 TcpSocket :: init (   const char    * host,
-                      unsigned short  port )          throw ( Exception )
+                      unsigned short  port,
+                      unsigned int    connectTimeout )  throw ( Exception )
 {
-    this->host   = Util::strDup( host);
-    this->port   = port;
-    this->sockfd = 0;
+    this->host           = Util::strDup( host);
+    this->port           = port;
+    this->connectTimeout = connectTimeout;
+    this->sendBufferSize = 0;
+    this->noDelay        = false;
+    this->notSentLowat   = 0;
+    this->cork           = false;
+    this->userTimeout    = 0;
+    this->congestion     = 0;
+    this->pacingRate     = 0;
+    this->catchUpRate    = 0;
+    this->catchingUp     = false;
+    this->infoInterval   = 0;
+    this->rttAlarm       = 0;
+    this->nextInfo       = 0.0;
+    this->rtt            = 0;
+    this->rttVar         = 0;
+    this->cwnd           = 0;
+    this->unsent         = 0;
+    this->retransmits    = 0;
+    this->peakRtt        = 0;
+    this->peakUnsent     = 0;
+    this->sockfd         = 0;
 }
 
 
@@ -133,6 +184,7 @@ TcpSocket :: strip ( void)                           throw ( Exception )
     }
 
     delete[] host;
+    delete[] congestion;
 }
 
 
@@ -144,7 +196,8 @@ TcpSocket :: TcpSocket (  const TcpSocket &    ss )    throw ( Exception )
 {
     int     fd;
     
-    init( ss.host, ss.port);
+    init( ss.host, ss.port, ss.connectTimeout);
+    copyOptions( ss);
 
     if ( (fd = ss.sockfd ? dup( ss.sockfd) : 0) == -1 ) {
         strip();
@@ -172,7 +225,8 @@ TcpSocket :: operator= (  const TcpSocket &    ss )   throw ( Exception )
         Sink::operator=( ss );
         Source::operator=( ss );
 
-        init( ss.host, ss.port);
+        init( ss.host, ss.port, ss.connectTimeout);
+        copyOptions( ss);
         
         if ( (fd = ss.sockfd ? dup( ss.sockfd) : 0) == -1 ) {
             strip();
@@ -187,54 +241,283 @@ TcpSocket :: operator= (  const TcpSocket &    ss )   throw ( Exception )
 
 
 /*------------------------------------------------------------------------------
- *  Open the file
+ *  Copy the socket options of another TcpSocket
  *----------------------------------------------------------------------------*/
-bool
-TcpSocket :: open ( void )                       throw ( Exception )
+void
+TcpSocket :: copyOptions (  const TcpSocket   & ss )    throw ()
 {
-    int                     optval;
-    socklen_t               optlen;
-#ifdef HAVE_ADDRINFO
-    struct addrinfo         hints
-    struct addrinfo       * ptr;
-    struct sockaddr_storage addr;
-    char                    portstr[6];
+    sendBufferSize = ss.sendBufferSize;
+    noDelay        = ss.noDelay;
+    notSentLowat   = ss.notSentLowat;
+    cork           = ss.cork;
+    userTimeout    = ss.userTimeout;
+    pacingRate     = ss.pacingRate;
+    catchUpRate    = ss.catchUpRate;
+    infoInterval   = ss.infoInterval;
+    rttAlarm       = ss.rttAlarm;
+    delete[] congestion;
+    congestion     = ss.congestion ? Util::strDup( ss.congestion) : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Set the congestion control algorithm
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: setCongestion (    const char    * name )  throw ( Exception )
+{
+    delete[] congestion;
+    congestion = name ? Util::strDup( name) : 0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Apply the socket options to a socket
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: applyOptions ( int     fd )                throw ()
+{
+    int         optval;
+
+    if ( sendBufferSize ) {
+        optval = sendBufferSize;
+        if ( setsockopt( fd, SOL_SOCKET, SO_SNDBUF, &optval, sizeof(optval)) ) {
+            reportEvent( 2, "can't set TCP send buffer size", errno);
+        }
+    }
+    if ( noDelay ) {
+        optval = 1;
+        if ( setsockopt( fd, IPPROTO_TCP, TCP_NODELAY, &optval,
+                                                            sizeof(optval)) ) {
+            reportEvent( 2, "can't set TCP_NODELAY", errno);
+        }
+    }
+    if ( notSentLowat ) {
+#ifdef TCP_NOTSENT_LOWAT
+        optval = notSentLowat;
+        if ( setsockopt( fd, IPPROTO_TCP, TCP_NOTSENT_LOWAT, &optval,
+                                                            sizeof(optval)) ) {
+            reportEvent( 2, "can't set TCP_NOTSENT_LOWAT", errno);
+        }
 #else
-    struct sockaddr_in      addr;
-    struct hostent        * pHostEntry;
+        reportEvent( 2, "TCP_NOTSENT_LOWAT not supported on this system");
 #endif
- 
-    if ( isOpen() ) {
-        return false;
     }
+    if ( cork ) {
+#ifdef TCP_CORK
+        optval = 1;
+        if ( setsockopt( fd, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval)) ) {
+            reportEvent( 2, "can't set TCP_CORK", errno);
+        }
+#else
+        reportEvent( 2, "TCP_CORK not supported on this system");
+#endif
+    }
+    if ( userTimeout ) {
+#ifdef TCP_USER_TIMEOUT
+        optval = userTimeout;
+        if ( setsockopt( fd, IPPROTO_TCP, TCP_USER_TIMEOUT, &optval,
+                                                            sizeof(optval)) ) {
+            reportEvent( 2, "can't set TCP_USER_TIMEOUT", errno);
+        }
+#else
+        reportEvent( 2, "TCP_USER_TIMEOUT not supported on this system");
+#endif
+    }
+    if ( catchUpRate ) {
+        applyPacing( fd, catchUpRate);
+    } else if ( pacingRate ) {
+        applyPacing( fd, pacingRate);
+    }
+    if ( congestion ) {
+#ifdef TCP_CONGESTION
+        if ( setsockopt( fd, IPPROTO_TCP, TCP_CONGESTION, congestion,
+                                                    strlen( congestion)) ) {
+            reportEvent( 2, "can't set TCP congestion control", congestion,
+                            errno);
+        }
+#else
+        reportEvent( 2, "TCP_CONGESTION not supported on this system");
+#endif
+    }
+}
 
-#ifdef HAVE_ADDRINFO
-    memset(&hints, 0, sizeof(hints));
-    hints.ai_socktype = SOCK_STREAM;
-    hints.ai_family = AF_ANY;
-    snprintf(portstr, sizeof(portstr), "%d", port);
 
-    if (getaddrinfo(host , portstr, &hints, &ptr)) {
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "getaddrinfo error", errno);
+/*------------------------------------------------------------------------------
+ *  Set the pacing rate of a socket
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: applyPacing (  int             fd,
+                            unsigned int    rate )      throw ()
+{
+#ifdef SO_MAX_PACING_RATE
+    // ~0U turns pacing off
+    unsigned int    optval = rate ? rate : ~0U;
+
+    if ( setsockopt( fd, SOL_SOCKET, SO_MAX_PACING_RATE, &optval,
+                                                        sizeof(optval)) ) {
+        reportEvent( 2, "can't set SO_MAX_PACING_RATE", errno);
     }
-    memcpy ( addr, ptr->ai_addr, ptr->ai_addrlen);
-    freeaddrinfo(ptr);
 #else
-    if ( !(pHostEntry = gethostbyname( host)) ) {
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "gethostbyname error", errno);
-    }
-    
-    memset( &addr, 0, sizeof(addr));
-    addr.sin_family      = AF_INET;
-    addr.sin_port        = htons(port);
-    addr.sin_addr.s_addr = *((long*) pHostEntry->h_addr_list[0]);
+    reportEvent( 2, "SO_MAX_PACING_RATE not supported on this system");
 #endif
+}
+
+
+/*------------------------------------------------------------------------------
+ *  The current time, in milliseconds, on a clock that isn't set back
+ *----------------------------------------------------------------------------*/
+static double
+msecsNow ( void )                                       throw ()
+{
+    struct timespec     ts;
+
+    clock_gettime( CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec * 1000.0 + ts.tv_nsec / 1000000.0;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Connect to the first of the addresses that answers
+ *----------------------------------------------------------------------------*/
+int
+TcpSocket :: connectAny ( const std::vector<DnsCache::Address> & addresses )
+                                                        throw ( Exception )
+{
+    std::vector<int>    pending;
+    size_t              next      = 0;
+    double              deadline  = msecsNow() + connectTimeout * 1000.0;
+    double              nextStart = 0.0;
+    int                 lastError = ETIMEDOUT;
+    int                 fd        = -1;
+    size_t              i;
+
+    while ( fd == -1 ) {
+        double          now = msecsNow();
+
+        // start the next attempt, if the others take long,
+        // but not once the time is up
+        if ( next < addresses.size() && now < deadline
+          && (pending.empty() || now >= nextStart) ) {
+            const DnsCache::Address   & address = addresses[next++];
+            int                         s;
+
+            s = socket( address.addr.ss_family, SOCK_STREAM, IPPROTO_TCP);
+            if ( s == -1 ) {
+                lastError = errno;
+                continue;
+            }
+            fcntl( s, F_SETFL, fcntl( s, F_GETFL) | O_NONBLOCK);
+            // before connecting, so that the send buffer size is
+            // taken into account for window scaling
+            applyOptions( s);
+
+            if ( connect( s, (struct sockaddr*) &address.addr, address.len)
+                                                                    == 0 ) {
+                fd = s;
+            } else if ( errno == EINPROGRESS ) {
+                pending.push_back( s);
+                nextStart = now + attemptDelay;
+            } else {
+                lastError = errno;
+                ::close( s);
+            }
+            continue;
+        }
+
+        if ( pending.empty() || now >= deadline ) {
+            break;
+        }
+
+        // wait for an attempt to finish, or for the time of the next one
+        fd_set              fdset;
+        struct timeval      tv;
+        double              until = deadline;
+        int                 maxfd = 0;
+
+        if ( next < addresses.size() && nextStart < until ) {
+            until = nextStart;
+        }
+        tv.tv_sec  = (long) (until - now) / 1000;
+        tv.tv_usec = (long) (until - now) % 1000 * 1000;
+
+        FD_ZERO( &fdset);
+        for ( i = 0; i < pending.size(); ++i ) {
+            FD_SET( pending[i], &fdset);
+            if ( pending[i] > maxfd ) {
+                maxfd = pending[i];
+            }
+        }
+
+        if ( select( maxfd + 1, NULL, &fdset, NULL, &tv) == -1 ) {
+            if ( errno == EINTR ) {
+                continue;
+            }
+            lastError = errno;
+            break;
+        }
+
+        for ( i = 0; i < pending.size(); ) {
+            int         error  = 0;
+            socklen_t   errlen = sizeof(error);
+
+            if ( !FD_ISSET( pending[i], &fdset) ) {
+                ++i;
+                continue;
+            }
+
+            getsockopt( pending[i], SOL_SOCKET, SO_ERROR, &error, &errlen);
+            if ( error == 0 && fd == -1 ) {
+                fd = pending[i];
+            } else {
+                lastError = error ? error : lastError;
+                ::close( pending[i]);
+            }
+            pending.erase( pending.begin() + i);
+        }
+    }
+
+    // give up the attempts still in progress
+    for ( i = 0; i < pending.size(); ++i ) {
+        ::close( pending[i]);
+    }
+
+    if ( fd == -1 ) {
+        throw Exception( __FILE__, __LINE__,
+                         "connect error, host: ", host, lastError);
+    }
+
+    // the rest of TcpSocket uses blocking I/O
+    fcntl( fd, F_SETFL, fcntl( fd, F_GETFL) & ~O_NONBLOCK);
+
+    return fd;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Open the file
+ *----------------------------------------------------------------------------*/
+bool
+TcpSocket :: open ( void )                       throw ( Exception )
+{
+    int                                 optval;
+    socklen_t                           optlen;
+    std::vector<DnsCache::Address>      addresses;
+ 
+    if ( isOpen() ) {
+        return false;
+    }
+
+    DnsCache::resolve( host, port, addresses);
 
-    if ( (sockfd = socket( AF_INET, SOCK_STREAM,  IPPROTO_TCP)) == -1 ) {
+    try {
+        sockfd = connectAny( addresses);
+    } catch ( Exception     & e ) {
+        // the host may have moved, resolve it again next time
+        DnsCache::invalidate( host, port);
         sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "socket error", errno);
+        throw;
     }
 
     // set TCP keep-alive
@@ -244,12 +527,15 @@ TcpSocket :: open ( void )                       throw ( Exception )
         reportEvent(5, "can't set TCP socket keep-alive mode", errno);
     }
 
-    // connect
-    if ( connect( sockfd, (struct sockaddr*)&addr, sizeof(addr)) == -1 ) {
-        ::close( sockfd);
-        sockfd = 0;
-        throw Exception( __FILE__, __LINE__, "connect error", errno);
-    }
+    rtt         = 0;
+    rttVar      = 0;
+    cwnd        = 0;
+    unsent      = 0;
+    retransmits = 0;
+    peakRtt     = 0;
+    peakUnsent  = 0;
+    nextInfo    = msecsNow() + infoInterval * 1000.0;
+    catchingUp  = catchUpRate != 0;
 
     return true;
 }
@@ -293,6 +579,28 @@ TcpSocket :: canRead (      unsigned int    sec,
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Check if the peer has closed the connection
+ *----------------------------------------------------------------------------*/
+bool
+TcpSocket :: isPeerClosed ( void ) const            throw ()
+{
+    char        c;
+    int         ret;
+
+    if ( !isOpen() ) {
+        return true;
+    }
+
+    ret = recv( sockfd, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+    if ( ret == -1 ) {
+        return errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR;
+    }
+
+    return ret == 0;
+}
+
+
 /*------------------------------------------------------------------------------
  *  Read from the socket
  *----------------------------------------------------------------------------*/
@@ -395,10 +703,165 @@ TcpSocket :: write (    const void    * buf,
         }
     }
 
+    if ( catchingUp ) {
+        checkCaughtUp();
+    }
+    if ( infoInterval && msecsNow() >= nextInfo ) {
+        sampleInfo();
+    }
+
     return ret;
 }
 
 
+/*------------------------------------------------------------------------------
+ *  Write several buffers to the socket
+ *----------------------------------------------------------------------------*/
+unsigned int
+TcpSocket :: writev (   const struct iovec    * iov,
+                        unsigned int            iovcnt )
+                                                    throw ( Exception )
+{
+    struct msghdr   msg;
+    ssize_t         ret;
+
+    if ( !isOpen() ) {
+        return 0;
+    }
+
+    memset( &msg, 0, sizeof(msg));
+    msg.msg_iov    = (struct iovec *) iov;
+    msg.msg_iovlen = iovcnt;
+
+#ifdef HAVE_MSG_NOSIGNAL
+    ret = sendmsg( sockfd, &msg, MSG_NOSIGNAL);
+#else
+    ret = sendmsg( sockfd, &msg, 0);
+#endif
+
+    if ( ret == -1 ) {
+        if ( errno == EAGAIN ) {
+            ret = 0;
+        } else {
+            ::close( sockfd);
+            sockfd = 0;
+            throw Exception( __FILE__, __LINE__, "sendmsg error", errno);
+        }
+    }
+
+    if ( catchingUp ) {
+        checkCaughtUp();
+    }
+    if ( infoInterval && msecsNow() >= nextInfo ) {
+        sampleInfo();
+    }
+
+    return ret;
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Switch to the steady pacing rate once caught up after reconnecting
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: checkCaughtUp ( void )                 throw ()
+{
+    unsigned int    limit = (pacingRate ? pacingRate : catchUpRate) / 4;
+
+#ifdef TIOCOUTQ
+    int             queued;
+
+    // on sockets TIOCOUTQ is SIOCOUTQ, the bytes not yet acknowledged
+    if ( ioctl( sockfd, TIOCOUTQ, &queued) == 0
+      && queued >= 0 && (unsigned int) queued > limit ) {
+        return;
+    }
+#endif
+
+    catchingUp = false;
+    applyPacing( sockfd, pacingRate);
+    reportEvent( 4, "TcpSocket, caught up, pacing at (bytes / sec):",
+                    host, pacingRate);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Sample the transport statistics of the connection
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: sampleInfo ( void )                    throw ()
+{
+    nextInfo = msecsNow() + infoInterval * 1000.0;
+
+#ifdef TCP_INFO
+    struct tcp_info     info;
+    socklen_t           len = sizeof(info);
+
+    if ( getsockopt( sockfd, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 ) {
+        bool    wasAlarm = rttAlarm && rtt > rttAlarm * 1000;
+
+        rtt    = info.tcpi_rtt;
+        rttVar = info.tcpi_rttvar;
+        cwnd   = info.tcpi_snd_cwnd;
+
+        if ( info.tcpi_total_retrans > retransmits ) {
+            reportEvent( 3, "TcpSocket, segments retransmitted to", host,
+                            info.tcpi_total_retrans - retransmits);
+        }
+        retransmits = info.tcpi_total_retrans;
+
+        if ( peakRtt < rtt ) {
+            peakRtt = rtt;
+            reportEvent( 4, "TcpSocket, new rtt peak (us):", host, peakRtt);
+        }
+        if ( rttAlarm && rtt > rttAlarm * 1000 && !wasAlarm ) {
+            reportEvent( 2, "TcpSocket, rtt above alarm level (us):",
+                            host, rtt);
+        }
+    }
+#endif
+
+    // on sockets TIOCOUTQ is SIOCOUTQ, the bytes not yet acknowledged
+#ifdef TIOCOUTQ
+    int     queued;
+
+    if ( ioctl( sockfd, TIOCOUTQ, &queued) == 0 && queued >= 0 ) {
+        unsent = queued;
+
+        if ( peakUnsent < unsent ) {
+            peakUnsent = unsent;
+            reportEvent( 4, "TcpSocket, new send queue peak:", host,
+                            peakUnsent);
+        }
+    }
+#endif
+
+    reportEvent( 6, "TcpSocket, rtt / rttvar (us):", host, rtt, rttVar);
+    reportEvent( 6, "TcpSocket, cwnd / send queue:", host, cwnd, unsent);
+}
+
+
+/*------------------------------------------------------------------------------
+ *  Flush the data written, sending out a partial segment when corking
+ *----------------------------------------------------------------------------*/
+void
+TcpSocket :: flush ( void )                         throw ( Exception )
+{
+#ifdef TCP_CORK
+    int     optval;
+
+    if ( !isOpen() || !cork ) {
+        return;
+    }
+
+    optval = 0;
+    setsockopt( sockfd, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval));
+    optval = 1;
+    setsockopt( sockfd, IPPROTO_TCP, TCP_CORK, &optval, sizeof(optval));
+#endif
+}
+
+
 /*------------------------------------------------------------------------------
  *  Close the socket
  *----------------------------------------------------------------------------*/
@@ -36,9 +36,12 @@
 
 /* ============================================================ include files */
 
+#include <vector>
+
 #include "Source.h"
 #include "Sink.h"
 #include "Reporter.h"
+#include "DnsCache.h"
 
 
 /* ================================================================ constants */
@@ -69,6 +72,118 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
          */
         unsigned short      port;
 
+        /**
+         *  Seconds to wait for a connection to be established.
+         */
+        unsigned int        connectTimeout;
+
+        /**
+         *  The size of the kernel send buffer, 0 for the system default.
+         */
+        unsigned int        sendBufferSize;
+
+        /**
+         *  Turn off the Nagle algorithm (TCP_NODELAY).
+         */
+        bool                noDelay;
+
+        /**
+         *  Limit of unsent data in the kernel (TCP_NOTSENT_LOWAT),
+         *  0 for the system default.
+         */
+        unsigned int        notSentLowat;
+
+        /**
+         *  Only send full segments, until flushed (TCP_CORK).
+         */
+        bool                cork;
+
+        /**
+         *  Milliseconds sent data may stay unacknowledged before the
+         *  connection is dropped (TCP_USER_TIMEOUT), 0 for the system
+         *  default.
+         */
+        unsigned int        userTimeout;
+
+        /**
+         *  The congestion control algorithm (TCP_CONGESTION),
+         *  0 for the system default.
+         */
+        char              * congestion;
+
+        /**
+         *  The sending rate of the connection in bytes / sec
+         *  (SO_MAX_PACING_RATE), 0 for no pacing.
+         */
+        unsigned int        pacingRate;
+
+        /**
+         *  The sending rate in bytes / sec after connecting, while
+         *  data queued during the reconnect is sent, 0 for no pacing.
+         */
+        unsigned int        catchUpRate;
+
+        /**
+         *  Is the connection still sending data queued during the
+         *  reconnect, at catchUpRate.
+         */
+        bool                catchingUp;
+
+        /**
+         *  Seconds between samples of the transport statistics of the
+         *  connection, 0 for not sampling at all.
+         */
+        unsigned int        infoInterval;
+
+        /**
+         *  Round trip time in milliseconds above which an alarm is
+         *  reported, 0 for no alarm.
+         */
+        unsigned int        rttAlarm;
+
+        /**
+         *  The time of the next sample, in milliseconds.
+         */
+        double              nextInfo;
+
+        /**
+         *  The smoothed round trip time of the last sample,
+         *  in microseconds.
+         */
+        unsigned int        rtt;
+
+        /**
+         *  The round trip time variance of the last sample,
+         *  in microseconds.
+         */
+        unsigned int        rttVar;
+
+        /**
+         *  The congestion window of the last sample, in segments.
+         */
+        unsigned int        cwnd;
+
+        /**
+         *  The bytes in the kernel send queue at the last sample,
+         *  not yet sent or not yet acknowledged.
+         */
+        unsigned int        unsent;
+
+        /**
+         *  The number of segments retransmitted on the connection.
+         */
+        unsigned int        retransmits;
+
+        /**
+         *  The highest round trip time sampled, in microseconds.
+         */
+        unsigned int        peakRtt;
+
+        /**
+         *  The most bytes sampled in the kernel send queue.
+         */
+        unsigned int        peakUnsent;
+
         /**
          *  Low-level socket descriptor.
          */
@@ -79,11 +194,70 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
          *
          *  @param host name of the host this socket connects to.
          *  @param port port to connect to.
+         *  @param connectTimeout seconds to wait for a connection.
          *  @exception Exception
          */
         void
         init (  const char        * host,
-                unsigned short      port )              throw ( Exception );
+                unsigned short      port,
+                unsigned int        connectTimeout )    throw ( Exception );
+
+        /**
+         *  Copy the socket options of another TcpSocket.
+         *
+         *  @param ss the TcpSocket to copy the options of.
+         */
+        void
+        copyOptions (   const TcpSocket   & ss )        throw ();
+
+        /**
+         *  Apply the socket options to a socket descriptor.
+         *  Options that can't be set are reported, but are not fatal.
+         *
+         *  @param fd the socket descriptor.
+         */
+        void
+        applyOptions (  int                 fd )        throw ();
+
+        /**
+         *  Connect to one of a list of addresses, without blocking
+         *  for more than connectTimeout. While an attempt is in progress,
+         *  the next address is tried in parallel after attemptDelay
+         *  milliseconds. The first connection established is used.
+         *
+         *  @param addresses the addresses to try.
+         *  @return the connected socket descriptor.
+         *  @exception Exception if no connection could be made.
+         */
+        int
+        connectAny ( const std::vector<DnsCache::Address> & addresses )
+                                                        throw ( Exception );
+
+        /**
+         *  Set the pacing rate of a socket descriptor.
+         *
+         *  @param fd the socket descriptor.
+         *  @param rate the rate in bytes / sec, 0 for no pacing.
+         */
+        void
+        applyPacing (   int                 fd,
+                        unsigned int        rate )      throw ();
+
+        /**
+         *  Check if the data queued during the reconnect has been sent,
+         *  and if so, switch from catchUpRate to pacingRate.
+         *  This is the case when the kernel send queue is almost empty,
+         *  as data is queued as fast as the socket accepts it until then.
+         */
+        void
+        checkCaughtUp ( void )                          throw ();
+
+        /**
+         *  Sample the transport statistics of the connection
+         *  (TCP_INFO and SIOCOUTQ), and report what is worth reporting.
+         */
+        void
+        sampleInfo ( void )                             throw ();
 
         /**
          *  De-initialize the object.
@@ -110,18 +284,27 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
 
     public:
 
+        /**
+         *  Milliseconds to wait for a connection attempt, before
+         *  trying the next address in parallel.
+         */
+        static const unsigned int   attemptDelay = 250;
+
         /**
          *  Constructor.
          *
          *  @param host name of the host this socket connects to.
          *  @param port port to connect to.
+         *  @param connectTimeout seconds to wait for a connection.
          *  @exception Exception
          */
         inline
         TcpSocket(   const char        * host,
-                     unsigned short      port )         throw ( Exception )
+                     unsigned short      port,
+                     unsigned int        connectTimeout = 10 )
+                                                        throw ( Exception )
         {
-            init( host, port);
+            init( host, port, connectTimeout);
         }
 
         /**
@@ -175,6 +358,209 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
             return port;
         }
 
+        /**
+         *  Get the seconds to wait for a connection to be established.
+         *
+         *  @return the connect timeout, in seconds.
+         */
+        inline unsigned int
+        getConnectTimeout ( void ) const            throw ()
+        {
+            return connectTimeout;
+        }
+
+        /**
+         *  Set the size of the kernel send buffer (SO_SNDBUF).
+         *  Takes effect on the next open().
+         *
+         *  @param size the size in bytes, 0 for the system default.
+         */
+        inline void
+        setSendBufferSize ( unsigned int    size )  throw ()
+        {
+            sendBufferSize = size;
+        }
+
+        /**
+         *  Turn the Nagle algorithm on or off (TCP_NODELAY).
+         *  Takes effect on the next open().
+         *
+         *  @param noDelay true to send small writes without delay.
+         */
+        inline void
+        setNoDelay (    bool            noDelay )   throw ()
+        {
+            this->noDelay = noDelay;
+        }
+
+        /**
+         *  Limit the amount of unsent data queued in the kernel
+         *  (TCP_NOTSENT_LOWAT), so that canWrite() reflects the real
+         *  backlog. Takes effect on the next open().
+         *
+         *  @param bytes the limit in bytes, 0 for the system default.
+         */
+        inline void
+        setNotSentLowat (   unsigned int    bytes )     throw ()
+        {
+            notSentLowat = bytes;
+        }
+
+        /**
+         *  Only send full segments until flush() is called (TCP_CORK).
+         *  Takes effect on the next open().
+         *
+         *  @param cork true to batch writes into full segments.
+         */
+        inline void
+        setCork (       bool            cork )      throw ()
+        {
+            this->cork = cork;
+        }
+
+        /**
+         *  Set how long sent data may stay unacknowledged before the
+         *  connection is dropped (TCP_USER_TIMEOUT).
+         *  Takes effect on the next open().
+         *
+         *  @param msecs the timeout in milliseconds, 0 for the system
+         *               default.
+         */
+        inline void
+        setUserTimeout (    unsigned int    msecs )     throw ()
+        {
+            userTimeout = msecs;
+        }
+
+        /**
+         *  Set the congestion control algorithm (TCP_CONGESTION).
+         *  Takes effect on the next open().
+         *
+         *  @param name the name of the algorithm, 0 for the system default.
+         *  @exception Exception
+         */
+        void
+        setCongestion ( const char    * name )      throw ( Exception );
+
+        /**
+         *  Set the rates to pace sending at (SO_MAX_PACING_RATE).
+         *  Takes effect on the next open().
+         *
+         *  @param rate the rate in bytes / sec, 0 for no pacing.
+         *  @param catchUpRate the rate in bytes / sec after connecting,
+         *                     until the data queued during the reconnect
+         *                     is sent, 0 for no pacing.
+         */
+        inline void
+        setPacingRate ( unsigned int    rate,
+                        unsigned int    catchUpRate )   throw ()
+        {
+            this->pacingRate  = rate;
+            this->catchUpRate = catchUpRate;
+        }
+
+        /**
+         *  Set how often the transport statistics of the connection
+         *  are sampled. Samples are taken when writing.
+         *
+         *  @param secs the seconds between samples, 0 for no sampling.
+         */
+        inline void
+        setInfoInterval (   unsigned int    secs )      throw ()
+        {
+            infoInterval = secs;
+        }
+
+        /**
+         *  Set the round trip time above which an alarm is reported.
+         *
+         *  @param msecs the round trip time in milliseconds,
+         *               0 for no alarm.
+         */
+        inline void
+        setRttAlarm (   unsigned int    msecs )         throw ()
+        {
+            rttAlarm = msecs;
+        }
+
+        /**
+         *  Get the smoothed round trip time of the last sample.
+         *
+         *  @return the round trip time, in microseconds.
+         */
+        inline unsigned int
+        getRtt ( void ) const                       throw ()
+        {
+            return rtt;
+        }
+
+        /**
+         *  Get the round trip time variance of the last sample.
+         *
+         *  @return the round trip time variance, in microseconds.
+         */
+        inline unsigned int
+        getRttVar ( void ) const                    throw ()
+        {
+            return rttVar;
+        }
+
+        /**
+         *  Get the congestion window of the last sample.
+         *
+         *  @return the congestion window, in segments.
+         */
+        inline unsigned int
+        getCongestionWindow ( void ) const          throw ()
+        {
+            return cwnd;
+        }
+
+        /**
+         *  Get the bytes in the kernel send queue at the last sample.
+         *
+         *  @return the bytes not yet sent or not yet acknowledged.
+         */
+        inline unsigned int
+        getUnsent ( void ) const                    throw ()
+        {
+            return unsent;
+        }
+
+        /**
+         *  Get the number of segments retransmitted on the connection.
+         *
+         *  @return the number of segments retransmitted.
+         */
+        inline unsigned int
+        getRetransmits ( void ) const               throw ()
+        {
+            return retransmits;
+        }
+
+        /**
+         *  Get the highest round trip time sampled since opening.
+         *
+         *  @return the highest round trip time, in microseconds.
+         */
+        inline unsigned int
+        getPeakRtt ( void ) const                   throw ()
+        {
+            return peakRtt;
+        }
+
+        /**
+         *  Get the most bytes sampled in the kernel send queue
+         *  since opening.
+         *
+         *  @return the most bytes in the kernel send queue.
+         */
+        inline unsigned int
+        getPeakUnsent ( void ) const                throw ()
+        {
+            return peakUnsent;
+        }
+
         /**
          *  Open the TcpSocket.
          *
@@ -195,6 +581,17 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
             return sockfd != 0;
         }
 
+        /**
+         *  Check, without blocking and without reconnecting, if the peer
+         *  has closed the connection. Data sent by the peer is left
+         *  unread.
+         *
+         *  @return true if the connection is closed or broken,
+         *          false if it is still up.
+         */
+        bool
+        isPeerClosed ( void ) const                 throw ();
+
         /**
          *  Check if the TcpScoket can be read from.
          *  Blocks until the specified time for data to be available.
@@ -248,16 +645,28 @@ class TcpSocket : public Source, public Sink, public virtual Reporter
         write (        const void    * buf,
                        unsigned int    len )        throw ( Exception );
 
+        /**
+         *  Write data from several buffers to the TcpSocket,
+         *  with a single system call.
+         *
+         *  @param iov the buffers to write.
+         *  @param iovcnt the number of buffers in iov.
+         *  @return the number of bytes written.
+         *  @exception Exception
+         */
+        virtual unsigned int
+        writev (       const struct iovec    * iov,
+                       unsigned int            iovcnt )
+                                                    throw ( Exception );
+
         /**
          *  Flush all data that was written to the TcpSocket to the underlying
-         *  connection.
+         *  connection. When corking, this sends out a partial segment.
          *
          *  @exception Exception
          */
-        inline virtual void
-        flush ( void )                              throw ( Exception )
-        {
-        }
+        virtual void
+        flush ( void )                              throw ( Exception );
 
         /**
          *  Cut what the sink has been doing so far, and start anew.
@@ -39,6 +39,7 @@
 
 #include "Exception.h"
 #include "Util.h"
+#include "BufferAllocator.h"
 #include "VorbisLibEncoder.h"
 
 
@@ -52,6 +53,11 @@
  *----------------------------------------------------------------------------*/
 static const char fileid[] = "$Id$";
 
+/*------------------------------------------------------------------------------
+ *  The number of samples per channel encoded in one go
+ *----------------------------------------------------------------------------*/
+static const unsigned int scratchSamples = 8192;
+
 
 /* ===============================================  local function prototypes */
 
@@ -65,7 +71,9 @@ void
 VorbisLibEncoder :: init ( unsigned int     outMaxBitrate )
                                                             throw ( Exception )
 {
-    this->outMaxBitrate = outMaxBitrate;
+    this->outMaxBitrate   = outMaxBitrate;
+    this->shortBuffer     = 0;
+    this->resampledBuffer = 0;
 
     if ( getInBitsPerSample() != 16 && getInBitsPerSample() != 8 ) {
         throw Exception( __FILE__, __LINE__,
@@ -243,8 +251,13 @@ VorbisLibEncoder :: open ( void )
 
     ogg_page        oggPage;
     while ( ogg_stream_flush( &oggStreamState, &oggPage) ) {
-        getSink()->write( oggPage.header, oggPage.header_len);
-        getSink()->write( oggPage.body, oggPage.body_len);
+        struct iovec    iov[2];
+
+        iov[0].iov_base = oggPage.header;
+        iov[0].iov_len  = oggPage.header_len;
+        iov[1].iov_base = oggPage.body;
+        iov[1].iov_len  = oggPage.body_len;
+        getSink()->writev( iov, 2);
     }
 
     vorbis_comment_clear( &vorbisComment );
@@ -252,7 +265,7 @@ VorbisLibEncoder :: open ( void )
     // initialize the resampling coverter if needed
     if ( converter ) {
 #ifdef HAVE_SRC_LIB
-        converterData.input_frames   = 4096/((getInBitsPerSample() / 8) * getInChannel());
+        converterData.input_frames   = scratchSamples;
         converterData.data_in        = new float[converterData.input_frames*getInChannel()];
         converterData.output_frames  = (int) (converterData.input_frames * resampleRatio + 1);
         converterData.data_out       = new float[getInChannel() * converterData.output_frames];
@@ -263,6 +276,17 @@ VorbisLibEncoder :: open ( void )
 #endif
     }
 
+    // the scratch buffers used by write(), for a block of scratchSamples
+    shortBuffer = (short int *) BufferAllocator::allocate(
+                        scratchSamples * getInChannel() * sizeof(short int));
+    if ( converter ) {
+        unsigned int    outCount = (unsigned int)
+                                   (scratchSamples * resampleRatio + 2);
+
+        resampledBuffer = (short int *) BufferAllocator::allocate(
+                        outCount * getInChannel() * sizeof(short int));
+    }
+
     encoderOpen = true;
 
     return true;
@@ -308,59 +332,70 @@ VorbisLibEncoder :: write ( const void    * buf,
     sampleSize = (bitsPerSample / 8) * channels;
     unsigned char * b = (unsigned char*) buf;
     unsigned int    processed = len - (len % sampleSize);
-    unsigned int    nSamples = processed / sampleSize;
-    float        ** vorbisBuffer;
-
-
-    // convert the byte-based raw input into a short buffer
-    // with channels still interleaved
-    unsigned int    totalSamples = nSamples * channels;
-    short int     * shortBuffer  = new short int[totalSamples];
+    unsigned int    offset = 0;
 
+    // encode in blocks that fit the scratch buffers
+    while ( offset < processed ) {
+        unsigned int    nSamples = (processed - offset) / sampleSize;
+        unsigned int    size;
+        float        ** vorbisBuffer;
 
-    Util::conv( bitsPerSample, b, processed, shortBuffer, isInBigEndian());
-
-    if ( converter ) {
-        // resample if needed
-        int         inCount  = nSamples;
-        int         outCount = (int) (inCount * resampleRatio);
-        short int * resampledBuffer = new short int[(outCount+1)* channels];
-        int         converted;
+        if ( nSamples > scratchSamples ) {
+            nSamples = scratchSamples;
+        }
+        size = nSamples * sampleSize;
+
+        // convert the byte-based raw input into a short buffer
+        // with channels still interleaved
+        unsigned int    totalSamples = nSamples * channels;
+
+        Util::conv( bitsPerSample,
+                    b + offset,
+                    size,
+                    shortBuffer,
+                    isInBigEndian());
+
+        if ( converter ) {
+            // resample if needed
+            int         inCount  = nSamples;
+            int         outCount = (int) (inCount * resampleRatio);
+            int         converted;
 #ifdef HAVE_SRC_LIB
-        converterData.input_frames   = nSamples;
-        src_short_to_float_array (shortBuffer, converterData.data_in, totalSamples);
-        int srcError = src_process (converter, &converterData);
-        if (srcError)
-             throw Exception (__FILE__, __LINE__, "libsamplerate error: ", src_strerror (srcError));
-        converted = converterData.output_frames_gen;
+            converterData.input_frames   = nSamples;
+            src_short_to_float_array (shortBuffer, converterData.data_in, totalSamples);
+            int srcError = src_process (converter, &converterData);
+            if (srcError)
+                 throw Exception (__FILE__, __LINE__, "libsamplerate error: ", src_strerror (srcError));
+            converted = converterData.output_frames_gen;
 
-        src_float_to_short_array(converterData.data_out, resampledBuffer, converted*channels);
+            src_float_to_short_array(converterData.data_out, resampledBuffer, converted*channels);
 
 #else
-        converted = converter->resample( inCount,
-                                         outCount,
-                                         shortBuffer,
-                                         resampledBuffer );
+            converted = converter->resample( inCount,
+                                             outCount,
+                                             shortBuffer,
+                                             resampledBuffer );
 #endif
 
-        vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState,
-                                               converted);
-        Util::conv( resampledBuffer,
-                    converted * channels,
-                    vorbisBuffer,
-                    channels);
-        delete[] resampledBuffer;
+            vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState,
+                                                   converted);
+            Util::conv( resampledBuffer,
+                        converted * channels,
+                        vorbisBuffer,
+                        channels);
 
-        vorbis_analysis_wrote( &vorbisDspState, converted);
+            vorbis_analysis_wrote( &vorbisDspState, converted);
 
-    } else {
+        } else {
 
-        vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState, nSamples);
-        Util::conv( shortBuffer, totalSamples, vorbisBuffer, channels);
-        vorbis_analysis_wrote( &vorbisDspState, nSamples);
+            vorbisBuffer = vorbis_analysis_buffer( &vorbisDspState, nSamples);
+            Util::conv( shortBuffer, totalSamples, vorbisBuffer, channels);
+            vorbis_analysis_wrote( &vorbisDspState, nSamples);
+        }
+
+        offset += size;
     }
 
-    delete[] shortBuffer;
     vorbisBlocksOut();
 
     return processed;
@@ -402,10 +437,15 @@ VorbisLibEncoder :: vorbisBlocksOut ( void )                throw ( Exception )
             ogg_stream_packetin( &oggStreamState, &oggPacket);
 
             while ( ogg_stream_pageout( &oggStreamState, &oggPage) ) {
-                int    written;
-                
-                written  = getSink()->write(oggPage.header, oggPage.header_len);
-                written += getSink()->write( oggPage.body, oggPage.body_len);
+                struct iovec    iov[2];
+                int             written;
+
+                // send the page header and body in one go
+                iov[0].iov_base = oggPage.header;
+                iov[0].iov_len  = oggPage.header_len;
+                iov[1].iov_base = oggPage.body;
+                iov[1].iov_len  = oggPage.body_len;
+                written         = getSink()->writev( iov, 2);
 
                 if ( written < oggPage.header_len + oggPage.body_len ) {
                     // just let go data that could not be written
@@ -434,6 +474,11 @@ VorbisLibEncoder :: close ( void )                    throw ( Exception )
         vorbis_comment_clear( &vorbisComment);
         vorbis_info_clear( &vorbisInfo);
 
+        BufferAllocator::release( shortBuffer);
+        BufferAllocator::release( resampledBuffer);
+        shortBuffer     = 0;
+        resampledBuffer = 0;
+
         encoderOpen = false;
 
         getSink()->close();
@@ -51,7 +51,7 @@
 #include "Exception.h"
 #include "Reporter.h"
 #include "AudioEncoder.h"
-#include "CastSink.h"
+#include "Sink.h"
 #ifdef HAVE_SRC_LIB
 #include <samplerate.h>
 #else
@@ -128,6 +128,16 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
         aflibConverter                * converter;
 #endif
 
+        /**
+         *  Scratch buffer for the input converted to shorts.
+         */
+        short int                     * shortBuffer;
+
+        /**
+         *  Scratch buffer for the resampled input, if resampling.
+         */
+        short int                     * resampledBuffer;
+
         /**
          *  Initialize the object.
          *
@@ -199,7 +209,7 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
          *  @exception Exception
          */
         inline
-        VorbisLibEncoder (  CastSink      * sink,
+        VorbisLibEncoder (  Sink          * sink,
                             unsigned int    inSampleRate,
                             unsigned int    inBitsPerSample,
                             unsigned int    inChannel,
@@ -244,7 +254,7 @@ class VorbisLibEncoder : public AudioEncoder, public virtual Reporter
          *  @exception Exception
          */
         inline
-        VorbisLibEncoder (  CastSink              * sink,
+        VorbisLibEncoder (  Sink                  * sink,
                             const AudioSource     * as,
                             BitrateMode             outBitrateMode,
                             unsigned int            outBitrate,